@@ -0,0 +1,153 @@
+#!/bin/sh
+# perfcheck.sh
+#
+# A/B benchmark for Whack-A-Mole: plays many headless, seeded autoplay
+# games (-H -a -f -b -z N) with two builds or configurations, and compares
+# their -b result lines.
+#
+# Runs are paired: both sides play the same seed, one right after the
+# other, and which side goes first alternates, so slow drift in the
+# machine's load hits both sides alike.  Each metric is reported as the
+# mean change from A to B with a 95% confidence interval (paired t).  A
+# metric fails when B is worse than A by more than the threshold and the
+# interval doesn't include zero.
+#
+# Usage: perfcheck.sh [-n pairs] [-t pct] [-l pct] [-z seed] "A command" "B command"
+#   -n  Paired runs (default 10)
+#   -t  Threshold for CPU time and throughput, percent (default 5)
+#   -l  Threshold for ack latency, percent (default 10)
+#   -z  First seed (default 1; pair i uses seed + i - 1)
+#
+# A command / B command: a binary, with any options, e.g. "./a.out -r".
+#
+# Exit status: 0 pass, 1 a metric failed, 2 usage or run error.
+#
+
+pairs=10
+cputhreshold=5
+latencythreshold=10
+seed=1
+
+usage() {
+    echo "Usage: $0 [-n pairs] [-t pct] [-l pct] [-z seed] \"A command\" \"B command\"" >&2
+    exit 2
+}
+
+while getopts "n:t:l:z:" opt; do
+    case $opt in
+        n) pairs=$OPTARG ;;
+        t) cputhreshold=$OPTARG ;;
+        l) latencythreshold=$OPTARG ;;
+        z) seed=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 2 ] || usage
+[ "$pairs" -ge 2 ] 2>/dev/null || { echo "$0: need at least 2 pairs" >&2; exit 2; }
+
+a=$1
+b=$2
+for cmd in "$a" "$b"; do
+    set -- $cmd
+    if ! command -v "$1" >/dev/null 2>&1; then
+        echo "$0: can't run \"$1\" (set BASELINE= for make perfcheck)" >&2
+        exit 2
+    fi
+done
+
+results=$(mktemp) || exit 2
+trap 'rm -f "$results"' EXIT
+
+# run side command seed: one game, appends "side name=value..." to $results
+run() {
+    line=$($2 -H -a -f -b -z "$3" 2>&1 </dev/null >/dev/null | grep '^bench:')
+    if [ -z "$line" ]; then
+        echo "$0: no result from \"$2\" (seed $3)" >&2
+        exit 2
+    fi
+    echo "$1 ${line#bench: }" >>"$results"
+}
+
+echo "perfcheck: $pairs paired runs"
+echo "  A: $a"
+echo "  B: $b"
+i=1
+while [ "$i" -le "$pairs" ]; do
+    s=$((seed + i - 1))
+    echo "  pair $i/$pairs (seed $s)" >&2
+    if [ $((i % 2)) -eq 1 ]; then
+        run A "$a" "$s" || exit 2
+        run B "$b" "$s" || exit 2
+    else
+        run B "$b" "$s" || exit 2
+        run A "$a" "$s" || exit 2
+    fi
+    i=$((i + 1))
+done
+
+awk -v cputhreshold="$cputhreshold" -v latencythreshold="$latencythreshold" '
+# 97.5th percentile of Student t, by degrees of freedom
+function tq(df) {
+    split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 " \
+          "2.201 2.179 2.160 2.145 2.131 2.120 2.110 2.101 2.093 2.086 " \
+          "2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ")
+    return df <= 30 ? t[df] : 1.960
+}
+
+# metric name, which way is better (-1 lower, +1 higher), threshold
+function report(m, better, threshold,    i, n, d, sd, ma, mb, half, pct, lo, hi, verdict) {
+    n = pairs
+    ma = 0; mb = 0; d = 0
+    for (i = 1; i <= n; i++) { ma += A[m, i]; mb += B[m, i]; d += B[m, i] - A[m, i] }
+    ma /= n; mb /= n; d /= n
+    sd = 0
+    for (i = 1; i <= n; i++) sd += (B[m, i] - A[m, i] - d) ^ 2
+    sd = sqrt(sd / (n - 1))
+    half = tq(n - 1) * sd / sqrt(n)
+    if (ma == 0) {
+        printf "  %-16s %10.1f %10.1f %8s  %-19s %s\n", m, ma, mb, "-", "-", "n/a"
+        return
+    }
+    pct = 100 * d / ma
+    lo = 100 * (d - half) / ma
+    hi = 100 * (d + half) / ma
+    verdict = "pass"
+    if (lo > 0 || hi < 0) {  # Significant
+        if (pct * better < 0 && pct * -better > threshold) {
+            verdict = "FAIL"
+            failed = 1
+        } else if (pct * better > 0) {
+            verdict = "pass (better)"
+        }
+    }
+    printf "  %-16s %10.1f %10.1f %+7.1f%%  [%+6.1f%%, %+6.1f%%]  %s\n", m, ma, mb, pct, lo, hi, verdict
+}
+
+{
+    side = $1
+    for (f = 2; f <= NF; f++) {
+        split($f, kv, "=")
+        v[kv[1]] = kv[2]
+    }
+    i = ++count[side]
+    # Throughput: animation frames drawn per CPU second
+    v["frames_per_cpu_s"] = v["cpu_ms"] > 0 ? 1000 * v["frames"] / v["cpu_ms"] : 0
+    for (k in v) {
+        if (side == "A") A[k, i] = v[k]; else B[k, i] = v[k]
+    }
+}
+
+END {
+    pairs = count["A"] < count["B"] ? count["A"] : count["B"]
+    printf "  %-16s %10s %10s %8s  %-19s %s\n", "metric", "A mean", "B mean", "change", "95% CI", "verdict"
+    report("cpu_ms", -1, cputhreshold)
+    report("frames_per_cpu_s", 1, cputhreshold)
+    report("ack_p50", -1, latencythreshold)
+    report("ack_p95", -1, latencythreshold)
+    report("ack_p99", -1, latencythreshold)
+    report("wall_ms", -1, 1e9)  # Set by the game clock; shown as a sanity check only
+    print "perfcheck: " (failed ? "FAIL" : "PASS") " (thresholds: cpu/throughput " cputhreshold "%, latency " latencythreshold "%)"
+    exit failed
+}
+' "$results"
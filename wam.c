@@ -2,7 +2,7 @@
 //
 // A terminal mode whack-a-mole type game.
 //
-// Missing the Makefile? try: gcc -pthread -Wall -lrt -lncurses wam.c
+// Missing the Makefile? try: gcc -pthread -Wall wam.c -lrt -lncurses
 //
 // Questions/comments to: paulweaver@paulweaver.org
 //
@@ -13,16 +13,29 @@
 #include <ctype.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <ncurses.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <termios.h>
 #include <time.h>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 //=========
 // #defines
@@ -30,15 +43,127 @@
 #define MAXDURATION     15000 // Limit on max mole cycle time (msec)
                               // This is a limit for reasonability check only, actual time is
                               // set by moletime variable in main().
-#define MOLEHOLES       9     // How many holes do moles have available to choose
+#define MOLEHOLES       9     // How many holes in the classic 3x3 playfield (default grid,
+                              // also used by the intro and instructions).
+#define MAXMOLEHOLES    36    // Limit on holes for -g. (One key each from HOLEKEYS.)
+#define MAXGRIDSIDE     12    // Limit on rows or columns for -g.
+#define MINGRIDSIDE     3     // ...and the minimum. (The intro and instructions use holes 0-8.)
+#define HOLEKEYS        "1234567890abcdefghijklmnopqrstuvwxyz" // Keys for grids other than 3x3
+#define SCROLLUPKEY     'K'   // Viewport scroll keys (vi style, upper case so they never
+#define SCROLLDOWNKEY   'J'   // collide with HOLEKEYS).
+#define SCROLLLEFTKEY   'H'
+#define SCROLLRIGHTKEY  'L'
 #define CONCURRENTMOLES 3     // How many threaded moles at once
 #define GRACEPERIOD     500   // How long after mole times out (msec) before we
                               // consider its key to be a misfire.
 #define SCAREDDURATION  2000  // How long moles stay scared after misfire (msec).
 #define MSEC            1000000L // Handy define for use with nanosleep()
+#define BONUSSLICES     5     // Bonus stages of a whack (see compute_score()).
+
+// Grid engine.  Built with -Dclassicgrid (make Whack-A-Mole-3x3), the grid is fixed
+// at the classic 3x3: its size is a constant, so hole loops, key lookups and hole
+// position arithmetic are folded and unrolled by the compiler.  -g with any other
+// grid runs the generic build (GENERICENGINE) instead.
+#define GENERICENGINE   "Whack-A-Mole" // Generic build, looked for next to the classic one.
+#if defined(classicgrid)
+#define LAYOUTROWS      (MOLEHOLES / REFGRIDCOLS) // Rows and columns of the grid being laid out:
+#define LAYOUTCOLS      REFGRIDCOLS               // always 3x3 here...
+#else
+#define LAYOUTROWS      layout.gridrows           //    ...otherwise whatever compute_layout() was
+#define LAYOUTCOLS      layout.gridcols           //    last given (3x3 for menus, -g for play).
+#endif
 
-//#define AUTOPLAY        10000    // Causes input thread to start and play the game
-                                // Number is the max delay between simulated keystrokes.
+#define COUNTDOWNSTEPS  5     // Normal countdown: 5 counts...
+#define COUNTDOWNSTEP   300   //     ...of 2 x 300 msec each.
+#define FASTCOUNTDOWNSTEPS 3  // Fast start (-f) countdown: 3 counts...
+#define FASTCOUNTDOWNSTEP  150 //    ...of 2 x 150 msec each.
+
+#define CALIBRATEBYTES  2048  // Bytes written at startup to measure terminal throughput.
+#define CALIBRATESLEEPS 20    // Number of 1 msec sleeps used to measure wakeup jitter.
+#define POPUPFRAMEMIN   30    // Fastest pop-up frame step (msec). Used for fast terminals.
+#define POPUPFRAMEMAX   100   // Slowest pop-up frame step (msec). 5 steps must fit well
+                              // inside the shortest mole up time.
+#define FRAMEBYTES      120   // Approx bytes to draw one mole frame (5 rows + cursor moves).
+#define FRAMEDROPQUEUE  (4 * FRAMEBYTES) // Cosmetic frames are dropped while more than this
+                              // many bytes are still queued for the terminal (serial lines)...
+#define FRAMEDROPLAG    20    //    ...or for a second after a screen flush took this long (msec).
+
+#define RAWVTGAP        6     // Raw VT backend: Unchanged chars bridged, rather than
+                              // emitting a cursor move. (A cursor move costs at least that much.)
+#define RAWVTIOVMAX     1024  // Max iovecs per writev() (IOV_MAX on Linux).
+#define RAWVTESCLEN     16    // Max length of one cursor movement sequence.
+
+#define REFGRIDCOLS     3     // Holes per row of the classic playfield (MOLEHOLES / REFGRIDCOLS rows).
+#define HOLEWIDTH       12    // Size of one hole, including its key label.
+#define HOLEHEIGHT      7
+#define HOLESPACINGX    14    // Hole spacing at the reference 80x25 layout.
+#define HOLESPACINGXMAX 24    //     ...and how far it may stretch on big terminals.
+#define HOLESPACINGYMAX 11
+#define HUDWIDTH        15    // Width of the MOLES/SCORE panel.
+#define RESIZESETTLE    40    // Relayout once no resize notice has arrived for this long (msec)...
+#define RESIZEMAXDELAY  200   //    ...or this long after the first one, if the window keeps moving.
+#define MENUANIMMAX     MOLEHOLES // Most animations one menu page runs at once.
+
+#define WATCHDOGPERIOD  250   // Watchdog checks the SLOs this often (msec).
+#define HEARTBEATSLO    2000  // Input, display or control thread silent this long (msec) is a stall...
+#define ACKSLO          1000  //    ...as is a mole status change display_thread hasn't acked...
+#define DWELLSLACK      2000  //    ...or a mole in one state this much longer than it should be.
+#define TRACEEVENTS     64    // Recent trace events kept for the watchdog dump.
+#define WATCHDOGDUMP    "wam-watchdog.txt" // Where the watchdog writes its diagnostic dump...
+#define WATCHDOGDUMPS   3     //    ...for at most this many breaches per game.
+
+#define LOGBUFFERS      64    // Logger (-L): per-thread record buffers, one per live thread...
+#define LOGRECORDS      256   //    ...each holding this many records...
+#define LOGARGS         6     //    ...of up to this many arguments.
+#define LOGDRAINMSEC    50    // Logger thread drains and formats the buffers this often.
+#define DEBUGLOG        "wam-debug.log" // Debug builds log here unless -L says otherwise.
+
+#define GAMEEVENTSEG    4096  // Game event log: events per segment (a 100 mole game needs ~1500;
+                              // held keys repeat, so it grows a segment at a time)...
+#define GAMEEVENTSEGS   256   //    ...and segments at most.  Past GAMEEVENTS events they are
+#define GAMEEVENTS      (GAMEEVENTSEG * GAMEEVENTSEGS) // counted and dropped...
+#define GAMEEVENTSFULL  " (log full, later ones dropped)" // ...and -E's game header says so.
+
+#define AUTOPLAYREACTMIN 150  // Autoplay (-a) bot: delay between moves is random within this
+#define AUTOPLAYREACTMAX 1500 //    range (msec)...
+#define AUTOPLAYMISFIRE 10    //    ...and 1 move in this many hits a random hole instead of a mole.
+#define AUTOPLAYRACE    4     // Two players: 1 whack in this many, the other player goes for it too.
+
+#define ACKHISTMSEC     250   // Display ack latency histogram: 1 msec buckets up to this.
+#define SOAKSAMPLES     512   // Soak (-S): per-game samples kept. When full, every other one
+                              // is dropped, so memory use stays flat however long it runs.
+#define SOAKREPORTROWS  12    // Soak report shows at most this many per-game rows.
+#define SOAKRSSSLACK    1024  // Soak: RSS growth (kB) beyond the first game tolerated as noise.
+#define SOAKLATENCYSLACK 5    // Soak: ack p95 may grow this much (msec), or double, before it
+                              // counts as drift.
+
+#define TOURNAMENTMAX   9     // Tournament (-T): most rounds per player...
+#define ROUNDMOLESTEP   5     //    ...each round has this many more moles than the last...
+#define ROUNDSPEEDUP    85    //    ...with this % of the last round's cycle time...
+#define ROUNDMINMOLETIME 2500 //    ...down to this (msec).
+#define LEADERBOARDSIZE 10    // Tournament players kept on the leaderboard.
+
+#define HEATWIDTH       8     // Heatmap (-m): characters of each hole rim it uses.
+
+#define SPRITEWIDTH     8     // Sprites: characters per row...
+#define SPRITEROWS      5     //    ...and rows.
+#define SPRITEPACKMAGIC "WAMPACK 1\n" // First line of a sprite pack file (-p).
+
+#define INPUTBUFSIZE    64    // Terminal input bytes read at once (see read_input()).
+#define ESCSEQMSEC      25    // A lone ESC is the Escape key if nothing follows this soon (msec).
+
+#define PLAYERS         2     // Two-player mode (-2): players sharing the playfield...
+#define PLAYER2KEYS     "qweasdzxc" //    ...player 2's hole keys, laid out like the keypad's...
+#define PLAYERLOGSIZE   1024  //    ...and score records kept per player. Past this they are dropped.
+#define WHACKCLOSED     -1L   // MoleCommRecord whackclaim once the mole has been scored.
+
+#define RESCOREMAXSCORE 4096  // Offline rescoring (-R): scores counted one by one up to this...
+#define RESCOREBUCKET   50    //    ...and shown in buckets this wide...
+#define RESCOREQUEUE    32    //    ...games read ahead for the workers...
+#define RESCOREWORKERS  16    //    ...and most worker threads (one per core).
+
+#define KEYMAPS         4     // Keymap rotation (-k): maps in the pool. One is live; the rest
+                              // are free, or retired and waiting out a grace period.
 
                             // DISP_ELE... Bits to control display_empty_playfield().
 #define DISP_ELE_HOLES  1   // Indicates holes should be displayed.
@@ -46,8 +171,14 @@
 #define DISP_ELE_VERS   4   //        ...version string...
 #define DISP_ELE_MSG    8   //        ...message text...
 #define DISP_ELE_STAT   16  //        ...game status...
+#define DISP_ELE_HEAT   32  //        ...heatmap overlay (if -m)...
 #define DISP_ELE_ALL    0xffffffff // ...all items...
 
+                            // HOLE_... Bits in holeuse[], the hole occupancy index.
+#define HOLE_MOLE       1   // A mole has claimed the hole.
+#define HOLE_OVERLAY    2   // A misfire panel is showing there.  (Moles skip it.)
+#define HOLE_RESULT     4   // A whacked/escaped mole's result is still showing there.
+
 //=====================================
 // Functions implemented as #defines...
 // Used to compress code for readability, while maintaining ability to reference
@@ -59,11 +190,13 @@
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock molecomm mutex.");\
     }\
+    lockowners[LK_MOLECOMM] = threadrole;\
 }
 
 #define unlock_molecomm() \
 {\
     int err;\
+    lockowners[LK_MOLECOMM] = TR_NONE;\
     if ((err = pthread_mutex_unlock(&molecomm_mtx)) != 0) {\
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock molecomm mutex.");\
@@ -77,11 +210,13 @@
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock ncurses mutex.");\
     }\
+    lockowners[LK_NCURSES] = threadrole;\
 }
 
 #define unlock_ncurses() \
 {\
     int err;\
+    lockowners[LK_NCURSES] = TR_NONE;\
     if ((err = pthread_mutex_unlock(&ncurses_mtx)) != 0) {\
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock ncurses mutex.");\
@@ -95,17 +230,34 @@
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock scores mutex.");\
     }\
+    lockowners[LK_SCORES] = threadrole;\
 }
 
 #define unlock_scores() \
 {\
     int err;\
+    lockowners[LK_SCORES] = TR_NONE;\
     if ((err = pthread_mutex_unlock(&score_mtx)) != 0) {\
         restore_terminal();\
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock scores mutex.");\
     }\
 }
 
+// log_event(fmt, ...) logs a diagnostic record, if logging (-L) is on.  Nothing is
+// formatted here: the call site (a static LogSite) and up to LOGARGS arguments go
+// into the thread's buffer, and logger_thread() formats them later.  So fmt may
+// only use %ld style conversions, and %s for static strings (literals, or the
+// ...names[] tables) passed as (long).
+#define log_event(fmt, ...) \
+{\
+    static const struct LogSite logsite = {__FILE__, __LINE__, fmt};\
+    if (logfile != NULL) {\
+        long logargs[] = {0, ##__VA_ARGS__};\
+        _Static_assert(sizeof(logargs) / sizeof(long) - 1 <= LOGARGS, "Too many log_event() arguments.");\
+        log_record(&logsite, logargs + 1, sizeof(logargs) / sizeof(long) - 1);\
+    }\
+}
+
 #define disable_thread_cancel()\
 {\
     int oldstate; \
@@ -128,12 +280,13 @@
 
 //======
 // enums
-enum PlayResult { WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF };
+enum PlayResult { WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF, PLAYRESULTS };
                 // WHACK = Mole hit successfully.
                 // ESCAPE = Mole missed.
                 // MISFIRE = Key hit when no mole was up in that hole.
                 // TOOSOON = Key hit when mole was hiding in that hole.
                 // SCAREDOFF = Mole scared off by misfire.
+                // PLAYRESULTS = Number of results (not a result).
 
 enum MoleStatus { AVAILABLE = 0, ASSIGNED, HIDING, UP, WHACKED, EXPIRED, SCARED, TERMINATING, COMPLETE };
                 // AVAILABLE = Indicates this slot may be assigned to new thread
@@ -146,13 +299,27 @@ enum MoleStatus { AVAILABLE = 0, ASSIGNED, HIDING, UP, WHACKED, EXPIRED, SCARED,
                 // SCARED = Mole was scared away by a misfire. (Functionally same as
                 //          EXPIRED status)
                 // TERMINATING = Mole thread performing final scorekeeping and cleanup.
-                // COMPLETE = Thread is done and may be joined
+                // COMPLETE = Visit is done. Slot may be given back (AVAILABLE).
+
+enum StartupPhase { SP_LAUNCH = 0, SP_TERMINAL, SP_CALIBRATE, SP_MENU, SP_THREADS, SP_COUNTDOWN, SP_PLAYFIELD, SP_FIRSTHIDING, SP_FIRSTUP, SP_PHASES };
+                // SP_LAUNCH = main() entered.
+                // SP_TERMINAL = ncurses initialized.
+                // SP_CALIBRATE = Terminal throughput and timer jitter measured.
+                // SP_MENU = Splash screen / instructions done (includes player think time).
+                // SP_THREADS = Input and display threads running.
+                // SP_COUNTDOWN = Countdown finished.
+                // SP_PLAYFIELD = Display thread has drawn the empty playfield.
+                // SP_FIRSTHIDING = First mole visible in its hole.
+                // SP_FIRSTUP = First mole popped up.
+
+enum Edge { EDGE_UP, EDGE_DOWN, EDGE_LEFT, EDGE_RIGHT };
+                // Sides of the playfield viewport, for off-screen mole indicators.
 
 enum GameMode { BASEGAME, TIMEDGAME };  // GameMode unimplemented. Only BASEGAME supported.
                 // BASEGAME = Fixed number of moles fit into a target time.
                 // TIMEDGAME = Unlimited moles in fixed amount of time.
 
-enum AnimationType { ANIMHIDING, ANIMPOPUP, ANIMWHACKED, ANIMESCAPED, ANIMMISFIRE, ANIMMISFIRESCARED, ANIMUPSCARED, SPLASHPOPUP, INSTRPOPUP, INSTRSCARED};
+enum AnimationType { ANIMHIDING, ANIMPOPUP, ANIMWHACKED, ANIMESCAPED, ANIMMISFIRE, ANIMMISFIRESCARED, ANIMUPSCARED, SPLASHPOPUP, INSTRPOPUP, INSTRSCARED, GAMEOVERBLINK};
                 // ANIMHIDING = Mole hiding in hole, but not popped up yet.
                 //              (Ears will periodically bob up and down).
                 // ANIMPOPUP = Mole Quickly pops up and slowly drops until whacked.
@@ -164,12 +331,84 @@ enum AnimationType { ANIMHIDING, ANIMPOPUP, ANIMWHACKED, ANIMESCAPED, ANIMMISFIR
                 // SPLASHPOPUP = Mole pops up, but never drops. (Used by splash page).
                 // INSTRPOPUP = Mole pops up, drops, and loops. (Used by instruction page).
                 // INSTRSCARED = Mole is up, scared, blank, loops (Used by instruction page).
+                // GAMEOVERBLINK = Blinks GAME OVER, then "Press any key".
+                // The last four (and ANIMHIDING on the instruction page) are stepped
+                // by menu_tick_loop(), not by animation_thread().
+
+enum FrameClass { FRAME_FEEDBACK, FRAME_COSMETIC, FRAMECLASSES };
+                // Priority of an animation frame (see lock_frame()).
+                // FRAME_FEEDBACK = Something the player needs to see: pop-up start,
+                //                  WHACK/ESCAPE/MISFIRE/SCARED panels, clearing a hole.
+                //                  Never dropped.
+                // FRAME_COSMETIC = Ear bobs and pop-up decay steps.  Dropped when a
+                //                  feedback frame is waiting, or the terminal is behind.
+
+enum InputState { IN_GROUND, IN_ESC, IN_CSI, IN_SS3 };
+                // Where parse_input() is in the terminal's input.
+                // IN_GROUND = Between keys.
+                // IN_ESC = After an ESC.
+                // IN_CSI = In a control sequence (ESC [ ...): cursor and editing keys.
+                // IN_SS3 = After ESC O: the keypad in application mode, and cursor keys.
+
+enum Sprite { SPR_MOLE, SPR_WHACK, SPR_ESCAPE, SPR_MISFIRE, SPR_SCARED, SPRITES };
+                // Sprites a pack (-p) can replace, in the order it has them.
+                // SPR_MOLE = asciimole[]
+                // SPR_WHACK = asciiwhack[]
+                // SPR_ESCAPE = asciiescape[]
+                // SPR_MISFIRE = asciimisfire[]
+                // SPR_SCARED = asciiscared[]
+                // SPRITES = Number of sprites (not a sprite).
+
+enum ThreadRole { TR_NONE = -1, TR_INPUT, TR_DISPLAY, TR_CONTROL, TR_MOLE, TR_ANIMATION = TR_MOLE + CONCURRENTMOLES, TR_WATCHDOG, THREADROLES };
+                // Which thread is which, for the watchdog (see threadrole).
+                // TR_NONE = No thread. (A lock nobody holds.)
+                // TR_INPUT, TR_DISPLAY = input_thread(), display_thread().
+                // TR_CONTROL = main(), running control_moles().
+                // TR_MOLE = mole_thread() for slot 0. Slot n is TR_MOLE + n.
+                // TR_ANIMATION = animation_thread(). (Any thread that doesn't say otherwise.)
+                // TR_WATCHDOG = watchdog_thread().
+                // The first TR_ANIMATION roles also index heartbeats[].
+
+enum TrackedLock { LK_MOLECOMM, LK_SCORES, LK_NCURSES, TRACKEDLOCKS };
+                // Mutexes whose owner is recorded in lockowners[] by the lock_... macros.
+
+enum PerfCounter { PC_CYCLES, PC_INSTRUCTIONS, PC_CACHEMISSES, PC_CTXSWITCHES, PERFCOUNTERS };
+                // Counters collected per thread with -P (see perf_thread_begin()).
+
+enum PerfPhase { PP_INTRO, PP_PLAY, PP_SCORESHEET, PERFPHASES };
+                // What main() is doing, for attributing counts (see perf_phase()).
+                // PP_INTRO = Startup, splash, instructions and countdown.
+                // PP_PLAY = Game play.
+                // PP_SCORESHEET = Game over and score sheet.
+
+enum LogBufState { LOGBUF_FREE, LOGBUF_OWNED, LOGBUF_RETIRED };
+                // LOGBUF_FREE = In the pool.
+                // LOGBUF_OWNED = Claimed by a thread, which writes records into it.
+                // LOGBUF_RETIRED = Its thread has exited. logger_thread() drains it and frees it.
+
+enum TraceType { TE_STATUS, TE_ACK, TE_KEY, TE_SCORE, TE_RESULTDONE };
+                // Trace events kept for the watchdog dump (see trace_event()).
+                // TE_STATUS = Mole status change (arg1 = slot, arg2 = new MoleStatus).
+                // TE_ACK = display_thread acked it (arg1 = slot, arg2 = MoleStatus).
+                // TE_KEY = Hole key pressed during play (arg1 = key).
+                // TE_SCORE = Score sheet record added (arg1 = hole, arg2 = PlayResult).
+                // TE_RESULTDONE = Result animation joined, hole released (arg1 = hole).
+
+enum GameEventType { GE_GAMESTART, GE_STATUS, GE_KEY, GE_SCORE, GE_GAMEEND };
+                // Game event log entries (see append_game_event()).
+                // GE_GAMESTART = Game began (mole = moles in the game).
+                // GE_STATUS = Mole slot status change (slot, mole, hole, status = new MoleStatus).
+                // GE_KEY = Hole key pressed during play (key).
+                // GE_SCORE = Score sheet record added (slot = its index in scores[], or in its
+                //            player's PlayerLog (-1 if that was full), score).
+                // GE_GAMEEND = Every mole is done.
 
 //===========
 // Structures
 struct ScoreSheetRecord {
     long totaltime;         // total up time for this mole in msec
     long remainingtime;     // up time remaining in msec when mole was whacked
+    int player;             // player # (two-player mode), else 0
     int mole;               // mole #
     int hole;               // hole # where mole appeared (-1 for n/a)
     int startscore;         // starting score before changes applied from this mole
@@ -179,13 +418,14 @@ struct ScoreSheetRecord {
     int penaltyscore;       // lost points for misfire
     int endscore;           // ending score after these changes are applied
     enum PlayResult playresult; // WHACK, ESCAPE, MISFIRE, TOOSOON, or SCAREDOFF
+    int bonusstage;         // how far up the mole was when whacked (see compute_score())
     char selection;         // Player choice (key pressed or '\x0' for timeout)
 };
 
 struct AnimationSpec {
     enum AnimationType animationtype;   // See enum definition for description.
     int hole;                           // Hole number .
-    int numholes;                       // Total number of holes. (must always be MOLEHOLES for now)
+    int numholes;                       // Total number of holes. (0 = current grid, moleholes)
     int duration;                       // Start to end duration in msec.
     int score1;                         // Main score or penalty for animations that use it.
     int score2;                         // Bonus score if needed.
@@ -209,7 +449,347 @@ struct AnimationSpec {
 #endif
 };
 
+struct MenuAnim {            // One menu/intro animation, stepped by menu_tick_loop().
+    enum AnimationType animationtype; // SPLASHPOPUP, INSTRPOPUP, INSTRSCARED, ANIMHIDING
+                                      // or GAMEOVERBLINK.
+    int hole;                // Hole number (classic 3x3 layout). Unused by GAMEOVERBLINK.
+    int step;                // Next frame to draw. Start at zero.
+    struct timespec due;     // When the next frame is due (CLOCK_MONOTONIC).
+    int done;                // Set once a non-looping animation has drawn its last frame.
+};
+
+struct PageCache {           // A menu page rendered once into a pad, for instant redisplay.
+    WINDOW *pad;             // Copy of the page, or NULL until first shown.
+    int rows, cols;          // Terminal size it was rendered at.
+    int animcount;           // Animations the page runs...
+    struct MenuAnim anims[MENUANIMMAX]; // ...and their starting state.
+};
+
+struct Calibration {         // Terminal and timer measurements taken at startup, and the
+                             // animation settings chosen from them.
+    long drainrate;          // Bytes/sec the terminal accepted (and drained) during calibration.
+    long jitterp50;          // Median nanosleep() oversleep (usec).
+    long jitterp95;          // 95th percentile nanosleep() oversleep (usec).
+    long jittermax;          // Worst nanosleep() oversleep (usec).
+    int framemsec;           // Chosen pop-up animation frame step (msec).
+    int coalesce;            // 1 = animation frames are batched and flushed by display_thread,
+                             // 0 = each animation frame is flushed to the terminal immediately.
+    int measured;            // 0 = calibration skipped (-c), defaults in use.
+};
+
+struct RawVT {
+    int active;             // 1 = game play output is going through this backend.
+    int rows, cols;         // Screen size when rawvt_begin() was called.
+    char *back;             // What we want on the screen (rows * cols chars).
+    char *front;            // What the terminal is showing.
+    int *dirtymin;          // Per row: first and last column written since last flush,
+    int *dirtymax;          //          or -1 if untouched.
+    int clearpending;       // Erase the screen before the next frame.
+    int currow, curcol;     // Terminal cursor position (-1 = unknown).
+    struct iovec iov[RAWVTIOVMAX];
+    char esc[RAWVTIOVMAX][RAWVTESCLEN];  // Cursor movement sequences for this frame.
+};
+
+struct FrameStats {          // Per FrameClass, for -s.
+    long drawn;              // Frames drawn.
+    long preempted;          // Frames dropped because a feedback frame was waiting...
+    long backlogged;         //    ...or the terminal output queue was over FRAMEDROPQUEUE.
+};
+
+struct RenderStats {        // Output cost during game play, for -s.
+    long frames;            // screen_flush() calls.
+    long rawwrites;         // writev() calls made by the raw backend.
+    long rawbytes;          // Bytes written by the raw backend.
+    long syscw, wchar;      // write syscalls / bytes written by the process (from /proc/self/io).
+                            // Holds starting values until screen_end_play() computes the deltas.
+    int sampled;            // 1 = /proc/self/io was readable at start and end of play.
+    int playing;            // 1 = between screen_begin_play() and screen_end_play().
+};
+
+struct Layout {              // Screen geometry, recomputed by compute_layout() once per resize
+                             // (and per viewport scroll).
+    int rows, cols;          // Terminal size the layout was computed for.
+    int scaled;              // 1 = game play grid, fitted to the terminal,
+                             // 0 = classic 3x3 at the reference 80x25 layout (menus and instructions).
+    int gridrows, gridcols;  // Grid being laid out.
+    int viewtop, viewleft;   // First grid row and column inside the viewport.
+    int viewrows, viewcols;  // Rows and columns of holes that fit in the viewport.
+    int fieldtop, fieldleft; // Top left corner of the first visible hole.
+    int fieldbottom, fieldright; // One past the last visible hole.
+    int cellw, cellh;        // Hole spacing.
+    int fits;                // 0 = terminal too small for even one hole, it is clipped.
+    int offscreen[4];        // Active (non-blank) holes beyond each edge: EDGE_UP, EDGE_DOWN,
+                             // EDGE_LEFT, EDGE_RIGHT. Shown as edge indicators.
+    int hudframe;            // 1 = MOLES/SCORE panel beside the playfield, 0 = one line under it.
+    int molesrow, molescol;  // "MOLES:" label position. (Count goes 10 columns to the right.)
+    int scorerow, scorecol;  // "SCORE:" position.
+    int msgrow, msgcol;      // Centre of the welcome message (msgrow -1 = no room for it).
+};
+
+struct HoleScreenCoords {
+    int top[5];              // Top row for moles at level 1-5
+    int height[5];           // Height for moles at level 1-5
+    int left;                // Column of left side of mole
+    int frametop, frameleft; // Top left corner of the hole itself
+    int visible;             // 0 = outside the viewport. Not drawn.
+};
+
+struct HoleSprite {          // What was last drawn in a hole, so a relayout can redraw it.
+    int kind;                // 0 = blank, 1 = mole (level), 2 = play result
+    int level;
+    int result;              // enum PlayResult, or -1 for txt
+    int score1, score2;
+    char txt[9];
+};
+
+struct SlotStats {           // For -s.  Updated under molecomm_mtx.
+    long moles;              // Mole visits completed.
+    long delaymsec;          // Slot time spent in the staggered start delay,
+    long livemsec;           //    ...with the mole hiding or up (hole claimed until scored),
+    long tailmsec;           //    ...and after scoring, until the slot was given back.
+    long workers;            // Mole worker threads started (one per slot per game)...
+    long lifecycleusec;      //    ...and time spent creating and joining them.
+};
+
+struct TraceEvent {          // One entry in the trace ring (traceevents[]).
+    long seq;                // Event number + 1. Written last: 0 or stale = slot not valid.
+    long msec;               // When, in msec since launch.
+    int role;                // enum ThreadRole of the thread that logged it.
+    enum TraceType type;
+    int arg1, arg2;          // See enum TraceType.
+};
+
+struct LogSite {             // A log_event() call site. (Static, one per call.)
+    const char *file;
+    int line;
+    const char *fmt;         // Format for the record's arguments. (See log_event().)
+};
+
+struct LogRecord {           // One log_event(), unformatted.
+    long nsec;               // When, in nsec since launch.
+    const struct LogSite *site;
+    int nargs;
+    long args[LOGARGS];
+};
+
+struct LogBuffer {           // Single producer (its thread), single consumer (logger_thread()) ring.
+    volatile int state;      // LOGBUF_FREE, LOGBUF_OWNED or LOGBUF_RETIRED (see enum LogBufState).
+    int tid;                 // Kernel thread id of the owner...
+    int role;                //    ...and its enum ThreadRole.
+    volatile unsigned long head; // Records written. Only the owner changes this...
+    volatile unsigned long tail; //    ...and records formatted. Only logger_thread() changes this.
+    long dropped;            // Records lost because the ring was full.
+    struct LogRecord recs[LOGRECORDS];
+};
+
+struct LogEntry {            // A drained record, with its owner, for sorting by time.
+    struct LogRecord rec;
+    int tid, role;
+};
+
+struct PerfCounts {          // Counter totals (-P).
+    long long count[PERFCOUNTERS];
+};
+
+struct PerfThread {          // One thread's perf_event_open() counters. (Thread local.)
+    int fd[PERFCOUNTERS];    // Counter fds (-1 = not open / not available).
+    long long last[PERFCOUNTERS]; // Values at the last perf_sample().
+    int open;                // 1 = perf_thread_begin() has been called.
+};
+
+struct ScoreRules {          // Score rule table: the compiled-in one (defaultrules), or one read for -R.
+    int whacked;             // Points for a whack...
+    int bonus[BONUSSLICES];  //    ...plus a bonus, by bonus stage.
+    int missed;              // Missed mole penalty, per mole missed so far...
+    int multiplier;          //    ...times this...
+    int cap;                 //    ...but no worse than this.
+};
+
+struct RescoreTally {        // Offline rescoring (-R): one worker's counts (added up at the end).
+    long games;              // Games rescored...
+    long scores;             //    ...player scores in them (two in a two-player game)...
+    long records;            //    ...and score records.
+    long skipped;            // Games logged without bonus stages, so not rescored...
+    long truncated;          //    ...games whose event log filled up, ditto...
+    long malformed;          //    ...and score lines that couldn't be read.
+    long reproduced;         // Scores the compiled-in rules give back as logged (a check).
+    long raised, lowered;    // Scores the new rules change, up and down...
+    int mostup, mostdown;    //    ...and the biggest changes.
+    long beforesum, aftersum; // All scores added up, as logged and rescored...
+    long before[RESCOREMAXSCORE]; //    ...and counts by score.  (Higher ones are counted
+    long after[RESCOREMAXSCORE];  //    in the last.)
+};
+
+struct RescoreWorker {       // Offline rescoring (-R): a worker thread...
+    pthread_t tid;
+    struct RescoreTally tally; //    ...and its counts.
+};
+
+struct RescoreQueue {        // Offline rescoring (-R): games read, waiting for a worker.
+                             // Locked by rescore_mtx.
+    char *games[RESCOREQUEUE]; // Each game's event log lines. (Ring buffer)...
+    long head, tail;         //    ...next to take, and next free (free running)...
+    int done;                //    ...and 1 = the archive has been read, no more are coming.
+};
+
+struct RoundPlan {           // A game or tournament round, set up ahead (see prepare_round()).
+    int round;               // Round number (1 based). 0 = no plan: play_game() sets up as it goes.
+    int moles;               // Moles in the round...
+    int moletime;            //    ...and their cycle time (msec).
+    long startdelay[MAXPOPUPCOUNT]; // Spawn schedule: each mole's start delay...
+    long uptime[MAXPOPUPCOUNT];     //    ...and up time (msec).
+    struct ScoreSheetRecord *scores; // Score sheet storage, room for scorescapacity records.
+    int scorescapacity;
+};
+
+struct LeaderboardEntry {    // Tournament (-T) player totals. One per player, kept sorted.
+    char initials[4];
+    int total;               // Sum of round scores...
+    int best;                //    ...best round...
+    int rounds;              //    ...and rounds played.
+};
+
+struct InputParser {         // Terminal input, parsed in place where read() put it.
+    unsigned char buf[INPUTBUFSIZE]; // Bytes read...
+    int head, tail;          //    ...parsed up to head, read up to tail...
+    struct timespec readtime; //    ...and when they were read.
+    enum InputState state;   // Where we are in an escape sequence. (It may span reads.)
+    struct timespec seqstart; // When that sequence's ESC was read.
+    int param;               // CSI sequence's first parameter, so far...
+    int paramdone;           //    ...and whether it is complete (';' seen).
+};
+
+struct InputStats {          // Terminal input, for -s.
+    long reads;              // read()s...
+    long keys;               //    ...keys they produced...
+    long sequences;          //    ...escape sequences that mapped to a key...
+    long ignored;            //    ...ones that didn't (function keys, say)...
+    long split;              //    ...and ones that spanned reads.
+};
+
+struct Keymap {              // Hole keys (see assign_hole_keys()). Not changed while published.
+    char keys[PLAYERS][MAXMOLEHOLES]; // Key for each hole, per player (only the first
+                             // is used unless -2)
+    long generation;         // Rotations before this one was published
+    long retired;            // -1 = free, 0 = live, else keymapepoch when it was replaced...
+    long retiredmsec;        //    ...and launch_msec() then.
+};
+
+struct KeymapStats {         // Keymap rotation (-k), for -s.
+    long rotations;          // New keymaps published...
+    long reclaimed;          //    ...old ones reclaimed after their grace period...
+    long deferred;           //    ...rotations put off for lack of a free map...
+    long gracemsec;          //    ...and the longest grace period (msec).
+};
+
+struct HoleStats {           // Outcomes at one hole, kept up to date by compute_score().
+    int results[PLAYRESULTS]; // Moles (or misfires) by enum PlayResult...
+    long reactmsec;          //    ...and the sum of reaction times of the whacks (msec).
+};
+
+struct PlayerLog {           // Two-player mode (-2): one player's score stream.  Lock free: any
+                             // thread appends (record_player_result()), any thread reads.
+    struct ScoreSheetRecord records[PLAYERLOGSIZE];
+    volatile long seq[PLAYERLOGSIZE]; // Record n's position + 1, written last: 0 = not published yet.
+    volatile long reserved;  // Records claimed so far (may pass PLAYERLOGSIZE: those are dropped).
+    volatile int total;      // Running score. (Updated with compare and swap.)
+    volatile int missedcount; // Moles that got away from this player.
+};
+
+struct PlayerStats {         // Two-player mode (-2), for -s.  Totals over all games.
+    int games;               // Games played (see tally_players())...
+    int wins[PLAYERS];       //    ...won by each player...
+    long points[PLAYERS];    //    ...points scored...
+    long results[PLAYERS][PLAYRESULTS]; //    ...and results, by enum PlayResult.
+    long contested;          // Whack claims that found the mole already claimed...
+    long late;               //    ...or already scored (the whack race was over), claimed
+                             //    or not (a key for a mole just whacked or escaped)...
+    long dropped;            //    ...and score records lost to a full PlayerLog.
+};
+
+struct SpritePackFile {      // Sprite pack (-p) file layout.  Plain text, fixed width, so it
+                             // can be edited as text and used as is once read: every
+                             // line is exactly as long as shown, newline included.
+    char magic[sizeof(SPRITEPACKMAGIC) - 1]; // SPRITEPACKMAGIC
+    struct {
+        char name[SPRITEWIDTH + 1];          // spritenames[], padded with spaces...
+        char rows[SPRITEROWS][SPRITEWIDTH + 1]; //    ...then its rows.
+    } sprites[SPRITES];      // By enum Sprite.
+    char framename[SPRITEWIDTH + 1];         // "frame", padded with spaces...
+    char frame[HOLEHEIGHT][HOLEWIDTH + 1];   //    ...then holeframe[]'s rows.
+};
+
+struct SpritePack {          // The sprite pack in use.
+    struct SpritePackFile pack; // Copy of the file, as checked...
+    const char *path;        //    ...where it came from (NULL = no pack in use)...
+    long loadusec;           //    ...and how long reading and checking it took (usec).
+};
+
+struct RoundStats {          // Tournament (-T) round setup, for -s and the leaderboard.
+    long prepared;           // Rounds prepared in the background...
+    long prepusec;           //    ...time spent preparing them...
+    long waitusec;           //    ...and time the next round had to wait for it.
+};
+
+struct GameEvent {           // One entry in the game event log (gameevents[]).  Never
+                             // changed once published.
+    volatile long seq;       // Position in the log + 1. Written last: 0 = not published yet.
+    long msec;               // When, in msec since launch.
+    enum GameEventType type;
+    int role;                // enum ThreadRole of the thread that appended it.
+    int slot, mole, hole;    // See enum GameEventType.
+    int status;
+    char key;
+    struct ScoreSheetRecord score;
+};
+
+struct EventStats {          // For -s.
+    long games;              // Games whose log was audited...
+    long events;             //    ...events in them...
+    long dropped;            //    ...lost to a full log...
+    long records;            //    ...score sheet records checked against the log...
+    long mismatches;         //    ...and those that didn't match. (See audit_game_events().)
+    long worstlag;           // Most events display_thread has been behind the log.
+    int segments;            // Most log segments a game has needed (GAMEEVENTSEG events each).
+};
+
+struct WatchdogStats {       // For -s, and the exit message.
+    long checks;             // SLO checks made.
+    int breaches;            // SLO breaches found (each stall counted once).
+    int dumps;               // Diagnostic dumps written to WATCHDOGDUMP this game (reset_game()).
+    long worstbeat;          // Longest input/display/control heartbeat gap seen (msec)...
+    int worstbeatrole;       //    ...and whose it was.
+    long worstack;           // Longest wait seen for a display ack (msec).
+};
+
+struct SoakSample {          // Process resources after one soak game (see sample_resources()).
+    int game;                // Game number (1 based).
+    long msec;               // When, in msec since launch.
+    long rsskb;              // Resident set size (kB).
+    int threads;             // Threads in the process.
+    int fds;                 // Open file descriptors.
+    long syncobjects;        // Condition variables / mutexes initialized but not destroyed.
+    long ackp50, ackp95, ackp99, ackmax; // Display ack latency this game (msec).
+};
+
+struct ResizeStats {         // For -s.
+    long notices;            // SIGWINCH notices collected.
+    long relayouts;          // Times the screen was actually relaid out.
+    long worstusec;          // Longest relayout + redraw (usec, ncurses mutex held).
+};
+
 struct MoleCommRecord {// Mole thread communications
+                                // The slot's worker (kept for the whole game):
+    pthread_t thread;           // Thread ID for this slot's mole_thread
+    pthread_cond_t keycond;     // Thread condition variable used by input_thread
+                                // to signal mole_thread that its key was pressed.
+    pthread_cond_t dispcond;    // Thread condition variable used by display_thread
+                                // to acknowledge mole status change.
+    pthread_cond_t workcond;    // Thread condition variable used by control_moles
+                                // to hand mole_thread its next mole (or end the game).
+    int threadslot;             // Index to this molecomm element, because 
+                                // sometimes we only have a pointer
+                                // The visit (cleared from here on when the slot goes AVAILABLE):
     volatile 
     enum MoleStatus molestatus; // State of this mole
     volatile
@@ -217,26 +797,26 @@ struct MoleCommRecord {// Mole thread communications
                                 // indicate it has handled the status change.
                                 // Also used within display thread to check prion
                                 // mole status.
-    pthread_t thread;           // Thread ID for this moles mole_thread
-    pthread_cond_t keycond;     // Thread condition variable used by input_thread
-                                // to signal mole_thread that its key was pressed.
-    pthread_cond_t dispcond;    // Thread condition variable used by display_thread
-                                // to acknowledge mole status change.
-    int threadslot;             // Index to this molecomm element, because 
-                                // sometimes we only have a pointer
     int mole;                   // Mole # - aka round #
     long duration;              // Cycle time (hiding + up time) in msec
     long uptime;                // Portion of cycle time when mole will be up (not hiding)
     int hole;                   // Hole # this mole has chosen
     volatile
     char keystruck;             // Set when proper key struck. Used to catch spurious wakeups
+    int keyhole;                // Hole that key was for (-1 = none).  Decided once, by
+                                // whoever read the key, from one keymap.
     pthread_t animthread;       // Thread ID for this mole's animation_thread
     struct AnimationSpec animspec; // Animation Spec buffer for above thread;
     int animcancelled;          // Flag to prevent animation thread from being double-cancelled
                                 // 0 = Not cancelled, 1 = Cancelled.
-    int scoreidx;               // Index into scores array for this mole's score
+    int scoreidx;               // Index into scores array for this mole's score...
+    int scoreplayer;            //    ...or into this player's PlayerLog (two-player mode).
+    volatile
+    long whackclaim;            // Earliest claim to whacking the mole so far: key stamp * PLAYERS
+                                // + player, 0 = none, WHACKCLOSED = scored. (See claim_whack().)
     int scaredflag;             // Indicates this mole is scared.  Set by input_thread,
                                 // used by mole_thread.
+    int scaredby;               // ...and the player whose misfire scared it.
     struct timespec scaredtime; // Time mole was scared. (Used for delay before new moles start).
 } molecomm[CONCURRENTMOLES];
 
@@ -244,101 +824,343 @@ struct MoleCommRecord {// Mole thread communications
 // prototypes
 //
 void clear_input_buffer(void);
-int compute_score(int mole, int hole, char key, int bonusstage, enum PlayResult playresult);
+int compute_score(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime);
 void display_score_sheet(int gamescore, int moles, int gametime);
 void display_intro(int moles, int gametime);
 void initialize_terminal(void);
-int record_results(int mole, int hole, char key, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult);
+void compute_layout(int rows, int cols, int scaled);
+void count_offscreen(int hole, int delta);
+void show_edge_indicators(void);
+void scroll_viewport(int drows, int dcols);
+int handle_resize(void);
+void redraw_playfield(void);
+int set_hole_sprite(int hole, const struct HoleSprite *sprite);
+void calibrate_terminal(void);
+void screen_update(void);
+void screen_print(int row, int col, const char *fmt, ...);
+void screen_clear(void);
+void screen_flush(void);
+void screen_begin_play(void);
+void rawvt_begin(void);
+void rawvt_release(void);
+void screen_end_play(void);
+int record_results(int mole, int hole, char key, int bonusstage, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult, long totaltime, long remainingtime);
+int record_player_result(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime);
+const struct ScoreSheetRecord *score_record(int player, int idx);
 void control_moles(int count, int duration);
 void restore_terminal(void);
 char waitforkey(long *msec);
+int wait_input(long msec);
+int wait_menu_input(long msec);
+void read_input(void);
+char parse_input(void);
+char sequence_key(char final, int param);
+int input_pending(void);
+long key_stamp(const struct timespec *t, int pos);
+void print_input_stats(FILE *f);
+const char *load_sprite_pack(const char *path);
+int pack_row_ok(const char *row, int width);
+int write_sprite_pack(const char *path);
+void print_sprite_stats(FILE *f);
+void run_generic_engine(char *argv[]);
+int rescore_archives(const char *rulespath, char *paths[], int npaths);
+int read_score_rules(const char *path, struct ScoreRules *rules);
+void *rescore_worker(void *arg);
+void rescore_queue_put(char *game);
+char *rescore_queue_take(void);
+void rescore_game(char *game, struct RescoreTally *t);
+int rule_score(const struct ScoreRules *rules, enum PlayResult result, int stage, int *missedcount, int score);
+void print_rescore_report(FILE *f, const struct RescoreTally *t, int workers, long msec);
 long tsrandom();
+long elapsed_msec(const struct timespec *start, const struct timespec *end);
+void add_msec(struct timespec *t, long msec);
 pthread_t *start_input_thread(void);
 pthread_t *start_display_thread(void);
 void *display_thread(void *arg);
 void *mole_thread(void *arg);
+void mole_visit(struct MoleCommRecord *p);
+void start_mole_workers(void);
+void stop_mole_workers(void);
 void *animation_thread(void *arg);
 int claim_mole_hole(int molehole);
-int check_mole_hole(int molehole);
 void release_mole_hole(int molehole);
+int overlay_mole_hole(int molehole, int on);
+void hand_off_mole_hole(int molehole);
+int check_hole_grace(int molehole);
 void assign_hole_keys(void);
 void set_mole_status(struct MoleCommRecord *p, enum MoleStatus newstatus);
 void set_mole_uptime(struct MoleCommRecord *p, long uptime);
 void display_empty_playfield(enum GameMode gamemode, int elements, int holes, char *msg);
+WINDOW *render_score_page(int page, int pages, int pagesize, int gamescore, int moles);
 void show_mole(int hole, int maxholes, int level);
 void show_result(int hole, int maxholes, enum PlayResult result, int score1, int score2, char *txt);
-int intro_overview(int);
-int intro_playfield(int);
-int intro_hidingmoles(int);
-int intro_popup(int);
-int intro_playresults(int);
-int intro_scoring(int);
-int intro_penalties(int);
-int intro_scoresheet(int);
-void display_countdown(void);
+long menu_anim_frame(struct MenuAnim *ma);
+char menu_tick_loop(struct MenuAnim *anims, int count, int untildone);
+void blit_page(WINDOW *pad);
+int show_intro_page(int page, struct PageCache *pc, struct MenuAnim *anims);
+void intro_splashscreen(void);
+int intro_overview(int, struct MenuAnim *);
+int intro_playfield(int, struct MenuAnim *);
+int intro_hidingmoles(int, struct MenuAnim *);
+int intro_popup(int, struct MenuAnim *);
+int intro_playresults(int, struct MenuAnim *);
+int intro_scoring(int, struct MenuAnim *);
+int intro_penalties(int, struct MenuAnim *);
+int intro_scoresheet(int, struct MenuAnim *);
+void display_countdown(int steps, long stepmsec);
 void display_gameover(void);
+void mark_startup_phase(enum StartupPhase phase);
+void print_startup_profile(FILE *f);
+void print_calibration(FILE *f);
+void print_render_stats(FILE *f);
+void print_resize_stats(FILE *f);
+void print_slot_stats(FILE *f);
+void print_frame_stats(FILE *f);
+int lock_frame(enum FrameClass fc);
+long launch_msec(void);
+void heartbeat(int role);
+void trace_event(enum TraceType type, int arg1, int arg2);
+const char *role_name(int role);
+long mole_dwell_slo(const struct MoleCommRecord *p);
+void write_watchdog_dump(const char *reason, long now);
+void *watchdog_thread(void *arg);
+pthread_t *start_watchdog_thread(void);
+void print_watchdog_stats(FILE *f);
+void log_record(const struct LogSite *site, const long *args, int nargs);
+void release_log_buffer(void *arg);
+int compare_log_entries(const void *a, const void *b);
+int drain_log_buffers(void);
+void *logger_thread(void *arg);
+pthread_t *start_logger(const char *path);
+void stop_logger(pthread_t *tid);
+void print_log_stats(FILE *f);
+void append_game_event(enum GameEventType type, int slot, int mole, int hole, int status, char key, const struct ScoreSheetRecord *score);
+struct GameEvent *game_event_at(long idx, int grow);
+const struct GameEvent *next_game_event(long *cursor);
+void reset_game_events(void);
+void write_game_events(FILE *f, int game);
+void audit_game_events(void);
+void print_event_stats(FILE *f);
+void perf_thread_begin(void);
+void perf_sample(int stage);
+void perf_thread_end(void *arg);
+void perf_phase(enum PerfPhase phase);
+void print_perf_row(FILE *f, const char *name, const struct PerfCounts *pc);
+void print_perf_report(FILE *f);
+char autoplay_key(void);
+void play_game(int moles, int moletime);
+void reset_game(void);
+long histogram_percentile(const long *hist, int buckets, int pct);
+void sample_resources(int game);
+int print_soak_report(FILE *f, long seed);
+void print_benchmark_line(FILE *f, long seed, int games, int score);
+void reset_slots(void);
+void prepare_round(struct RoundPlan *plan);
+void *round_prep_thread(void *arg);
+void read_initials(char *initials);
+int leaderboard_player(const char *initials);
+int leaderboard_add_round(int idx, int score);
+int leaderboard_place(int idx);
+void print_leaderboard(FILE *f);
+void show_hole_heat(int hole);
+const struct Keymap *keymap_read_lock(void);
+void keymap_read_unlock(void);
+int keymap_hole(char key, int *player);
+int claim_whack(struct MoleCommRecord *p, long stamp, int player);
+void show_hud_score(void);
+void tally_players(void);
+void print_player_stats(FILE *f);
+void rotate_keymap(void);
+void reclaim_keymaps(void);
+void show_hole_keys(void);
+void print_keymap_stats(FILE *f);
+void print_hole_stats(FILE *f);
+int display_leaderboard(int player);
+int play_tournament(int moles, int moletime);
+void print_stats(FILE *f);
 
 // Pointers to introductory instruction page functions.
-int (*intropages[])(int) = {intro_overview, intro_playfield, intro_hidingmoles, intro_popup, intro_playresults, intro_scoring, intro_penalties, intro_scoresheet};
+int (*intropages[])(int, struct MenuAnim *) = {intro_overview, intro_playfield, intro_hidingmoles, intro_popup, intro_playresults, intro_scoring, intro_penalties, intro_scoresheet};
 
 //=================
 // global variables
 struct ScoreSheetRecord *scores = NULL;
 int numscores = 0;
+int scorescapacity = 0;   // Records scores has room for
 char inputkey; // From input_thread();
-char holekeys[MOLEHOLES];  // Allows reassignment of keys for each mole hole
+struct Keymap *volatile holekeys = NULL; // Live keymap: key for each mole hole. Only ever
+                          // replaced whole (rotate_keymap()); read with keymap_read_lock().
+struct Keymap keymappool[KEYMAPS]; // Storage for holekeys and the maps it replaced.
+volatile long keymapepoch = 1; // Advanced each time holekeys is replaced...
+volatile long keymapreaders[TR_ANIMATION]; //    ...and the epoch each reader thread saw, 0 when not reading.
+int keymaprotate = 0;     // -k option: new keymap after each whack...
+volatile long keymapwhacks = 0; //    ...counted by input_thread.
+struct KeymapStats keymapstats;
+struct InputParser inputparser; // Keyboard input. (Read by one thread at a time.)
+struct InputStats inputstats;
+struct SpritePack spritepack; // -p option: sprite pack in use, if any
+struct ScoreRules rescorerules; // -R option: rule table to rescore archived games with...
+struct RescoreQueue rescorequeue; //    ...and games waiting for a rescoring worker.
+#if defined(classicgrid)
+const int gridrows = MOLEHOLES / REFGRIDCOLS; // Playfield grid size, fixed (and so folded by
+const int gridcols = REFGRIDCOLS;             // the compiler) in the classic build
+const int moleholes = MOLEHOLES;
+#else
+int gridrows = MOLEHOLES / REFGRIDCOLS; // -g option: playfield grid size
+int gridcols = REFGRIDCOLS;
+int moleholes = MOLEHOLES;    // gridrows * gridcols
+#endif
+volatile int scrollrows = 0;  // Viewport scroll requested by input_thread, applied by
+volatile int scrollcols = 0;  // display_thread. (Updated with __sync builtins.)
 volatile int kbthread_running = 0;       // input_thread status
 volatile int display_thread_running = 0; // display_thread status
 const struct timespec one_msec = {0, MSEC};
 int molesremaining = -1;  // Global count for main display
+volatile int countdown_complete = 0;     // Set by main() when countdown is over. (Fast start
+                                         // runs the input and display threads during countdown).
+int faststart = 0;        // -f option: skip intro, short countdown, overlap thread startup
+int showstats = 0;        // -s option: print statistics to stderr at exit
+struct timespec startupmarks[SP_PHASES]; // Time each startup phase completed (CLOCK_MONOTONIC)
+int skipcalibration = 0;  // -c option: use default animation timing
+struct Calibration calibration = {0, 0, 0, 0, POPUPFRAMEMIN, 0, 0};
+volatile int screen_dirty = 0;  // Coalesced animation frames waiting for display_thread to flush
+long framerequests = 0;   // Animation frames drawn (screen_update() calls)
+long frameflushes = 0;    // Terminal updates actually performed for them
+int rawoutput = 0;        // -r option: game play output through raw VT backend instead of ncurses
+struct RawVT rawvt;       // Raw VT backend state
+struct RenderStats renderstats;
+struct Layout layout;     // Current screen geometry
+struct HoleScreenCoords holescreencoords[MAXMOLEHOLES]; // Cached by compute_layout()
+struct HoleSprite holesprites[MAXMOLEHOLES];           // Last thing drawn in each hole
+unsigned char holeuse[MAXMOLEHOLES]; // Hole occupancy index (HOLE_... bits). Guarded by hole_mtx.
+struct timespec holegrace[MAXMOLEHOLES]; // End of each hole's near-miss window. Guarded by hole_mtx.
+struct SlotStats slotstats;
+struct ResizeStats resizestats;
+int resizepending = 0;    // handle_resize() has a resize waiting for the window to settle.
+int resizefd = -1;        // Readable while a SIGWINCH is pending: wakes the menus (wait_menu_input()).
+struct FrameStats framestats[FRAMECLASSES];
+volatile int feedbackwaiting = 0; // Feedback frames waiting for ncurses_mtx (see lock_frame())
+long flushmsec = 0;       // How long the last screen_flush() took...
+struct timespec flushdone; //    ...and when it finished. (Both guarded by ncurses_mtx.)
+int hudscores[PLAYERS];   // Scores currently shown in the HUD
+int missedcount = 0;      // Moles missed so far this game (see compute_score())
+const char *logpath = NULL; // -L option: diagnostics log file
+const char *eventpath = NULL; // -E option: game event log file...
+FILE *eventfile = NULL;   //    ...each game's log is written to at game end.
+struct GameEvent *gameeventsegs[GAMEEVENTSEGS]; // This game's event log (append_game_event()), in
+                                                 // segments, allocated as needed and kept...
+volatile long gameeventhead = 0; //    ...and how many events have been appended (or are being).
+struct EventStats eventstats;
+int tournamentrounds = 0; // -T option: rounds per player in a tournament
+struct RoundPlan roundplan; // Current (or next) round's setup. round = 0 when not in use.
+struct LeaderboardEntry leaderboard[LEADERBOARDSIZE]; // Tournament players, best total first...
+int leaderboardsize = 0;  //    ...and how many.
+struct RoundStats roundstats;
+int players = 1;          // -2 option: two players, each with their own keys and score...
+struct PlayerLog playerlogs[PLAYERS]; //    ...kept here instead of scores[]...
+struct PlayerStats playerstats; //    ...and how the whack races went.
+int heatmap = 0;          // -m option: show per-hole outcomes on the playfield
+struct HoleStats holestats[MAXMOLEHOLES];    // This game's outcomes per hole...
+struct HoleStats holestatsrun[MAXMOLEHOLES]; //    ...and earlier games' (added in by reset_game()).
+int perfcounters = 0;     // -P option: sample hardware performance counters
+volatile enum PerfPhase perfphase = PP_INTRO; // Set by perf_phase()
+__thread struct PerfThread perfthread = {{-1, -1, -1, -1}, {0, 0, 0, 0}, 0};
+pthread_key_t perfthreadkey;  // Runs perf_thread_end() when a thread exits or is cancelled
+struct PerfCounts perfbyrole[THREADROLES][PERFPHASES]; // Totals per thread role and phase...
+struct PerfCounts perfbystage[COMPLETE + 1]; //    ...and per mole lifecycle stage (mole threads).
+int perferrno[PERFCOUNTERS];  // Why a counter couldn't be opened (first failure), or 0.
+int perfuseronly = 0;     // 1 = kernel not permitted, counting user space only.
+int autoplay = 0;         // -a option: a bot plays (no intro, game over or score sheet)
+int headless = 0;         // -H option: no terminal. Output to /dev/null, keyboard ignored.
+double soakhours = 0;     // -S option: play autoplay games back to back, headless, this long
+long syncinits = 0;       // pthread_cond_init() / pthread_mutex_init() calls at run time...
+long syncdestroys = 0;    //    ...and matching destroys. (Only the mole workers' conditions.)
+volatile int moleworkersdone = 0; // Set by stop_mole_workers() to end the mole_thread()s.
+long acklatency[ACKHISTMSEC + 1]; // Display ack latency histogram (msec, last = overflow)...
+long acklatencyrun[ACKHISTMSEC + 1]; //    ...and the same for the whole run (not cleared per soak game).
+int benchmark = 0;        // -b option: print a one line result for perfcheck.sh at exit
+struct SoakSample soaksamples[SOAKSAMPLES]; // One per soak game (thinned out when full)...
+int numsoaksamples = 0;   //    ...and how many there are.
+__thread int threadrole = TR_ANIMATION; // enum ThreadRole of the running thread
+volatile long heartbeats[TR_ANIMATION]; // Per role: last sign of progress, msec since launch.
+                          // Mole slots beat on every status change, so a slot's beat is
+                          // also the time it entered its current state.
+volatile int lockowners[TRACKEDLOCKS] = {TR_NONE, TR_NONE, TR_NONE}; // Who holds which mutex.
+                          // (Cleared while a cond wait has the mutex released.)
+struct TraceEvent traceevents[TRACEEVENTS]; // Ring of recent trace events...
+volatile long tracehead = 0; //    ...and how many have been logged.
+struct WatchdogStats watchdogstats;
+FILE *logfile = NULL;     // -L option: diagnostics log, or NULL for no logging
+struct LogBuffer logbuffers[LOGBUFFERS]; // Pool of per-thread log buffers
+__thread struct LogBuffer *logbuffer = NULL; // This thread's, once it has logged something
+pthread_key_t logbufferkey; // Hands a thread's buffer back (release_log_buffer()) when it exits
+volatile int logstopping = 0; // Tells logger_thread() to do a last drain and exit
+long logwritten = 0;      // Records formatted to logfile...
+long logdropped = 0;      //    ...lost to a full buffer (retired buffers only, see print_log_stats())...
+long lognobuffer = 0;     //    ...and lost because the buffer pool was empty.
+const char *molestatusnames[] = {"AVAILABLE", "ASSIGNED", "HIDING", "UP", "WHACKED", "EXPIRED", "SCARED", "TERMINATING", "COMPLETE"};
+const char *playresultnames[] = {"WHACK", "ESCAPE", "MISFIRE", "TOOSOON", "SCAREDOFF"};
 #if defined(debug)
 int threadsn = 0;
 #endif
 
 //===========
 // Animations
-const struct AnimationSpec WhackedAnim = {ANIMWHACKED,0,MOLEHOLES,1500,0,0,3,0};
-const struct AnimationSpec EscapedAnim = {ANIMESCAPED,0,MOLEHOLES,1500,0,0,3,0};
-const struct AnimationSpec HidingAnim = {ANIMHIDING,0,MOLEHOLES,0,0,0,2,0};
-const struct AnimationSpec PopupAnim = {ANIMPOPUP,0,MOLEHOLES,0,0,0,6,0};
-const struct AnimationSpec MisfireScaredAnim = {ANIMMISFIRESCARED,0,MOLEHOLES,2000,0,0,2,0};
-const struct AnimationSpec HideScaredAnim = {ANIMUPSCARED,0,MOLEHOLES,2000,0,0,2,0};
-const struct AnimationSpec UpScaredAnim = {ANIMUPSCARED,0,MOLEHOLES,2000,0,0,2,0};
-const struct AnimationSpec PopupSplash = {SPLASHPOPUP,0,MOLEHOLES,0,0,0,2,0};
-const struct AnimationSpec PopupInstr = {INSTRPOPUP,0,MOLEHOLES,0,0,0,2,0};
-const struct AnimationSpec ScaredInstr = {INSTRSCARED,0,MOLEHOLES,0,0,0,2,0};
+const struct AnimationSpec WhackedAnim = {ANIMWHACKED,0,0,1500,0,0,3,0};
+const struct AnimationSpec EscapedAnim = {ANIMESCAPED,0,0,1500,0,0,3,0};
+const struct AnimationSpec HidingAnim = {ANIMHIDING,0,0,0,0,0,2,0};
+const struct AnimationSpec PopupAnim = {ANIMPOPUP,0,0,0,0,0,6,0};
+const struct AnimationSpec MisfireScaredAnim = {ANIMMISFIRESCARED,0,0,2000,0,0,2,0};
+const struct AnimationSpec HideScaredAnim = {ANIMUPSCARED,0,0,2000,0,0,2,0};
+const struct AnimationSpec UpScaredAnim = {ANIMUPSCARED,0,0,2000,0,0,2,0};
 
 //===============================
 // Ascii art for animation frames
+//
+// A sprite pack (-p) replaces these row pointers with ones into its copy
+// (spritepack.pack), where rows end with a newline rather than a NUL: print
+// them with a precision (SPRITEWIDTH, HOLEWIDTH).
+//
 const char *asciimole[] = { " ^=--=^ ", 
                             " | oO | ", 
                             " (\"||\") ", 
                             " / \\/ \\ ", 
                             "(((  )))"};
-char *asciiwhack[] = {  " *   *  ",
+const char *asciiwhack[] = {  " *   *  ",
                         "  * *   ",
                         "*WHACK!*",
                         "  * *   ",
                         " *   *  " };
 
-char *asciiescape[] = { "  .  .  ",
+const char *asciiescape[] = { "  .  .  ",
                         " . .. . ",
                         "  poof  ",
                         " . .. . ",
                         "  .  .  " };
 
-char *asciimisfire[] = {" \\\\  // ",
+const char *asciimisfire[] = {" \\\\  // ",
                         "  \\\\//  ",
                         "   //   ",
                         "  //\\\\  ",
                         " //  \\\\ " };
 
-char *asciiscared[] = {  " ^\\^^/^ ",
+const char *asciiscared[] = {  " ^\\^^/^ ",
                           " |(OO)| ",
                           " ( __ ) ",
                           " /    \\ ",
                           "'''  '''" };
 
+const char *holeframe[HOLEHEIGHT] = { "  ________  ",
+                                      " /        \\ ",  // Key label goes in the last column
+                                      "/          \\",
+                                      "|          |",
+                                      "|          |",
+                                      "\\          /",
+                                      " \\________/ " };
+
+const char **spriteart[SPRITES] = { asciimole, asciiwhack, asciiescape, asciimisfire, asciiscared };
+const char *spritenames[SPRITES] = { "mole", "whack", "escape", "misfire", "scared" };
+
 //========
 // Mutexes
 //
@@ -352,8 +1174,10 @@ pthread_mutex_t start_mtx = PTHREAD_MUTEX_INITIALIZER; // Used to make sure thre
 pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;  // Condition variable to go along 
                                                        // with start_mtx
 
-pthread_mutex_t hole_mtx[MOLEHOLES]; // Used to prevent two moles trying to pop up in
-                                     // same hole. Need to dynamically initialize at run time
+pthread_mutex_t hole_mtx = PTHREAD_MUTEX_INITIALIZER; // Lock for holeuse[]. Used to prevent two
+                                                      // moles trying to pop up in same hole.
+
+pthread_cond_t hole_cond = PTHREAD_COND_INITIALIZER;  // Broadcast whenever a hole frees up.
 
 pthread_mutex_t molecomm_mtx = PTHREAD_MUTEX_INITIALIZER; // Lock for Mole communications
                                                           // buffer. Coordinates interaction 
@@ -374,6 +1198,13 @@ pthread_mutex_t ncurses_mtx = PTHREAD_MUTEX_INITIALIZER; // Our use of ncurses i
                                                          // display thread. So, we need to 
                                                          // lock ncurses calls.
 
+pthread_mutex_t rescore_mtx = PTHREAD_MUTEX_INITIALIZER; // Lock for rescorequeue (-R). Offline
+                                                         // rescoring runs alone, so it is never
+                                                         // held with any of the above.
+
+pthread_cond_t rescore_ready = PTHREAD_COND_INITIALIZER; // Signalled when a game is queued...
+pthread_cond_t rescore_room = PTHREAD_COND_INITIALIZER;  //    ...and when one is taken.
+
 //=============================
 // long tsrandom()
 //
@@ -401,2935 +1232,8068 @@ long tsrandom() {
     return randbuf;
 };
 
-//===================================
-// int claim_mole_hole(int molehole)
+//===============================================================
+// long elapsed_msec(const struct timespec *start, const struct timespec *end)
 //
-// Assures that only one mole claims a hole at any given time
-// by locking the hole_mtx for that hole.
+// Returns: milliseconds from start to end (negative if end is before start).
 //
-// molehole = Hole number to claim (zero based). Function will
-//            block until that hole is available...  
-//            Or, -1 to indicate that that a random hole should be
-//            assigned.  In this case, function will keep trying 
-//            until a hole is available.
+long elapsed_msec(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000L + (end->tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+//===================================================
+// void add_msec(struct timespec *t, long msec)
 //
-// Returns: hole number assigned (zero based).
+// Advances t by msec milliseconds.
 //
-int claim_mole_hole(int molehole) {
-    if (molehole < -1 || molehole >= MOLEHOLES) {
-        error_at_line(-1, -1, __FILE__, __LINE__, "hole number (%d) out of range.", molehole);
-    }
-
-    if (molehole == -1) { // search random holes until an available one is found
-        for (;;) {
-            molehole = tsrandom() % MOLEHOLES;
-            int err;
-            err = pthread_mutex_trylock(&hole_mtx[molehole]);
-            if (err == 0) {
-                break; // Lock acquired
-            } else if (err == EBUSY) {
-                struct timespec sleeptime = {0, 10000000L}; // 10 msec sleep so we
-                nanosleep(&sleeptime, NULL);                // don't burn up the cpu
-                continue;  // try again
-            } else {
-                restore_terminal();
-                error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole %d mutex.", molehole);
-            }
-        }
-    } else { // Block waiting for lock on specific hole.
-        int err;
-        if ((err = pthread_mutex_lock(&hole_mtx[molehole])) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole %d mutex.", molehole);
-        }
+// Returns: void
+//
+void add_msec(struct timespec *t, long msec) {
+    t->tv_sec += msec / 1000L;
+    t->tv_nsec += msec % 1000L * MSEC;
+    if (t->tv_nsec >= 1000000000L) {
+        ++t->tv_sec;
+        t->tv_nsec -= 1000000000L;
     }
-
-    return molehole;
 }
 
-//===================================
-// int check_mole_hole(int molehole)
+//===================================================
+// void mark_startup_phase(enum StartupPhase phase)
 //
-// Checks to see if a mole hole mutex is locked.
+// Records the time a startup phase completed.  Only the first call for each
+// phase counts, so it is safe to call from places that run repeatedly (such as
+// display_thread noticing the first HIDING mole).
 //
-// molehole = Hole number to check (zero based). 
+// phase = Startup phase that just completed.
 //
-// Returns: 1 = already claimed, 0 = available.
+// Returns: void
 //
-int check_mole_hole(int molehole) {
-    if (molehole < 0 || molehole >= MOLEHOLES) {
-        error_at_line(-1, -1, __FILE__, __LINE__, "hole number (%d) out of range.", molehole);
-    }
+void mark_startup_phase(enum StartupPhase phase) {
+    struct timespec *ts = &startupmarks[phase];
 
-    int err = pthread_mutex_trylock(&hole_mtx[molehole]);
-    if (err == 0) {
-        if ((err = pthread_mutex_unlock(&hole_mtx[molehole])) != 0) {
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole %d mutex.", molehole);
-        }
-        return 0; // hole is available
-    } else if (err == EBUSY) {
-        return 1; // hole is already claimed
-    } else {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole %d mutex.", molehole);
+    if (ts->tv_sec == 0 && ts->tv_nsec == 0) {
+        clock_gettime(CLOCK_MONOTONIC, ts);
+        log_event("startup phase %ld done", phase);
     }
+}
+
+//=======================
+// long launch_msec(void)
+//
+// Returns: msec since launch (SP_LAUNCH). The time base for heartbeats
+//          and trace events.
+//
+long launch_msec(void) {
+    struct timespec now;
 
-    assert(0); // Control flow never gets here. 
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return elapsed_msec(&startupmarks[SP_LAUNCH], &now);
 }
 
-//=====================================
-// void release_mole_hole(int molehole)
+//=========================
+// void heartbeat(int role)
 //
-// Releases mutex lock on a hole.
+// Records a sign of progress for the watchdog.  Input, display and control
+// threads beat once per pass of their main loop.  Mole slots beat on each
+// status change (see set_mole_status()).  Just a clock read and a store,
+// so cheap enough for the 1 msec input loop.
 //
-// molehole = hole number (zero based)
+// role = enum ThreadRole, below TR_ANIMATION.
 //
 // Returns: void
 //
-void release_mole_hole(int molehole) {
-    int err;
-    if ((err = pthread_mutex_unlock(&hole_mtx[molehole])) != 0) {
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole %d mutex.", molehole);
-    }
+void heartbeat(int role) {
+    heartbeats[role] = launch_msec();
 }
 
-//==============================
-//void initialize_terminal(void)
+//=============================================================
+// void trace_event(enum TraceType type, int arg1, int arg2)
 //
-// Set terminal to raw mode for direct access to keystrokes
+// Logs an event in the trace ring, for the watchdog dump.  Lock free: each
+// caller takes the next slot with an atomic add, and the slot's seq is
+// written last so the dump can skip one still being filled in (or
+// overwritten).
 //
-void initialize_terminal(void) {
-    initscr();  // Enter ncurses mode
-
-    if (COLS < 80 || LINES <25) {
-        restore_terminal();
-        error_at_line(-1, 0, __FILE__, __LINE__, "Minimum terminal size is 80x25 (Yours is %dx%d).", COLS, LINES);
-    }
-
-    scrollok(stdscr, TRUE); // Allow scrolling
-    curs_set(0);            // Disable cursor
+// type = what happened (see enum TraceType)
+// arg1, arg2 = details, depending on type.
+//
+// Returns: void
+//
+void trace_event(enum TraceType type, int arg1, int arg2) {
+    long seq = __sync_fetch_and_add(&tracehead, 1);
+    struct TraceEvent *te = &traceevents[seq % TRACEEVENTS];
+
+    te->seq = 0;
+    __sync_synchronize();
+    te->msec = launch_msec();
+    te->role = threadrole;
+    te->type = type;
+    te->arg1 = arg1;
+    te->arg2 = arg2;
+    __sync_synchronize();
+    te->seq = seq + 1;
 }
 
-//============================
-// void restore_terminal(void)
+//==================================
+// const char *role_name(int role)
 //
-// restores terminal settings back to the way we found them
+// role = enum ThreadRole
 //
+// Returns: printable name for the role. (Mole slot names are built in a
+//          static buffer, so only the watchdog and main() should call this.)
 //
-void restore_terminal(void) {
-    if (stdscr != NULL && isendwin() == FALSE) {
-        endwin();  // Exit ncurses mode.
+const char *role_name(int role) {
+    static char molenames[CONCURRENTMOLES][16];
+
+    switch (role) {
+        case TR_NONE: return "-";
+        case TR_INPUT: return "input";
+        case TR_DISPLAY: return "display";
+        case TR_CONTROL: return "control";
+        case TR_ANIMATION: return "animation";
+        case TR_WATCHDOG: return "watchdog";
+    }
+    if (role >= TR_MOLE && role < TR_MOLE + CONCURRENTMOLES) {
+        snprintf(molenames[role - TR_MOLE], sizeof(molenames[0]), "mole slot %d", role - TR_MOLE);
+        return molenames[role - TR_MOLE];
     }
+    return "?";
 }
 
-//============================
-// char waitforkey(long *msec)
+//==========================================================================
+// void log_record(const struct LogSite *site, const long *args, int nargs)
 //
-// nonblocking keyboard input
-// msec = pointer to max wait time in miliseconds
-//        or NULL for blocking input
-// returns key pressed, or '\0' for timeout
-// also (if msec is ! NULL), sets contents of msec to time remaining 
-// when key was pressed (or zero if !pressed)
+// The hot half of log_event(): copies the call site, a timestamp and the
+// arguments into this thread's ring buffer.  No locks, no formatting, no
+// system calls beyond a clock read.  A thread's first record claims it a
+// buffer from the pool (with compare and swap), which goes back when the
+// thread exits.  If the ring is full (logger_thread() is behind) or the
+// pool is empty, the record is dropped and counted, rather than wait.
 //
-char waitforkey(long *msec) {
-    struct timeval waittime;
-    fd_set stdin_fd;
-    char cbuf;
-
-    if (msec == NULL) {  // do blocking input
-        int result;
-        for (;;) {
-            errno = 0;
-            result = read(STDIN_FILENO, &cbuf, 1);
-            if (errno == EINTR) { // i.e. if window resized
-                lock_ncurses();
-                refresh();
-                unlock_ncurses();
-                continue;
-            } else {
-                break;
-            }
+// site = call site (static, from log_event())
+// args = arguments
+// nargs = how many (only the first LOGARGS are kept)
+//
+// Returns: void
+//
+void log_record(const struct LogSite *site, const long *args, int nargs) {
+    struct LogBuffer *lb = logbuffer;
+    struct timespec now;
+    int i;
+
+    if (lb == NULL) {  // First record from this thread. Claim a buffer.
+        for (i = 0; i < LOGBUFFERS; i++) {
+            if (__sync_bool_compare_and_swap(&logbuffers[i].state, LOGBUF_FREE, LOGBUF_OWNED)) break;
         }
-        if (result != 1) {
-            restore_terminal();
-            error_at_line(-1, errno, __FILE__, __LINE__, "stdin read error.");
+        if (i == LOGBUFFERS) {
+            __sync_fetch_and_add(&lognobuffer, 1);
+            return;
         }
-        clear_input_buffer();  // swallow extra keys, extended key codes, etc.
-        return cbuf;
-    } else {           // do timed input
-        if (*msec < 0L) *msec = 0L;
+        lb = &logbuffers[i];
+        lb->tid = (int)syscall(SYS_gettid);
+        lb->role = threadrole;
+        lb->head = lb->tail = 0;
+        lb->dropped = 0;
+        logbuffer = lb;
+        pthread_setspecific(logbufferkey, lb);
+    }
+
+    unsigned long head = lb->head;
+    if (head - lb->tail >= LOGRECORDS) {
+        ++lb->dropped;
+        return;
+    }
 
-        FD_ZERO(&stdin_fd);
-        FD_SET(STDIN_FILENO, &stdin_fd);
+    struct LogRecord *r = &lb->recs[head % LOGRECORDS];
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    r->nsec = (now.tv_sec - startupmarks[SP_LAUNCH].tv_sec) * 1000000000L + now.tv_nsec - startupmarks[SP_LAUNCH].tv_nsec;
+    r->site = site;
+    r->nargs = nargs < LOGARGS ? nargs : LOGARGS;
+    for (i = 0; i < r->nargs; i++) {
+        r->args[i] = args[i];
+    }
+    __sync_synchronize();  // Record complete before logger_thread() can see it
+    lb->head = head + 1;
+}
 
-        waittime.tv_sec = (int)(*msec / 1000L);
-        waittime.tv_usec = (long)*msec % 1000L * 1000L;
+//=====================================
+// void release_log_buffer(void *arg)
+//
+// Thread exit destructor for logbufferkey. (Also runs when a thread is
+// cancelled.)  Marks the thread's buffer retired, for logger_thread() to
+// drain and put back in the pool.
+//
+// arg = the thread's LogBuffer
+//
+// Returns: void
+//
+void release_log_buffer(void *arg) {
+    struct LogBuffer *lb = (struct LogBuffer *)arg;
 
-        int keyhit = select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, &waittime);
-        if (keyhit == 0) { //timeout
-            *msec = 0L;
-            return '\0';
-        } else if (keyhit > 0) { //key pressed
-            int result;
+    __sync_synchronize();
+    lb->state = LOGBUF_RETIRED;
+}
 
-            *msec = (long) waittime.tv_sec * 1000L + waittime.tv_usec / 1000L;
+//=========================================================
+// int compare_log_entries(const void *a, const void *b)
+//
+// qsort() comparison for LogEntry records: oldest first.
+//
+int compare_log_entries(const void *a, const void *b) {
+    long d = ((const struct LogEntry *)a)->rec.nsec - ((const struct LogEntry *)b)->rec.nsec;
+    return d < 0 ? -1 : d > 0;
+}
 
-            for (;;) {
-                errno = 0;
-                result = read(STDIN_FILENO, &cbuf, 1);
-                if (errno == EINTR) { // i.e. if window resized
-                    lock_ncurses();
-                    refresh();
-                    unlock_ncurses();
-                    continue;
-                } else {
-                    break;
-                }
-            }
-            if (result != 1) {
-                restore_terminal();
-                error_at_line(-1, errno, __FILE__, __LINE__, "stdin read error.");
-            }
+//==============================
+// int drain_log_buffers(void)
+//
+// Collects every record written since the last drain, from all buffers,
+// sorts them by time and formats them to logfile.  Retired buffers are
+// returned to the pool once empty.  Called by logger_thread() only.
+//
+// Returns: number of records written.
+//
+int drain_log_buffers(void) {
+    static struct LogEntry entries[LOGBUFFERS * LOGRECORDS];
+    int n = 0;
+    int i;
 
-            clear_input_buffer();  // swallow extra keys, extended key codes, etc.
-            return cbuf;
-        } else { // error
-            restore_terminal();
-            error_at_line(-1, errno, __FILE__, __LINE__, "select call error.");
+    for (i = 0; i < LOGBUFFERS; i++) {
+        struct LogBuffer *lb = &logbuffers[i];
+        int state = lb->state;
+
+        if (state == LOGBUF_FREE) continue;
+        __sync_synchronize();  // (Pairs with log_record() / release_log_buffer())
+
+        unsigned long head = lb->head;
+        unsigned long tail;
+        for (tail = lb->tail; tail < head; tail++) {
+            entries[n].rec = lb->recs[tail % LOGRECORDS];
+            entries[n].tid = lb->tid;
+            entries[n].role = lb->role;
+            ++n;
+        }
+        __sync_synchronize();  // Done reading before the slots can be reused
+        lb->tail = head;
+
+        if (state == LOGBUF_RETIRED) {
+            logdropped += lb->dropped;
+            lb->state = LOGBUF_FREE;
         }
     }
-    assert(0); // Control flow never gets here. 
-    return '\0';
+
+    qsort(entries, n, sizeof(struct LogEntry), compare_log_entries);
+    for (i = 0; i < n; i++) {
+        struct LogRecord *r = &entries[i].rec;
+        fprintf(logfile, "%12.3f %6d %-12s %s:%-5d ", r->nsec / 1000000.0, entries[i].tid, role_name(entries[i].role), r->site->file, r->site->line);
+        fprintf(logfile, r->site->fmt, r->args[0], r->args[1], r->args[2], r->args[3], r->args[4], r->args[5]);
+        fputc('\n', logfile);
+    }
+    if (n > 0) fflush(logfile);
+    logwritten += n;
+
+    return n;
 }
 
-//=============================
-//void clear_input_buffer(void)
+//==============================
+// void *logger_thread(void *arg)
 //
-//Swallow all keys in the buffer
+// Drains the log buffers every LOGDRAINMSEC until stop_logger() sets
+// logstopping, then does one last drain.  Records are sorted within a
+// drain; one committed just after a drain can land a little out of order.
 //
-void clear_input_buffer(void) {
-    long zerotime = 0L;
-    while (waitforkey(&zerotime));
+void *logger_thread(void *arg) {
+    struct timespec sleeptime = {0, LOGDRAINMSEC * MSEC};
+
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-Logger");
+ #endif
+
+    for (;;) {
+        int stopping = logstopping;  // Read first, so the last drain misses nothing
+        drain_log_buffers();
+        if (stopping) break;
+        nanosleep(&sleeptime, NULL);
+    }
+
+    return NULL;
 }
 
-//============================================================================================
-// int compute_score(int mole, int hole, char key, int bonusstage, enum PlayResult playresult)
+//=============================================
+// pthread_t *start_logger(const char *path)
 //
-// computes score based on target hole, key pressed, how long it took player to
-// press it, how long they had available, and their total score so far.
+// Opens the log file and starts logger_thread().
 //
-// mole = mole #
-// hole = hole #
-// key = the key pressed by player
-// bonusstage = For whacked mole, how par through the pop animation was the mole?
-//              (0=<20%, 1=20 to <40%, 2+40 to <60%, 3=60 to <80%, 4=80 to 100%)
-// playresult = WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF
+// path = log file to create (or truncate).
 //
-// Returns: Index to scores buffer
-//
-// Score #defines...
-//          Missed mole =  -10 pts per mole,
-//                         multiplied by # moles missed (so far)
-//                         capped at -50 per mole.
-//                         Cannot cause cumulative score to go negative.
-//          Whacked mole = 20 pts
-//          Bonus for fast reactions or for waiting until last moment.
-//              wait < 20% of up time =         25 pts
-//              wait >=20% to <40% of up time =  0 pts.
-//              wait >=40% to <60% of up time =  0 pts.
-//              wait >=60% to <80% of up time = 20 pts.
-//              wait >=80% to 100% of up time = 80 pts.
+// Returns: the logger's thread ID, or NULL if the file can't be opened.
 //
+pthread_t *start_logger(const char *path) {
+    static pthread_t tid;   // thread ID
+    int err;
 
-// NOTES ON SCORES: Care should be taken if changing scores beyond 2 digits (plus sign), 
-//                  as this will probably require adjustments to some of the animations
-//                  that include a score display.
-#define MISSEDMOLESCORE -10
-#define MISSEDMOLEMULTIPLIER 1
-#define MISSEDMOLECAP -50
-#define WHACKEDMOLESCORE 20
-#define BONUSSLICES 5
-const int BONUSPOINTS[BONUSSLICES] = {25,0,0,20,80};
-int compute_score(int mole, int hole, char key, int bonusstage, enum PlayResult playresult) {
-    static int missedcount = 0;
-    int missedscore = 0;
-    int whackedscore = 0;
-    int bonusscore = 0;
-    int penaltyscore = 0;
-    int curscore = 0;
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return NULL;
+    fprintf(f, "# Whack-A-Mole %s diagnostics log. msec since launch, thread id, thread, call site, event.\n", VERSTRING);
 
-    lock_scores();
+    if ((err = pthread_key_create(&logbufferkey, release_log_buffer)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create log buffer key.");
+    }
+    logfile = f;
 
-    if (numscores > 0) {
-        curscore = scores[numscores-1].endscore;
+    if ((err = pthread_create(&tid, NULL, logger_thread, NULL)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create logger thread.");
     }
 
-    switch(playresult) {
-        case WHACK: {
-            whackedscore += WHACKEDMOLESCORE;
-            bonusscore = BONUSPOINTS[bonusstage];
-        } break;
+    return &tid;
+}
 
-        case ESCAPE: 
-        case SCAREDOFF: {
-            missedscore = ++missedcount * MISSEDMOLESCORE * MISSEDMOLEMULTIPLIER;
-            if (missedscore < MISSEDMOLECAP) missedscore = MISSEDMOLECAP;
-            if (-missedscore > curscore) missedscore = -curscore;
-        } break;
+//==================================
+// void stop_logger(pthread_t *tid)
+//
+// Stops logger_thread() after a final drain, and closes the log file.
+// Anything logged after this is ignored.
+//
+// tid = logger's thread ID, from start_logger()
+//
+// Returns: void
+//
+void stop_logger(pthread_t *tid) {
+    int err;
+    void *retval;
+    int i;
 
-        case MISFIRE: 
-        case TOOSOON: {
-            penaltyscore = 0;  // no score penalty in this version
-        } break;
+    logstopping = 1;
+    if ((err = pthread_join(*tid, &retval)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join logger thread. Error=%d.", err);
+    }
 
-        default: {
-            // intentionally left empty
-        };
+    for (i = 0; i < LOGBUFFERS; i++) {  // Count drops in buffers still owned (main's, at least)
+        if (logbuffers[i].state != LOGBUF_FREE) logdropped += logbuffers[i].dropped;
     }
+    fprintf(logfile, "# %ld records, %ld dropped (buffer full), %ld dropped (no buffer free)\n", logwritten, logdropped, lognobuffer);
+    fclose(logfile);
+    logfile = NULL;
+}
 
-    // pass index into scores buffer back to caller
-    int scorenum = record_results(mole, hole, key, curscore, missedscore, whackedscore, bonusscore, penaltyscore, curscore + missedscore + whackedscore + bonusscore + penaltyscore, playresult);
+//==================================================================================
+// void append_game_event(enum GameEventType type, int slot, int mole, int hole,
+//                        int status, char key, const struct ScoreSheetRecord *score)
+//
+// Appends an event to the game event log.  Writers never wait: each takes
+// the next position with an atomic add, which fixes the order of events,
+// fills it in, and publishes it by writing seq last.  Entries are never
+// changed after that, so readers (next_game_event()) need no lock either.
+// The log grows a segment at a time (game_event_at()), so held keys can't
+// fill it and starve the projections that read it of score records.
+//
+// type = what happened (see enum GameEventType)
+// slot, mole, hole, status, key = details, depending on type
+// score = score sheet record (GE_SCORE), or NULL
+//
+// Returns: void
+//
+void append_game_event(enum GameEventType type, int slot, int mole, int hole, int status, char key, const struct ScoreSheetRecord *score) {
+    long idx = __sync_fetch_and_add(&gameeventhead, 1);
 
-    unlock_scores();
+    if (idx >= GAMEEVENTS) {  // Full. (audit_game_events() counts these.)
+        if (idx == GAMEEVENTS) log_event("event log full (%ld events), later ones dropped", (long)GAMEEVENTS);
+        return;
+    }
+    if (idx % GAMEEVENTSEG == GAMEEVENTSEG / 2 && idx + GAMEEVENTSEG < GAMEEVENTS) {
+        game_event_at(idx + GAMEEVENTSEG, 1);  // Half way through a segment: have the next one ready
+    }
 
-    return scorenum;
+    struct GameEvent *ge = game_event_at(idx, 1);
+    ge->msec = launch_msec();
+    ge->type = type;
+    ge->role = threadrole;
+    ge->slot = slot;
+    ge->mole = mole;
+    ge->hole = hole;
+    ge->status = status;
+    ge->key = key;
+    if (score != NULL) ge->score = *score;
+    __atomic_store_n(&ge->seq, idx + 1, __ATOMIC_RELEASE);
 }
 
-//============================================================================================
-//int record_results(int mole, int hole, char key, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult);
-//
-//  Records results for later use in score display
+//================================================
+// struct GameEvent *game_event_at(long idx, int grow)
 //
-//  mole = mole number
-//  hole = hole number
-//  key = key pressed by player
-//  startscore = player score before any changes from this mole
-//  missedscore = score for missing mole completely (negative)
-//  whackedscore = score for successfully whacking mole
-//  bonus score = extra points for waiting to whack mole
-//  penalty score = score for hitting wrong key (negative)
-//  endscore = cumulative score after these changes are applied to startscore
-//  playresult = WHACK, ESCAPE, MISFIRE, TOOSOON, or SCAREDOFF
+// Finds an event's place in the log's segments.  A missing segment is
+// allocated if grow is set: whoever gets it in first with compare and swap
+// keeps theirs, and the others free theirs, so writers still never wait on
+// each other.
 //
-//  Returns: index to scores buffer 
+// idx = event's position in the log (below GAMEEVENTS)
+// grow = 1: allocate the segment if need be (writers), 0: don't (readers)
 //
-//  This function is called exclusively by compute_score(...) function, which holds a mutex lock on scores
-//  buffer.  Therefore, no lock is required here.
+// Returns: the event, or NULL if its segment hasn't been allocated (grow = 0).
 //
-int record_results(int mole, int hole, char key, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult){
+struct GameEvent *game_event_at(long idx, int grow) {
+    struct GameEvent **segp = &gameeventsegs[idx / GAMEEVENTSEG];
+    struct GameEvent *seg = __atomic_load_n(segp, __ATOMIC_ACQUIRE);
 
-    ++numscores;
-    if (scores == NULL) {
-        scores = malloc(sizeof(struct ScoreSheetRecord)); 
-        if (scores == NULL) {
+    if (seg == NULL && grow) {
+        struct GameEvent *fresh = calloc(GAMEEVENTSEG, sizeof(struct GameEvent));
+        if (fresh == NULL) {
             restore_terminal();
-            error_at_line(-1, errno, __FILE__, __LINE__, "malloc failed.");
+            error_at_line(-1, errno, __FILE__, __LINE__, "Unable to grow the game event log.");
         }
-    } else {
-        struct ScoreSheetRecord *temp;  // temp pointer. (In case realloc fails)
-        temp = realloc(scores, numscores * sizeof(struct ScoreSheetRecord));
-        if (temp == NULL) {
-            free(scores);
-            restore_terminal();
-            error_at_line(-1, errno, __FILE__, __LINE__, "realloc failed.\n");
+        if (__atomic_compare_exchange_n(segp, &seg, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            seg = fresh;
+        } else {
+            free(fresh);  // (seg is the one that got in first)
         }
-        scores = temp;
     }
+    return seg == NULL ? NULL : &seg[idx % GAMEEVENTSEG];
+}
 
-    struct ScoreSheetRecord *p = &scores[numscores-1];
+//=========================================================
+// const struct GameEvent *next_game_event(long *cursor)
+//
+// Reads the game event log.  Each reader (projection) keeps its own cursor
+// and goes at its own pace.  An event still being written stops the reader
+// there until the next call, so it always sees events in order.
+//
+// cursor = reader's position in the log (start at 0). Advanced past the
+//          event returned.
+//
+// Returns: the next event, or NULL if there isn't one yet.
+//
+const struct GameEvent *next_game_event(long *cursor) {
+    if (*cursor >= GAMEEVENTS) return NULL;
 
-    p->mole = mole;
-    p->hole = hole;
-    p->startscore = startscore;
-    p->missedscore = missedscore;
-    p->whackedscore = whackedscore;
-    p->bonusscore = bonusscore;
-    p->penaltyscore = penaltyscore;
-    p->selection = key;
-    p->playresult = playresult;
-    p->endscore = endscore;
+    const struct GameEvent *ge = game_event_at(*cursor, 0);
+    if (ge == NULL || __atomic_load_n(&ge->seq, __ATOMIC_ACQUIRE) != *cursor + 1) return NULL;
+    ++*cursor;
+    return ge;
+}
 
-    return numscores - 1;
+//=============================
+// void reset_game_events(void)
+//
+// Empties the event log for a new game.  Its segments are kept for the
+// next game, and the first is allocated now, so a game usually never has
+// to grow the log.  Only the main thread may be running.
+//
+// Returns: void
+//
+void reset_game_events(void) {
+    long used = gameeventhead < GAMEEVENTS ? gameeventhead : GAMEEVENTS;
+    int i;
+
+    for (i = 0; i < GAMEEVENTSEGS && gameeventsegs[i] != NULL; i++) {
+        long n = used - (long)i * GAMEEVENTSEG;
+        if (n <= 0) break;
+        memset(gameeventsegs[i], 0, (n < GAMEEVENTSEG ? n : GAMEEVENTSEG) * sizeof(struct GameEvent));
+    }
+    gameeventhead = 0;
+    game_event_at(0, 1);
 }
 
-//============================================================
-// void set_mole_uptime(struct MoleCommRecord *p, long uptime)
+//=============================================
+// void write_game_events(FILE *f, int game)
 //
-// Updates mole's chosen random uptime in molecomm. Wrapped with molecomm mutex 
-// to prevent race conditions when interracting with display_thread().
-// 
-// p = pointer to the molecomm record for this thread.
-// uptime = mole up time in msec
+// Writes the game's event log (-E), one event per line.
 //
-// Return: void
+// f = stream to write to
+// game = game number (1 based)
 //
-void set_mole_uptime(struct MoleCommRecord *p, long uptime) {
-    lock_molecomm();
+// Returns: void
+//
+void write_game_events(FILE *f, int game) {
+    const struct GameEvent *ge;
+    long cursor = 0;
+
+    fprintf(f, "# game %d: %ld events%s\n", game, gameeventhead,
+            gameeventhead > GAMEEVENTS ? GAMEEVENTSFULL : "");
+    while ((ge = next_game_event(&cursor)) != NULL) {
+        fprintf(f, "%5ld %8ld %-11s ", ge->seq, ge->msec, role_name(ge->role));
+        switch (ge->type) {
+            case GE_GAMESTART: fprintf(f, "start    %d moles\n", ge->mole); break;
+            case GE_STATUS:
+                fprintf(f, "status   slot %d mole %d hole %d %s\n", ge->slot, ge->mole, ge->hole, molestatusnames[ge->status]);
+                break;
+            case GE_KEY: fprintf(f, "key      '%c'\n", ge->key); break;
+            case GE_SCORE:
+                fprintf(f, "score    #%d mole %d hole %d %s key '%c' %d %+d %+d %+d %+d = %d stage %d", ge->slot,
+                        ge->score.mole, ge->score.hole, playresultnames[ge->score.playresult],
+                        ge->score.selection ? ge->score.selection : '-', ge->score.startscore,
+                        ge->score.missedscore, ge->score.whackedscore, ge->score.bonusscore,
+                        ge->score.penaltyscore, ge->score.endscore, ge->score.bonusstage);
+                if (players > 1) fprintf(f, " player %d", ge->score.player + 1);
+                fprintf(f, "\n");
+                break;
+            case GE_GAMEEND: fprintf(f, "end\n"); break;
+        }
+    }
+    fflush(f);
+}
 
-    p->uptime = uptime;
+//=============================
+// void audit_game_events(void)
+//
+// Replays the finished game's event log and checks it against the game's
+// other state: the score sheet projected from the log must match scores[]
+// record for record, and every mole that was assigned must have completed.
+// In two-player mode each player's records are checked against their score
+// stream.  (Those can be logged out of turn, so only the counts have to
+// come out even.)
+// Writes the log out if -E was given.  Called at game end, with only the
+// main thread running.
+//
+// Returns: void
+//
+void audit_game_events(void) {
+    const struct GameEvent *ge;
+    long cursor = 0;
+    int assigned = 0, completed = 0;
+    int records = 0, mismatches = 0;
+    int playerrecords[PLAYERS] = {0, 0};
+    int i;
 
-    unlock_molecomm();
+    while ((ge = next_game_event(&cursor)) != NULL) {
+        switch (ge->type) {
+            case GE_STATUS:
+                if (ge->status == ASSIGNED) ++assigned;
+                if (ge->status == COMPLETE) ++completed;
+                break;
+            case GE_SCORE: {
+                if (ge->slot < 0) {  // Its PlayerLog was full: only the log has it
+                    ++records;
+                    break;
+                }
+                const struct ScoreSheetRecord *sr = score_record(ge->score.player, ge->slot);
+                if ((players == 1 && ge->slot != records) || sr == NULL || sr->mole != ge->score.mole
+                    || sr->hole != ge->score.hole || sr->playresult != ge->score.playresult
+                    || sr->selection != ge->score.selection || sr->endscore != ge->score.endscore) {
+                    ++mismatches;
+                }
+                ++records;
+                ++playerrecords[ge->score.player];
+            } break;
+            default: {
+                // intentionally left empty
+            };
+        }
+    }
+    if (players > 1) {
+        for (i = 0; i < players; i++) {
+            int logged = playerlogs[i].reserved < PLAYERLOGSIZE ? playerlogs[i].reserved : PLAYERLOGSIZE;
+            if (playerrecords[i] != logged) mismatches += abs(logged - playerrecords[i]);
+        }
+    } else if (records != numscores) {
+        mismatches += abs(numscores - records);
+    }
+    if (assigned != completed) ++mismatches;
+
+    for (i = 0; i < GAMEEVENTSEGS && gameeventsegs[i] != NULL; i++);
+    if (i > eventstats.segments) eventstats.segments = i;
+    ++eventstats.games;
+    eventstats.events += cursor;
+    eventstats.dropped += gameeventhead - cursor;
+    eventstats.records += records;
+    eventstats.mismatches += mismatches;
+    log_event("event log audit: %ld events, %ld score records, %ld mismatches", cursor, records, mismatches);
+
+    if (eventfile != NULL) {
+        write_game_events(eventfile, eventstats.games);
+    }
 }
 
-//=========================================================================
-//void set_mole_status(Struct MoleCommRecord *p, enum MoleStatus newstatus)
+//==================================
+// void print_event_stats(FILE *f)
 //
-// Updates a mole's status.  
+// Prints the game event log totals and audit results.
 //
-// Calling function is responsible for obtaining molecomm mutex lock before 
-// calling this function.
+// f = stream to print on.
 //
-// In the case of HIDING, UP, WHACKED, EXPIRED and TERMINATING moles, this function
-// will wait for display_thread to acknowledge the change.
+// Returns: void
 //
-// p = pointer to the molecomm record for this thread.
-// newstatus = New value to set p->molestatus to.
+void print_event_stats(FILE *f) {
+    if (eventstats.games == 0) return;
+
+    fprintf(f, "Event log: %ld events in %ld games, %ld dropped (log full)\n",
+            eventstats.events, eventstats.games, eventstats.dropped);
+    fprintf(f, "  audit:           %ld score records, %ld mismatches%s\n", eventstats.records,
+            eventstats.mismatches, eventstats.mismatches > 0 ? "  <-- MISMATCH" : "");
+    fprintf(f, "  display lag:     %ld events at most\n", eventstats.worstlag);
+    fprintf(f, "  log size:        %d segments of %d events at most\n", eventstats.segments, GAMEEVENTSEG);
+}
+
+//=============================
+// void perf_thread_begin(void)
 //
-// Return: void
+// Opens this thread's performance counters (-P): cycles, instructions and
+// cache misses (hardware), and context switches (software), counting this
+// thread only.  If the kernel refuses to count itself (perf_event_paranoid),
+// all threads fall back to counting user space only.  A counter that can't
+// be opened at all (no PMU in a VM, say) is left out, and the first errno
+// kept for the report.  Also arranges for perf_thread_end() to run when the
+// thread exits or is cancelled.
 //
-void set_mole_status(struct MoleCommRecord *p, enum MoleStatus newstatus) {
-    int err;
+// Does nothing unless -P is on (and main() found at least one counter).
+//
+// Returns: void
+//
+void perf_thread_begin(void) {
+    static const struct { __u32 type; __u64 config; } events[PERFCOUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}};
+    struct PerfThread *pt = &perfthread;
+    int i;
 
-    switch (newstatus) {
-        case AVAILABLE: assert(p->molestatus == COMPLETE) ;  break;
-        case ASSIGNED: assert(p->molestatus == AVAILABLE) ;  break;
-        case HIDING: assert(p->molestatus == ASSIGNED) ;  break;
-        case UP: assert(p->molestatus == HIDING) ;  break;
-        case WHACKED: assert(p->molestatus == UP) ;  break;
-        case EXPIRED: assert(p->molestatus == UP) ;  break;
-        case SCARED: assert(p->molestatus == HIDING || p->molestatus == UP) ;  break;
-        case TERMINATING: assert(p->molestatus == WHACKED || p->molestatus == EXPIRED || p->molestatus == SCARED) ;  break;
-        case COMPLETE: assert(p->molestatus == TERMINATING) ;  break;
-    }
+    if (perfcounters != 1 || pt->open) return;
 
-    if (newstatus == AVAILABLE) {
-        memset(p, 0, sizeof(struct MoleCommRecord));    // Clear out any left over data
-    }
+    for (i = 0; i < PERFCOUNTERS; i++) {
+        struct perf_event_attr attr;
 
-    p->molestatus = newstatus;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.exclude_kernel = perfuseronly;
+        attr.exclude_hv = 1;
 
-    if (newstatus==HIDING || newstatus==UP || newstatus==WHACKED || newstatus==EXPIRED || newstatus==TERMINATING) {
-        while (p->molestatus != p->displayack) {
-            if ((err = pthread_cond_wait(&p->dispcond, &molecomm_mtx)) != 0) {
-                restore_terminal();
-                error_at_line(-1, err, __FILE__, __LINE__, "Display thread cond wait failed.");
-            }
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && ! attr.exclude_kernel) {
+            perfuseronly = 1;  // Not allowed to count the kernel. User space only, then.
+            attr.exclude_kernel = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
         }
+        if (fd < 0 && perferrno[i] == 0) {
+            perferrno[i] = errno;
+        }
+        pt->fd[i] = fd;
+        pt->last[i] = 0;
     }
+    pt->open = 1;
+    pthread_setspecific(perfthreadkey, pt);
 }
 
-// ============================
-// void *mole_thread(void *arg)
+//==============================
+// void perf_sample(int stage)
 //
-// Handle a single thread-based visit by one mole.
+// Reads this thread's counters and adds what they counted since the last
+// sample to its role's total for the current phase (perfphase) and, for a
+// mole thread, to the lifecycle stage it was in.
 //
-// Locks mole hole.
-// Selects random timing for mole.
-// Sets state to HIDING, waits for hiding animation to finish.
-// Sets state to UP, waits for popup animation to finish or be terminated.
-// Sets state to EXPIRED or WHACKED, waits for animation to finish.
-// Sets state to TERMINATED, waits for display ack
-// Releases mole hole.
-// sets state to COMPLETE
-// 
-// arg = pointer to molecomm record
+// stage = enum MoleStatus the counts belong to, or -1 for none.
 //
-#define MOLESTARTDELAYMIN 250  //msec
-#define MOLESTARTDELAYMAX 3000 //msec
-void *mole_thread(void *arg) {
-    struct MoleCommRecord *p = (struct MoleCommRecord *)arg;
+// Returns: void
+//
+void perf_sample(int stage) {
+    struct PerfThread *pt = &perfthread;
+    enum PerfPhase phase = perfphase;
+    int i;
 
- #if defined(debug) && defined(_GNU_SOURCE)
-    pthread_setname_np(pthread_self(), "WAM-Mole");
- #endif
+    if (! pt->open) return;
 
-    // Varying delay so they don't all start at once.
-    long molestartdelay;
-    if (p->mole == 1) {
-        molestartdelay = MOLESTARTDELAYMIN; // Start the first one quickly ,
-                                            // to avoid seeming like program locked up.
-    } else {
-        // subsequent moles can wait longer.
-        molestartdelay = ( tsrandom() % (MOLESTARTDELAYMAX - MOLESTARTDELAYMIN) ) + MOLESTARTDELAYMIN;
-    }
-    struct timespec delaytime;
-    delaytime.tv_sec = molestartdelay / 1000;
-    delaytime.tv_nsec = molestartdelay % 1000 * 1000000L;
-    nanosleep(&delaytime, NULL);
+    for (i = 0; i < PERFCOUNTERS; i++) {
+        long long value;
+        if (pt->fd[i] < 0 || read(pt->fd[i], &value, sizeof(value)) != sizeof(value)) continue;
 
-    // Claim mole hole
-    int molehole; 
-    molehole = claim_mole_hole(-1); // Claim random mole hole
+        long long delta = value - pt->last[i];
+        pt->last[i] = value;
+        __sync_fetch_and_add(&perfbyrole[threadrole][phase].count[i], delta);
+        if (stage >= 0) {
+            __sync_fetch_and_add(&perfbystage[stage].count[i], delta);
+        }
+    }
+}
 
-    lock_molecomm();
-    p->hole = (int)molehole;
+//==================================
+// void perf_thread_end(void *arg)
+//
+// Takes a last sample and closes this thread's counters.  Runs as the
+// perfthreadkey destructor; main() calls it directly before reporting.
+//
+// arg = unused
+//
+// Returns: void
+//
+void perf_thread_end(void *arg) {
+    struct PerfThread *pt = &perfthread;
+    int i;
 
-    unlock_molecomm();
+    if (! pt->open) return;
 
-    // Set random timing for mole...
-    // Duty cycle of each popup ranges from 30% to 80%
-    long uptime = tsrandom();
-    uptime = (uptime % 5000L + 3000L) * (long)p->duration / 10000L;
-    set_mole_uptime(p, uptime);
+    perf_sample(-1);
+    for (i = 0; i < PERFCOUNTERS; i++) {
+        if (pt->fd[i] >= 0) close(pt->fd[i]);
+        pt->fd[i] = -1;
+    }
+    pt->open = 0;
+}
 
-    lock_molecomm();
-    set_mole_status(p, HIDING);
-    unlock_molecomm();
+//=========================================
+// void perf_phase(enum PerfPhase phase)
+//
+// Called by main() as the program moves on to the next phase.  Counts so
+// far go to the phase that is ending.  (The other threads only live
+// through game play.)
+//
+// phase = phase starting
+//
+// Returns: void
+//
+void perf_phase(enum PerfPhase phase) {
+    perf_sample(-1);
+    perfphase = phase;
+}
 
-    for (;;) {  // Wait for HIDING animation to signal it has completed (synccount == syncpoints)
-        lock_molecomm();
-        if (p->animspec.syncpoints > 0 && p->animspec.synccount == p->animspec.syncpoints) {
-            break;
+//=====================================
+// void print_startup_profile(FILE *f)
+//
+// Prints the time at which each startup phase completed, relative to launch,
+// and the time it took to get from launch to the first mole.  Menu time is
+// reported separately since it is mostly the player reading the instructions.
+// Phases are listed in the order they happened, which differs between normal
+// and fast start.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_startup_profile(FILE *f) {
+    const char *names[SP_PHASES] = {"launch", "terminal", "calibrate", "menu", "threads", "countdown", "playfield", "first hiding", "first up"};
+    struct timespec *launch = &startupmarks[SP_LAUNCH];
+    struct timespec *prev = launch;
+    int order[SP_PHASES];
+    int count = 0;
+    int i, j;
+
+    for (i = SP_TERMINAL; i < SP_PHASES; i++) { // Insertion sort phases by completion time
+        struct timespec *ts = &startupmarks[i];
+        if (ts->tv_sec == 0 && ts->tv_nsec == 0) continue; // Phase skipped or never reached
+
+        for (j = count; j > 0 && elapsed_msec(ts, &startupmarks[order[j-1]]) > 0; j--) {
+            order[j] = order[j-1];
         }
-
-        unlock_molecomm();
-        nanosleep(&one_msec, NULL);
+        order[j] = i;
+        ++count;
     }
-    unlock_molecomm();
-
-    if (! p->scaredflag) {  // Pop up mole, unless it was scared. 
-        struct timespec waituntil, starttime; // convert uptime to absolute time in timespec format
-        clock_gettime(CLOCK_REALTIME, &starttime);
-
-        waituntil.tv_sec = starttime.tv_sec + (uptime % 1000L * 1000000L + starttime.tv_nsec) / 1000000000L + uptime / 1000L;
-        waituntil.tv_nsec = (uptime % 1000L * 1000000L + starttime.tv_nsec) % 1000000000L;
-
-        lock_molecomm();
-        set_mole_status(p, UP);
 
-        p->keystruck = '\0'; // serves as predicate check for spurious wakeups
-        int condretval = 0;
-
-        while (p->keystruck == '\0' && condretval == 0) {
-            // timed wait for input_thread to signal key was hit
+    fprintf(f, "Startup profile (%s start):\n", faststart ? "fast" : "normal");
+    for (i = 0; i < count; i++) {
+        struct timespec *ts = &startupmarks[order[i]];
+        fprintf(f, "  %-14s %6ld ms  (+%ld ms)\n", names[order[i]], elapsed_msec(launch, ts), elapsed_msec(prev, ts));
+        prev = ts;
+    }
 
-            condretval = pthread_cond_timedwait(&p->keycond, &molecomm_mtx, &waituntil);
+    struct timespec *first = &startupmarks[SP_FIRSTHIDING];
+    if (first->tv_sec != 0 || first->tv_nsec != 0) {
+        long menuwait = 0;
+        if (startupmarks[SP_MENU].tv_sec != 0) {
+            menuwait = elapsed_msec(&startupmarks[SP_CALIBRATE], &startupmarks[SP_MENU]);
         }
+        fprintf(f, "  time to first mole: %ld ms (excluding %ld ms in menus)\n", elapsed_msec(launch, first) - menuwait, menuwait);
+    }
+}
 
-        --molesremaining;
-
-        switch (condretval) {
-            case 0: {
-                //Mole was either whacked or scared off
-
-                //Check if mole was whacked ( p->keystruck matches holekeys[p->hole] )
-                if (p->keystruck == holekeys[p->hole]) {
-                    int ssidx;  // index into scoresheets
-
-                    ssidx = compute_score(p->mole, p->hole, (char)p->hole + '0',p->animspec.synccount-1 , WHACK);
-
-                    p->scoreidx = ssidx;  // Save index into scores buffer. display_thread will need it to pass to animation_thread
+//==================================
+// void print_calibration(FILE *f)
+//
+// Prints terminal calibration results and the animation settings chosen.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_calibration(FILE *f) {
+    if (calibration.measured) {
+        fprintf(f, "Terminal calibration:\n");
+        fprintf(f, "  drain rate:      %ld bytes/sec\n", calibration.drainrate);
+        fprintf(f, "  wakeup jitter:   p50 %ld us, p95 %ld us, max %ld us\n", calibration.jitterp50, calibration.jitterp95, calibration.jittermax);
+    } else {
+        fprintf(f, "Terminal calibration: skipped (defaults)\n");
+    }
+    fprintf(f, "  pop-up frame:    %d ms\n", calibration.framemsec);
+    fprintf(f, "  frame policy:    %s\n", calibration.coalesce ? "coalesce (flushed by display thread)" : "immediate");
+    fprintf(f, "  frames drawn:    %ld\n", framerequests);
+    fprintf(f, "  frames flushed:  %ld\n", frameflushes);
+}
 
-                    set_mole_status(p, WHACKED);
+//==================================
+// void print_render_stats(FILE *f)
+//
+// Prints output cost during game play: frames flushed, and the write
+// syscalls and bytes per frame measured from /proc/self/io.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_render_stats(FILE *f) {
+    long frames = renderstats.frames > 0 ? renderstats.frames : 1;
+
+    fprintf(f, "Game play output (%s backend):\n", rawoutput ? "raw VT" : "ncurses");
+    fprintf(f, "  frames:          %ld\n", renderstats.frames);
+    if (renderstats.sampled) {
+        fprintf(f, "  write syscalls:  %ld (%.2f per frame)\n", renderstats.syscw, (double)renderstats.syscw / frames);
+        fprintf(f, "  bytes written:   %ld (%.1f per frame)\n", renderstats.wchar, (double)renderstats.wchar / frames);
+    } else {
+        fprintf(f, "  write syscalls:  n/a (/proc/self/io not readable)\n");
+    }
+    if (rawoutput) {
+        fprintf(f, "  raw writev():    %ld calls, %ld bytes\n", renderstats.rawwrites, renderstats.rawbytes);
+    }
+}
 
-                    unlock_molecomm();
+//==================================
+// void print_resize_stats(FILE *f)
+//
+// Prints how many resize notices arrived and how many relayouts they cost.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_resize_stats(FILE *f) {
+    fprintf(f, "Resize: %ld notices, %ld relayouts, worst relayout %ld us (final layout %dx%d%s)\n",
+            resizestats.notices, resizestats.relayouts, resizestats.worstusec,
+            layout.cols, layout.rows, layout.fits ? "" : ", clipped");
+}
 
-                    // Wait for GRACEPERIOD msec (in this case, it acts as a debounce
-                    // since double strikes are fairly common).
-                    struct timespec graceperiod;
-                    graceperiod.tv_sec = GRACEPERIOD / 1000;
-                    graceperiod.tv_nsec = GRACEPERIOD % 1000 * 1000000L;
-                    nanosleep(&graceperiod, NULL);
-                } else { // Mole was scared 
-                    int ssidx;  // index into scoresheets
-                    ssidx = compute_score(p->mole, p->hole, 0, 0, SCAREDOFF);
-                    p->scoreidx = ssidx;  // Save index into scores buffer. display_thread will need it to pass to animation_thread
-                    set_mole_status(p, SCARED);
-                    unlock_molecomm();
-                }
-            } break; 
+//==================================
+// void print_slot_stats(FILE *f)
+//
+// Prints how the mole slots' time was spent: how much of it had a live
+// (hiding or up) mole, versus start delay and the tail after scoring.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_slot_stats(FILE *f) {
+    long n = slotstats.moles > 0 ? slotstats.moles : 1;
+    long busy = slotstats.delaymsec + slotstats.livemsec + slotstats.tailmsec;
+
+    fprintf(f, "Mole slots (%d): %ld visits, live mole %.0f%% of slot time\n", CONCURRENTMOLES,
+            slotstats.moles, busy > 0 ? 100.0 * slotstats.livemsec / busy : 0.0);
+    fprintf(f, "  per visit:       %ld ms start delay, %ld ms live, %ld ms after scoring\n",
+            slotstats.delaymsec / n, slotstats.livemsec / n, slotstats.tailmsec / n);
+    if (slotstats.workers > 0) {
+        long perthread = slotstats.lifecycleusec / slotstats.workers;
+        fprintf(f, "  workers:         %ld threads for %ld visits, %ld us each to create + join,\n",
+                slotstats.workers, slotstats.moles, perthread);
+        fprintf(f, "                   ~%ld us saved vs a thread per visit\n",
+                (slotstats.moles - slotstats.workers) * perthread);
+    }
+}
 
-            case ETIMEDOUT: {
-                unlock_molecomm();
+//==================================
+// void print_frame_stats(FILE *f)
+//
+// Prints animation frames drawn and dropped, per priority class.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_frame_stats(FILE *f) {
+    static const char *names[FRAMECLASSES] = {"feedback", "cosmetic"};
+    int fc;
+
+    fprintf(f, "Animation frames by class:\n");
+    for (fc = 0; fc < FRAMECLASSES; fc++) {
+        fprintf(f, "  %-9s %6ld drawn, %ld dropped (%ld preempted, %ld terminal backlog)\n", names[fc],
+                framestats[fc].drawn, framestats[fc].preempted + framestats[fc].backlogged,
+                framestats[fc].preempted, framestats[fc].backlogged);
+    }
+}
 
-                int ssidx;  // index into scores buf
-                ssidx = compute_score(p->mole, p->hole, 0, 0, ESCAPE);
-                lock_molecomm();
+//====================================
+// void print_watchdog_stats(FILE *f)
+//
+// Prints how close game play came to the watchdog's SLOs, and any breaches.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_watchdog_stats(FILE *f) {
+    fprintf(f, "Watchdog: %ld checks, %d SLO breaches", watchdogstats.checks, watchdogstats.breaches);
+    if (watchdogstats.breaches > 0) {  // (dumps only counts the last game's)
+        fprintf(f, " (see %s)", WATCHDOGDUMP);
+    }
+    fprintf(f, "\n  worst seen:      %ld ms heartbeat gap (%s, SLO %d), %ld ms display ack wait (SLO %d)\n",
+            watchdogstats.worstbeat, role_name(watchdogstats.worstbeatrole), HEARTBEATSLO, watchdogstats.worstack, ACKSLO);
+}
 
-                p->scoreidx = ssidx;  // Save ndex into scores buf. display_thread will need it to pass to animation_thread
+//===============================
+// void print_log_stats(FILE *f)
+//
+// Prints how many diagnostics records were logged (-L), and lost.
+// Called after stop_logger().
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_log_stats(FILE *f) {
+    if (logpath == NULL) return;
 
-                set_mole_status(p, EXPIRED);
+    fprintf(f, "Log: %ld records to %s, %ld dropped (buffer full), %ld dropped (no buffer free)\n",
+            logwritten, logpath, logdropped, lognobuffer);
+}
 
-                unlock_molecomm();
-                // Wait for GRACEPERIOD msec
-                struct timespec graceperiod;
-                graceperiod.tv_sec = GRACEPERIOD / 1000;
-                graceperiod.tv_nsec = GRACEPERIOD % 1000 * 1000000L;
-                nanosleep(&graceperiod, NULL);
-            } break;
+//===================================================================
+// void print_perf_row(FILE *f, const char *name, const struct PerfCounts *pc)
+//
+// Prints one row of the performance counter report.  Counters that
+// couldn't be opened show as n/a.
+//
+// f = stream to print on.
+// name = row label
+// pc = counts
+//
+// Returns: void
+//
+void print_perf_row(FILE *f, const char *name, const struct PerfCounts *pc) {
+    int i;
 
-            default: {
-                restore_terminal();
-                error_at_line(-1, condretval, __FILE__, __LINE__, "Mole thread error on condition timedwait.");
-            } break;
+    fprintf(f, "    %-14s", name);
+    for (i = 0; i < PERFCOUNTERS; i++) {
+        if (perferrno[i] != 0) {
+            fprintf(f, " %14s", "n/a");
+        } else {
+            fprintf(f, " %14lld", pc->count[i]);
         }
-
-        for (;;) {  // wait for WHACKED/ESCAPED animation to signal it has completed (synccount == syncpoints)
-            lock_molecomm();
-            if (p->animspec.syncpoints > 0 && p->animspec.synccount == p->animspec.syncpoints) {
-                unlock_molecomm();
-                break;
+        if (i == PC_INSTRUCTIONS) {
+            if (perferrno[PC_CYCLES] == 0 && perferrno[PC_INSTRUCTIONS] == 0 && pc->count[PC_CYCLES] > 0) {
+                fprintf(f, " %5.2f", (double)pc->count[PC_INSTRUCTIONS] / pc->count[PC_CYCLES]);
+            } else {
+                fprintf(f, " %5s", "-");
             }
-            unlock_molecomm();
-            nanosleep(&one_msec, NULL);
         }
-    } else { // mole was scared, so no popup.  Set status to SCARED and release molecomm lock.
-        compute_score(p->mole, p->hole, 0, 0, SCAREDOFF);
-        set_mole_status(p, SCARED);
+    }
+    fprintf(f, "\n");
+}
 
-        --molesremaining;
+//==================================
+// void print_perf_report(FILE *f)
+//
+// Prints the -P performance counter totals: by phase, by thread (mole
+// slots combined), and by mole lifecycle stage.  Or, if no counter could
+// be opened, why not.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_perf_report(FILE *f) {
+    static const char *phasenames[PERFPHASES] = {"intro", "play", "score sheet"};
+    static const char *counternames[PERFCOUNTERS] = {"cycles", "instructions", "cache misses", "ctx switches"};
+    struct PerfCounts total;
+    int role, phase, i;
+
+    if (perfcounters == 0) return;
+
+    if (perfcounters < 0) {
+        int paranoid = -1;
+        FILE *pf = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (pf != NULL) {
+            if (fscanf(pf, "%d", &paranoid) != 1) paranoid = -1;
+            fclose(pf);
+        }
+        fprintf(f, "Performance counters: not available (%s; kernel.perf_event_paranoid = %d)\n", strerror(perferrno[PC_CYCLES]), paranoid);
+        return;
+    }
 
-        unlock_molecomm();
+    fprintf(f, "Performance counters (%s):\n", perfuseronly ? "user space only, kernel counting not permitted" : "user + kernel");
+    fprintf(f, "    %-14s %14s %14s %5s %14s %14s\n", "", counternames[0], counternames[1], "IPC", counternames[2], counternames[3]);
+
+    fprintf(f, "  by phase:\n");
+    for (phase = 0; phase < PERFPHASES; phase++) {
+        memset(&total, 0, sizeof(total));
+        for (role = 0; role < THREADROLES; role++) {
+            for (i = 0; i < PERFCOUNTERS; i++) total.count[i] += perfbyrole[role][phase].count[i];
+        }
+        print_perf_row(f, phasenames[phase], &total);
     }
 
-    if (p->molestatus == SCARED) {
-        for (;;) {  // wait for SCARED animation to signal it has completed (synccount == syncpoints)
-            lock_molecomm();
-            if (p->animspec.animationtype == ANIMMISFIRESCARED || p->animspec.animationtype == ANIMUPSCARED) {
-                if (p->animspec.syncpoints > 0 && p->animspec.synccount == p->animspec.syncpoints) {
-                    unlock_molecomm();
-                    break;
-                }
+    fprintf(f, "  by thread:\n");
+    for (role = 0; role < THREADROLES; role++) {
+        if (role > TR_MOLE && role < TR_ANIMATION) continue;  // Slots 1..n were added in with slot 0
+        memset(&total, 0, sizeof(total));
+        int last = role == TR_MOLE ? TR_ANIMATION - 1 : role;
+        int r;
+        for (r = role; r <= last; r++) {
+            for (phase = 0; phase < PERFPHASES; phase++) {
+                for (i = 0; i < PERFCOUNTERS; i++) total.count[i] += perfbyrole[r][phase].count[i];
             }
-            unlock_molecomm();
-            nanosleep(&one_msec, NULL);
         }
+        if (total.count[PC_CYCLES] == 0 && total.count[PC_CTXSWITCHES] == 0) continue;  // Never ran
+        print_perf_row(f, role == TR_MOLE ? "moles" : role_name(role), &total);
     }
 
-    lock_molecomm();
-    release_mole_hole((int)molehole);
-    set_mole_status(p, TERMINATING);
-    set_mole_status(p, COMPLETE);
-    unlock_molecomm();
+    fprintf(f, "  by mole stage (mole threads):\n");
+    for (i = ASSIGNED; i < COMPLETE; i++) {
+        if (perfbystage[i].count[PC_CYCLES] == 0 && perfbystage[i].count[PC_CTXSWITCHES] == 0) continue;
+        print_perf_row(f, molestatusnames[i], &perfbystage[i]);
+    }
 
-    return NULL;
+    for (i = 0; i < PERFCOUNTERS; i++) {
+        if (perferrno[i] != 0) {
+            fprintf(f, "  %s: n/a (%s)\n", counternames[i], strerror(perferrno[i]));
+        }
+    }
 }
 
-//============================================
-// void control_moles(int count, int duration)
+//==========================
+// void print_stats(FILE *f)
 //
-// Creates threads for moles. Runs up to CONCURRENTMOLES threads at a time
-// until "count" mole threads have been completed.
+// Prints all collected statistics. Called at exit when -s option is used.
 //
-//     count = number of popups (range 1 to MAXPOPUPCOUNT), 
-//     duration = Mole cycle time in msec.
+// f = stream to print on.
 //
-//     return: void
+// Returns: void
 //
-void control_moles(int count, int duration) {
-    int err;
-
-    // force args to sane values
-    if (count < 1) count = 1;
-    if (count > MAXPOPUPCOUNT) count = MAXPOPUPCOUNT;
-    if (duration < 1000) duration = 1000;
-    if (duration > MAXDURATION) {
-        duration = MAXDURATION;
-    }
+void print_stats(FILE *f) {
+    print_startup_profile(f);
+    print_calibration(f);
+    print_render_stats(f);
+    print_resize_stats(f);
+    print_slot_stats(f);
+    print_frame_stats(f);
+    print_watchdog_stats(f);
+    print_log_stats(f);
+    print_event_stats(f);
+    print_hole_stats(f);
+    print_keymap_stats(f);
+    print_input_stats(f);
+    print_player_stats(f);
+    print_sprite_stats(f);
+}
 
-    int molesstarted = 0;
-    int molescompleted = 0;
-    int idx = 0;
-    molesremaining = count;
+//=================================================================
+// long histogram_percentile(const long *hist, int buckets, int pct)
+//
+// hist = counts per bucket (bucket n = n msec)
+// buckets = number of buckets
+// pct = percentile wanted (1-100)
+//
+// Returns: the bucket the pct'th percentile falls in. 0 for an empty histogram.
+//
+long histogram_percentile(const long *hist, int buckets, int pct) {
+    long total = 0, seen = 0;
+    int i;
 
-    while (molescompleted < count) {
-        // p is pointer to the MoleCommRecord for this thread slot
-        struct MoleCommRecord *p = &molecomm[idx];
+    for (i = 0; i < buckets; i++) total += hist[i];
+    if (total == 0) return 0;
 
-        // If prior moles were scared off by a misfire, wait until creating new moles.
-        struct timespec tsnow, tsexp;
-        clock_gettime(CLOCK_MONOTONIC, &tsnow);
-        tsexp = p->scaredtime;
-        tsexp.tv_nsec += (SCAREDDURATION % 1000) * MSEC;
-        tsexp.tv_sec += SCAREDDURATION / 1000;
-        if (tsexp.tv_nsec >=  1000000000L) {
-            tsexp.tv_nsec -= 1000000000L;
-            tsexp.tv_sec++;
-        }
-        if (tsnow.tv_sec > tsexp.tv_sec || (tsnow.tv_sec == tsexp.tv_sec && tsnow.tv_nsec > tsexp.tv_nsec )) {
-            switch (p->molestatus) {
-                case AVAILABLE: { // empty slot, create a thread
-                    if (molesstarted < count) {
-                        lock_molecomm();
-                        p->mole = molesstarted + 1;
-                        p->threadslot = idx;
-                        p->duration = duration;
+    long target = (total * pct + 99) / 100;
+    for (i = 0; i < buckets - 1; i++) {
+        seen += hist[i];
+        if (seen >= target) break;
+    }
+    return i;
+}
 
-                        unlock_molecomm();
-                        set_mole_status(p, ASSIGNED);
+//=====================================================================
+// void print_benchmark_line(FILE *f, long seed, int games, int score)
+//
+// Prints the -b result: one line of name=value pairs that perfcheck.sh
+// collects from many runs of two builds and compares.  CPU time comes from
+// getrusage() (all threads); ack latency is over the whole run.
+//
+// f = stream to print on.
+// seed = random seed used
+// games = games played
+// score = final score of the last game
+//
+// Returns: void
+//
+void print_benchmark_line(FILE *f, long seed, int games, int score) {
+    struct rusage ru;
+    long cpumsec = 0, acks = 0;
+    int i;
 
-                        if ((err = pthread_cond_init(&molecomm[idx].dispcond, NULL)) != 0) {
-                            restore_terminal();
-                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize mole display condition %d.",idx);
-                        }
-                        if ((err = pthread_cond_init(&molecomm[idx].keycond, NULL)) != 0) {
-                            restore_terminal();
-                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize mole key condition %d.",idx);
-                        }
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        cpumsec = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000
+                  + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000;
+    }
+    for (i = 0; i <= ACKHISTMSEC; i++) acks += acklatencyrun[i];
+
+    fprintf(f, "bench: seed=%ld games=%d score=%d wall_ms=%ld cpu_ms=%ld frames=%ld flushes=%ld acks=%ld"
+            " ack_p50=%ld ack_p95=%ld ack_p99=%ld ack_max=%ld\n",
+            seed, games, score, launch_msec(), cpumsec, framerequests, frameflushes, acks,
+            histogram_percentile(acklatencyrun, ACKHISTMSEC + 1, 50),
+            histogram_percentile(acklatencyrun, ACKHISTMSEC + 1, 95),
+            histogram_percentile(acklatencyrun, ACKHISTMSEC + 1, 99),
+            histogram_percentile(acklatencyrun, ACKHISTMSEC + 1, 100));
+}
 
-                        if ((err = pthread_create(&molecomm[idx].thread, NULL, mole_thread, p)) != 0) {
-                            restore_terminal();
-                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create mole thread %d.", idx);
-                        }
+//===================================
+// void sample_resources(int game)
+//
+// Records process resources in soaksamples[] after a soak game: RSS,
+// threads and open fds (from /proc/self), condition variables and mutexes
+// initialized but never destroyed, and the game's display ack latency
+// percentiles.  The ack latency histogram is cleared for the next game.
+// Called between games, with only the main thread running.
+//
+// game = game number (1 based)
+//
+// Returns: void
+//
+void sample_resources(int game) {
+    char line[128];
+    FILE *f;
+    DIR *d;
+    int i;
 
-                        ++molesstarted;
-                    }
-                } break;
+    if (numsoaksamples == SOAKSAMPLES) {  // Full: keep every other sample
+        for (i = 0; i < SOAKSAMPLES / 2; i++) {
+            soaksamples[i] = soaksamples[2 * i];
+        }
+        numsoaksamples = SOAKSAMPLES / 2;
+    }
 
-                case COMPLETE: { // mole thread ready to be joined
-                    void *retval;
-                    if ((err = pthread_join(p->thread, &retval)) != 0) { // join mole thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join mole thread %d. Error=%d", idx, err);
-                    }
+    struct SoakSample *ss = &soaksamples[numsoaksamples++];
+    memset(ss, 0, sizeof(struct SoakSample));
+    ss->game = game;
+    ss->msec = launch_msec();
 
-                    set_mole_status(p, AVAILABLE);
-                    ++molescompleted;
-                } break;
+    if ((f = fopen("/proc/self/statm", "r")) != NULL) {
+        long pages;
+        if (fscanf(f, "%*s %ld", &pages) == 1) {
+            ss->rsskb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        fclose(f);
+    }
 
-                default: {
-                    // intentionally left empty
-                };
-            }
+    if ((f = fopen("/proc/self/status", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "Threads: %d", &ss->threads) == 1) break;
         }
+        fclose(f);
+    }
 
-        if (++idx == CONCURRENTMOLES) {
-            idx = 0;
-            struct timespec sleeptime = {0, 100000000L}; // 100 msec sleep so we
-            nanosleep(&sleeptime, NULL);                 // don't burn up the cpu
+    if ((d = opendir("/proc/self/fd")) != NULL) {
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] != '.') ++ss->fds;
         }
+        closedir(d);
+        --ss->fds;  // Don't count opendir()'s own fd
     }
+
+    ss->syncobjects = syncinits - syncdestroys;
+    ss->ackp50 = histogram_percentile(acklatency, ACKHISTMSEC + 1, 50);
+    ss->ackp95 = histogram_percentile(acklatency, ACKHISTMSEC + 1, 95);
+    ss->ackp99 = histogram_percentile(acklatency, ACKHISTMSEC + 1, 99);
+    ss->ackmax = histogram_percentile(acklatency, ACKHISTMSEC + 1, 100);
+    memset(acklatency, 0, sizeof(acklatency));
 }
 
-//==============================
-// void intro_splashscreen(void)
+//==============================================
+// int print_soak_report(FILE *f, long seed)
 //
-// Part of the instructions presented by display_intro()
+// Prints the soak (-S) results: a sample of the per-game rows, then drift
+// from the first game to the last.  RSS may grow by up to SOAKRSSSLACK kB
+// (allocator noise), threads, fds and live sync objects may not change at
+// all, and ack p95 over the last quarter of the games may not be more than
+// double (and SOAKLATENCYSLACK msec over) that of the first quarter.
+// Watchdog breaches also count against the run.
 //
-void intro_splashscreen(void) {
-    struct AnimationSpec anim[MOLEHOLES];
-    pthread_t animthread[MOLEHOLES];
-    display_empty_playfield(BASEGAME, DISP_ELE_HOLES, MOLEHOLES, NULL);
-
-    int linenum = 3;
-    const int startcol = 43;
-    lock_ncurses();
-    mvprintw(++linenum,startcol,"        Whack-A-Mole %s\n", VERSTRING);
-    refresh();
-    unlock_ncurses();
-
+// f = stream to print on.
+// seed = random seed used (-z to repeat the run's random choices).
+//
+// Returns: 1 if drift (or a breach) was found, 0 if not.
+//
+int print_soak_report(FILE *f, long seed) {
+    int n = numsoaksamples;
+    int drift = 0;
     int i;
-    for (i=0; i<MOLEHOLES; i++) {
-        anim[i] = PopupSplash;
-        anim[i].hole = i;
-
-        int err;
-        if ((err = pthread_create(&animthread[i], NULL, animation_thread, &anim[i])) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-        }
 
-        struct timespec sleeptime = {0, 150000000L}; // 150 msec sleep 
-        nanosleep(&sleeptime, NULL);
+    if (n == 0) return 0;
+
+    struct SoakSample *first = &soaksamples[0];
+    struct SoakSample *last = &soaksamples[n - 1];
+    double hours = (last->msec - first->msec) / 3600000.0;
+
+    fprintf(f, "Soak: %d games in %.2f hours (seed %ld)\n", last->game, last->msec / 3600000.0, seed);
+    fprintf(f, "   game   hours    rss kB threads fds sync objs  ack p50/p95/p99/max ms\n");
+    int step = (n + SOAKREPORTROWS - 1) / SOAKREPORTROWS;
+    for (i = 0; i < n; i += step) {
+        struct SoakSample *ss = &soaksamples[i];
+        if (i + step >= n) ss = last;  // Always finish on the last game
+        fprintf(f, "  %5d %7.2f %9ld %7d %3d %9ld  %ld/%ld/%ld/%ld%s\n", ss->game, ss->msec / 3600000.0,
+                ss->rsskb, ss->threads, ss->fds, ss->syncobjects, ss->ackp50, ss->ackp95, ss->ackp99, ss->ackmax,
+                ss->ackmax == ACKHISTMSEC ? "+" : "");
     }
 
-    for (i=0; i<MOLEHOLES; i++) {
-        int err;
-        void *retval;
-        if ((err = pthread_join(animthread[i], &retval)) != 0) { // Join animation thread
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d Error=%d.", i,err);
-        }
+    if (n < 2) {
+        fprintf(f, "  (at least 2 games are needed to measure drift)\n");
+        return watchdogstats.breaches > 0;
     }
 
-    lock_ncurses();
-    linenum += 2;
-    mvprintw(++linenum,startcol,"   A Linux / ncurses implementation  ");
-    mvprintw(++linenum,startcol,"   of the classic electromechanical  ");
-    mvprintw(++linenum,startcol,"   arcade game, using POSIX threads. ");
-    linenum += 2;
-    mvprintw(++linenum,startcol,"         ==================          ");
-    mvprintw(++linenum,startcol,"         Please select one:          ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           I)nstructions             ");
-    mvprintw(++linenum,startcol,"           P)lay                     ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"         ==================          ");
-    refresh();
-    unlock_ncurses();
-}
-
-//============================
-//int intro_overview(int page)
-//
-// Part of the instructions presented by display_intro()
-//
-int intro_overview(int page) {
-    lock_ncurses();
-    clear();
-    int linenum = 0;
-    const int startcol = 22;
-    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    linenum +=2;
-    mvprintw(++linenum,startcol,"              OVERVIEW               ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Score points by whacking the      ");
-    mvprintw(++linenum,startcol,"   moles when they pop up in the     ");
-    mvprintw(++linenum,startcol,"   holes.                            ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   A penalty score is assessed for   ");
-    mvprintw(++linenum,startcol,"   any missed moles.                 ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Up to %d moles may be active at   ", CONCURRENTMOLES);
-    mvprintw(++linenum,startcol,"   the same time.                    ");
-    linenum += 2;
-    mvprintw(++linenum,startcol,"   ===============================   ");
-    mvprintw(++linenum,startcol,"        Options: (N)ext pg,          ");
-    mvprintw(++linenum,startcol,"                 (S)tart game        ");
-    mvprintw(++linenum,startcol,"   ===============================   ");
-    refresh();
-    unlock_ncurses();
-
-    return linenum;
+    int quarter = n / 4 > 0 ? n / 4 : 1;
+    long p95first = 0, p95last = 0;
+    for (i = 0; i < quarter; i++) {
+        p95first += soaksamples[i].ackp95;
+        p95last += soaksamples[n - 1 - i].ackp95;
+    }
+    p95first /= quarter;
+    p95last /= quarter;
+
+    long rssdelta = last->rsskb - first->rsskb;
+    int rssdrift = rssdelta > SOAKRSSSLACK;
+    int threaddrift = last->threads != first->threads;
+    int fddrift = last->fds != first->fds;
+    int syncdrift = last->syncobjects != 0 || first->syncobjects != 0;
+    int latencydrift = p95last > 2 * p95first && p95last > p95first + SOAKLATENCYSLACK;
+
+    fprintf(f, "Drift, game %d to game %d:\n", first->game, last->game);
+    fprintf(f, "  rss:           %+ld kB (%+.0f kB/hour)%s\n", rssdelta, hours > 0 ? rssdelta / hours : 0.0, rssdrift ? "  <-- DRIFT" : "");
+    fprintf(f, "  threads:       %d -> %d%s\n", first->threads, last->threads, threaddrift ? "  <-- DRIFT" : "");
+    fprintf(f, "  open fds:      %d -> %d%s\n", first->fds, last->fds, fddrift ? "  <-- DRIFT" : "");
+    fprintf(f, "  sync objects:  %ld -> %ld live (%ld init, %ld destroy)%s\n", first->syncobjects, last->syncobjects,
+            syncinits, syncdestroys, syncdrift ? "  <-- LEAK" : "");
+    fprintf(f, "  ack p95:       %ld ms (first quarter) -> %ld ms (last quarter)%s\n", p95first, p95last, latencydrift ? "  <-- DRIFT" : "");
+    fprintf(f, "  watchdog:      %d SLO breaches%s\n", watchdogstats.breaches, watchdogstats.breaches > 0 ? "  (see " WATCHDOGDUMP ")" : "");
+
+    drift = rssdrift || threaddrift || fddrift || syncdrift || latencydrift || watchdogstats.breaches > 0;
+    fprintf(f, "Soak result: %s\n", drift ? "DRIFT DETECTED" : "no drift");
+    return drift;
 }
 
-//=============================
-//int intro_playfield(int page)
+//===================================
+// int claim_mole_hole(int molehole)
 //
-// Part of the instructions presented by display_intro()
+// Assures that only one mole claims a hole at any given time, by marking
+// it in the hole occupancy index (holeuse[]).  Holes with a misfire panel
+// showing are skipped, as are holes already claimed.
 //
-int intro_playfield(int page) {
-    lock_ncurses();
-    clear();
-    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
-    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    int linenum = 0;
-    const int startcol = 43;
-    linenum +=2;
-    mvprintw(++linenum,startcol,"              PLAYFIELD              ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   This is the playfield for the     ");
-    mvprintw(++linenum,startcol,"   game.                             ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"   The key assigned to each hole is  ");
-    mvprintw(++linenum,startcol,"   displayed to the upper right of   ");
-    mvprintw(++linenum,startcol,"   the hole.                         ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"   Press that key to swing your      ");
-    mvprintw(++linenum,startcol,"   virtual hammer at the hole.       ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"   HINT: Make sure numlock is on.    ");
-    linenum += 2;
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
-    mvprintw(++linenum,startcol,"            (S)tart game             ");
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    refresh();
-    unlock_ncurses();
-
-    return linenum;
-}
-
-//===============================
-//int intro_hidingmoles(int page)
+// molehole = Hole number to claim (zero based). Function will
+//            block until that hole is available...  
+//            Or, -1 to indicate that that a random hole should be
+//            assigned.  In this case, one of the free holes is picked
+//            at random, and the function only waits if there are none.
 //
-// Part of the instructions presented by display_intro()
+// Returns: hole number assigned (zero based).
 //
-int intro_hidingmoles(int page) {
-    lock_ncurses();
-    clear();
-    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
-    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    int linenum = 0;
-    const int startcol = 43;
-    linenum +=2;
-    mvprintw(++linenum,startcol,"              GAMEPLAY               ");
-    mvprintw(++linenum,startcol,"            Hiding Moles             ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Each mole starts out by choosing  ");
-    mvprintw(++linenum,startcol,"   a hole and hiding.  Look closely, ");
-    mvprintw(++linenum,startcol,"   and you can occasionally see the  ");
-    mvprintw(++linenum,startcol,"   mole's ears in the hole.          ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   You CANNOT whack a mole while it  ");
-    mvprintw(++linenum,startcol,"   is hiding.  You must wait for it  ");
-    mvprintw(++linenum,startcol,"   to pop up.                        ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Hole 5 on the left shows an       ");
-    mvprintw(++linenum,startcol,"   example of a mole hiding.         ");
-    linenum += 2;
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
-    mvprintw(++linenum,startcol,"            (S)tart game             ");
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    refresh();
-    unlock_ncurses();
+int claim_mole_hole(int molehole) {
+    if (molehole < -1 || molehole >= moleholes) {
+        error_at_line(-1, -1, __FILE__, __LINE__, "hole number (%d) out of range.", molehole);
+    }
 
-    struct AnimationSpec anim = HidingAnim;
-    pthread_t thread;
-    anim.hole = 4;
-    anim.duration = -1; //run until cancelled
     int err;
-    if ((err = pthread_create(&thread, NULL, animation_thread, &anim)) != 0) {
+    if ((err = pthread_mutex_lock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole mutex.");
     }
 
-    // now wait for key to be hit
-    const struct timeval onesecond = {1, 0L};
-    struct timeval waittime;
-    fd_set stdin_fd;
-    do {
-        waittime = onesecond;
-        FD_ZERO(&stdin_fd);
-        FD_SET(STDIN_FILENO, &stdin_fd);
-    } while (0 == select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, &waittime)); //wait for keypress
-
-    // Now kill the animation thread and join it
-    if ((err = pthread_cancel(thread)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
+    for (;;) {
+        if (molehole == -1) { // pick a random free hole, if there are any
+            int i, free = 0;
+            for (i=0; i<moleholes; i++) {
+                if (holeuse[i] == 0) ++free;
+            }
+            if (free > 0) {
+                int pick = tsrandom() % free;
+                for (i=0; holeuse[i] != 0 || pick-- > 0; i++);
+                molehole = i;
+                break;
+            }
+        } else if (holeuse[molehole] == 0) {
+            break;
+        }
+        if ((err = pthread_cond_wait(&hole_cond, &hole_mtx)) != 0) { // wait for a hole to free up
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to wait on hole cond.");
+        }
     }
-    void *retval;
-    if ((err = pthread_join(thread, &retval)) != 0) { 
+    holeuse[molehole] |= HOLE_MOLE;
+    log_event("hole %ld claimed", molehole);
+
+    if ((err = pthread_mutex_unlock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread. Error=%d.", err);
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole mutex.");
     }
-
-    return linenum;
+    return molehole;
 }
 
-//=========================
-//int intro_popup(int page)
+//=====================================
+// void release_mole_hole(int molehole)
 //
-// Part of the instructions presented by display_intro()
+// Releases a mole's claim on a hole (or the claim of a result animation
+// it was handed off to), and wakes anyone waiting for one.
 //
-int intro_popup(int page) {
-    lock_ncurses();
-    clear();
-    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
-    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    int linenum = 0;
-    const int startcol = 43;
-    linenum +=2;
-    mvprintw(++linenum,startcol,"              GAMEPLAY               ");
-    mvprintw(++linenum,startcol,"           Popped Up Moles           ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   When a mole is ready, it pops its ");
-    mvprintw(++linenum,startcol,"   head up in the hole.              ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Press the key for that hole       ");
-    mvprintw(++linenum,startcol,"   before the mole gets away.        ");
-    mvprintw(++linenum,startcol,"                                     ");
-    mvprintw(++linenum,startcol,"   Hole 5 on the left shows a mole   ");
-    mvprintw(++linenum,startcol,"   popping up and getting away.      ");
-    linenum += 2;
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
-    mvprintw(++linenum,startcol,"            (S)tart game             ");
-    mvprintw(++linenum,startcol,"   ==============================    ");
-    refresh();
-    unlock_ncurses();
-
-    struct AnimationSpec anim = PopupInstr;
-    pthread_t thread;
-    anim.hole = 4;
-    anim.duration = 3000;
+// molehole = hole number (zero based)
+//
+// Returns: void
+//
+void release_mole_hole(int molehole) {
     int err;
-    if ((err = pthread_create(&thread, NULL, animation_thread, &anim)) != 0) {
+    if ((err = pthread_mutex_lock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole mutex.");
     }
-
-    // now wait for key to be hit
-    const struct timeval onesecond = {1, 0L};
-    struct timeval waittime;
-    fd_set stdin_fd;
-    do {
-        waittime = onesecond;
-        FD_ZERO(&stdin_fd);
-        FD_SET(STDIN_FILENO, &stdin_fd);
-    } while (0 == select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, &waittime)); //wait for keypress
-
-    // Now kill the animation thread and join it
-    if ((err = pthread_cancel(thread)) != 0) {
+    holeuse[molehole] &= ~(HOLE_MOLE | HOLE_RESULT);
+    if ((err = pthread_cond_broadcast(&hole_cond)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to broadcast hole cond.");
     }
-    void *retval;
-    if ((err = pthread_join(thread, &retval)) != 0) { 
+    if ((err = pthread_mutex_unlock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread. Error=%d.", err);
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole mutex.");
     }
-
-    return linenum;
 }
 
-//===============================
-//int intro_playresults(int page)
+//======================================
+// void hand_off_mole_hole(int molehole)
 //
-// Part of the instructions presented by display_intro()
+// Called by a mole thread once its mole is whacked or has escaped.  The
+// hole passes to the result animation (display_thread releases it when
+// the animation is done), and a GRACEPERIOD near-miss window starts for
+// the hole's key.  The mole thread, and its slot, are then free to go.
 //
-int intro_playresults(int page) {
-    lock_ncurses();
-    clear();
-    int linenum = 0;
-    const int startcol = 0;
-    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    ++linenum;
-    mvprintw(++linenum,startcol,"                                                                 ________");
-    mvprintw(++linenum,startcol,"                                 +----------------------------- /%8.8s\\", asciiwhack[0]);
-    mvprintw(++linenum,startcol,"           PLAY RESULTS          | If all goes well and you    / %8.8s \\", asciiwhack[1]);
-    mvprintw(++linenum,startcol,"                                 | press the correct key in    | %8.8s |", asciiwhack[2]);
-    mvprintw(++linenum,startcol,"    ________                     | time, you WHACK the mole.   | %8.8s |", asciiwhack[3]);
-    mvprintw(++linenum,startcol,"   /%8.8s\\ -------------------+------------+--------------- \\ %8.8s /", asciiescape[0], asciiwhack[4]);
-    mvprintw(++linenum,startcol,"  / %8.8s \\   If you're too slow, the mole |                 \\________/", asciiescape[1]);
-    mvprintw(++linenum,startcol,"  | %8.8s |   will ESCAPE and disappear in |                 ", asciiescape[2]);
-    mvprintw(++linenum,startcol,"  | %8.8s |   a \"poof\" of dust.            |                  ________", asciiescape[3]);
-    mvprintw(++linenum,startcol,"  \\ %8.8s / -----------------+-------------+---------------- /%8.8s\\", asciiescape[4], asciimisfire[0]);
-    mvprintw(++linenum,startcol,"   \\________/                   | If you have BAD AIM and      / %8.8s \\", asciimisfire[1]);
-    mvprintw(++linenum,startcol,"                                | hit the wrong key, or you    | %8.8s |", asciimisfire[2]);
-    mvprintw(++linenum,startcol,"                                | swing TOO SOON, the hammer   | %8.8s |", asciimisfire[3]);
-    mvprintw(++linenum,startcol,"    ________                    | will slam into the ground.   \\ %8.8s /",asciimisfire[4]);
-    mvprintw(++linenum,startcol,"   /        \\ ------------------+-----------------------+------ \\________/");
-    mvprintw(++linenum,startcol,"  /          \\   When the hammer slams the ground, all  |");
-    mvprintw(++linenum,startcol,"  |          |   moles that are up or hiding are SCARED |");
-    mvprintw(++linenum,startcol,"  |          |   OFF and can no longer be whacked.      |");
-    mvprintw(++linenum,startcol,"  \\          / -----------------------------------------+");
-    mvprintw(++linenum,startcol,"   \\________/");
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    refresh();
-    unlock_ncurses();
-
-    struct AnimationSpec anim = ScaredInstr;
-    pthread_t thread;
-    anim.hole = 6;
-    anim.duration = 3000;
+// molehole = hole number (zero based)
+//
+// Returns: void
+//
+void hand_off_mole_hole(int molehole) {
     int err;
-    if ((err = pthread_create(&thread, NULL, animation_thread, &anim)) != 0) {
+    if ((err = pthread_mutex_lock(&hole_mtx)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole mutex.");
+    }
+    holeuse[molehole] = (holeuse[molehole] & ~HOLE_MOLE) | HOLE_RESULT;
+    clock_gettime(CLOCK_MONOTONIC, &holegrace[molehole]);
+    add_msec(&holegrace[molehole], GRACEPERIOD);
+    if ((err = pthread_mutex_unlock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole mutex.");
     }
+}
 
-    // now wait for key to be hit
-    const struct timeval onesecond = {1, 0L};
-    struct timeval waittime;
-    fd_set stdin_fd;
-    do {
-        waittime = onesecond;
-        FD_ZERO(&stdin_fd);
-        FD_SET(STDIN_FILENO, &stdin_fd);
-    } while (0 == select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, &waittime)); //wait for keypress
+//===================================
+// int check_hole_grace(int molehole)
+//
+// Checks whether a hole is within the near-miss window after its mole was
+// whacked or escaped.  A key hit then is a near miss (no score or penalty)
+// rather than a misfire: a double strike, or a swing just too late.
+//
+// molehole = hole number (zero based)
+//
+// Returns: 1 = within the window, 0 = not.
+//
+int check_hole_grace(int molehole) {
+    struct timespec now;
+    int err;
 
-    // Now kill the animation thread and join it
-    if ((err = pthread_cancel(thread)) != 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((err = pthread_mutex_lock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole mutex.");
     }
-    void *retval;
-    if ((err = pthread_join(thread, &retval)) != 0) { 
+    int ingrace = elapsed_msec(&now, &holegrace[molehole]) > 0;
+    if ((err = pthread_mutex_unlock(&hole_mtx)) != 0) {
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread. Error=%d.", err);
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole mutex.");
     }
-
-    return linenum;
+    return ingrace;
 }
 
-//===========================
-//int intro_scoring(int page)
+//===============================================
+// int overlay_mole_hole(int molehole, int on)
 //
-// Part of the instructions presented by display_intro()
+// Marks a hole as showing (or no longer showing) a misfire panel.  This
+// is only an entry in the occupancy index, not a claim: nobody waits on an
+// overlaid hole, new moles just pick a different one.  A hole a mole has
+// already claimed is not overlaid (its own animation shows the misfire),
+// nor is one still showing a mole's result.
 //
-int intro_scoring(int page) {
-    lock_ncurses();
-    clear();
-    int linenum = 0;
-    const int startcol = 0;
-    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    ++linenum;
-    mvprintw(++linenum,startcol,"                                    SCORING");
-    ++linenum;
-    mvprintw(++linenum,startcol,"              Each successfully whacked mole earns you %d points. ", WHACKEDMOLESCORE);
-    mvprintw(++linenum,startcol,"                                                                                ");
-    mvprintw(++linenum,startcol,"              You can also earn a speed or skill bonus.  Whack the mole");
-    mvprintw(++linenum,startcol,"              at the follwing times to earn one of these bonuses.");
-    mvprintw(++linenum,startcol,"  +--------------+-----------------------------+-----------------------------+  ");
-    mvprintw(++linenum,startcol,"  |   Lightning  |            Meh...           |       Nerves of steel.      |  ");
-    mvprintw(++linenum,startcol,"  |   Reflexes.  |     Thanks for playing.     |   (Push it to the limit!)   |  ");
-    mvprintw(++linenum,startcol,"  |   ________   |   ________       ________   |   ________       ________   |  ");
-    mvprintw(++linenum,startcol,"  |  /%8.8s\\  |  /        \\     /        \\  |  /        \\     /        \\  |  ", asciimole[0]);
-    mvprintw(++linenum,startcol,"  | / %8.8s \\ | / %8.8s \\   /          \\ | /          \\   /          \\ |  ", asciimole[1], asciimole[0]);
-    mvprintw(++linenum,startcol,"  | | %8.8s | | | %8.8s |   | %8.8s | | |          |   |          | |  ", asciimole[2], asciimole[1], asciimole[0]);
-    mvprintw(++linenum,startcol,"  | | %8.8s | | | %8.8s |   | %8.8s | | | %8.8s |   |          | |  ", asciimole[3], asciimole[2], asciimole[1], asciimole[0]);
-    mvprintw(++linenum,startcol,"  | \\ %8.8s / | \\ %8.8s /   \\ %8.8s / | \\ %8.8s /   \\ %8.8s / |  ", asciimole[4], asciimole[3], asciimole[2], asciimole[1], asciimole[0]);
-    mvprintw(++linenum,startcol,"  |  \\________/  |  \\________/     \\________/  |  \\________/     \\________/  |  ");
-    mvprintw(++linenum,startcol,"  |              |                             |                             |  ");
-    mvprintw(++linenum,startcol,"  |   Bonus: %-2d  |   Bonus: %-2d      Bonus: %-2d  |   Bonus: %-2d      Bonus:%-2d   |  ", BONUSPOINTS[0], BONUSPOINTS[1], BONUSPOINTS[2], BONUSPOINTS[3], BONUSPOINTS[4]);
-    mvprintw(++linenum,startcol,"  +--------------+-----------------------------+-----------------------------+  ");
-    ++linenum;
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    refresh();
-    unlock_ncurses();
-
-    return linenum;
-}
-
-//=============================
-//int intro_penalties(int page)
+// molehole = hole number (zero based)
+// on = 1 to start the overlay, 0 to end it.
 //
-// Part of the instructions presented by display_intro()
+// Returns: 1 = done, 0 = not overlaid because a mole has the hole.
 //
-int intro_penalties(int page) {
-    lock_ncurses();
-    clear();
-    int linenum = 0;
-    const int startcol = 0;
-    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    ++linenum;
-    mvprintw(++linenum,startcol,"                                   PENALTIES");
-    ++linenum;
-    mvprintw(++linenum,startcol,"             You will be assessed a penalty for each mole that escapes.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"             The first mole to escape will cost you a %d point penalty.", abs(MISSEDMOLESCORE));
-    ++linenum;
-    mvprintw(++linenum,startcol,"             Each additional escaped mole costs another penalty AND ");
-    mvprintw(++linenum,startcol,"             increases the size of the penalty by %d points.  (So the ", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER);
-    mvprintw(++linenum,startcol,"             first costs you %d points, the second costs %d, third", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER, abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER * 2);
-    mvprintw(++linenum,startcol,"             costs %d, etc.)", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER * 3);
-    ++linenum;
-    mvprintw(++linenum,startcol,"             The size of the penalty is capped at %d points.  A penalty", abs(MISSEDMOLECAP));
-    mvprintw(++linenum,startcol,"             will never make your accumulated score go below 0.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"             Scared moles (caused by your hammer slamming the ground)");
-    mvprintw(++linenum,startcol,"             count as missed, and recieve all escaped-mole penalties.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
-    mvprintw(++linenum,startcol,"                   ===========================================");
-    refresh();
-    unlock_ncurses();
+int overlay_mole_hole(int molehole, int on) {
+    int err, done = 1;
 
-    return linenum;
+    if ((err = pthread_mutex_lock(&hole_mtx)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock hole mutex.");
+    }
+    if (on) {
+        if (holeuse[molehole] & (HOLE_MOLE | HOLE_RESULT)) {
+            done = 0;
+        } else {
+            holeuse[molehole] |= HOLE_OVERLAY;
+        }
+    } else {
+        holeuse[molehole] &= ~HOLE_OVERLAY;
+        if ((err = pthread_cond_broadcast(&hole_cond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to broadcast hole cond.");
+        }
+    }
+    if ((err = pthread_mutex_unlock(&hole_mtx)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock hole mutex.");
+    }
+    return done;
 }
 
 //==============================
-//int intro_scoresheet(int page)
+//void initialize_terminal(void)
 //
-// Part of the instructions presented by display_intro()
+// Set terminal to raw mode for direct access to keystrokes
 //
-int intro_scoresheet(int page) {
-    lock_ncurses();
-    clear();
-    int linenum = 0;
-    const int startcol = 0;
-    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
-    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(int(*)()));
-    ++linenum;
-    mvprintw(++linenum,startcol,"                                   SCORE SHEET");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           When you finish the game, you will see a score sheet with the");
-    mvprintw(++linenum,startcol,"           details of your game.  The score sheet events are:");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           Whacked Mole!     - Success!  You whacked a mole, earned a");
-    mvprintw(++linenum,startcol,"                               score, and possibly a bonus.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           Mole Escaped      - The mole got away, costing you a penalty.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           Bad Aim           - You hit a hole with no mole present.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           Hit Too Soon      - You hit a hole when the mole was still");
-    mvprintw(++linenum,startcol,"                               hiding.");
-    ++linenum;
-    mvprintw(++linenum,startcol,"           Mole Scared Away  - This mole was scared away by the \"Bad Aim\"");
-    mvprintw(++linenum,startcol,"                               or \"Hit Too Soon\" event above. (Costing you");
-    mvprintw(++linenum,startcol,"                               an escaped-mole penalty)");
-    ++linenum;
-    mvprintw(++linenum,startcol,"                         ================================");
-    mvprintw(++linenum,startcol,"                         Options: (P)rev pg, (S)tart game");
-    mvprintw(++linenum,startcol,"                         ================================");
-    refresh();
-    unlock_ncurses();
+// SIGWINCH is blocked here, before any other thread exists, so every thread
+// inherits the blocked mask.  Resizes are then collected synchronously by
+// handle_resize(), and never interrupt a mole's nanosleep() or the input
+// thread's select().  The menus, which have nothing else to wake them, also
+// watch a signalfd (resizefd) for them.
+//
+void initialize_terminal(void) {
+    sigset_t winch;
+    int err;
+
+    sigemptyset(&winch);
+    sigaddset(&winch, SIGWINCH);
+    if ((err = pthread_sigmask(SIG_BLOCK, &winch, NULL)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to block SIGWINCH.");
+    }
+    resizefd = signalfd(-1, &winch, SFD_NONBLOCK | SFD_CLOEXEC);  // (Never read: -1 just means no wakeups)
+
+    initscr();  // Enter ncurses mode
 
-    return linenum;
+    scrollok(stdscr, TRUE); // Allow scrolling
+    curs_set(0);            // Disable cursor
+    compute_layout(LINES, COLS, 0);
 }
 
-//=========================
-// void display_intro(int moles, int gametime)
+//===========================================================
+// void compute_layout(int rows, int cols, int scaled)
 //
-// Shows introduction, rules, etc.
+// Works out where the holes, moles and HUD go for a terminal of the given
+// size, and caches the mole coordinates for each hole in holescreencoords[].
+// Called once per resize (or viewport scroll), so the drawing functions
+// never do geometry.
 //
-// Locks curses_mutex out of an abundance of caution. Display_thread is not
-// even running yet, when this function ir called.  Locking the mutex is just
-// done to prevent problems if future updates change this. 
-void display_intro(int moles, int gametime) {
-    char key;
+// At 80x25 the classic 3x3 layout is the original one.  When scaled, extra
+// room spreads the holes apart (up to HOLESPACINGXMAX/YMAX) and less room
+// packs them together.  If the HUD no longer fits beside the holes, it moves
+// to a single line underneath.
+//
+// If the grid is bigger than the terminal, only a viewport of it is laid out:
+// as many whole holes as fit, starting at layout.viewtop/viewleft (kept from
+// the previous layout, so scrolling survives a resize).  Holes outside it are
+// marked not visible, and active holes there are counted per edge for the
+// edge indicators.  A terminal too small for even one hole is flagged
+// (layout.fits = 0) and drawing is clipped, rather than aborting.
+//
+// rows, cols = terminal size.
+// scaled = 1 for game play (gridrows x gridcols), 0 for the classic 3x3 at the
+//          reference layout (menus and instructions have text positioned
+//          around it).
+//
+// The calling function must hold the ncurses mutex (or be the only thread).
+//
+// Returns: void
+//
+void compute_layout(int rows, int cols, int scaled) {
+    int i, k;
 
-    intro_splashscreen();
-    int playselected = 0;
-    while (! playselected) {
-        clear_input_buffer();
-        key = waitforkey(NULL);
-        switch(toupper(key)) {
-            case 'I': {
-                int page = 0;
-                while (! playselected) {
-                    (*intropages[page])(page);
-                    key = waitforkey(NULL);
-                    switch (toupper(key)) {
-                        case 'N': { // Next page
-                            if (page < sizeof(intropages) / sizeof(int(*)()) -1) {
-                                ++page;
-                            }
-                        } break;
+    if (scaled != layout.scaled) {  // Switching grids, start at the top left
+        layout.viewtop = layout.viewleft = 0;
+    }
+    layout.rows = rows;
+    layout.cols = cols;
+    layout.scaled = scaled;
+    layout.gridrows = scaled ? gridrows : MOLEHOLES / REFGRIDCOLS;
+    layout.gridcols = scaled ? gridcols : REFGRIDCOLS;
+    layout.fieldtop = 1;
+    layout.fieldleft = 2;
+    layout.cellw = HOLESPACINGX;
+    layout.cellh = HOLEHEIGHT;
+    layout.viewrows = LAYOUTROWS;
+    layout.viewcols = LAYOUTCOLS;
+
+    if (scaled) {
+        layout.cellw += (cols - 80) / (2 * LAYOUTCOLS);  // Half the extra width goes between holes
+        layout.cellh += (rows - 25) / LAYOUTROWS;
+        if (layout.cellw < HOLEWIDTH) layout.cellw = HOLEWIDTH;
+        if (layout.cellw > HOLESPACINGXMAX) layout.cellw = HOLESPACINGXMAX;
+        if (layout.cellh < HOLEHEIGHT) layout.cellh = HOLEHEIGHT;
+        if (layout.cellh > HOLESPACINGYMAX) layout.cellh = HOLESPACINGYMAX;
+
+        // Room for holes with the HUD beside them, or with it underneath.
+        // (Keep two columns on the right and a line below for edge indicators.)
+        int sidew = cols - layout.fieldleft - 11 - HUDWIDTH;
+        int fieldw = cols - layout.fieldleft - 2;
+        int fieldh = rows - layout.fieldtop;
+        if (sidew >= LAYOUTCOLS * HOLEWIDTH) {
+            fieldw = sidew;
+        }
+        if (LAYOUTROWS * HOLEHEIGHT > fieldh || fieldw != sidew) {
+            --fieldh;
+        }
 
-                        case 'P': { // Prev page
-                            if (page > 0) {
-                                --page;
-                            }
-                        } break;
+        layout.viewcols = fieldw / HOLEWIDTH;  // n holes need (n-1) * cellw + HOLEWIDTH
+        layout.viewrows = fieldh / HOLEHEIGHT;
+        if (layout.viewcols > LAYOUTCOLS) layout.viewcols = LAYOUTCOLS;
+        if (layout.viewrows > LAYOUTROWS) layout.viewrows = LAYOUTROWS;
+        if (layout.viewcols < 1) layout.viewcols = 1;
+        if (layout.viewrows < 1) layout.viewrows = 1;
+        if (layout.viewcols > 1 && (layout.viewcols - 1) * layout.cellw + HOLEWIDTH > fieldw) {
+            layout.cellw = (fieldw - HOLEWIDTH) / (layout.viewcols - 1);
+        }
+        if (layout.viewrows > 1 && (layout.viewrows - 1) * layout.cellh + HOLEHEIGHT > fieldh) {
+            layout.cellh = (fieldh - HOLEHEIGHT) / (layout.viewrows - 1);
+        }
+    }
 
-                        case 'S': { // Start Game
-                            playselected = 1; 
-                        } break;
-                    }
-                }
-            } break;
+    if (layout.viewtop > LAYOUTROWS - layout.viewrows) layout.viewtop = LAYOUTROWS - layout.viewrows;
+    if (layout.viewleft > LAYOUTCOLS - layout.viewcols) layout.viewleft = LAYOUTCOLS - layout.viewcols;
+    if (layout.viewtop < 0) layout.viewtop = 0;
+    if (layout.viewleft < 0) layout.viewleft = 0;
+
+    layout.fieldright = layout.fieldleft + (layout.viewcols - 1) * layout.cellw + HOLEWIDTH;
+    layout.fieldbottom = layout.fieldtop + (layout.viewrows - 1) * layout.cellh + HOLEHEIGHT;
+    layout.fits = (layout.fieldright <= cols && layout.fieldbottom <= rows);
+
+    int hudcol = layout.fieldright + 11;
+    if (hudcol + HUDWIDTH <= cols) {  // Beside the playfield
+        layout.hudframe = 1;
+        layout.molesrow = layout.fieldtop + 5;
+        layout.molescol = hudcol;
+        layout.scorerow = layout.fieldtop + 9;
+        layout.scorecol = hudcol;
+        layout.msgrow = layout.fieldtop + 1;
+        layout.msgcol = hudcol + HUDWIDTH / 2;
+    } else {                          // One line under it (or the top line, if no room)
+        layout.hudframe = 0;
+        layout.molesrow = layout.scorerow = (layout.fieldbottom < rows ? layout.fieldbottom : 0);
+        layout.molescol = (layout.molesrow == 0 ? cols - 34 : 0);
+        if (layout.molescol < 0) layout.molescol = 0;
+        layout.scorecol = layout.molescol + 17;
+        layout.msgrow = -1;
+        layout.msgcol = 0;
+    }
 
-            case 'P': {
-                playselected = 1; // Start the game
-            } break;
+    memset(layout.offscreen, 0, sizeof(layout.offscreen));
+    for (i = 0; i < MAXMOLEHOLES; i++) {
+        struct HoleScreenCoords *hsc = &holescreencoords[i];
+        int row = i / LAYOUTCOLS - layout.viewtop;   // Position within the viewport
+        int col = i % LAYOUTCOLS - layout.viewleft;
+
+        hsc->visible = (i < LAYOUTROWS * LAYOUTCOLS
+                        && row >= 0 && row < layout.viewrows && col >= 0 && col < layout.viewcols);
+        hsc->frametop = layout.fieldtop + row * layout.cellh;
+        hsc->frameleft = layout.fieldleft + col * layout.cellw;
+        hsc->left = hsc->frameleft + 2;
+        for (k = 0; k < 5; k++) {  // Mole at level k+1 rises from the bottom of the hole
+            hsc->top[k] = hsc->frametop + 5 - k;
+            hsc->height[k] = k + 1;
+        }
+        if (! hsc->visible && i < LAYOUTROWS * LAYOUTCOLS && holesprites[i].kind != 0) {
+            count_offscreen(i, 1);
         }
     }
-    display_countdown();
 }
 
-//============================
-//void display_countdown(void)
+//===========================================
+// void count_offscreen(int hole, int delta)
 //
-// Displays a brief countdown so player can get ready.
+// Adjusts the edge indicator counts for an off-screen hole that became
+// active (delta 1) or blank (delta -1).  A hole off a corner counts on
+// both edges.
 //
+// Returns: void
 //
-void display_countdown() {
-    int row = 8;
-    int col = 32;
-    struct timespec sleeptime = {0, 300000000L}; // 300 msec sleep 
-    lock_ncurses();
-    clear();
-    mvprintw(row, col, "===============");
-    mvprintw(row+1, col, "GAME STARTS IN:");
-    mvprintw(row+5, col, "===============");
-    refresh();
-    unlock_ncurses();
+void count_offscreen(int hole, int delta) {
+    int row = hole / LAYOUTCOLS;
+    int col = hole % LAYOUTCOLS;
+
+    if (row < layout.viewtop) layout.offscreen[EDGE_UP] += delta;
+    if (row >= layout.viewtop + layout.viewrows) layout.offscreen[EDGE_DOWN] += delta;
+    if (col < layout.viewleft) layout.offscreen[EDGE_LEFT] += delta;
+    if (col >= layout.viewleft + layout.viewcols) layout.offscreen[EDGE_RIGHT] += delta;
+}
 
-    int i;
-    for (i=5; i>0; i--) {
-        lock_ncurses();
-        mvprintw(row+2,col+5,"+---+");
-        mvprintw(row+3,col+5,"| %d |", i);
-        mvprintw(row+4,col+5,"+---+");
-        refresh();
-        unlock_ncurses();
-        nanosleep(&sleeptime, NULL);
-        lock_ncurses();
-        mvprintw(row+2,col+5,"     ");
-        mvprintw(row+3,col+5,"  %d  ", i);
-        mvprintw(row+4,col+5,"     ");
-        refresh();
-        unlock_ncurses();
-        nanosleep(&sleeptime, NULL);
+//===================================
+// void show_edge_indicators(void)
+//
+// Draws (or blanks) the markers at each edge of the viewport that show how
+// many active holes are beyond it.  Only drawn when the grid is bigger than
+// the viewport.
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: void
+//
+void show_edge_indicators(void) {
+    int midrow = (layout.fieldtop + layout.fieldbottom) / 2;
+    int midcol = (layout.fieldleft + layout.fieldright) / 2;
+    int *n = layout.offscreen;
+
+    if (layout.viewrows < LAYOUTROWS) {
+        int uprow = layout.fieldtop - 1;
+        int upcol = midcol - 3 > 24 ? midcol - 3 : 24;  // (clear of the version string)
+        screen_print(uprow, upcol, n[EDGE_UP] ? "^ %-2d ^" : "      ", n[EDGE_UP]);
+        if (layout.fieldbottom < layout.rows) {
+            screen_print(layout.fieldbottom, midcol - 3, n[EDGE_DOWN] ? "v %-2d v" : "      ", n[EDGE_DOWN]);
+        }
     }
- }
+    if (layout.viewcols < LAYOUTCOLS) {
+        screen_print(midrow, 0, n[EDGE_LEFT] ? "<%d" : "  ", n[EDGE_LEFT] > 9 ? 9 : n[EDGE_LEFT]);
+        screen_print(midrow, layout.fieldright, n[EDGE_RIGHT] ? "%d>" : "  ", n[EDGE_RIGHT] > 9 ? 9 : n[EDGE_RIGHT]);
+    }
+}
 
-//===========================
-//void display_gameover(void)
+//================================================
+// void scroll_viewport(int drows, int dcols)
 //
-// Displays the GAME OVER message
+// Moves the playfield viewport by whole holes and redraws it.  Called by
+// display_thread with the scroll keys collected by input_thread.  Does
+// nothing if the whole grid is already on screen.
 //
+// The calling function must NOT hold the ncurses mutex.
 //
-void display_gameover() {
-    int row = 13;
-    int col = 53;
-
+// Returns: void
+//
+void scroll_viewport(int drows, int dcols) {
     lock_ncurses();
-    mvprintw(row, col, "===============");
-    mvprintw(row+1, col, "   GAME OVER");
-    mvprintw(row+2, col, "===============");
-    mvprintw(row+3, col, " Press any key");
-    refresh();
+    int top = layout.viewtop, left = layout.viewleft;
+    layout.viewtop += drows;
+    layout.viewleft += dcols;
+    compute_layout(layout.rows, layout.cols, layout.scaled);  // (clamps the viewport to the grid)
+    if (layout.viewtop != top || layout.viewleft != left) {
+        redraw_playfield();
+    }
     unlock_ncurses();
+}
 
-    const struct timeval halfsecond = {0, 500000L};
-    struct timeval waittime;
-    fd_set stdin_fd;
-    int i = 0;
-    do {
-        lock_ncurses();
-        if (i<11) {
-            if (i % 2 == 0) {
-                mvprintw(row, col, "===============");
-                mvprintw(row+1, col, "   GAME OVER");
-                mvprintw(row+2, col, "===============");
-            } else {
-                mvprintw(row, col, "               ");
-                mvprintw(row+1, col, "            ");
-                mvprintw(row+2, col, "               ");
-            }
-        } else {
-            if (i % 2 == 0) {
-                mvprintw(row+3, col, " Press any key");
-            } else {
-                mvprintw(row+3, col, "              ");
-            }
+//============================
+// int handle_resize(void)
+//
+// Collects pending SIGWINCH notices (without blocking) and, once the window
+// has settled, relays out the screen for the new size and redraws it once.
+//
+// A storm of notices while the user drags the window costs one relayout
+// per RESIZESETTLE quiet period (or at least one every RESIZEMAXDELAY).
+// The only time taken from the game is the redraw itself, done with the
+// ncurses mutex held.  Nothing else is interrupted.
+//
+// Called from display_thread during play, and from the menus.  Only one
+// of those runs at a time.  The calling function must NOT hold the ncurses
+// mutex.
+//
+// Returns: 1 = screen was relaid out, 0 = nothing to do (yet).
+//
+int handle_resize(void) {
+    static struct timespec firstseen, lastseen;
+    const struct timespec nowait = {0, 0};
+    struct timespec now, done;
+    struct winsize ws;
+    sigset_t winch;
+
+    sigemptyset(&winch);
+    sigaddset(&winch, SIGWINCH);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (sigtimedwait(&winch, NULL, &nowait) == SIGWINCH) {
+        if (! resizepending) firstseen = now;
+        lastseen = now;
+        resizepending = 1;
+        ++resizestats.notices;
+    }
+
+    if (! resizepending) return 0;
+    if (elapsed_msec(&lastseen, &now) < RESIZESETTLE && elapsed_msec(&firstseen, &now) < RESIZEMAXDELAY) {
+        return 0;  // Still resizing
+    }
+    resizepending = 0;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row == 0 || ws.ws_col == 0) {
+        return 0;  // Not a terminal, or it won't say
+    }
+    if (ws.ws_row == layout.rows && ws.ws_col == layout.cols) {
+        return 0;  // Resized and back again
+    }
+
+    lock_ncurses();
+    resizeterm(ws.ws_row, ws.ws_col);
+    compute_layout(LINES, COLS, layout.scaled);
+    if (layout.scaled) {  // In play: new back buffer for raw output, then draw everything once
+        if (rawvt.active) {
+            rawvt_release();
+            rawvt_begin();
         }
+        redraw_playfield();
+    } else {              // Menu: repaint the page from stdscr (see blit_page())
+        clearok(stdscr, TRUE);
         refresh();
-        unlock_ncurses();
+    }
+    unlock_ncurses();
 
-        ++i;
-        waittime = halfsecond;
-        FD_ZERO(&stdin_fd);
-        FD_SET(STDIN_FILENO, &stdin_fd);
-    } while (0 == select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, &waittime)); //wait for keypress
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    long usec = (done.tv_sec - now.tv_sec) * 1000000L + (done.tv_nsec - now.tv_nsec) / 1000L;
+    if (usec > resizestats.worstusec) resizestats.worstusec = usec;
+    ++resizestats.relayouts;
+    log_event("relayout to %ldx%ld in %ld us", COLS, LINES, usec);
 
-    clear_input_buffer();
- }
+    return 1;
+}
 
-//=================================================================
-// void display_score_sheet(int gamescore, int moles, int gametime)
+//============================
+// void redraw_playfield(void)
 //
-// gamescore = total score for entire game
+// Redraws the whole game screen at the current layout: playfield, HUD, and
+// whatever each hole was last showing (from holesprites[]).  Animations carry
+// on from there with their next frame.
 //
-// Shows game results and any other closing thoughts.
-// 
-// Uses ncurses for navigable paginated display.
-// Locks curses_mutex out of an abundance of caution. Display_thread should
-// be dead (or at least no longer actively outputting) when this is called.
-// Locking the mutex is just done to prevent problems if future updates change
-// that behavior.
+// The calling function must hold the ncurses mutex.
 //
-#define EXTRALINES      12  // For headers and footers in scoresheet pad
-#define DATALINESTART   9   // Number of lines in page heading
-void display_score_sheet (int gamescore, int moles, int gametime){
+// Returns: void
+//
+void redraw_playfield(void) {
+    struct HoleSprite saved[MAXMOLEHOLES];
     int i;
-    int molenum = 1;
 
-    // Mole numbers in scores[] were assigned at thread creation, which may result in
-    // them being out of numerical order within the array.  Here, we reassign them
-    // so as not to confuse the player.
-    for (i=0; i<numscores; i++) {
-        if (scores[i].mole > 0) {
-            scores[i].mole = molenum++;
+    memcpy(saved, holesprites, sizeof(saved));  // (display_empty_playfield() blanks holesprites[])
+    display_empty_playfield(BASEGAME, DISP_ELE_ALL, moleholes, "Good luck and have fun!!!");
+    for (i = 0; i < moleholes; i++) {  // (Off-screen holes only update the edge counts.)
+        if (saved[i].kind == 1) {
+            show_mole(i, moleholes, saved[i].level);
+        } else if (saved[i].kind == 2) {
+            show_result(i, moleholes, saved[i].result, saved[i].score1, saved[i].score2, saved[i].txt);
         }
     }
+    if (molesremaining >= 0) {
+        screen_print(layout.molesrow, layout.molescol + 10, "%-4d ", molesremaining);
+    }
+    show_hud_score();
+    screen_flush();
+}
 
-    // Static Display
-    lock_ncurses();
-    clear();
-    mvprintw(0,0,"===================");
-    mvprintw(1,0,"Your score was %d", gamescore);
-    mvprintw(2,0,moles == 1 ? "for 1 mole" : "for %d moles",moles);
-    mvprintw(3,0,"===================");
-    mvprintw(4,35, "Score Sheet:");
-    mvprintw(6,0,"\t\t\t\t\t\t\tBonus\tRunning");
-    mvprintw(7,0,"\tMole\tHole\tEvent\t\t\tScore\tScore\tTotal");
-    mvprintw(1,27,"Thank you for playing Whack-A-Mole %s", VERSTRING);
+//==========================
+// void show_hud_score(void)
+//
+// Shows the score in the HUD, from hudscores[]: both players' side by side
+// in two-player mode (-2).
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: void
+//
+void show_hud_score(void) {
+    if (players > 1) {
+        screen_print(layout.scorerow, layout.scorecol, "P1 %-4d P2 %-4d", hudscores[0], hudscores[1]);
+    } else {
+        screen_print(layout.scorerow, layout.scorecol, "   SCORE: %d ", hudscores[0]);
+    }
+}
 
-    // Paginated score display
-    int pagesize = (LINES - EXTRALINES);
-    int pages = (numscores + (pagesize -1))/ (LINES - EXTRALINES);
-    int currentpage = 0;
-    char cmd = '1';
+//============================
+// void restore_terminal(void)
+//
+// restores terminal settings back to the way we found them
+//
+//
+void restore_terminal(void) {
+    if (stdscr != NULL && isendwin() == FALSE) {
+        endwin();  // Exit ncurses mode.
+    }
+}
 
-    while(toupper(cmd) != 'Q') {
-        int startat = currentpage * pagesize;
-        move(DATALINESTART, 0);
-        clrtobot();
-        unlock_ncurses();  // just to maintain mutex lock order
-        lock_scores();
-        lock_ncurses();
-        int linenum;
-        for (i=startat, linenum=DATALINESTART; i<numscores && i<startat+pagesize; i++, linenum++) {
-            struct ScoreSheetRecord *p = &scores[i];
-            mvprintw(linenum, 0, p->mole <= 0 ? "\t\t" : "\t%d\t",p->mole);
-            printw(p->hole == -1 ? "\t" : "%c\t",holekeys[p->hole]);
-            printw(p->playresult == WHACK ? "Whacked Mole!\t\t" : p->playresult == ESCAPE ? "Mole Escaped\t\t" : p->playresult == MISFIRE ? "Bad Aim\t\t\t" : p->playresult == TOOSOON ? "Hit Too Soon\t\t" : "Mole Scared Away\t");
-            printw(p->missedscore + p->whackedscore + p->penaltyscore == 0 ? "\t" : "% 3d\t", p->missedscore + p->whackedscore + p->penaltyscore);
-            //
-            // only display bonus if mole was whacked (bonus could be 0)
-            printw(p->bonusscore == 0 ? "\t" : "%d\t", p->bonusscore);
-            printw("%d", p->startscore + p->missedscore + p->whackedscore + p->bonusscore + p->penaltyscore);
-        }
-        unlock_scores();
+//=============================
+// void calibrate_terminal(void)
+//
+// Measures how fast the terminal drains output and how late nanosleep()
+// wakes up, then picks the pop-up animation frame step and whether animation
+// frames are flushed immediately or coalesced by display_thread.
+//
+// Drain rate is measured by writing CALIBRATEBYTES of blanks over the top
+// line and timing write() + tcdrain().  On a local console this is near
+// instantaneous; on a slow serial line or congested link it is not.
+//
+// Must be called after initialize_terminal() and before any other threads
+// are started.  The screen is cleared afterward, since ncurses has no idea
+// what we wrote.
+//
+// Returns: void
+//
+void calibrate_terminal(void) {
+    long oversleep[CALIBRATESLEEPS];
+    struct timespec start, end;
+    char buf[CALIBRATEBYTES];
+    int i, j;
+
+    if (skipcalibration) {
+        return;  // keep the defaults
+    }
 
-        if (pages > 1) {
-            mvprintw(LINES-1,0,"[Page %d/%d]\tCommand: (Q)uit, (1)st pg, (P)rev pg, (N)ext pg, (L)ast pg.", currentpage+1, pages);
-        } else {
-            mvprintw(LINES-1,0,"Press Q to quit.");
+    // Terminal throughput: home the cursor and overwrite line 1 with blanks, repeatedly.
+    const char *home = "\033[H";
+    int len = strlen(home);
+    int width = COLS;  // (Wider than the buffer: a partial line still times the terminal)
+    if (width > sizeof(buf) - len) width = sizeof(buf) - len;
+    for (i = 0; i + len + width <= sizeof(buf); ) {
+        memcpy(buf + i, home, len);
+        i += len;
+        memset(buf + i, ' ', width);
+        i += width;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < i; ) {
+        ssize_t n = write(STDOUT_FILENO, buf + j, i - j);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            restore_terminal();
+            error_at_line(-1, errno, __FILE__, __LINE__, "terminal write failed.");
         }
-        refresh();
-        unlock_ncurses();
-        cmd = toupper(waitforkey(NULL));
-        lock_ncurses();
-        switch (cmd) {
-            case '1': {
-               currentpage = 0; 
-            } break;
+        j += n;
+    }
+    tcdrain(STDOUT_FILENO);  // fails harmlessly if stdout is not a tty
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-            case 'P': {
-                if (--currentpage < 0) currentpage = 0;
-            } break;
+    long usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L;
+    if (usec < 1) usec = 1;
+    calibration.drainrate = (long)((long long)i * 1000000LL / usec);
+    if (calibration.drainrate < 1) calibration.drainrate = 1;  // (Divided by below)
 
-            case 'N': {
-                if (++currentpage >= pages) currentpage = pages - 1;
-            } break;
+    // Timer jitter: how late do 1 msec sleeps actually wake up?
+    for (i = 0; i < CALIBRATESLEEPS; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        nanosleep(&one_msec, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long late = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L - 1000L;
+        if (late < 0) late = 0;
 
-            case 'L': {
-                currentpage = pages - 1;
-            } break;
+        for (j = i; j > 0 && oversleep[j-1] > late; j--) { // keep sorted (insertion sort)
+            oversleep[j] = oversleep[j-1];
         }
+        oversleep[j] = late;
     }
-    unlock_ncurses();
+    calibration.jitterp50 = oversleep[CALIBRATESLEEPS / 2];
+    calibration.jitterp95 = oversleep[CALIBRATESLEEPS * 95 / 100];
+    calibration.jittermax = oversleep[CALIBRATESLEEPS - 1];
+
+    // Frame budget: time to push one frame for every concurrent mole, plus
+    // typical wakeup lateness, with 2x headroom.  Never faster than the
+    // original 30 msec step.
+    long frameusec = (long)((long long)FRAMEBYTES * CONCURRENTMOLES * 1000000LL / calibration.drainrate);
+    long budget = (frameusec + calibration.jitterp95) * 2 / 1000L;
+    if (budget < POPUPFRAMEMIN) budget = POPUPFRAMEMIN;
+    if (budget > POPUPFRAMEMAX) budget = POPUPFRAMEMAX;
+    calibration.framemsec = (int)budget;
+
+    // If a frame takes more than a few msec to reach the screen, or sleeps
+    // wake up erratically, let display_thread batch frames from all
+    // animation threads into one update per pass instead of one per frame.
+    calibration.coalesce = (frameusec > 5000L || calibration.jitterp95 > 2000L);
+    calibration.measured = 1;
+
+    clearok(stdscr, TRUE);  // We wrote behind ncurses' back, so force a full repaint.
+    clear();
+    refresh();
 }
 
-//==================================================
-// void show_mole(int hole, int maxholes, int level)
+//=============================
+// void screen_update(void)
 //
-// Displays one mole within one hole at a specified level.
-// Doesn't actually call refresh() to draw screen.
+// Used in place of refresh() for animation frames during game play.  Either
+// refreshes immediately or leaves the frame for display_thread to flush,
+// depending on the coalescing policy chosen by calibrate_terminal().
 //
-// hole: Hole number to show mole in (zero based)
+// The calling function must hold the ncurses mutex.
 //
-// maxholes: Determines hole geometry. As of V1.0, this must be MOLEHOLES
+// Returns: void
 //
-// level: 0 = No mole
-//        1-4 = Partial moles
-//        5 = Full mole
+void screen_update(void) {
+    ++framerequests;
+    if (calibration.coalesce && display_thread_running) { // (No one to flush frames in menus)
+        screen_dirty = 1;
+    } else {
+        screen_flush();
+        ++frameflushes;
+    }
+}
+
+//========================================================
+// Raw VT output backend
 //
-// This function does NOT lock the curses_mutex because this is a low level
-// function and will have no way of knowing which other mutex locks may
-// be in effect. That would be bad, since this program relies on mutexes 
-// being locked in a defined order to prevent deadlocks.
-// The calling function definitely should have a lock in effect when
-// it calls this function.
+// Optional (-r) replacement for ncurses output during game play.  Drawing
+// goes into a back buffer.  screen_flush() compares it with what the terminal
+// is showing (the front buffer) and sends only the changed spans, as cursor
+// movement sequences plus text, gathered into one iovec and written with a
+// single writev().  The text itself is never copied; its iovecs point straight
+// into the back buffer.
+//
+// Menus, intro and score sheet still use ncurses.  rawvt_end() hands the final
+// screen back to ncurses.
+//
+// Like the ncurses calls they replace, these functions require the caller to
+// hold the ncurses mutex.
 //
-const struct HoleScreenCoords {
-    int top[5];     // Top row for moles at level 1-5
-    int height[5];  // Height for moles at level 1-5
-    int left;       // Column of left side of mole
-} holescreencoords[MOLEHOLES] = {{{6,5,4,3,2},{1,2,3,4,5},4},
-                         {{6,5,4,3,2},{1,2,3,4,5},18},
-                         {{6,5,4,3,2},{1,2,3,4,5},32},
-                         {{13,12,11,10,9},{1,2,3,4,5},4},
-                         {{13,12,11,10,9},{1,2,3,4,5},18},
-                         {{13,12,11,10,9},{1,2,3,4,5},32},
-                         {{20,19,18,17,16},{1,2,3,4,5},4},
-                         {{20,19,18,17,16},{1,2,3,4,5},18},
-                         {{20,19,18,17,16},{1,2,3,4,5},32}};
 
-int moleheight = sizeof(asciimole) / sizeof(char*); // Lines per mole
+//===============================================
+// int read_proc_io(long *syscw, long *wchar)
+//
+// Reads this process's write syscall count and bytes written from /proc/self/io.
+// Covers all threads, and all output, ncurses or not.
+//
+// Returns: 1 = success, 0 = not available.
+//
+int read_proc_io(long *syscw, long *wchar) {
+    char line[80];
+    int found = 0;
+    FILE *f = fopen("/proc/self/io", "r");
+
+    if (f == NULL) return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "wchar: %ld", wchar) == 1) found |= 1;
+        if (sscanf(line, "syscw: %ld", syscw) == 1) found |= 2;
+    }
+    fclose(f);
 
-void show_mole(int hole, int maxholes, int level) {
-    struct HoleScreenCoords *hsc = (struct HoleScreenCoords *)&holescreencoords[hole];
+    return found == 3;
+}
 
-    if (maxholes == MOLEHOLES) { // currently, MOLEHOLES is the only valid choice
-        int i;
-        // First for loop blanks hole
-        for (i=0; i < moleheight; i++) {
-            mvprintw(hsc->top[moleheight - 1] + i, hsc->left, "        ");
+//======================================================
+// void rawvt_write(struct iovec *iov, int iovcnt)
+//
+// writev() the whole iovec, resuming after partial writes.
+//
+void rawvt_write(struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(STDOUT_FILENO, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            restore_terminal();
+            error_at_line(-1, errno, __FILE__, __LINE__, "terminal writev failed.");
         }
-        // level zero = clear hole, so don't paint mole
-        if (level > 0) {
-            // Second for loop paints mole
-            for (i=0; i < hsc->height[level-1]; i++) {
-                mvprintw(hsc->top[level-1] + i, hsc->left, asciimole[i]);
-            }
+        ++renderstats.rawwrites;
+        renderstats.rawbytes += n;
+
+        while (iovcnt > 0 && n >= iov->iov_len) { // skip fully written iovecs
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {  // partially written iovec
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
         }
-        refresh();
-    } else {
-        restore_terminal();
-        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", maxholes);
     }
 }
 
-//=========================================================================================
-// void show_result(int hole, int maxholes, enum PlayResult result, int score1, int score2, char *txt)
-//
-// Shows play result on playfield in place of mole.  Related to show_mole() function
-// above, and re-uses its holescreencoords data for screen positioning.
+//=========================
+// void rawvt_begin(void)
 //
-// hole: Hole number to show result in (zero based)
+// Switches game play output to the raw backend.  Screen size is taken from
+// ncurses (LINES, COLS).  The first flush erases the screen.
 //
-// maxholes: Determines hole geometry. As of V1.0, this must be MOLEHOLES
+void rawvt_begin(void) {
+    rawvt.rows = LINES;
+    rawvt.cols = COLS;
+    rawvt.back = malloc(rawvt.rows * rawvt.cols);
+    rawvt.front = malloc(rawvt.rows * rawvt.cols);
+    rawvt.dirtymin = malloc(rawvt.rows * sizeof(int));
+    rawvt.dirtymax = malloc(rawvt.rows * sizeof(int));
+    if (rawvt.back == NULL || rawvt.front == NULL || rawvt.dirtymin == NULL || rawvt.dirtymax == NULL) {
+        restore_terminal();
+        error_at_line(-1, errno, __FILE__, __LINE__, "malloc failed.");
+    }
+
+    memset(rawvt.back, ' ', rawvt.rows * rawvt.cols);
+    memset(rawvt.front, ' ', rawvt.rows * rawvt.cols);
+    int i;
+    for (i = 0; i < rawvt.rows; i++) {
+        rawvt.dirtymin[i] = rawvt.dirtymax[i] = -1;
+    }
+    rawvt.clearpending = 1;
+    rawvt.currow = rawvt.curcol = -1;
+    rawvt.active = 1;
+}
+
+//=======================
+// void rawvt_end(void)
 //
-// result: Game play result: WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF (or -1 to blank and display txt)
+// Hands the screen back to ncurses: copies the back buffer into stdscr and
+// repaints, since ncurses has no idea what is on the terminal.
 //
-// score1: Score for WHACK, penalty for ESCAPE.  If score1 is zero,
-//         the ascii graphic will be displayed. Otherwise, the score graphic
-//         (see char *[]'s below)
+void rawvt_end(void) {
+    int i;
+
+    if (! rawvt.active) return;
+
+    rawvt.active = 0;
+    clear();
+    for (i = 0; i < rawvt.rows && i < LINES; i++) {
+        mvaddnstr(i, 0, rawvt.back + i * rawvt.cols, (rawvt.cols < COLS ? rawvt.cols : COLS) - (i == LINES - 1));
+    }
+    clearok(stdscr, TRUE);
+    refresh();
+
+    rawvt_release();
+}
+
+//==========================
+// void rawvt_release(void)
 //
-// score2: Bonus score for WHACK, ignored for others
+// Frees the screen buffers. (Also used when a resize calls for new ones.)
 //
-// txt: Text msg to display when PlayResult == -1
+void rawvt_release(void) {
+    free(rawvt.back);
+    free(rawvt.front);
+    free(rawvt.dirtymin);
+    free(rawvt.dirtymax);
+    rawvt.back = rawvt.front = NULL;
+    rawvt.dirtymin = rawvt.dirtymax = NULL;
+}
+
+//========================================================
+// void rawvt_put(int row, int col, const char *txt, int len)
 //
-// This function does NOT lock the curses_mutex because this is a low level
-// function and will have no way of knowing which other mutex locks may
-// be in effect. That would be bad, since this program relies on mutexes 
-// being locked in a defined order to prevent deadlocks.
-// The calling function definitely should have a lock in effect when
-// it calls this function.
+// Copies text into the back buffer, clipped to the screen, and marks the
+// row dirty.  The bottom right cell is never written, so the terminal never
+// scrolls.
 //
-char scorewhackpat[5][9] = {"        ",
-                           " WHACK! ",
-                           "        ",
-                           "Score:#1",     // #1 is macro that expands to score1
-                           "Bonus:#2" };   // #2 is macro that expands to score2
-char scorewhackbuf[5][9];
-char *scorewhack[]={(char *)&scorewhackbuf[0],(char *)&scorewhackbuf[1],(char *)&scorewhackbuf[2],(char *)&scorewhackbuf[3],(char *)&scorewhackbuf[4]};
-
-char scoreescapebuf[5][9];
-char scoreescapepat[5][9] ={"        ",
-                           " ESCAPE ",
-                           "        ",      
-                           " Score  ",
-                           "  #1    " };   // #1 is macro that expands to score1
-char *scoreescape[]={(char *)&scoreescapebuf[0],(char *)&scoreescapebuf[1],(char *)&scoreescapebuf[2],(char *)&scoreescapebuf[3],(char *)&scoreescapebuf[4]};
-
-char asciiblankbuf[5][9] = {  "        ",
-                           "        ",
-                           "        ",
-                           "        ",
-                           "        " };
-char *asciiblank[]={(char *)&asciiblankbuf[0],(char *)&asciiblankbuf[1],(char *)&asciiblankbuf[2],(char *)&asciiblankbuf[3],(char *)&asciiblankbuf[4]};
-
-void show_result(int hole, int maxholes, enum PlayResult result, int score1, int score2, char *txt) {
-    struct HoleScreenCoords *hsc = (struct HoleScreenCoords *)&holescreencoords[hole];
-    char **ascii;
-    int height;
+void rawvt_put(int row, int col, const char *txt, int len) {
+    if (row < 0 || row >= rawvt.rows || col >= rawvt.cols) return;
+    if (col < 0) {
+        txt -= col;
+        len += col;
+        col = 0;
+    }
+    const char *nl = memchr(txt, '\n', len);
+    if (nl != NULL) len = nl - txt;
+    if (col + len > rawvt.cols) len = rawvt.cols - col;
+    if (row == rawvt.rows - 1 && col + len == rawvt.cols) --len;
+    if (len <= 0) return;
+
+    memcpy(rawvt.back + row * rawvt.cols + col, txt, len);
+    if (rawvt.dirtymin[row] < 0 || col < rawvt.dirtymin[row]) rawvt.dirtymin[row] = col;
+    if (col + len - 1 > rawvt.dirtymax[row]) rawvt.dirtymax[row] = col + len - 1;
+}
 
-    if (score1 < -99 || score1 > 99 || score2 <- 99 || score2 > 99) {
-        restore_terminal();
-        error_at_line(-1, 0, __FILE__, __LINE__, "Score (%d/%d) outside range.", score1, score2);
+//=======================
+// void rawvt_flush(void)
+//
+// Sends everything that changed since the last flush in one writev().
+// Changed spans on the same row that are separated by fewer than RAWVTGAP
+// unchanged chars are sent as one span.  Cursor movement uses CUF (cursor
+// forward) when already on the right row, otherwise CUP (cursor position).
+//
+void rawvt_flush(void) {
+    int iovcnt = 0;
+    int esccnt = 0;
+    int row;
+
+    if (rawvt.clearpending) {
+        static char erase[] = "\033[H\033[2J";
+        rawvt.iov[iovcnt].iov_base = erase;
+        rawvt.iov[iovcnt++].iov_len = sizeof(erase) - 1;
+        memset(rawvt.front, ' ', rawvt.rows * rawvt.cols);
+        rawvt.currow = rawvt.curcol = 0;
+        for (row = 0; row < rawvt.rows; row++) { // anything non-blank must be redrawn
+            rawvt.dirtymin[row] = 0;
+            rawvt.dirtymax[row] = rawvt.cols - 1;
+        }
+        rawvt.clearpending = 0;
     }
 
-    if (maxholes == MOLEHOLES) { // currently, MOLEHOLES is the only valid choice
-        switch (result) {
-            case WHACK: {
-                if (score1 == 0) {
-                    ascii = asciiwhack;
-                    height = sizeof(asciiwhack) / sizeof(char*); // Lines in ascii graphic
+    for (row = 0; row < rawvt.rows; row++) {
+        if (rawvt.dirtymin[row] < 0) continue;
+
+        char *back = rawvt.back + row * rawvt.cols;
+        char *front = rawvt.front + row * rawvt.cols;
+        int col = rawvt.dirtymin[row];
+        int last = rawvt.dirtymax[row];
+
+        while (col <= last) {
+            while (col <= last && back[col] == front[col]) ++col; // find start of change
+            if (col > last) break;
+
+            int end = col;    // one past last changed char in span
+            int scan = col;
+            while (scan <= last) {
+                if (back[scan] != front[scan]) {
+                    end = ++scan;
+                } else if (scan - end < RAWVTGAP) {
+                    ++scan;
                 } else {
-                    int i;
-                    ascii = (char **)scorewhack;
-                    height = sizeof(scorewhack)/sizeof(scorewhack[0]);// Lines in ascii graphic
-
-                    memcpy(scorewhackbuf, scorewhackpat, sizeof(scorewhackbuf));
-                    for (i=0; i<height; i++) {
-                        char *c;
-                        c = strstr(scorewhack[i],"#1");
-                        if (c != NULL) {
-                            sprintf(c, "%d", score1);
-                        }
-                        c = strstr(scorewhack[i],"#2");
-                        if (c != NULL) {
-                            sprintf(c, "%d", score2);
-                        }
-                    }
+                    break;
                 }
-            break; }
+            }
 
-            case ESCAPE: {
-                if (score1 == 0) {
-                    ascii = asciiescape;
-                    height = sizeof(asciiescape) / sizeof(char*); // Lines in ascii graphic
-                } else {
-                    int i;
-                    ascii = (char **)scoreescape;
-                    height = sizeof(scoreescape)/sizeof(scoreescape[0]);// Lines in ascii graphic
+            if (iovcnt + 2 > RAWVTIOVMAX) {  // Out of iovecs. (Not expected at 80x25.)
+                rawvt_write(rawvt.iov, iovcnt);
+                iovcnt = esccnt = 0;
+            }
 
-                    memcpy(scoreescapebuf, scoreescapepat, sizeof(scoreescapebuf));
-                    for (i=0; i<height; i++) {
-                        char *c;
-                        c = strstr(scoreescape[i],"#1");
-                        if (c != NULL) {
-                            sprintf(c, "%d ", score1);
-                        }
-                    }
+            if (row != rawvt.currow || col != rawvt.curcol) {
+                char *esc = rawvt.esc[esccnt++];
+                int len;
+                if (row == rawvt.currow && col > rawvt.curcol) {
+                    len = snprintf(esc, RAWVTESCLEN, "\033[%dC", col - rawvt.curcol);
+                } else {
+                    len = snprintf(esc, RAWVTESCLEN, "\033[%d;%dH", row + 1, col + 1);
                 }
-            break; }
+                rawvt.iov[iovcnt].iov_base = esc;
+                rawvt.iov[iovcnt++].iov_len = len;
+            }
+            rawvt.iov[iovcnt].iov_base = back + col;
+            rawvt.iov[iovcnt++].iov_len = end - col;
 
-            case MISFIRE: 
-            case TOOSOON: {
-                ascii = asciimisfire;
-                height = sizeof(asciimisfire) / sizeof(char*); // Lines in ascii graphic
-            break; }
+            memcpy(front + col, back + col, end - col);
+            rawvt.currow = row;
+            rawvt.curcol = end;
+            col = end;
+        }
+        rawvt.dirtymin[row] = rawvt.dirtymax[row] = -1;
+    }
 
-            case SCAREDOFF: {
-                ascii = asciiscared;
-                height = sizeof(asciiscared) / sizeof(char*); // Lines in ascii graphic
-            break; }
+    if (iovcnt > 0) {
+        rawvt_write(rawvt.iov, iovcnt);
+    }
+}
 
-            default: {
-                sprintf(asciiblankbuf[2], "%8.8s",txt);
-                ascii = asciiblank;
-                height = sizeof(asciiblank) / sizeof(char*); // Lines in ascii graphic
-            } break;
-        }
+//===========================================================
+// void screen_print(int row, int col, const char *fmt, ...)
+//
+// mvprintw() replacement for drawing that may happen during game play.
+// Goes to the raw backend when it is active, otherwise to ncurses.
+//
+// Text is clipped to the screen.  (The layout may not fit a small terminal,
+// and a failed move() would otherwise leave mvprintw() writing wherever the
+// cursor happened to be, or wrapping and scrolling the screen.)
+//
+// The calling function must hold the ncurses mutex.
+//
+void screen_print(int row, int col, const char *fmt, ...) {
+    va_list ap;
+    char buf[256];
+
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buf) - 1) len = sizeof(buf) - 1;
+
+    if (rawvt.active) {
+        rawvt_put(row, col, buf, len);
+        return;
+    }
 
-        int i;
-        for (i=0; i < height; i++) {
-            mvprintw(hsc->top[height - 1] + i, hsc->left, ascii[i]);
-        }
-        refresh();
+    char *txt = buf;
+    if (row < 0 || row >= LINES || col >= COLS) return;
+    if (col < 0) {
+        txt -= col;
+        len += col;
+        col = 0;
+    }
+    if (col + len > COLS) len = COLS - col;
+    if (row == LINES - 1 && col + len == COLS) --len;  // Don't scroll
+    if (len > 0) {
+        mvaddnstr(row, col, txt, len);
+    }
+}
+
+//==========================
+// void screen_clear(void)
+//
+// clear() replacement for drawing that may happen during game play.
+//
+// The calling function must hold the ncurses mutex.
+//
+void screen_clear(void) {
+    if (rawvt.active) {
+        memset(rawvt.back, ' ', rawvt.rows * rawvt.cols);
+        rawvt.clearpending = 1;
     } else {
-        restore_terminal();
-        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", maxholes);
+        clear();
     }
 }
 
-//=========================================================================================
-// void display_empty_playfield(enum GameMode gamemode, int elements, int holes, char *msg)
+//==========================
+// void screen_flush(void)
 //
-// Shows the play field including holes, welcome message, score area, etc.
+// refresh() replacement for drawing that may happen during game play.
 //
-// gamemode: BASEGAME = Fixed number of moles
-//           TIMEDGAME = Fixed Duration
+// The calling function must hold the ncurses mutex.
 //
-// holes: As of V1.0, this must be MOLEHOLES
+void screen_flush(void) {
+    struct timespec start;
+
+    if (renderstats.playing) {
+        ++renderstats.frames;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (rawvt.active) {
+        rawvt_flush();
+    } else {
+        refresh();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &flushdone);
+    flushmsec = elapsed_msec(&start, &flushdone);  // (A write to a terminal that is behind blocks.)
+}
+
+//===============================
+// void screen_begin_play(void)
 //
-// msg: Welcome message
+// Called by display_thread before it draws the playfield.  Selects the
+// output backend and the full-terminal layout for game play, and starts
+// counting output cost.
 //
-// This function does NOT lock the curses_mutex because this is a low level
-// function and will have no way of knowing which other mutex locks may
-// be in effect. That would be bad, since this program relies on mutexes 
-// being locked in a defined order to prevent deadlocks.
-// The calling function definitely should have a lock in effect when
-// it calls this function.
+// The calling function must hold the ncurses mutex.
 //
-void display_empty_playfield(enum GameMode gamemode, int elements, int holes, char *msg) {
-    clear();
-    if (elements & DISP_ELE_VERS) {
-        mvprintw(0,0,"Whack-A-Mole %s ",VERSTRING);
+void screen_begin_play(void) {
+    renderstats.sampled = read_proc_io(&renderstats.syscw, &renderstats.wchar);
+    renderstats.playing = 1;
+    compute_layout(LINES, COLS, 1);  // Game play uses the whole terminal
+    if (rawoutput) {
+        rawvt_begin();
     }
+}
 
-    if (holes != MOLEHOLES) {
-        restore_terminal();
-        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", holes);
+//=============================
+// void screen_end_play(void)
+//
+// Called once display_thread has stopped.  Returns output to ncurses and
+// the reference layout, and finishes counting output cost.
+//
+// The calling function must hold the ncurses mutex.
+//
+void screen_end_play(void) {
+    long syscw, wchar;
+
+    if (! renderstats.playing) return;
+    renderstats.playing = 0;
+    if (renderstats.sampled && read_proc_io(&syscw, &wchar)) {
+        renderstats.syscw = syscw - renderstats.syscw;
+        renderstats.wchar = wchar - renderstats.wchar;
+    } else {
+        renderstats.sampled = 0;
     }
+    rawvt_end();
+    compute_layout(LINES, COLS, 0);
+}
 
-    if (elements & DISP_ELE_HOLES) {
-        mvprintw(1,2,"  ________      ________      ________   ");
-        mvprintw(2,2,elements & DISP_ELE_KEYS ? " /        \\%c   /        \\%c   /        \\%c " : " /        \\    /        \\    /        \\  ",holekeys[0],holekeys[1],holekeys[2]);
-        mvprintw(3,2,"/          \\  /          \\  /          \\ ");
-        mvprintw(4,2,"|          |  |          |  |          | ");
-        mvprintw(5,2,"|          |  |          |  |          | ");
-        mvprintw(6,2,"\\          /  \\          /  \\          / ");
-        mvprintw(7,2," \\________/    \\________/    \\________/  ");
-        mvprintw(8,2,"  ________      ________      ________   ");
-        mvprintw(9,2,elements & DISP_ELE_KEYS ? " /        \\%c   /        \\%c   /        \\%c " : " /        \\    /        \\    /        \\  ",holekeys[3],holekeys[4],holekeys[5]);
-        mvprintw(10,2,"/          \\  /          \\  /          \\ ");
-        mvprintw(11,2,"|          |  |          |  |          | ");
-        mvprintw(12,2,"|          |  |          |  |          | ");
-        mvprintw(13,2,"\\          /  \\          /  \\          / ");
-        mvprintw(14,2," \\________/    \\________/    \\________/  ");
-        mvprintw(15,2,"  ________      ________      ________   ");
-        mvprintw(16,2,elements & DISP_ELE_KEYS ? " /        \\%c   /        \\%c   /        \\%c " : " /        \\    /        \\    /        \\  ",holekeys[6],holekeys[7],holekeys[8]);
-        mvprintw(17,2,"/          \\  /          \\  /          \\ ");
-        mvprintw(18,2,"|          |  |          |  |          | ");
-        mvprintw(19,2,"|          |  |          |  |          | ");
-        mvprintw(20,2,"\\          /  \\          /  \\          / ");
-        mvprintw(21,2," \\________/    \\________/    \\________/  ");
-    }
-
-    if (elements & DISP_ELE_MSG && msg != NULL) {
-        mvprintw(2,60-strlen(msg)/2,msg);
+//============================
+// char waitforkey(long *msec)
+//
+// nonblocking keyboard input
+// msec = pointer to max wait time in miliseconds
+//        or NULL for blocking input
+// returns key pressed, or '\0' for timeout
+// also (if msec is ! NULL), sets contents of msec to time remaining
+// when key was pressed (or zero if !pressed)
+//
+// Keys come from parse_input(), so escape sequences (keypad, cursor keys)
+// arrive as the keys they map to, and keys typed quickly enough to be read
+// together are each returned in turn, rather than swallowed.
+//
+char waitforkey(long *msec) {
+    struct timespec deadline, now;
+    char key;
+
+    if (msec != NULL) {
+        if (*msec < 0L) *msec = 0L;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        add_msec(&deadline, *msec);
     }
 
-    if (elements & DISP_ELE_STAT) {
-        mvprintw(9,53,"===============");
-        mvprintw(10,53,"   SCORE: %d", 0);
-        mvprintw(11,53,"===============");
+    for (;;) {
+        long callerwait = -1;  // msec the caller will wait, -1 = for ever...
+        long wait;             //    ...and we will, before looking again
 
-        if (gamemode == BASEGAME) {
-            mvprintw(6,53,"   MOLES:   "); 
-        } else {
-            mvprintw(6,53,"   TIME:    "); 
-            restore_terminal();
-            error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported game mode.");
+        if ((key = parse_input()) != '\0') {
+            break;
+        }
+        if (input_pending()) {  // (Never waits on the terminal with keys already read)
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (msec != NULL) {
+            callerwait = elapsed_msec(&now, &deadline);
+            if (callerwait < 0) callerwait = 0;
+        }
+        wait = callerwait;
+        if (inputparser.state != IN_GROUND) {  // The rest of a sequence comes right away, or not at all
+            long left = ESCSEQMSEC - elapsed_msec(&inputparser.seqstart, &now);
+            if (left <= 0 && inputparser.state == IN_ESC) {  // Nothing followed: the Escape key
+                inputparser.state = IN_GROUND;
+                key = '\033';
+                break;
+            } else if (left <= 0) {  // A sequence cut short: drop it
+                inputparser.state = IN_GROUND;
+                ++inputstats.ignored;
+                continue;
+            }
+            if (wait < 0 || left < wait) wait = left;
+        }
+
+        if (msec == NULL ? wait_menu_input(wait) : wait_input(wait)) {
+            read_input();
+        } else if (msec != NULL && wait == callerwait) {
+            *msec = 0L;  // timeout. (A sequence part way in carries over to the next call.)
+            return '\0';
         }
     }
 
-    refresh();
+    ++inputstats.keys;
+    if (msec != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        *msec = elapsed_msec(&now, &deadline);
+        if (*msec < 0L) *msec = 0L;
+    } else {
+        handle_resize();  // Menus: pick up any resize before the next page is drawn
+    }
+    return key;
 }
 
-//=================================
-//void *animation_thread(void *arg)
+//============================
+// int wait_input(long msec)
 //
-// arg = pointer to AnimationSpec structure. (See struct tag for more info)
-// 
-// These animations are code driven. A data driven animation would be
-// more flexible, but not worth it at this point as there are only two
-// animations right now.
+// Waits for terminal input to read.
 //
-void *animation_thread(void *arg) {
-    struct AnimationSpec *aspec = (struct AnimationSpec *)arg;
-    struct timespec sleeptime = {0, 0}; 
- #if defined(debug) && defined(_GNU_SOURCE)
-    pthread_setname_np(pthread_self(), "WAM-Animation");
- #endif
+// msec = longest wait (msec), or -1 to wait for ever
+//
+// Returns: 1 = input ready, 0 = timed out (or interrupted)
+//
+int wait_input(long msec) {
+    struct timeval waittime;
+    fd_set stdin_fd;
 
-    switch (aspec->animationtype) {
-        case ANIMHIDING: {
-            // The mole is hiding...
-            // Animation behavior: 1) 200msec up
-            //                     2) 200msec 1/3 chance up, 2/3 chance down
-            //                     3) 200msec 1/3 chance up, 2/3 chance down
-            //                     (so either short, medium or long single pop
-            //                     or double pop)
-            //                     4) Random down time from 800 to 2000 msec
-            //                     Above steps repead until duration expires.
-            //                     A duration of -1 indicates "run forever".
+    FD_ZERO(&stdin_fd);
+    FD_SET(STDIN_FILENO, &stdin_fd);
+    waittime.tv_sec = msec / 1000L;
+    waittime.tv_usec = msec % 1000L * 1000L;
 
- #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-Hiding");
- #endif
-            lock_molecomm();
-            aspec->synccount = 1;  // Indicate animation running
-            unlock_molecomm();
+    int keyhit = select(STDIN_FILENO + 1, &stdin_fd, NULL, NULL, msec < 0 ? NULL : &waittime);
+    if (keyhit < 0 && errno != EINTR) {
+        restore_terminal();
+        error_at_line(-1, errno, __FILE__, __LINE__, "select call error.");
+    }
+    return keyhit > 0;
+}
 
-            int timeremaining = aspec->duration;
-            while (timeremaining > 0 || aspec->duration == -1) {
-                if (timeremaining < 600 && aspec->duration != -1) {  // < 600msec left?
-                    sleeptime.tv_sec = 0;
-                    sleeptime.tv_nsec = timeremaining * MSEC;
-                    nanosleep(&sleeptime, NULL);
-                    break;
-                } else {
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, 1); // show the ears
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    // Ears up for 200 msec
-                    sleeptime.tv_sec = 0;
-                    sleeptime.tv_nsec = 200*MSEC; 
-                    nanosleep(&sleeptime, NULL);
+//================================
+// int wait_menu_input(long msec)
+//
+// wait_input() for the menus, which have no display_thread to notice a
+// resize: a SIGWINCH wakes it too (resizefd), and the screen is relaid out
+// and repainted (handle_resize()) as soon as the window settles, without
+// waiting for a key.
+//
+// msec = longest wait (msec), or -1 to wait for ever
+//
+// Returns: 1 = input ready, 0 = timed out
+//
+int wait_menu_input(long msec) {
+    struct timespec deadline, now;
+    struct timeval waittime;
+    fd_set fds;
 
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, tsrandom()%3?0:1); // 1/3 chance for extended bounce
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    // Ears up for 200 msec
-                    sleeptime.tv_sec = 0;
-                    sleeptime.tv_nsec = 200*MSEC; 
-                    nanosleep(&sleeptime, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    add_msec(&deadline, msec > 0 ? msec : 0);
+    for (;;) {
+        handle_resize();
+        long wait = -1;
+        if (msec >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((wait = elapsed_msec(&now, &deadline)) < 0) wait = 0;
+        }
+        if (resizepending && (wait < 0 || wait > RESIZESETTLE)) {
+            wait = RESIZESETTLE;  // Come back when it may have settled
+        }
 
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, tsrandom()%3?0:1); // 1/3 chance for extended or double bounce
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    // Ears up for 200 msec
-                    sleeptime.tv_sec = 0;
-                    sleeptime.tv_nsec = 200*MSEC; 
-                    nanosleep(&sleeptime, NULL);
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        if (resizefd >= 0) FD_SET(resizefd, &fds);
+        waittime.tv_sec = wait / 1000L;
+        waittime.tv_usec = wait % 1000L * 1000L;
+        int ready = select((resizefd > STDIN_FILENO ? resizefd : STDIN_FILENO) + 1, &fds, NULL, NULL, wait < 0 ? NULL : &waittime);
+        if (ready < 0 && errno != EINTR) {
+            restore_terminal();
+            error_at_line(-1, errno, __FILE__, __LINE__, "select call error.");
+        }
+        if (ready > 0 && FD_ISSET(STDIN_FILENO, &fds)) {
+            return 1;
+        }
+        if (msec >= 0) {  // (A resize may have woken us early)
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (elapsed_msec(&now, &deadline) <= 0) return 0;
+        }
+    }
+}
 
-                    timeremaining -= 600;
-                }
+//=======================
+// void read_input(void)
+//
+// Reads what the terminal has for us (up to INPUTBUFSIZE bytes) into
+// inputparser.buf, for parse_input() to work through in place.  Only
+// called once the last read has been used up.  parse_input() keeps track
+// of where it was in an escape sequence, so one may start in one read and
+// end in the next.
+//
+// Returns: void
+//
+void read_input(void) {
+    struct InputParser *ip = &inputparser;
+    int result;
 
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
-                show_mole(aspec->hole, aspec->numholes, 0); // blank hole
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
-                long targettime;
-                targettime = tsrandom();
-                targettime = targettime % 1200 + 800;
-                if (targettime > timeremaining && aspec->duration != -1) {
-                    targettime = timeremaining;
+    if (ip->state != IN_GROUND) {
+        ++inputstats.split;
+    }
+    for (;;) {
+        errno = 0;
+        result = read(STDIN_FILENO, ip->buf, INPUTBUFSIZE);
+        if (errno == EINTR) { // (SIGWINCH is blocked, see initialize_terminal())
+            continue;
+        } else {
+            break;
+        }
+    }
+    if (result < 1) {
+        restore_terminal();
+        error_at_line(-1, errno, __FILE__, __LINE__, "stdin read error.");
+    }
+    ip->head = 0;
+    ip->tail = result;
+    clock_gettime(CLOCK_MONOTONIC, &ip->readtime);
+    ++inputstats.reads;
+}
+
+//========================
+// char parse_input(void)
+//
+// Takes the next key from the input read so far.  Escape sequences are
+// decoded a byte at a time, without copying, and turned into keys by
+// sequence_key().  Sequences that aren't keys we use are skipped whole, so
+// none of their bytes leak out as keys.
+//
+// Returns: the key, or '\0' if the input read so far has no more (it may
+//          have stopped part way into a sequence: see inputparser.state).
+//
+char parse_input(void) {
+    struct InputParser *ip = &inputparser;
+
+    while (ip->head < ip->tail) {
+        unsigned char c = ip->buf[ip->head++];
+        char key;
+
+        switch (ip->state) {
+            case IN_GROUND: {
+                if (c == '\033') {
+                    ip->state = IN_ESC;
+                    ip->seqstart = ip->readtime;
+                    continue;
                 }
-                sleeptime.tv_sec = targettime / 1000; 
-                sleeptime.tv_nsec = (targettime % 1000) * MSEC; 
-                nanosleep(&sleeptime, NULL);
-                timeremaining -= targettime;
+                if (c == '\0') {  // (A NUL, e.g. Ctrl+Space, would read as "no more keys")
+                    ++inputstats.ignored;
+                    continue;
+                }
+                return c;
             }
-            lock_molecomm();
-            aspec->synccount = 2;  // Indicate animation complete
-            unlock_molecomm();
-        } break;
-
-        case ANIMPOPUP: 
-        case INSTRPOPUP: 
-        case SPLASHPOPUP: {
-            // The mole is up!
-            // Animation behavior: 1) Mole rises 5 steps. 30msec after each. (150msec total)
-            //                        This counts as part of the initial stage when the
-            //                        player is eligible for "lightning reflexes" bonus.
-            //                     2) Mole stays up at level 5 for (duration/5) -150 msec.
-            //                     3) Mole drops one level each (duration/5) msec.
-            //
-            //                     For SPLASHPOPUP, only part 1 is displayed.
-            //                     For INSTRPOPUP, animation repeats until cancelled.
 
- #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-PopUp");
- #endif
-            do {    // INSTRPOPUP loops forever, others just once through
-                int synccount = 0;
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_molecomm();
-                aspec->synccount = ++synccount;
-                unlock_molecomm();
-                enable_thread_cancel();
-                sleeptime.tv_sec = 0;
-                sleeptime.tv_nsec = 30*MSEC; 
-                int i;
-                for (i=1; i<=5; i++) {
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, i); // Mole popping up
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    nanosleep(&sleeptime, NULL);
+            case IN_ESC: {
+                if (c == '[') {
+                    ip->state = IN_CSI;
+                    ip->param = 0;
+                    ip->paramdone = 0;
+                    continue;
+                } else if (c == 'O') {
+                    ip->state = IN_SS3;
+                    ip->param = 0;
+                    ip->paramdone = 0;
+                    continue;
                 }
+                ip->state = IN_GROUND;  // ESC and a key (Alt+key): the Escape key, then that key
+                --ip->head;
+                return '\033';
+            }
 
-                if (aspec->animationtype == ANIMPOPUP || aspec->animationtype == INSTRPOPUP) {
-                    int leveltime = aspec->duration / 5; // amount of time to keep mole at each level
-                    sleeptime.tv_sec = (leveltime - 150) / 1000;
-                    sleeptime.tv_nsec = (leveltime - 150) % 1000 * 1000000L;
-
-                    nanosleep(&sleeptime, NULL);
+            case IN_CSI:
+            case IN_SS3: {
+                if (c >= '0' && c <= '9') {  // Parameters (and modifiers, which we don't use)
+                    if (! ip->paramdone && ip->param < 1000) ip->param = ip->param * 10 + c - '0';
+                    continue;
+                } else if (c < 0x40 || c == '[') {  // ';', intermediates, and the Linux console's ESC [ [ A
+                    ip->paramdone = 1;
+                    continue;
+                }
+                key = sequence_key(c, ip->state == IN_CSI ? ip->param : 0);
+                ip->state = IN_GROUND;
+                if (key == '\0') {
+                    ++inputstats.ignored;
+                    continue;
+                }
+                ++inputstats.sequences;
+                return key;
+            }
+        }
+    }
+    return '\0';
+}
 
-                    sleeptime.tv_sec = leveltime / 1000;
-                    sleeptime.tv_nsec = (leveltime % 1000) * 1000000L;
-                    for (i=4; i>=1; i--) {
-                        disable_thread_cancel(); // don't get cancelled while holding a lock
-                        lock_ncurses();
-                        show_mole(aspec->hole, aspec->numholes, i); // Mole going back down
-                        refresh();
-                        unlock_ncurses();
-                        lock_molecomm();
-                        aspec->synccount = ++synccount; // synccounts 2-5
-                        unlock_molecomm();
-                        enable_thread_cancel();
+//==========================================
+// char sequence_key(char final, int param)
+//
+// The key an escape sequence stands for.  On the classic 3x3 grid, whose
+// hole keys are the keypad's digits, the numeric keypad's keys give their
+// digits whether it is in application mode (ESC O p to ESC O y) or not (the
+// cursor keys it doubles as when Num Lock is off: Home is 7, Up 8 and so
+// on), so a keypad cabinet works either way.  The cursor keys send the same
+// sequences as the keypad's, so they give those digits too.  On other grids
+// (-g) the digits are just the first hole keys, nowhere near where the
+// arrows point, so none of these give anything.  Function keys never do.
+//
+// final = the sequence's last byte
+// param = its first parameter (ESC [ param ~), 0 if none
+//
+// Returns: the key, or '\0' for none
+//
+char sequence_key(char final, int param) {
+    int keypad = (gridrows == MOLEHOLES / REFGRIDCOLS && gridcols == REFGRIDCOLS);  // (See assign_hole_keys())
 
-                        nanosleep(&sleeptime, NULL);
-                    }
+    if (! keypad && final != 'M' && ! (final >= 'j' && final <= 'o')) {
+        return '\0';  // (Keypad Enter and symbols still go through: they are never hole keys)
+    }
+    if (final >= 'p' && final <= 'y') {  // Keypad digits, application mode
+        return '0' + final - 'p';
+    }
+    switch (final) {
+        case 'H': return '7';   // Home
+        case 'A': return '8';   // Up
+        case 'D': return '4';   // Left
+        case 'E':               // Keypad 5 (Begin)...
+        case 'G': return '5';   //    ...on the Linux console
+        case 'C': return '6';   // Right
+        case 'F': return '1';   // End
+        case 'B': return '2';   // Down
+        case 'M': return '\r';  // Keypad Enter
+        case 'j': return '*';   // Keypad * + - . /, application mode
+        case 'k': return '+';
+        case 'm': return '-';
+        case 'n': return '.';
+        case 'o': return '/';
+        case '~': {             // ESC [ param ~
+            switch (param) {
+                case 1: case 7: return '7';  // Home
+                case 4: case 8: return '1';  // End
+                case 5: return '9';          // Page Up
+                case 6: return '3';          // Page Down
+                case 2: return '0';          // Insert
+                case 3: return '.';          // Delete
+            }
+        } break;
+    }
+    return '\0';
+}
+
+//==================================================
+// long key_stamp(const struct timespec *t, int pos)
+//
+// Stamps a key with when it arrived, for deciding whack races between
+// players (claim_whack()): usec since launch, times INPUTBUFSIZE, plus the
+// key's position in the read it came in.  So keys that came in one read
+// still stamp in the order they were typed.
+//
+// t = when the key was read (CLOCK_MONOTONIC)
+// pos = where it was in the read (0 if it wasn't read from the terminal)
+//
+// Returns: the stamp
+//
+long key_stamp(const struct timespec *t, int pos) {
+    long usec = (t->tv_sec - startupmarks[SP_LAUNCH].tv_sec) * 1000000L
+                + (t->tv_nsec - startupmarks[SP_LAUNCH].tv_nsec) / 1000L;
+    return usec * INPUTBUFSIZE + pos;
+}
+
+//=========================
+// int input_pending(void)
+//
+// Returns: 1 if input has been read that parse_input() hasn't been through
+//          yet (so waiting on the terminal would miss it), else 0.
+//
+int input_pending(void) {
+    return inputparser.head < inputparser.tail;
+}
+
+//=============================
+//void clear_input_buffer(void)
+//
+//Swallow all keys in the buffer
+//(Headless, the keyboard isn't read at all. stdin may not even be a terminal.)
+//
+void clear_input_buffer(void) {
+    if (headless) return;
+    while (wait_input(0)) {
+        read_input();
+    }
+    inputparser.head = inputparser.tail = 0;
+    inputparser.state = IN_GROUND;
+}
+
+//================================
+// void print_input_stats(FILE *f)
+//
+// Prints keyboard input statistics.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_input_stats(FILE *f) {
+    if (inputstats.reads == 0) return;
+
+    fprintf(f, "Input: %ld keys from %ld reads\n", inputstats.keys, inputstats.reads);
+    fprintf(f, "  escape sequences: %ld mapped to keys, %ld ignored, %ld split across reads\n",
+            inputstats.sequences, inputstats.ignored, inputstats.split);
+}
+
+//==============================================================================================================================================
+// int compute_score(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime)
+//
+// computes score based on target hole, key pressed, how long it took player to
+// press it, how long they had available, and their total score so far.
+// Also counts the result in the hole's holestats[] (for the -m heatmap).
+// In two-player mode (-2) the result goes to the player's own score stream
+// instead (see record_player_result()).
+//
+// player = player # (two-player mode), or -1 for a mole that got away from
+//          every player.  (Ignored with one player.)
+// mole = mole #
+// hole = hole #
+// key = the key pressed by player
+// bonusstage = For whacked mole, how par through the pop animation was the mole?
+//              (0=<20%, 1=20 to <40%, 2+40 to <60%, 3=60 to <80%, 4=80 to 100%)
+// playresult = WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF
+// totaltime = mole's up time (msec), 0 for a misfire
+// remainingtime = up time left when it was whacked or scared off (msec)
+//
+// Returns: Index to scores buffer (two-player mode: to the player's PlayerLog,
+//          the first player's for a mole that got away from both, or -1 if
+//          the log was full)
+//
+// Score #defines...
+//          Missed mole =  -10 pts per mole,
+//                         multiplied by # moles missed (so far)
+//                         capped at -50 per mole.
+//                         Cannot cause cumulative score to go negative.
+//          Whacked mole = 20 pts
+//          Bonus for fast reactions or for waiting until last moment.
+//              wait < 20% of up time =         25 pts
+//              wait >=20% to <40% of up time =  0 pts.
+//              wait >=40% to <60% of up time =  0 pts.
+//              wait >=60% to <80% of up time = 20 pts.
+//              wait >=80% to 100% of up time = 80 pts.
+//
+
+// NOTES ON SCORES: Care should be taken if changing scores beyond 2 digits (plus sign), 
+//                  as this will probably require adjustments to some of the animations
+//                  that include a score display.
+#define MISSEDMOLESCORE -10
+#define MISSEDMOLEMULTIPLIER 1
+#define MISSEDMOLECAP -50
+#define WHACKEDMOLESCORE 20
+#define BONUSSCORES {25,0,0,20,80}
+const int BONUSPOINTS[BONUSSLICES] = BONUSSCORES;
+const struct ScoreRules defaultrules = {WHACKEDMOLESCORE, BONUSSCORES, MISSEDMOLESCORE, MISSEDMOLEMULTIPLIER, MISSEDMOLECAP};
+                                      // The above as a rule table, for offline rescoring (-R).
+int compute_score(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime) {
+    int missedscore = 0;
+    int whackedscore = 0;
+    int bonusscore = 0;
+    int penaltyscore = 0;
+    int curscore = 0;
+
+    if (players > 1) {  // Each player has their own score stream. No lock needed.
+        int i, scorenum = -1;
+        if (hole >= 0 && hole < moleholes) {  // Once per result, even one that goes to both players
+            __sync_fetch_and_add(&holestats[hole].results[playresult], 1);
+            if (playresult == WHACK) {
+                __sync_fetch_and_add(&holestats[hole].reactmsec, totaltime - remainingtime);
+            }
+        }
+        for (i = players - 1; i >= 0; i--) {
+            if (player < 0 || player == i) {
+                scorenum = record_player_result(i, mole, hole, key, bonusstage, playresult, totaltime, remainingtime);
+            }
+        }
+        return scorenum;
+    }
+
+    lock_scores();
+
+    if (numscores > 0) {
+        curscore = scores[numscores-1].endscore;
+    }
+
+    switch(playresult) {
+        case WHACK: {
+            whackedscore += WHACKEDMOLESCORE;
+            bonusscore = BONUSPOINTS[bonusstage];
+        } break;
+
+        case ESCAPE: 
+        case SCAREDOFF: {
+            missedscore = ++missedcount * MISSEDMOLESCORE * MISSEDMOLEMULTIPLIER;
+            if (missedscore < MISSEDMOLECAP) missedscore = MISSEDMOLECAP;
+            if (-missedscore > curscore) missedscore = -curscore;
+        } break;
+
+        case MISFIRE: 
+        case TOOSOON: {
+            penaltyscore = 0;  // no score penalty in this version
+        } break;
+
+        default: {
+            // intentionally left empty
+        };
+    }
+
+    if (hole >= 0 && hole < moleholes) {
+        ++holestats[hole].results[playresult];
+        if (playresult == WHACK) {
+            holestats[hole].reactmsec += totaltime - remainingtime;
+        }
+    }
+
+    // pass index into scores buffer back to caller
+    int scorenum = record_results(mole, hole, key, bonusstage, curscore, missedscore, whackedscore, bonusscore, penaltyscore, curscore + missedscore + whackedscore + bonusscore + penaltyscore, playresult, totaltime, remainingtime);
+
+    unlock_scores();
+
+    return scorenum;
+}
+
+//============================================================================================
+//int record_results(int mole, int hole, char key, int bonusstage, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult, long totaltime, long remainingtime);
+//
+//  Records results for later use in score display
+//
+//  mole = mole number
+//  hole = hole number
+//  key = key pressed by player
+//  bonusstage = how far up a whacked mole was (see compute_score())
+//  startscore = player score before any changes from this mole
+//  missedscore = score for missing mole completely (negative)
+//  whackedscore = score for successfully whacking mole
+//  bonus score = extra points for waiting to whack mole
+//  penalty score = score for hitting wrong key (negative)
+//  endscore = cumulative score after these changes are applied to startscore
+//  playresult = WHACK, ESCAPE, MISFIRE, TOOSOON, or SCAREDOFF
+//  totaltime = mole's up time in msec
+//  remainingtime = up time remaining in msec when mole was whacked (or scared off)
+//
+//  Returns: index to scores buffer 
+//
+//  This function is called exclusively by compute_score(...) function, which holds a mutex lock on scores
+//  buffer.  Therefore, no lock is required here.
+//
+int record_results(int mole, int hole, char key, int bonusstage, int startscore, int missedscore, int whackedscore, int bonusscore, int penaltyscore, int endscore, enum PlayResult playresult, long totaltime, long remainingtime){
+
+    ++numscores;
+    if (numscores > scorescapacity) {  // Grow by doubling. (A prepared round starts with room.)
+        struct ScoreSheetRecord *temp;  // temp pointer. (In case realloc fails)
+        int capacity = scorescapacity > 0 ? scorescapacity * 2 : 16;
+        temp = realloc(scores, capacity * sizeof(struct ScoreSheetRecord));
+        if (temp == NULL) {
+            free(scores);
+            restore_terminal();
+            error_at_line(-1, errno, __FILE__, __LINE__, "realloc failed.\n");
+        }
+        scores = temp;
+        scorescapacity = capacity;
+    }
+
+    struct ScoreSheetRecord *p = &scores[numscores-1];
+
+    p->player = 0;
+    p->mole = mole;
+    p->bonusstage = bonusstage;
+    p->hole = hole;
+    p->startscore = startscore;
+    p->missedscore = missedscore;
+    p->whackedscore = whackedscore;
+    p->bonusscore = bonusscore;
+    p->penaltyscore = penaltyscore;
+    p->selection = key;
+    p->playresult = playresult;
+    p->endscore = endscore;
+    p->totaltime = totaltime;
+    p->remainingtime = remainingtime;
+    trace_event(TE_SCORE, hole, playresult);
+    append_game_event(GE_SCORE, numscores - 1, mole, hole, 0, key, p);
+    log_event("score: mole %ld hole %ld %s, %ld -> %ld", mole, hole, (long)playresultnames[playresult], startscore, endscore);
+
+    return numscores - 1;
+}
+
+//===================================================================================================================================================
+// int record_player_result(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime)
+//
+// compute_score() for two-player mode (-2): scores a result for one player
+// and appends it to their score stream, playerlogs[player].  Lock free, so
+// neither player's scoring waits on the other's: the running total is
+// updated with compare and swap, and the record goes in a slot taken with
+// an atomic add, published by writing its seq last (as in the game event
+// log).  Each record carries the totals it was scored at, so a record
+// published out of turn still reads right.
+//
+// player = player #
+// (The rest as for compute_score().)
+//
+// Returns: index to the player's PlayerLog records, or -1 if it was full
+//          (the record still goes in the game event log, for display_thread)
+//
+int record_player_result(int player, int mole, int hole, char key, int bonusstage, enum PlayResult playresult, long totaltime, long remainingtime) {
+    struct PlayerLog *pl = &playerlogs[player];
+    int missedscore = 0;
+    int whackedscore = 0;
+    int bonusscore = 0;
+    int penaltyscore = 0;
+    int curscore, missed;
+
+    switch(playresult) {
+        case WHACK: {
+            whackedscore = WHACKEDMOLESCORE;
+            bonusscore = BONUSPOINTS[bonusstage];
+        } break;
+
+        case ESCAPE:
+        case SCAREDOFF: {
+            missedscore = __sync_add_and_fetch(&pl->missedcount, 1) * MISSEDMOLESCORE * MISSEDMOLEMULTIPLIER;
+            if (missedscore < MISSEDMOLECAP) missedscore = MISSEDMOLECAP;
+        } break;
+
+        default: {
+            // intentionally left empty (no misfire penalty in this version)
+        };
+    }
+
+    do {  // The missed mole penalty can't take the total below zero
+        curscore = pl->total;
+        missed = -missedscore > curscore ? -curscore : missedscore;
+    } while (! __sync_bool_compare_and_swap(&pl->total, curscore, curscore + missed + whackedscore + bonusscore + penaltyscore));
+
+    struct ScoreSheetRecord dropped;
+    struct ScoreSheetRecord *p = &dropped;
+    long idx = __sync_fetch_and_add(&pl->reserved, 1);
+    if (idx < PLAYERLOGSIZE) {
+        p = &pl->records[idx];
+    } else {
+        __sync_fetch_and_add(&playerstats.dropped, 1);
+        idx = -1;
+    }
+
+    p->player = player;
+    p->mole = mole;
+    p->bonusstage = bonusstage;
+    p->hole = hole;
+    p->startscore = curscore;
+    p->missedscore = missed;
+    p->whackedscore = whackedscore;
+    p->bonusscore = bonusscore;
+    p->penaltyscore = penaltyscore;
+    p->selection = key;
+    p->playresult = playresult;
+    p->endscore = curscore + missed + whackedscore + bonusscore + penaltyscore;
+    p->totaltime = totaltime;
+    p->remainingtime = remainingtime;
+    if (idx >= 0) __atomic_store_n(&pl->seq[idx], idx + 1, __ATOMIC_RELEASE);
+
+    trace_event(TE_SCORE, hole, playresult);
+    append_game_event(GE_SCORE, idx, mole, hole, 0, key, p);
+    log_event("score: player %ld mole %ld hole %ld %s, %ld -> %ld", player + 1, mole, hole, (long)playresultnames[playresult], p->startscore, p->endscore);
+
+    return idx;
+}
+
+//=================================================================
+// const struct ScoreSheetRecord *score_record(int player, int idx)
+//
+// Looks up a score sheet record: scores[idx], or in two-player mode record
+// idx of the player's score stream.  With one player, the caller must hold
+// the scores mutex (scores[] moves when it grows).
+//
+// player = player # (ignored with one player)
+// idx = record index
+//
+// Returns: the record, or NULL if there is no such record (yet).
+//
+const struct ScoreSheetRecord *score_record(int player, int idx) {
+    if (players > 1) {
+        const struct PlayerLog *pl = &playerlogs[player];
+        if (idx < 0 || idx >= PLAYERLOGSIZE || __atomic_load_n(&pl->seq[idx], __ATOMIC_ACQUIRE) != idx + 1) {
+            return NULL;
+        }
+        return &pl->records[idx];
+    }
+    return idx >= 0 && idx < numscores ? &scores[idx] : NULL;
+}
+
+//============================================================
+// void set_mole_uptime(struct MoleCommRecord *p, long uptime)
+//
+// Updates mole's chosen random uptime in molecomm. Wrapped with molecomm mutex 
+// to prevent race conditions when interracting with display_thread().
+// 
+// p = pointer to the molecomm record for this thread.
+// uptime = mole up time in msec
+//
+// Return: void
+//
+void set_mole_uptime(struct MoleCommRecord *p, long uptime) {
+    lock_molecomm();
+
+    p->uptime = uptime;
+
+    unlock_molecomm();
+}
+
+//=========================================================================
+//void set_mole_status(Struct MoleCommRecord *p, enum MoleStatus newstatus)
+//
+// Updates a mole's status.  
+//
+// Calling function is responsible for obtaining molecomm mutex lock before 
+// calling this function.
+//
+// In the case of HIDING, UP, WHACKED, EXPIRED and TERMINATING moles, this function
+// will wait for display_thread to acknowledge the change.
+//
+// p = pointer to the molecomm record for this thread.
+// newstatus = New value to set p->molestatus to.
+//
+// Return: void
+//
+void set_mole_status(struct MoleCommRecord *p, enum MoleStatus newstatus) {
+    int err;
+
+    switch (newstatus) {
+        case AVAILABLE: assert(p->molestatus == COMPLETE) ;  break;
+        case ASSIGNED: assert(p->molestatus == AVAILABLE) ;  break;
+        case HIDING: assert(p->molestatus == ASSIGNED) ;  break;
+        case UP: assert(p->molestatus == HIDING) ;  break;
+        case WHACKED: assert(p->molestatus == UP) ;  break;
+        case EXPIRED: assert(p->molestatus == UP) ;  break;
+        case SCARED: assert(p->molestatus == HIDING || p->molestatus == UP) ;  break;
+        case TERMINATING: assert(p->molestatus == WHACKED || p->molestatus == EXPIRED || p->molestatus == SCARED) ;  break;
+        case COMPLETE: assert(p->molestatus == TERMINATING) ;  break;
+    }
+
+    log_event("slot %ld mole %ld hole %ld: %s -> %s", p - molecomm, p->mole, p->hole, (long)molestatusnames[p->molestatus], (long)molestatusnames[newstatus]);
+    if (threadrole >= TR_MOLE && threadrole < TR_ANIMATION) {
+        perf_sample(p->molestatus);  // -P: counts so far go to the stage that is ending
+    }
+
+    if (newstatus == AVAILABLE) {  // Clear out any left over data from the visit
+        memset((char *)p + offsetof(struct MoleCommRecord, molestatus), 0,
+               sizeof(struct MoleCommRecord) - offsetof(struct MoleCommRecord, molestatus));
+    }
+
+    p->molestatus = newstatus;
+    heartbeat(TR_MOLE + (p - molecomm));  // Also starts the watchdog's dwell and ack clocks
+    trace_event(TE_STATUS, p - molecomm, newstatus);
+    append_game_event(GE_STATUS, p - molecomm, p->mole, p->hole, newstatus, 0, NULL);
+
+    if (newstatus==HIDING || newstatus==UP || newstatus==WHACKED || newstatus==EXPIRED || newstatus==TERMINATING) {
+        while (p->molestatus != p->displayack) {
+            lockowners[LK_MOLECOMM] = TR_NONE;
+            if ((err = pthread_cond_wait(&p->dispcond, &molecomm_mtx)) != 0) {
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Display thread cond wait failed.");
+            }
+            lockowners[LK_MOLECOMM] = threadrole;
+        }
+    }
+}
+
+// ============================
+// void *mole_thread(void *arg)
+//
+// Worker for one mole slot, for the whole game.  Waits for control_moles()
+// to assign the slot a mole, runs the visit (mole_visit()), and goes back
+// for the next, until stop_mole_workers() says the game is over.
+//
+// arg = pointer to molecomm record
+//
+void *mole_thread(void *arg) {
+    struct MoleCommRecord *p = (struct MoleCommRecord *)arg;
+    int err;
+
+    threadrole = TR_MOLE + p->threadslot;
+    perf_thread_begin();
+
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-Mole");
+ #endif
+
+    lock_molecomm();
+    for (;;) {
+        while (p->molestatus != ASSIGNED && ! moleworkersdone) {
+            lockowners[LK_MOLECOMM] = TR_NONE;
+            if ((err = pthread_cond_wait(&p->workcond, &molecomm_mtx)) != 0) {
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Mole worker cond wait failed.");
+            }
+            lockowners[LK_MOLECOMM] = threadrole;
+        }
+        if (p->molestatus != ASSIGNED) break;  // Game over
+
+        unlock_molecomm();
+        mole_visit(p);
+        lock_molecomm();
+    }
+    unlock_molecomm();
+
+    return NULL;
+}
+
+// ===========================================
+// void mole_visit(struct MoleCommRecord *p)
+//
+// Handle a single visit by one mole, on its slot's worker thread.
+//
+// Locks mole hole.
+// Selects random timing for mole.
+// Sets state to HIDING, waits for hiding animation to finish.
+// Sets state to UP, waits for popup animation to finish or be terminated.
+// Sets state to EXPIRED or WHACKED, and hands the hole off to the result
+// animation (display_thread releases it), without waiting for it.
+// Or, if scared, waits for the scared animation, then releases the hole.
+// Sets state to TERMINATED, waits for display ack
+// sets state to COMPLETE
+// 
+// p = pointer to the slot's molecomm record, ASSIGNED
+//
+// Returns: void
+//
+#define MOLESTARTDELAYMIN 250  //msec
+#define MOLESTARTDELAYMAX 3000 //msec
+#define MOLESTARTDELAYFAST 0   //msec (First mole with fast start. The countdown covers the wait.)
+void mole_visit(struct MoleCommRecord *p) {
+    struct timespec tstart, tclaimed, tscored, tdone;  // For slotstats
+    int handedoff = 0;  // Hole handed off to the result animation
+
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+
+    // Varying delay so they don't all start at once.
+    long molestartdelay;
+    if (roundplan.round > 0) {
+        molestartdelay = roundplan.startdelay[p->mole - 1];  // Scheduled by prepare_round()
+    } else if (p->mole == 1) {
+        molestartdelay = faststart ? MOLESTARTDELAYFAST : MOLESTARTDELAYMIN;
+                                            // Start the first one quickly ,
+                                            // to avoid seeming like program locked up.
+    } else {
+        // subsequent moles can wait longer.
+        molestartdelay = ( tsrandom() % (MOLESTARTDELAYMAX - MOLESTARTDELAYMIN) ) + MOLESTARTDELAYMIN;
+    }
+    struct timespec delaytime;
+    delaytime.tv_sec = molestartdelay / 1000;
+    delaytime.tv_nsec = molestartdelay % 1000 * 1000000L;
+    nanosleep(&delaytime, NULL);
+
+    // Claim mole hole
+    int molehole; 
+    molehole = claim_mole_hole(-1); // Claim random mole hole
+    clock_gettime(CLOCK_MONOTONIC, &tclaimed);
+
+    lock_molecomm();
+    p->hole = (int)molehole;
+
+    unlock_molecomm();
+
+    // Set random timing for mole...
+    // Duty cycle of each popup ranges from 30% to 80%
+    long uptime;
+    if (roundplan.round > 0) {
+        uptime = roundplan.uptime[p->mole - 1];
+    } else {
+        uptime = tsrandom();
+        uptime = (uptime % 5000L + 3000L) * (long)p->duration / 10000L;
+    }
+    set_mole_uptime(p, uptime);
+
+    lock_molecomm();
+    p->keyhole = -1;
+    set_mole_status(p, HIDING);
+    unlock_molecomm();
+
+    for (;;) {  // Wait for HIDING animation to signal it has completed (synccount == syncpoints)
+        lock_molecomm();
+        if (p->animspec.syncpoints > 0 && p->animspec.synccount == p->animspec.syncpoints) {
+            break;
+        }
+
+        unlock_molecomm();
+        nanosleep(&one_msec, NULL);
+    }
+    unlock_molecomm();
+
+    if (! p->scaredflag) {  // Pop up mole, unless it was scared. 
+        struct timespec waituntil, starttime; // convert uptime to absolute time in timespec format
+        clock_gettime(CLOCK_REALTIME, &starttime);
+
+        waituntil.tv_sec = starttime.tv_sec + (uptime % 1000L * 1000000L + starttime.tv_nsec) / 1000000000L + uptime / 1000L;
+        waituntil.tv_nsec = (uptime % 1000L * 1000000L + starttime.tv_nsec) % 1000000000L;
+
+        lock_molecomm();
+        p->whackclaim = 0;  // (Before the input thread can see it UP)
+        set_mole_status(p, UP);
+
+        p->keystruck = '\0'; // serves as predicate check for spurious wakeups
+        p->keyhole = -1;
+        int condretval = 0;
+
+        while (p->keystruck == '\0' && condretval == 0) {
+            // timed wait for input_thread to signal key was hit
+
+            lockowners[LK_MOLECOMM] = TR_NONE;
+            condretval = pthread_cond_timedwait(&p->keycond, &molecomm_mtx, &waituntil);
+            lockowners[LK_MOLECOMM] = threadrole;
+        }
+
+        // Close the whack race (see claim_whack()). Whoever holds the claim now whacked
+        // the mole, even if the key only just beat the clock.
+        long claim = __atomic_exchange_n(&p->whackclaim, WHACKCLOSED, __ATOMIC_SEQ_CST);
+        if (claim > 0) {
+            condretval = 0;
+        }
+
+        --molesremaining;
+        clock_gettime(CLOCK_MONOTONIC, &tscored);
+
+        struct timespec scoredtime;  // Up time left, for the player's reaction time
+        clock_gettime(CLOCK_REALTIME, &scoredtime);
+        long remaining = uptime - elapsed_msec(&starttime, &scoredtime);
+        if (remaining < 0) remaining = 0;
+
+        switch (condretval) {
+            case 0: {
+                //Mole was either whacked or scared off
+
+                //Check if mole was whacked (the key struck was for this hole)
+                if (claim > 0 || p->keyhole == p->hole) {
+                    int ssidx;  // index into scoresheets
+                    int player = claim > 0 ? claim % PLAYERS : p->scaredby;
+
+                    ssidx = compute_score(player, p->mole, p->hole, (char)p->hole + '0',p->animspec.synccount-1 , WHACK, uptime, remaining);
+
+                    p->scoreidx = ssidx;  // Save index into scores buffer. display_thread will need it to pass to animation_thread
+                    p->scoreplayer = player;
+
+                    set_mole_status(p, WHACKED);
+
+                    unlock_molecomm();
+
+                    // The grace window (check_hole_grace()) acts as a debounce here,
+                    // since double strikes are fairly common.
+                    hand_off_mole_hole(molehole);
+                    handedoff = 1;
+                } else { // Mole was scared 
+                    int ssidx;  // index into scoresheets
+                    ssidx = compute_score(p->scaredby, p->mole, p->hole, 0, 0, SCAREDOFF, uptime, remaining);
+                    p->scoreidx = ssidx;  // Save index into scores buffer. display_thread will need it to pass to animation_thread
+                    p->scoreplayer = p->scaredby;
+                    set_mole_status(p, SCARED);
+                    unlock_molecomm();
+                }
+            } break; 
+
+            case ETIMEDOUT: {
+                unlock_molecomm();
+
+                int ssidx;  // index into scores buf
+                ssidx = compute_score(-1, p->mole, p->hole, 0, 0, ESCAPE, uptime, 0);  // (Every player missed it)
+                lock_molecomm();
+
+                p->scoreidx = ssidx;  // Save ndex into scores buf. display_thread will need it to pass to animation_thread
+                p->scoreplayer = 0;   // (Two players: the panel shows the first one's penalty)
+
+                set_mole_status(p, EXPIRED);
+
+                unlock_molecomm();
+                hand_off_mole_hole(molehole);  // Starts the grace window for a late swing
+                handedoff = 1;
+            } break;
+
+            default: {
+                restore_terminal();
+                error_at_line(-1, condretval, __FILE__, __LINE__, "Mole thread error on condition timedwait.");
+            } break;
+        }
+    } else { // mole was scared, so no popup.  Set status to SCARED and release molecomm lock.
+        clock_gettime(CLOCK_MONOTONIC, &tscored);
+        compute_score(p->scaredby, p->mole, p->hole, 0, 0, SCAREDOFF, uptime, uptime);  // (Never came up)
+        set_mole_status(p, SCARED);
+
+        --molesremaining;
+
+        unlock_molecomm();
+    }
+
+    if (p->molestatus == SCARED) {
+        for (;;) {  // wait for SCARED animation to signal it has completed (synccount == syncpoints)
+            lock_molecomm();
+            if (p->animspec.animationtype == ANIMMISFIRESCARED || p->animspec.animationtype == ANIMUPSCARED) {
+                if (p->animspec.syncpoints > 0 && p->animspec.synccount == p->animspec.syncpoints) {
+                    unlock_molecomm();
+                    break;
+                }
+            }
+            unlock_molecomm();
+            nanosleep(&one_msec, NULL);
+        }
+    }
+
+    if (! handedoff) {
+        release_mole_hole((int)molehole);  // (hole_mtx comes before molecomm_mtx)
+    }
+    clock_gettime(CLOCK_MONOTONIC, &tdone);
+    lock_molecomm();
+    ++slotstats.moles;
+    slotstats.delaymsec += elapsed_msec(&tstart, &tclaimed);
+    slotstats.livemsec += elapsed_msec(&tclaimed, &tscored);
+    slotstats.tailmsec += elapsed_msec(&tscored, &tdone);
+    set_mole_status(p, TERMINATING);
+    set_mole_status(p, COMPLETE);
+    unlock_molecomm();
+}
+
+//=============================
+// void start_mole_workers(void)
+//
+// Starts the mole slots' worker threads (mole_thread()) for a game, and
+// the conditions they wait on.  Times pthread_create() for slotstats.
+//
+// Returns: void
+//
+void start_mole_workers(void) {
+    struct timespec t0, t1;
+    int err, i;
+
+    moleworkersdone = 0;
+    for (i = 0; i < CONCURRENTMOLES; i++) {
+        struct MoleCommRecord *p = &molecomm[i];
+        p->threadslot = i;
+
+        if ((err = pthread_cond_init(&p->dispcond, NULL)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize mole display condition %d.", i);
+        }
+        if ((err = pthread_cond_init(&p->keycond, NULL)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize mole key condition %d.", i);
+        }
+        if ((err = pthread_cond_init(&p->workcond, NULL)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize mole work condition %d.", i);
+        }
+        syncinits += 3;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if ((err = pthread_create(&p->thread, NULL, mole_thread, p)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create mole thread %d.", i);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ++slotstats.workers;
+        slotstats.lifecycleusec += (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
+    }
+}
+
+//=============================
+// void stop_mole_workers(void)
+//
+// Tells the mole workers the game is over, joins them, and destroys their
+// conditions.  Must come after the input and display threads are gone:
+// they signal keycond and dispcond (display_thread even for the slots'
+// last change, to AVAILABLE).
+//
+// Returns: void
+//
+void stop_mole_workers(void) {
+    struct timespec t0, t1;
+    int err, i;
+
+    lock_molecomm();
+    moleworkersdone = 1;
+    for (i = 0; i < CONCURRENTMOLES; i++) {
+        if ((err = pthread_cond_signal(&molecomm[i].workcond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to signal mole work condition %d.", i);
+        }
+    }
+    unlock_molecomm();
+
+    for (i = 0; i < CONCURRENTMOLES; i++) {
+        struct MoleCommRecord *p = &molecomm[i];
+        void *retval;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if ((err = pthread_join(p->thread, &retval)) != 0) { // join mole worker
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to join mole thread %d. Error=%d", i, err);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        slotstats.lifecycleusec += (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
+
+        if ((err = pthread_cond_destroy(&p->dispcond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to destroy mole display condition %d.", i);
+        }
+        if ((err = pthread_cond_destroy(&p->keycond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to destroy mole key condition %d.", i);
+        }
+        if ((err = pthread_cond_destroy(&p->workcond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to destroy mole work condition %d.", i);
+        }
+        syncdestroys += 3;
+    }
+}
+
+//============================================
+// void control_moles(int count, int duration)
+//
+// Hands moles to the mole slots' workers. Runs up to CONCURRENTMOLES at a
+// time until "count" moles have been completed.  (start_mole_workers()
+// must have been called.)
+//
+//     count = number of popups (range 1 to MAXPOPUPCOUNT), 
+//     duration = Mole cycle time in msec.
+//
+//     return: void
+//
+void control_moles(int count, int duration) {
+    int err;
+
+    // force args to sane values
+    if (count < 1) count = 1;
+    if (count > MAXPOPUPCOUNT) count = MAXPOPUPCOUNT;
+    if (duration < 1000) duration = 1000;
+    if (duration > MAXDURATION) {
+        duration = MAXDURATION;
+    }
+
+    int molesstarted = 0;
+    int molescompleted = 0;
+    int idx = 0;
+    long keymapwhacksseen = keymapwhacks;
+    molesremaining = count;
+
+    while (molescompleted < count) {
+        heartbeat(TR_CONTROL);
+
+        if (keymaprotate) {  // New keys after each hit (-k)
+            reclaim_keymaps();
+            if (keymapwhacks != keymapwhacksseen) {
+                keymapwhacksseen = keymapwhacks;
+                rotate_keymap();
+            }
+        }
+
+        // p is pointer to the MoleCommRecord for this thread slot
+        struct MoleCommRecord *p = &molecomm[idx];
+
+        // If prior moles were scared off by a misfire, wait until creating new moles.
+        struct timespec tsnow, tsexp;
+        clock_gettime(CLOCK_MONOTONIC, &tsnow);
+        tsexp = p->scaredtime;
+        tsexp.tv_nsec += (SCAREDDURATION % 1000) * MSEC;
+        tsexp.tv_sec += SCAREDDURATION / 1000;
+        if (tsexp.tv_nsec >=  1000000000L) {
+            tsexp.tv_nsec -= 1000000000L;
+            tsexp.tv_sec++;
+        }
+        if (tsnow.tv_sec > tsexp.tv_sec || (tsnow.tv_sec == tsexp.tv_sec && tsnow.tv_nsec > tsexp.tv_nsec )) {
+            switch (p->molestatus) {
+                case AVAILABLE: { // empty slot, hand its worker a mole
+                    if (molesstarted < count) {
+                        lock_molecomm();
+                        p->mole = molesstarted + 1;
+                        p->duration = duration;
+                        set_mole_status(p, ASSIGNED);
+
+                        if ((err = pthread_cond_signal(&p->workcond)) != 0) {
+                            restore_terminal();
+                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to signal mole work condition %d.", idx);
+                        }
+                        unlock_molecomm();
+
+                        ++molesstarted;
+                    }
+                } break;
+
+                case COMPLETE: { // visit over, worker is waiting for the next
+                    lock_molecomm();
+                    if (p->displayack == COMPLETE) {  // Not until display_thread has seen
+                        set_mole_status(p, AVAILABLE); // the visit end
+                        ++molescompleted;
+                    }
+                    unlock_molecomm();
+                } break;
+
+                default: {
+                    // intentionally left empty
+                };
+            }
+        }
+
+        if (++idx == CONCURRENTMOLES) {
+            idx = 0;
+            struct timespec sleeptime = {0, 100000000L}; // 100 msec sleep so we
+            nanosleep(&sleeptime, NULL);                 // don't burn up the cpu
+        }
+    }
+}
+
+//=====================================================
+// long mole_dwell_slo(const struct MoleCommRecord *p)
+//
+// How long a mole slot may stay in its current state before the watchdog
+// calls it stuck: the longest the state should last, plus DWELLSLACK.
+// Called without the molecomm lock (it may be what is stuck), so the
+// record can change underneath us.  Worst case is one odd check, which the
+// watchdog rides out by confirming a breach on the next pass.
+//
+// p = molecomm record to check
+//
+// Returns: SLO in msec, or -1 if the state has none (AVAILABLE).
+//
+long mole_dwell_slo(const struct MoleCommRecord *p) {
+    switch (p->molestatus) {
+        case ASSIGNED: return MOLESTARTDELAYMAX + DWELLSLACK;   // Start delay, then claim a hole
+        case HIDING: return p->duration - p->uptime + DWELLSLACK;
+        case UP: return p->uptime + DWELLSLACK;
+        case SCARED: return SCAREDDURATION + DWELLSLACK;        // Scared animation
+        case COMPLETE: return SCAREDDURATION + DWELLSLACK;      // control_moles() holds off on
+                                                                // reassigning while moles are scared
+        case WHACKED:
+        case EXPIRED:
+        case TERMINATING: return DWELLSLACK;                    // Just scorekeeping
+        default: return -1;
+    }
+}
+
+//==========================================================
+// void write_watchdog_dump(const char *reason, long now)
+//
+// Writes what the watchdog knows to WATCHDOGDUMP: the breach, heartbeats,
+// each mole slot's molecomm record, lock owners, the hole occupancy index
+// and the trace ring.  Nothing is locked while reading: a wedged thread
+// may be holding the very lock we would want.  The first dump of a game
+// starts a new file, later ones are appended.
+//
+// reason = one line description of the breach.
+// now = msec since launch when it was found.
+//
+// Returns: void
+//
+void write_watchdog_dump(const char *reason, long now) {
+    static const char *tracenames[] = {"status", "ack", "key", "score", "result done"};
+    static const char *locknames[TRACKEDLOCKS] = {"molecomm", "scores", "ncurses"};
+    FILE *f = fopen(WATCHDOGDUMP, watchdogstats.dumps == 0 ? "w" : "a");
+    int i;
+
+    if (f == NULL) return;  // Nowhere to put it. The breach still counts in watchdogstats.
+
+    fprintf(f, "=== Whack-A-Mole %s watchdog, pid %d: SLO breach %ld ms after launch\n", VERSTRING, (int)getpid(), now);
+    fprintf(f, "%s\n\n", reason);
+
+    fprintf(f, "Heartbeats (ms ago):");
+    for (i = 0; i < TR_MOLE; i++) {
+        fprintf(f, "  %s %ld", role_name(i), now - heartbeats[i]);
+    }
+    fprintf(f, "\nMoles remaining: %d, score records: %d\n\n", molesremaining, numscores);
+
+    fprintf(f, "Mole slots (unlocked snapshot):\n");
+    fprintf(f, "  slot status      displayack  in state   SLO    mole hole  duration uptime anim sync  flags\n");
+    for (i = 0; i < CONCURRENTMOLES; i++) {
+        struct MoleCommRecord *p = &molecomm[i];
+        enum MoleStatus status = p->molestatus;
+        enum MoleStatus ack = p->displayack;
+
+        fprintf(f, "  %4d %-11s %-11s %6ld ms %6ld ms %4d %4d %6ld ms %4ld ms  %d/%d %s%s\n", i,
+                molestatusnames[status], molestatusnames[ack], now - heartbeats[TR_MOLE + i], mole_dwell_slo(p),
+                p->mole, p->hole, p->duration, p->uptime, p->animspec.synccount, p->animspec.syncpoints,
+                p->scaredflag ? "scared " : "", p->animcancelled ? "animcancelled" : "");
+    }
+
+    fprintf(f, "\nLock owners:");
+    for (i = 0; i < TRACKEDLOCKS; i++) {
+        fprintf(f, "  %s: %s", locknames[i], role_name(lockowners[i]));
+    }
+    fprintf(f, "  (hole, random and start mutexes not tracked)\n");
+
+    fprintf(f, "Holes in use:");
+    for (i = 0; i < moleholes; i++) {
+        unsigned char use = holeuse[i];
+        if (use != 0) {
+            fprintf(f, "  %d:%s%s%s", i, use & HOLE_MOLE ? "M" : "", use & HOLE_RESULT ? "R" : "", use & HOLE_OVERLAY ? "O" : "");
+        }
+    }
+    fprintf(f, "  (M = mole, R = result, O = misfire overlay)\n\n");
+
+    long head = tracehead;
+    long seq = head > TRACEEVENTS ? head - TRACEEVENTS : 0;
+    fprintf(f, "Last %ld trace events:\n", head - seq);
+    for (; seq < head; seq++) {
+        struct TraceEvent te = traceevents[seq % TRACEEVENTS];
+        if (te.seq != seq + 1) continue;  // Being written, or already overwritten
+
+        fprintf(f, "  %7ld ms  %-12s %-11s ", te.msec, role_name(te.role), tracenames[te.type]);
+        switch (te.type) {
+            case TE_STATUS: fprintf(f, "slot %d -> %s\n", te.arg1, molestatusnames[te.arg2]); break;
+            case TE_ACK: fprintf(f, "slot %d %s\n", te.arg1, molestatusnames[te.arg2]); break;
+            case TE_KEY: fprintf(f, "'%c'\n", te.arg1); break;
+            case TE_SCORE: fprintf(f, "hole %d %s\n", te.arg1, playresultnames[te.arg2]); break;
+            case TE_RESULTDONE: fprintf(f, "hole %d released\n", te.arg1); break;
+        }
+    }
+    fprintf(f, "\n");
+    fclose(f);
+}
+
+//================================
+// void *watchdog_thread(void *arg)
+//
+// Every WATCHDOGPERIOD msec, checks the latency SLOs:
+//     input, display and control heartbeats within HEARTBEATSLO,
+//     mole status changes acked by display_thread within ACKSLO,
+//     each mole slot's time in its current state within mole_dwell_slo().
+// A breach must still be there on the next check (same heartbeat), which
+// filters out reading a slot halfway through a status change.  Each stall
+// is then counted once, and the first WATCHDOGDUMPS get a diagnostic dump.
+//
+// Only reads shared state, and takes no locks, so it costs the game a few
+// hundred word reads a second when nothing is wrong.
+//
+void *watchdog_thread(void *arg) {
+    long suspect[TR_ANIMATION];   // Per role: heartbeat that was over its SLO last check...
+    long reported[TR_ANIMATION];  //    ...and the one last reported as a breach.
+    char reason[160];
+    int role;
+
+    threadrole = TR_WATCHDOG;
+    perf_thread_begin();
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-Watchdog");
+ #endif
+
+    for (role = 0; role < TR_ANIMATION; role++) {
+        suspect[role] = reported[role] = -1;
+    }
+
+    for (;;) {
+        struct timespec sleeptime = {0, WATCHDOGPERIOD * MSEC};
+        nanosleep(&sleeptime, NULL);
+
+        long now = launch_msec();
+        ++watchdogstats.checks;
+
+        for (role = 0; role < TR_ANIMATION; role++) {
+            long beat = heartbeats[role];
+            long age = now - beat;
+
+            reason[0] = '\0';
+            if (role < TR_MOLE) {
+                if (age > watchdogstats.worstbeat) {
+                    watchdogstats.worstbeat = age;
+                    watchdogstats.worstbeatrole = role;
+                }
+                if (age > HEARTBEATSLO) {
+                    snprintf(reason, sizeof(reason), "%s thread: no heartbeat for %ld ms (SLO %d ms)", role_name(role), age, HEARTBEATSLO);
+                }
+            } else {
+                struct MoleCommRecord *p = &molecomm[role - TR_MOLE];
+                enum MoleStatus status = p->molestatus;
+                long slo = mole_dwell_slo(p);
+
+                if (status != p->displayack && (status == HIDING || status == UP || status == WHACKED || status == EXPIRED || status == TERMINATING)) {
+                    if (age > watchdogstats.worstack) watchdogstats.worstack = age;
+                    if (age > ACKSLO) {
+                        snprintf(reason, sizeof(reason), "%s: %s not acked by display thread for %ld ms (SLO %d ms)", role_name(role), molestatusnames[status], age, ACKSLO);
+                    }
+                }
+                if (reason[0] == '\0' && slo >= 0 && age > slo) {
+                    snprintf(reason, sizeof(reason), "%s: %s for %ld ms (SLO %ld ms)", role_name(role), molestatusnames[status], age, slo);
+                }
+            }
+
+            if (reason[0] == '\0') {
+                suspect[role] = -1;
+            } else if (suspect[role] != beat) {
+                suspect[role] = beat;        // Confirm on the next check
+            } else if (reported[role] != beat) {
+                reported[role] = beat;
+                ++watchdogstats.breaches;
+                log_event("watchdog: SLO breach by %s, %ld ms since heartbeat", (long)role_name(role), age);
+                if (watchdogstats.dumps < WATCHDOGDUMPS) {
+                    disable_thread_cancel();  // Don't leave a half written dump
+                    write_watchdog_dump(reason, now);
+                    ++watchdogstats.dumps;
+                    enable_thread_cancel();
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//=========================================
+// pthread_t *start_watchdog_thread(void)
+//
+// Starts the watchdog for game play.  The input, display and control
+// heartbeats are reset first, so time spent in menus doesn't count.
+//
+// returns the thread ID
+//
+pthread_t *start_watchdog_thread(void) {
+    static pthread_t tid;   // thread ID
+    int err;
+    int role;
+
+    for (role = 0; role < TR_MOLE; role++) {
+        heartbeat(role);
+    }
+
+    if ((err = pthread_create(&tid, NULL, watchdog_thread, NULL)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create watchdog thread.");
+    }
+
+    return &tid;
+}
+
+//==============================================
+// long menu_anim_frame(struct MenuAnim *ma)
+//
+// Draws the next frame of a menu animation and advances it one step.  The
+// looping animations (INSTRPOPUP, INSTRSCARED, ANIMHIDING, GAMEOVERBLINK)
+// start over after their last frame; SPLASHPOPUP stops with the mole up.
+//
+// Holes are drawn at the classic 3x3 layout used by the menus.
+//
+// The calling function must hold the ncurses mutex, and refreshes the
+// screen once all of the frames due on this tick are drawn.
+//
+// Returns: msec until the next frame, or -1 if the animation is finished.
+//
+long menu_anim_frame(struct MenuAnim *ma) {
+    const int framemsec = calibration.framemsec;
+    const int leveltime = 600;    // INSTRPOPUP: msec per level on the way down
+    const int row = 13;           // GAMEOVERBLINK: where display_gameover() puts the panel
+    const int col = 53;
+    int step = ma->step++;
+
+    switch (ma->animationtype) {
+        case SPLASHPOPUP: {  // Rise 5 levels, then stay up
+            show_mole(ma->hole, 0, step + 1);
+            return step < 4 ? framemsec : -1;
+        }
+
+        case INSTRPOPUP: {   // Rise, hold, drop one level per leveltime, pause, repeat
+            if (step < 5) {
+                show_mole(ma->hole, 0, step + 1);
+                if (step < 4) {
+                    return framemsec;
+                }
+                int holdtime = leveltime - 5 * framemsec;  // less time spent rising
+                return framemsec + (holdtime > 0 ? holdtime : 0);
+            } else if (step < 9) {
+                show_mole(ma->hole, 0, 9 - step);  // levels 4..1
+                return leveltime;
+            }
+            show_mole(ma->hole, 0, 0);
+            ma->step = 0;
+            return 500;
+        }
+
+        case ANIMHIDING: {   // Ears bob (short, medium, long or double), then a random rest
+            if (step == 0) {
+                show_mole(ma->hole, 0, 1);
+                return 200;
+            } else if (step < 3) {
+                show_mole(ma->hole, 0, tsrandom()%3?0:1); // 1/3 chance for extended or double bounce
+                return 200;
+            }
+            show_mole(ma->hole, 0, 0);
+            ma->step = 0;
+            return tsrandom() % 1200 + 800;
+        }
+
+        case INSTRSCARED: {  // Mole up, scared off, flashing "!SCARED!", blank, repeat
+            switch (step) {
+                case 0: show_mole(ma->hole, 0, 5); return 3000;
+                case 1: show_result(ma->hole, 0, SCAREDOFF, 0, 0, NULL); return 750;
+                case 2: case 4: case 6:
+                        show_result(ma->hole, 0, -1, 0, 0, "!SCARED!"); return 150;
+                case 3: case 5: case 7:
+                        show_result(ma->hole, 0, -1, 0, 0, ""); return 150;
+                case 8: show_result(ma->hole, 0, SCAREDOFF, 0, 0, NULL); return 1500;
+                case 9: show_result(ma->hole, 0, -1, 0, 0, "!SCARED!"); return 600;
+            }
+            show_result(ma->hole, 0, -1, 0, 0, "");
+            ma->step = 0;
+            return 2500;
+        }
+
+        case GAMEOVERBLINK: { // Blink GAME OVER a few times, then blink the prompt
+            if (step >= 11) {
+                mvprintw(row+3, col, step % 2 == 0 ? " Press any key" : "              ");
+                if (step == 12) {
+                    ma->step = 11;
+                }
+            } else if (step % 2 == 0) {
+                mvprintw(row, col, "===============");
+                mvprintw(row+1, col, "   GAME OVER");
+                mvprintw(row+2, col, "===============");
+            } else {
+                mvprintw(row, col, "               ");
+                mvprintw(row+1, col, "            ");
+                mvprintw(row+2, col, "               ");
+            }
+            return 500;
+        }
+
+        default: {
+            return -1;
+        }
+    }
+}
+
+//==========================================================================
+// char menu_tick_loop(struct MenuAnim *anims, int count, int untildone)
+//
+// Runs the animations of a menu page until a key is pressed.  Everything
+// happens on the calling thread: one select() waits for either the keyboard
+// or the next frame due, and all frames due on a tick are drawn together
+// with one refresh().  No threads are created, so there is nothing to
+// cancel or join when the page changes.
+//
+// A frame is scheduled from when the previous one was due, so the
+// animations keep their pace.  A frame that is already late is scheduled
+// from now instead, rather than rushing to catch up.
+//
+// anims = animations for this page (each with step zero and a due time).
+// count = number of animations (zero just waits for a key).
+// untildone = 1: also return once every animation has finished.  A key
+//             press finishes them first, so the page is complete.  Only
+//             use with animations that end (SPLASHPOPUP).
+//
+// The calling function must NOT hold the ncurses mutex.
+//
+// Returns: key pressed, or '\0' if the animations finished (untildone).
+//
+char menu_tick_loop(struct MenuAnim *anims, int count, int untildone) {
+    struct timespec now;
+    int i;
+
+    for (;;) {
+        long wait = -1;  // msec until the next frame due, -1 for none
+        int drawn = 0;
+
+        handle_resize();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        lock_ncurses();
+        for (i = 0; i < count; i++) {
+            struct MenuAnim *ma = &anims[i];
+            if (ma->done) {
+                continue;
+            }
+            long left = elapsed_msec(&now, &ma->due);
+            if (left <= 0) {
+                long next = menu_anim_frame(ma);
+                drawn = 1;
+                if (next < 0) {
+                    ma->done = 1;
+                    continue;
+                }
+                if (left + next < 0) {  // Fallen behind
+                    ma->due = now;
+                }
+                add_msec(&ma->due, next);
+                left = elapsed_msec(&now, &ma->due);
+            }
+            if (wait < 0 || left < wait) {
+                wait = left;
+            }
+        }
+        if (drawn) {
+            refresh();
+        }
+        unlock_ncurses();
+
+        if (untildone && wait < 0) {
+            return '\0';
+        }
+
+        int keyhit = input_pending() || wait_menu_input(wait);
+        if (keyhit) {
+            if (untildone) {   // Skip to the end of the animations
+                lock_ncurses();
+                for (i = 0; i < count; i++) {
+                    while (! anims[i].done) {
+                        anims[i].done = (menu_anim_frame(&anims[i]) < 0);
+                    }
+                }
+                refresh();
+                unlock_ncurses();
+            }
+            return waitforkey(NULL);
+        }
+    }
+}
+
+//==============================
+// void intro_splashscreen(void)
+//
+// Part of the instructions presented by display_intro()
+//
+// Moles pop up in each hole in turn, then the menu is shown.  A key
+// pressed meanwhile skips to the menu, and goes no further: it was
+// pressed before there was a menu to choose from.
+//
+// Returns: void
+//
+void intro_splashscreen(void) {
+    struct MenuAnim anims[MOLEHOLES];
+    struct timespec start;
+    display_empty_playfield(BASEGAME, DISP_ELE_HOLES, MOLEHOLES, NULL);
+
+    int linenum = 3;
+    const int startcol = 43;
+    lock_ncurses();
+    mvprintw(++linenum,startcol,"        Whack-A-Mole %s\n", VERSTRING);
+    refresh();
+    unlock_ncurses();
+
+    int i;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; i<MOLEHOLES; i++) {
+        anims[i] = (struct MenuAnim) {SPLASHPOPUP, i, 0, start, 0};
+        add_msec(&start, 150);  // 150 msec between moles
+    }
+    menu_tick_loop(anims, MOLEHOLES, 1);  // (The key that skips it is used up)
+
+    lock_ncurses();
+    linenum += 2;
+    mvprintw(++linenum,startcol,"   A Linux / ncurses implementation  ");
+    mvprintw(++linenum,startcol,"   of the classic electromechanical  ");
+    mvprintw(++linenum,startcol,"   arcade game, using POSIX threads. ");
+    linenum += 2;
+    mvprintw(++linenum,startcol,"         ==================          ");
+    mvprintw(++linenum,startcol,"         Please select one:          ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           I)nstructions             ");
+    mvprintw(++linenum,startcol,"           P)lay                     ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"         ==================          ");
+    refresh();
+    unlock_ncurses();
+}
+
+//====================================================
+//int intro_overview(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_overview(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    int linenum = 0;
+    const int startcol = 22;
+    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    linenum +=2;
+    mvprintw(++linenum,startcol,"              OVERVIEW               ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Score points by whacking the      ");
+    mvprintw(++linenum,startcol,"   moles when they pop up in the     ");
+    mvprintw(++linenum,startcol,"   holes.                            ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   A penalty score is assessed for   ");
+    mvprintw(++linenum,startcol,"   any missed moles.                 ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Up to %d moles may be active at   ", CONCURRENTMOLES);
+    mvprintw(++linenum,startcol,"   the same time.                    ");
+    linenum += 2;
+    mvprintw(++linenum,startcol,"   ===============================   ");
+    mvprintw(++linenum,startcol,"        Options: (N)ext pg,          ");
+    mvprintw(++linenum,startcol,"                 (S)tart game        ");
+    mvprintw(++linenum,startcol,"   ===============================   ");
+    refresh();
+    unlock_ncurses();
+
+    return 0;
+}
+
+//=====================================================
+//int intro_playfield(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_playfield(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
+    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    int linenum = 0;
+    const int startcol = 43;
+    linenum +=2;
+    mvprintw(++linenum,startcol,"              PLAYFIELD              ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   This is the playfield for the     ");
+    mvprintw(++linenum,startcol,"   game.                             ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"   The key assigned to each hole is  ");
+    mvprintw(++linenum,startcol,"   displayed to the upper right of   ");
+    mvprintw(++linenum,startcol,"   the hole.                         ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"   Press that key to swing your      ");
+    mvprintw(++linenum,startcol,"   virtual hammer at the hole.       ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"   HINT: Make sure numlock is on.    ");
+    linenum += 2;
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
+    mvprintw(++linenum,startcol,"            (S)tart game             ");
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    refresh();
+    unlock_ncurses();
+
+    return 0;
+}
+
+//=======================================================
+//int intro_hidingmoles(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_hidingmoles(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
+    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    int linenum = 0;
+    const int startcol = 43;
+    linenum +=2;
+    mvprintw(++linenum,startcol,"              GAMEPLAY               ");
+    mvprintw(++linenum,startcol,"            Hiding Moles             ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Each mole starts out by choosing  ");
+    mvprintw(++linenum,startcol,"   a hole and hiding.  Look closely, ");
+    mvprintw(++linenum,startcol,"   and you can occasionally see the  ");
+    mvprintw(++linenum,startcol,"   mole's ears in the hole.          ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   You CANNOT whack a mole while it  ");
+    mvprintw(++linenum,startcol,"   is hiding.  You must wait for it  ");
+    mvprintw(++linenum,startcol,"   to pop up.                        ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Hole 5 on the left shows an       ");
+    mvprintw(++linenum,startcol,"   example of a mole hiding.         ");
+    linenum += 2;
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
+    mvprintw(++linenum,startcol,"            (S)tart game             ");
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    refresh();
+    unlock_ncurses();
+
+    anims[0] = (struct MenuAnim) {ANIMHIDING, 4, 0, {0, 0}, 0};  // due right away
+    return 1;
+}
+
+//=================================================
+//int intro_popup(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_popup(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    display_empty_playfield(BASEGAME, DISP_ELE_HOLES | DISP_ELE_KEYS, MOLEHOLES, NULL);
+    mvprintw(0,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    int linenum = 0;
+    const int startcol = 43;
+    linenum +=2;
+    mvprintw(++linenum,startcol,"              GAMEPLAY               ");
+    mvprintw(++linenum,startcol,"           Popped Up Moles           ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   When a mole is ready, it pops its ");
+    mvprintw(++linenum,startcol,"   head up in the hole.              ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Press the key for that hole       ");
+    mvprintw(++linenum,startcol,"   before the mole gets away.        ");
+    mvprintw(++linenum,startcol,"                                     ");
+    mvprintw(++linenum,startcol,"   Hole 5 on the left shows a mole   ");
+    mvprintw(++linenum,startcol,"   popping up and getting away.      ");
+    linenum += 2;
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    mvprintw(++linenum,startcol,"   Options: (N)ext pg, (P)rev pg,    ");
+    mvprintw(++linenum,startcol,"            (S)tart game             ");
+    mvprintw(++linenum,startcol,"   ==============================    ");
+    refresh();
+    unlock_ncurses();
+
+    anims[0] = (struct MenuAnim) {INSTRPOPUP, 4, 0, {0, 0}, 0};  // due right away
+    return 1;
+}
+
+//=======================================================
+//int intro_playresults(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_playresults(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    int linenum = 0;
+    const int startcol = 0;
+    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    ++linenum;
+    mvprintw(++linenum,startcol,"                                                                 ________");
+    mvprintw(++linenum,startcol,"                                 +----------------------------- /%8.8s\\", asciiwhack[0]);
+    mvprintw(++linenum,startcol,"           PLAY RESULTS          | If all goes well and you    / %8.8s \\", asciiwhack[1]);
+    mvprintw(++linenum,startcol,"                                 | press the correct key in    | %8.8s |", asciiwhack[2]);
+    mvprintw(++linenum,startcol,"    ________                     | time, you WHACK the mole.   | %8.8s |", asciiwhack[3]);
+    mvprintw(++linenum,startcol,"   /%8.8s\\ -------------------+------------+--------------- \\ %8.8s /", asciiescape[0], asciiwhack[4]);
+    mvprintw(++linenum,startcol,"  / %8.8s \\   If you're too slow, the mole |                 \\________/", asciiescape[1]);
+    mvprintw(++linenum,startcol,"  | %8.8s |   will ESCAPE and disappear in |                 ", asciiescape[2]);
+    mvprintw(++linenum,startcol,"  | %8.8s |   a \"poof\" of dust.            |                  ________", asciiescape[3]);
+    mvprintw(++linenum,startcol,"  \\ %8.8s / -----------------+-------------+---------------- /%8.8s\\", asciiescape[4], asciimisfire[0]);
+    mvprintw(++linenum,startcol,"   \\________/                   | If you have BAD AIM and      / %8.8s \\", asciimisfire[1]);
+    mvprintw(++linenum,startcol,"                                | hit the wrong key, or you    | %8.8s |", asciimisfire[2]);
+    mvprintw(++linenum,startcol,"                                | swing TOO SOON, the hammer   | %8.8s |", asciimisfire[3]);
+    mvprintw(++linenum,startcol,"    ________                    | will slam into the ground.   \\ %8.8s /",asciimisfire[4]);
+    mvprintw(++linenum,startcol,"   /        \\ ------------------+-----------------------+------ \\________/");
+    mvprintw(++linenum,startcol,"  /          \\   When the hammer slams the ground, all  |");
+    mvprintw(++linenum,startcol,"  |          |   moles that are up or hiding are SCARED |");
+    mvprintw(++linenum,startcol,"  |          |   OFF and can no longer be whacked.      |");
+    mvprintw(++linenum,startcol,"  \\          / -----------------------------------------+");
+    mvprintw(++linenum,startcol,"   \\________/");
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    refresh();
+    unlock_ncurses();
+
+    anims[0] = (struct MenuAnim) {INSTRSCARED, 6, 0, {0, 0}, 0};  // due right away
+    return 1;
+}
+
+//===================================================
+//int intro_scoring(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_scoring(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    int linenum = 0;
+    const int startcol = 0;
+    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    ++linenum;
+    mvprintw(++linenum,startcol,"                                    SCORING");
+    ++linenum;
+    mvprintw(++linenum,startcol,"              Each successfully whacked mole earns you %d points. ", WHACKEDMOLESCORE);
+    mvprintw(++linenum,startcol,"                                                                                ");
+    mvprintw(++linenum,startcol,"              You can also earn a speed or skill bonus.  Whack the mole");
+    mvprintw(++linenum,startcol,"              at the follwing times to earn one of these bonuses.");
+    mvprintw(++linenum,startcol,"  +--------------+-----------------------------+-----------------------------+  ");
+    mvprintw(++linenum,startcol,"  |   Lightning  |            Meh...           |       Nerves of steel.      |  ");
+    mvprintw(++linenum,startcol,"  |   Reflexes.  |     Thanks for playing.     |   (Push it to the limit!)   |  ");
+    mvprintw(++linenum,startcol,"  |   ________   |   ________       ________   |   ________       ________   |  ");
+    mvprintw(++linenum,startcol,"  |  /%8.8s\\  |  /        \\     /        \\  |  /        \\     /        \\  |  ", asciimole[0]);
+    mvprintw(++linenum,startcol,"  | / %8.8s \\ | / %8.8s \\   /          \\ | /          \\   /          \\ |  ", asciimole[1], asciimole[0]);
+    mvprintw(++linenum,startcol,"  | | %8.8s | | | %8.8s |   | %8.8s | | |          |   |          | |  ", asciimole[2], asciimole[1], asciimole[0]);
+    mvprintw(++linenum,startcol,"  | | %8.8s | | | %8.8s |   | %8.8s | | | %8.8s |   |          | |  ", asciimole[3], asciimole[2], asciimole[1], asciimole[0]);
+    mvprintw(++linenum,startcol,"  | \\ %8.8s / | \\ %8.8s /   \\ %8.8s / | \\ %8.8s /   \\ %8.8s / |  ", asciimole[4], asciimole[3], asciimole[2], asciimole[1], asciimole[0]);
+    mvprintw(++linenum,startcol,"  |  \\________/  |  \\________/     \\________/  |  \\________/     \\________/  |  ");
+    mvprintw(++linenum,startcol,"  |              |                             |                             |  ");
+    mvprintw(++linenum,startcol,"  |   Bonus: %-2d  |   Bonus: %-2d      Bonus: %-2d  |   Bonus: %-2d      Bonus:%-2d   |  ", BONUSPOINTS[0], BONUSPOINTS[1], BONUSPOINTS[2], BONUSPOINTS[3], BONUSPOINTS[4]);
+    mvprintw(++linenum,startcol,"  +--------------+-----------------------------+-----------------------------+  ");
+    ++linenum;
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    refresh();
+    unlock_ncurses();
+
+    return 0;
+}
+
+//=====================================================
+//int intro_penalties(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_penalties(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    int linenum = 0;
+    const int startcol = 0;
+    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    ++linenum;
+    mvprintw(++linenum,startcol,"                                   PENALTIES");
+    ++linenum;
+    mvprintw(++linenum,startcol,"             You will be assessed a penalty for each mole that escapes.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"             The first mole to escape will cost you a %d point penalty.", abs(MISSEDMOLESCORE));
+    ++linenum;
+    mvprintw(++linenum,startcol,"             Each additional escaped mole costs another penalty AND ");
+    mvprintw(++linenum,startcol,"             increases the size of the penalty by %d points.  (So the ", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER);
+    mvprintw(++linenum,startcol,"             first costs you %d points, the second costs %d, third", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER, abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER * 2);
+    mvprintw(++linenum,startcol,"             costs %d, etc.)", abs(MISSEDMOLESCORE) * MISSEDMOLEMULTIPLIER * 3);
+    ++linenum;
+    mvprintw(++linenum,startcol,"             The size of the penalty is capped at %d points.  A penalty", abs(MISSEDMOLECAP));
+    mvprintw(++linenum,startcol,"             will never make your accumulated score go below 0.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"             Scared moles (caused by your hammer slamming the ground)");
+    mvprintw(++linenum,startcol,"             count as missed, and recieve all escaped-mole penalties.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    mvprintw(++linenum,startcol,"                   Options: (N)ext pg, (P)rev pg, (S)tart game");
+    mvprintw(++linenum,startcol,"                   ===========================================");
+    refresh();
+    unlock_ncurses();
+
+    return 0;
+}
+
+//======================================================
+//int intro_scoresheet(int page, struct MenuAnim *anims)
+//
+// Part of the instructions presented by display_intro()
+//
+// Returns: number of animations for this page, set up in anims[].
+//
+int intro_scoresheet(int page, struct MenuAnim *anims) {
+    lock_ncurses();
+    clear();
+    int linenum = 0;
+    const int startcol = 0;
+    mvprintw(linenum,0,"Whack-A-Mole %s", VERSTRING);
+    mvprintw(0, 80 - 18,"[Instructions %d/%d]", page+1, sizeof(intropages) / sizeof(intropages[0]));
+    ++linenum;
+    mvprintw(++linenum,startcol,"                                   SCORE SHEET");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           When you finish the game, you will see a score sheet with the");
+    mvprintw(++linenum,startcol,"           details of your game.  The score sheet events are:");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           Whacked Mole!     - Success!  You whacked a mole, earned a");
+    mvprintw(++linenum,startcol,"                               score, and possibly a bonus.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           Mole Escaped      - The mole got away, costing you a penalty.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           Bad Aim           - You hit a hole with no mole present.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           Hit Too Soon      - You hit a hole when the mole was still");
+    mvprintw(++linenum,startcol,"                               hiding.");
+    ++linenum;
+    mvprintw(++linenum,startcol,"           Mole Scared Away  - This mole was scared away by the \"Bad Aim\"");
+    mvprintw(++linenum,startcol,"                               or \"Hit Too Soon\" event above. (Costing you");
+    mvprintw(++linenum,startcol,"                               an escaped-mole penalty)");
+    ++linenum;
+    mvprintw(++linenum,startcol,"                         ================================");
+    mvprintw(++linenum,startcol,"                         Options: (P)rev pg, (S)tart game");
+    mvprintw(++linenum,startcol,"                         ================================");
+    refresh();
+    unlock_ncurses();
+
+    return 0;
+}
+
+//==============================
+// void blit_page(WINDOW *pad)
+//
+// Puts a prerendered page on the screen: the pad is copied over stdscr and
+// the screen refreshed, so ncurses only sends what differs from the page
+// before.  Copying into stdscr (rather than prefresh() straight to the
+// screen) keeps stdscr showing the page, for the hole animations drawn on
+// top of it and for repainting after a resize.
+//
+// A pad rendered for a different terminal size is clipped to the screen.
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: void
+//
+void blit_page(WINDOW *pad) {
+    int rows = getmaxy(pad) < LINES ? getmaxy(pad) : LINES;
+    int cols = getmaxx(pad) < COLS ? getmaxx(pad) : COLS;
+
+    erase();
+    copywin(pad, stdscr, 0, 0, 0, 0, rows - 1, cols - 1, FALSE);
+    refresh();
+}
+
+//==========================================================================
+// int show_intro_page(int page, struct PageCache *pc, struct MenuAnim *anims)
+//
+// Shows an instructions page.  The first time (or after a resize), the page
+// function draws it, and the result is kept in pc.  After that, the page is
+// blitted from the cache.
+//
+// page = page number (index into intropages[]).
+// pc = cache entry for that page.
+// anims = set to the page's animations, ready to run.
+//
+// Returns: number of animations in anims.
+//
+int show_intro_page(int page, struct PageCache *pc, struct MenuAnim *anims) {
+    lock_ncurses();
+    if (pc->pad != NULL && (pc->rows != LINES || pc->cols != COLS)) {  // Resized since
+        delwin(pc->pad);
+        pc->pad = NULL;
+    }
+    if (pc->pad != NULL) {
+        blit_page(pc->pad);
+        unlock_ncurses();
+    } else {
+        unlock_ncurses();
+        pc->animcount = (*intropages[page])(page, pc->anims);
+        lock_ncurses();
+        pc->rows = LINES;
+        pc->cols = COLS;
+        if ((pc->pad = newpad(LINES, COLS)) == NULL) {
+            restore_terminal();
+            error_at_line(-1, 0, __FILE__, __LINE__, "Unable to create pad for instructions page %d.", page);
+        }
+        copywin(stdscr, pc->pad, 0, 0, 0, 0, LINES - 1, COLS - 1, FALSE);
+        unlock_ncurses();
+    }
+
+    memcpy(anims, pc->anims, pc->animcount * sizeof(struct MenuAnim));
+    return pc->animcount;
+}
+
+//=========================
+// void display_intro(int moles, int gametime)
+//
+// Shows introduction, rules, etc.
+//
+// Locks curses_mutex out of an abundance of caution. Display_thread is not
+// even running yet, when this function ir called.  Locking the mutex is just
+// done to prevent problems if future updates change this. 
+void display_intro(int moles, int gametime) {
+    struct PageCache pagecache[sizeof(intropages) / sizeof(intropages[0])];
+    struct MenuAnim anims[MENUANIMMAX];
+    char key;
+    int i;
+
+    memset(pagecache, 0, sizeof(pagecache));
+    clear_input_buffer();
+    intro_splashscreen();
+    key = '\0';
+    int playselected = 0;
+    while (! playselected) {
+        if (key == '\0') {
+            key = menu_tick_loop(NULL, 0, 0);
+        }
+        switch(toupper(key)) {
+            case 'I': {
+                int page = 0;
+                while (! playselected) {
+                    int count = show_intro_page(page, &pagecache[page], anims);
+                    key = menu_tick_loop(anims, count, 0);
+                    switch (toupper(key)) {
+                        case 'N': { // Next page
+                            if (page < sizeof(intropages) / sizeof(intropages[0]) -1) {
+                                ++page;
+                            }
+                        } break;
+
+                        case 'P': { // Prev page
+                            if (page > 0) {
+                                --page;
+                            }
+                        } break;
+
+                        case 'S': { // Start Game
+                            playselected = 1; 
+                        } break;
+                    }
+                }
+            } break;
+
+            case 'P': {
+                playselected = 1; // Start the game
+            } break;
+        }
+        key = '\0';
+    }
+
+    lock_ncurses();
+    for (i = 0; i < sizeof(pagecache) / sizeof(pagecache[0]); i++) {
+        if (pagecache[i].pad != NULL) {
+            delwin(pagecache[i].pad);
+        }
+    }
+    unlock_ncurses();
+}
+
+//====================================================
+//void display_countdown(int steps, long stepmsec)
+//
+// Displays a brief countdown so player can get ready.
+//
+// steps = number to count down from.
+// stepmsec = each number is shown for stepmsec, then blanked for stepmsec.
+//
+void display_countdown(int steps, long stepmsec) {
+    int row = 8;
+    int col = 32;
+    struct timespec sleeptime; 
+    sleeptime.tv_sec = stepmsec / 1000;
+    sleeptime.tv_nsec = stepmsec % 1000 * MSEC;
+    lock_ncurses();
+    clear();
+    mvprintw(row, col, "===============");
+    mvprintw(row+1, col, "GAME STARTS IN:");
+    mvprintw(row+5, col, "===============");
+    refresh();
+    unlock_ncurses();
+
+    int i;
+    for (i=steps; i>0; i--) {
+        lock_ncurses();
+        mvprintw(row+2,col+5,"+---+");
+        mvprintw(row+3,col+5,"| %d |", i);
+        mvprintw(row+4,col+5,"+---+");
+        refresh();
+        unlock_ncurses();
+        nanosleep(&sleeptime, NULL);
+        lock_ncurses();
+        mvprintw(row+2,col+5,"     ");
+        mvprintw(row+3,col+5,"  %d  ", i);
+        mvprintw(row+4,col+5,"     ");
+        refresh();
+        unlock_ncurses();
+        nanosleep(&sleeptime, NULL);
+    }
+ }
+
+//===========================
+//void display_gameover(void)
+//
+// Displays the GAME OVER message
+// (and, with two players, who won)
+//
+void display_gameover() {
+    int row = 13;
+    int col = 53;
+
+    lock_ncurses();
+    mvprintw(row, col, "===============");
+    mvprintw(row+1, col, "   GAME OVER");
+    mvprintw(row+2, col, "===============");
+    mvprintw(row+3, col, " Press any key");
+    if (players > 1) {  // (The HUD above has their scores)
+        int p1 = playerlogs[0].total, p2 = playerlogs[1].total;
+        if (p1 == p2) {
+            mvprintw(row+4, col, "     DRAW");
+        } else {
+            mvprintw(row+4, col, " PLAYER %d WINS", p1 > p2 ? 1 : 2);
+        }
+    }
+    if (heatmap) {  // The holes already show it. Add a key, and the hole that needs work.
+        int i, worst = -1, worstmissed = 0;
+        long whacks = 0, reactmsec = 0;
+        for (i = 0; i < moleholes; i++) {
+            struct HoleStats *hs = &holestats[i];
+            int missed = hs->results[ESCAPE] + hs->results[SCAREDOFF];
+            if (missed > worstmissed) {
+                worst = i;
+                worstmissed = missed;
+            }
+            whacks += hs->results[WHACK];
+            reactmsec += hs->reactmsec;
+        }
+        mvprintw(row+5, col, "Heatmap: W whacked,");
+        mvprintw(row+6, col, "M missed, F misfired,");
+        mvprintw(row+7, col, "# share missed");
+        if (worst >= 0) {
+            mvprintw(row+8, col, "Most missed: %c (%d)", keymap_read_lock()->keys[0][worst], worstmissed);
+            keymap_read_unlock();
+        }
+        if (whacks > 0) {
+            mvprintw(row+9, col, "Avg whack: %ld ms", reactmsec / whacks);
+        }
+    }
+    refresh();
+    unlock_ncurses();
+
+    struct MenuAnim blink = {GAMEOVERBLINK, 0, 0, {0, 0}, 0};
+    menu_tick_loop(&blink, 1, 0);  // until a key is pressed
+
+    clear_input_buffer();
+ }
+
+//=====================================================================================
+// WINDOW *render_score_page(int page, int pages, int pagesize, int gamescore, int moles)
+//
+// Renders one page of the score sheet (heading, score lines, and footer)
+// into a new pad, for display_score_sheet().
+//
+// page = page number (zero based), of pages.
+// pagesize = score lines per page.
+//
+// Takes the score and ncurses mutexes.
+//
+// Returns: the pad. The caller deletes it.
+//
+#define EXTRALINES      12  // For headers and footers in scoresheet pad
+#define DATALINESTART   9   // Number of lines in page heading
+WINDOW *render_score_page(int page, int pages, int pagesize, int gamescore, int moles) {
+    WINDOW *pad;
+    int i, linenum;
+    int startat = page * pagesize;
+
+    lock_scores();
+    lock_ncurses();
+    if ((pad = newpad(LINES, COLS)) == NULL) {
+        restore_terminal();
+        error_at_line(-1, 0, __FILE__, __LINE__, "Unable to create pad for score sheet page %d.", page);
+    }
+    mvwprintw(pad, 0,0,"===================");
+    mvwprintw(pad, 1,0,"Your score was %d", gamescore);
+    mvwprintw(pad, 2,0,moles == 1 ? "for 1 mole" : "for %d moles",moles);
+    mvwprintw(pad, 3,0,"===================");
+    mvwprintw(pad, 4,35, "Score Sheet:");
+    mvwprintw(pad, 6,0,"\t\t\t\t\t\t\tBonus\tRunning");
+    mvwprintw(pad, 7,0,"\tMole\tHole\tEvent\t\t\tScore\tScore\tTotal");
+    mvwprintw(pad, 1,27,"Thank you for playing Whack-A-Mole %s", VERSTRING);
+
+    for (i=startat, linenum=DATALINESTART; i<numscores && i<startat+pagesize; i++, linenum++) {
+        struct ScoreSheetRecord *p = &scores[i];
+        mvwprintw(pad, linenum, 0, p->mole <= 0 ? "\t\t" : "\t%d\t",p->mole);
+        wprintw(pad, p->hole == -1 ? "\t" : "%c\t",holekeys->keys[0][p->hole]);  // (Doesn't rotate now)
+        wprintw(pad, p->playresult == WHACK ? "Whacked Mole!\t\t" : p->playresult == ESCAPE ? "Mole Escaped\t\t" : p->playresult == MISFIRE ? "Bad Aim\t\t\t" : p->playresult == TOOSOON ? "Hit Too Soon\t\t" : "Mole Scared Away\t");
+        wprintw(pad, p->missedscore + p->whackedscore + p->penaltyscore == 0 ? "\t" : "% 3d\t", p->missedscore + p->whackedscore + p->penaltyscore);
+        //
+        // only display bonus if mole was whacked (bonus could be 0)
+        wprintw(pad, p->bonusscore == 0 ? "\t" : "%d\t", p->bonusscore);
+        wprintw(pad, "%d", p->startscore + p->missedscore + p->whackedscore + p->bonusscore + p->penaltyscore);
+    }
+
+    if (pages > 1) {
+        mvwprintw(pad, LINES-1,0,"[Page %d/%d]\tCommand: (Q)uit, (1)st pg, (P)rev pg, (N)ext pg, (L)ast pg.", page+1, pages);
+    } else {
+        mvwprintw(pad, LINES-1,0,"Press Q to quit.");
+    }
+    unlock_ncurses();
+    unlock_scores();
+
+    return pad;
+}
+
+//=================================================================
+// void display_score_sheet(int gamescore, int moles, int gametime)
+//
+// gamescore = total score for entire game
+//
+// Shows game results and any other closing thoughts.
+// 
+// Uses ncurses for navigable paginated display.  Each page is rendered once
+// into a pad (see render_score_page()) and blitted when shown.  The page
+// asked for is rendered on the spot if need be.  The rest are rendered one
+// at a time while no key is waiting, so on a long sheet they are usually
+// ready before the player gets to them.
+//
+// Locks curses_mutex out of an abundance of caution. Display_thread should
+// be dead (or at least no longer actively outputting) when this is called.
+// Locking the mutex is just done to prevent problems if future updates change
+// that behavior.
+//
+void display_score_sheet (int gamescore, int moles, int gametime){
+    int i;
+    int molenum = 1;
+
+    // Mole numbers in scores[] were assigned at thread creation, which may result in
+    // them being out of numerical order within the array.  Here, we reassign them
+    // so as not to confuse the player.
+    for (i=0; i<numscores; i++) {
+        if (scores[i].mole > 0) {
+            scores[i].mole = molenum++;
+        }
+    }
+
+    // Paginated score display
+    int pagesize = (LINES - EXTRALINES);
+    if (pagesize < 1) pagesize = 1;
+    int pages = (numscores + (pagesize -1))/ pagesize;
+    if (pages < 1) pages = 1;
+    WINDOW **pagepads = calloc(pages, sizeof(WINDOW *));
+    if (pagepads == NULL) {
+        restore_terminal();
+        error_at_line(-1, errno, __FILE__, __LINE__, "Unable to allocate score sheet pages.");
+    }
+    int currentpage = 0;
+    int nextrender = 0;  // Next page to render ahead
+    char cmd = '1';
+
+    while(toupper(cmd) != 'Q') {
+        if (pagepads[currentpage] == NULL) {
+            pagepads[currentpage] = render_score_page(currentpage, pages, pagesize, gamescore, moles);
+        }
+        lock_ncurses();
+        blit_page(pagepads[currentpage]);
+        unlock_ncurses();
+
+        // Render the remaining pages until a key is pressed
+        cmd = '\0';
+        while (cmd == '\0') {
+            while (nextrender < pages && pagepads[nextrender] != NULL) {
+                ++nextrender;
+            }
+            if (nextrender == pages) {
+                cmd = waitforkey(NULL);
+            } else {
+                long nowait = 0L;
+                if ((cmd = waitforkey(&nowait)) == '\0') {
+                    pagepads[nextrender] = render_score_page(nextrender, pages, pagesize, gamescore, moles);
+                }
+            }
+        }
+        cmd = toupper(cmd);
+        switch (cmd) {
+            case '1': {
+               currentpage = 0; 
+            } break;
+
+            case 'P': {
+                if (--currentpage < 0) currentpage = 0;
+            } break;
+
+            case 'N': {
+                if (++currentpage >= pages) currentpage = pages - 1;
+            } break;
+
+            case 'L': {
+                currentpage = pages - 1;
+            } break;
+        }
+    }
+
+    lock_ncurses();
+    for (i = 0; i < pages; i++) {
+        if (pagepads[i] != NULL) {
+            delwin(pagepads[i]);
+        }
+    }
+    unlock_ncurses();
+    free(pagepads);
+}
+
+//=================================================================
+// int set_hole_sprite(int hole, const struct HoleSprite *sprite)
+//
+// Remembers what a hole is showing, so redraw_playfield() can put it back
+// after a resize or scroll.  For a hole outside the viewport, that is all
+// that happens (besides updating the edge indicators): the caller skips
+// drawing it.
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: 1 = hole is visible and should be drawn, 0 = off screen.
+//
+int set_hole_sprite(int hole, const struct HoleSprite *sprite) {
+    int wasactive = (holesprites[hole].kind != 0);
+
+    holesprites[hole] = *sprite;
+    if (holescreencoords[hole].visible) {
+        return 1;
+    }
+    if ((sprite->kind != 0) != wasactive) {
+        count_offscreen(hole, wasactive ? -1 : 1);
+        show_edge_indicators();
+    }
+    return 0;
+}
+
+//==================================================
+// void show_mole(int hole, int maxholes, int level)
+//
+// Displays one mole within one hole at a specified level.
+// Doesn't actually call refresh() to draw screen. Caller uses screen_update()
+// or screen_flush() once it has drawn everything for the frame.
+//
+// hole: Hole number to show mole in (zero based)
+//
+// maxholes: Total holes. Must be moleholes (or 0, meaning the same).
+//
+// level: 0 = No mole
+//        1-4 = Partial moles
+//        5 = Full mole
+//
+// This function does NOT lock the curses_mutex because this is a low level
+// function and will have no way of knowing which other mutex locks may
+// be in effect. That would be bad, since this program relies on mutexes 
+// being locked in a defined order to prevent deadlocks.
+// The calling function definitely should have a lock in effect when
+// it calls this function.
+//
+int moleheight = sizeof(asciimole) / sizeof(char*); // Lines per mole
+
+void show_mole(int hole, int maxholes, int level) {
+    struct HoleScreenCoords *hsc = &holescreencoords[hole];
+
+    if ((maxholes == 0 || maxholes == moleholes) && hole >= 0 && hole < LAYOUTROWS * LAYOUTCOLS) {
+        int i;
+        struct HoleSprite hs = {level > 0, level, -1, 0, 0, ""};
+        if (! set_hole_sprite(hole, &hs)) {
+            return;  // Outside the viewport
+        }
+        // First for loop blanks hole
+        for (i=0; i < moleheight; i++) {
+            screen_print(hsc->top[moleheight - 1] + i, hsc->left, "        ");
+        }
+        // level zero = clear hole, so don't paint mole
+        if (level > 0) {
+            // Second for loop paints mole
+            for (i=0; i < hsc->height[level-1]; i++) {
+                screen_print(hsc->top[level-1] + i, hsc->left, "%.*s", SPRITEWIDTH, asciimole[i]);
+            }
+        }
+    } else {
+        restore_terminal();
+        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", maxholes);
+    }
+}
+
+//=========================================================================================
+// void show_result(int hole, int maxholes, enum PlayResult result, int score1, int score2, char *txt)
+//
+// Shows play result on playfield in place of mole.  Related to show_mole() function
+// above, and re-uses its holescreencoords data for screen positioning.
+//
+// hole: Hole number to show result in (zero based)
+//
+// maxholes: Total holes. Must be moleholes (or 0, meaning the same).
+//
+// result: Game play result: WHACK, ESCAPE, MISFIRE, TOOSOON, SCAREDOFF (or -1 to blank and display txt)
+//
+// score1: Score for WHACK, penalty for ESCAPE.  If score1 is zero,
+//         the ascii graphic will be displayed. Otherwise, the score graphic
+//         (see char *[]'s below)
+//
+// score2: Bonus score for WHACK, ignored for others
+//
+// txt: Text msg to display when PlayResult == -1
+//
+// Like show_mole(), doesn't call refresh().
+//
+// This function does NOT lock the curses_mutex because this is a low level
+// function and will have no way of knowing which other mutex locks may
+// be in effect. That would be bad, since this program relies on mutexes 
+// being locked in a defined order to prevent deadlocks.
+// The calling function definitely should have a lock in effect when
+// it calls this function.
+//
+char scorewhackpat[5][9] = {"        ",
+                           " WHACK! ",
+                           "        ",
+                           "Score:#1",     // #1 is macro that expands to score1
+                           "Bonus:#2" };   // #2 is macro that expands to score2
+char scorewhackbuf[5][9];
+char *scorewhack[]={(char *)&scorewhackbuf[0],(char *)&scorewhackbuf[1],(char *)&scorewhackbuf[2],(char *)&scorewhackbuf[3],(char *)&scorewhackbuf[4]};
+
+char scoreescapebuf[5][9];
+char scoreescapepat[5][9] ={"        ",
+                           " ESCAPE ",
+                           "        ",      
+                           " Score  ",
+                           "  #1    " };   // #1 is macro that expands to score1
+char *scoreescape[]={(char *)&scoreescapebuf[0],(char *)&scoreescapebuf[1],(char *)&scoreescapebuf[2],(char *)&scoreescapebuf[3],(char *)&scoreescapebuf[4]};
+
+char asciiblankbuf[5][9] = {  "        ",
+                           "        ",
+                           "        ",
+                           "        ",
+                           "        " };
+char *asciiblank[]={(char *)&asciiblankbuf[0],(char *)&asciiblankbuf[1],(char *)&asciiblankbuf[2],(char *)&asciiblankbuf[3],(char *)&asciiblankbuf[4]};
+
+void show_result(int hole, int maxholes, enum PlayResult result, int score1, int score2, char *txt) {
+    struct HoleScreenCoords *hsc = &holescreencoords[hole];
+    const char **ascii;
+    int height;
+
+    if (score1 < -99 || score1 > 99 || score2 <- 99 || score2 > 99) {
+        restore_terminal();
+        error_at_line(-1, 0, __FILE__, __LINE__, "Score (%d/%d) outside range.", score1, score2);
+    }
+
+    if ((maxholes == 0 || maxholes == moleholes) && hole >= 0 && hole < LAYOUTROWS * LAYOUTCOLS) {
+        struct HoleSprite hs = {((int)result == -1 && (txt == NULL || *txt == '\0')) ? 0 : 2, 0, result, score1, score2, ""};
+        snprintf(hs.txt, sizeof(hs.txt), "%s", txt != NULL ? txt : "");
+        if (! set_hole_sprite(hole, &hs)) {
+            return;  // Outside the viewport
+        }
+
+        switch (result) {
+            case WHACK: {
+                if (score1 == 0) {
+                    ascii = asciiwhack;
+                    height = sizeof(asciiwhack) / sizeof(char*); // Lines in ascii graphic
+                } else {
+                    int i;
+                    ascii = (const char **)scorewhack;
+                    height = sizeof(scorewhack)/sizeof(scorewhack[0]);// Lines in ascii graphic
+
+                    memcpy(scorewhackbuf, scorewhackpat, sizeof(scorewhackbuf));
+                    for (i=0; i<height; i++) {
+                        char *c;
+                        c = strstr(scorewhack[i],"#1");
+                        if (c != NULL) {
+                            sprintf(c, "%d", score1);
+                        }
+                        c = strstr(scorewhack[i],"#2");
+                        if (c != NULL) {
+                            sprintf(c, "%d", score2);
+                        }
+                    }
+                }
+            break; }
+
+            case ESCAPE: {
+                if (score1 == 0) {
+                    ascii = asciiescape;
+                    height = sizeof(asciiescape) / sizeof(char*); // Lines in ascii graphic
+                } else {
+                    int i;
+                    ascii = (const char **)scoreescape;
+                    height = sizeof(scoreescape)/sizeof(scoreescape[0]);// Lines in ascii graphic
+
+                    memcpy(scoreescapebuf, scoreescapepat, sizeof(scoreescapebuf));
+                    for (i=0; i<height; i++) {
+                        char *c;
+                        c = strstr(scoreescape[i],"#1");
+                        if (c != NULL) {
+                            sprintf(c, "%d ", score1);
+                        }
+                    }
+                }
+            break; }
+
+            case MISFIRE: 
+            case TOOSOON: {
+                ascii = asciimisfire;
+                height = sizeof(asciimisfire) / sizeof(char*); // Lines in ascii graphic
+            break; }
+
+            case SCAREDOFF: {
+                ascii = asciiscared;
+                height = sizeof(asciiscared) / sizeof(char*); // Lines in ascii graphic
+            break; }
+
+            default: {
+                sprintf(asciiblankbuf[2], "%8.8s",txt);
+                ascii = (const char **)asciiblank;
+                height = sizeof(asciiblank) / sizeof(char*); // Lines in ascii graphic
+            } break;
+        }
+
+        int i;
+        for (i=0; i < height; i++) {
+            screen_print(hsc->top[height - 1] + i, hsc->left, "%.*s", SPRITEWIDTH, ascii[i]);
+        }
+    } else {
+        restore_terminal();
+        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", maxholes);
+    }
+}
+
+//=========================================================================================
+// void display_empty_playfield(enum GameMode gamemode, int elements, int holes, char *msg)
+//
+// Shows the play field including holes, welcome message, score area, etc.
+//
+// gamemode: BASEGAME = Fixed number of moles
+//           TIMEDGAME = Fixed Duration
+//
+// holes: Total holes. Must match the current layout (MOLEHOLES in menus,
+//        moleholes in play).  Only holes inside the viewport are drawn.
+//
+// msg: Welcome message
+//
+// Positions come from the current layout (see compute_layout()).
+//
+// Doesn't call refresh(). Caller flushes once it has drawn the rest of the page.
+//
+// This function does NOT lock the curses_mutex because this is a low level
+// function and will have no way of knowing which other mutex locks may
+// be in effect. That would be bad, since this program relies on mutexes 
+// being locked in a defined order to prevent deadlocks.
+// The calling function definitely should have a lock in effect when
+// it calls this function.
+//
+void display_empty_playfield(enum GameMode gamemode, int elements, int holes, char *msg) {
+    screen_clear();
+    if (elements & DISP_ELE_VERS) {
+        if (layout.fits) {
+            screen_print(0,0,"Whack-A-Mole %s ",VERSTRING);
+        } else {
+            screen_print(0,0,"Terminal too small (%dx%d) ",layout.cols,layout.rows);
+        }
+    }
+
+    if (holes != LAYOUTROWS * LAYOUTCOLS) {
+        restore_terminal();
+        error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported number of mole holes (%d).", holes);
+    }
+
+    if (elements & DISP_ELE_HOLES) {
+        const struct Keymap *km = keymap_read_lock();
+        int r, c, j;
+        memset(holesprites, 0, sizeof(holesprites));  // All holes start out empty
+        memset(layout.offscreen, 0, sizeof(layout.offscreen));
+        for (r = layout.viewtop; r < layout.viewtop + layout.viewrows; r++) {
+            for (c = layout.viewleft; c < layout.viewleft + layout.viewcols; c++) {
+                int i = r * LAYOUTCOLS + c;
+                struct HoleScreenCoords *hsc = &holescreencoords[i];
+                for (j = 0; j < HOLEHEIGHT; j++) {
+                    if (j == 1 && (elements & DISP_ELE_KEYS) && players > 1) {  // Player 2's key on the left
+                        screen_print(hsc->frametop + j, hsc->frameleft, "%c%.10s%c", km->keys[1][i], holeframe[j] + 1, km->keys[0][i]);
+                    } else if (j == 1 && (elements & DISP_ELE_KEYS)) {
+                        screen_print(hsc->frametop + j, hsc->frameleft, "%.11s%c", holeframe[j], km->keys[0][i]);
+                    } else {
+                        screen_print(hsc->frametop + j, hsc->frameleft, "%.*s", HOLEWIDTH, holeframe[j]);
+                    }
+                }
+                if (heatmap && (elements & DISP_ELE_HEAT)) {
+                    show_hole_heat(i);
+                }
+            }
+        }
+        keymap_read_unlock();
+        show_edge_indicators();
+    }
+
+    if (elements & DISP_ELE_MSG && msg != NULL && layout.msgrow >= 0) {
+        screen_print(layout.msgrow, layout.msgcol - strlen(msg)/2, "%s", msg);
+    }
+
+    if (elements & DISP_ELE_STAT) {
+        if (layout.hudframe) {
+            screen_print(layout.scorerow - 1, layout.scorecol, "===============");
+            screen_print(layout.scorerow + 1, layout.scorecol, "===============");
+        }
+        show_hud_score();
+
+        if (gamemode == BASEGAME) {
+            screen_print(layout.molesrow, layout.molescol, "   MOLES:   "); 
+        } else {
+            screen_print(layout.molesrow, layout.molescol, "   TIME:    "); 
+            restore_terminal();
+            error_at_line(-1, 0, __FILE__, __LINE__, "Unsupported game mode.");
+        }
+    }
+}
+
+//=======================================
+// int lock_frame(enum FrameClass fc)
+//
+// Locks the ncurses mutex to draw one animation frame, unless the frame
+// is cosmetic and there is something more important to do:
+//   - a feedback frame is waiting for the mutex (it goes first, and the
+//     cosmetic frame is skipped rather than queued behind it), or
+//   - the terminal is behind, so drawing more would only add to the
+//     backlog: more than FRAMEDROPQUEUE bytes of output are still queued
+//     (TIOCOUTQ, which only serial lines report), or a screen flush in the
+//     last second took more than FRAMEDROPLAG (a pty's writes block).
+// Dropped frames are counted in framestats[].  A dropped frame leaves the
+// hole showing the previous one, which the next frame replaces.
+//
+// The calling function must not hold the ncurses mutex, and unlocks it
+// after drawing if (and only if) this returns 1.
+//
+// Returns: 1 = draw the frame (ncurses mutex held), 0 = frame dropped.
+//
+int lock_frame(enum FrameClass fc) {
+    if (fc == FRAME_COSMETIC) {
+        int queued = 0;
+        if (feedbackwaiting > 0) {
+            __sync_fetch_and_add(&framestats[fc].preempted, 1);
+            log_event("cosmetic frame dropped: feedback frame waiting");
+            return 0;
+        }
+        if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) == 0 && queued > FRAMEDROPQUEUE) {
+            __sync_fetch_and_add(&framestats[fc].backlogged, 1);
+            log_event("cosmetic frame dropped: %ld bytes queued", queued);
+            return 0;
+        }
+        lock_ncurses();
+        if (flushmsec > FRAMEDROPLAG) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (elapsed_msec(&flushdone, &now) < 1000) {
+                unlock_ncurses();
+                __sync_fetch_and_add(&framestats[fc].backlogged, 1);
+                return 0;
+            }
+        }
+    } else {
+        __sync_fetch_and_add(&feedbackwaiting, 1);
+        lock_ncurses();
+        __sync_fetch_and_sub(&feedbackwaiting, 1);
+    }
+    ++framestats[fc].drawn;
+    return 1;
+}
+
+//=================================
+//void *animation_thread(void *arg)
+//
+// arg = pointer to AnimationSpec structure. (See struct tag for more info)
+// 
+// These animations are code driven. A data driven animation would be
+// more flexible, but not worth it at this point as there are only two
+// animations right now.
+//
+void *animation_thread(void *arg) {
+    struct AnimationSpec *aspec = (struct AnimationSpec *)arg;
+    struct timespec sleeptime = {0, 0}; 
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-Animation");
+ #endif
+    log_event("animation type %ld start: hole %ld mole %ld, %ld ms", aspec->animationtype, aspec->hole, aspec->mole, aspec->duration);
+    perf_thread_begin();
+
+    switch (aspec->animationtype) {
+        case ANIMHIDING: {
+            // The mole is hiding...
+            // Animation behavior: 1) 200msec up
+            //                     2) 200msec 1/3 chance up, 2/3 chance down
+            //                     3) 200msec 1/3 chance up, 2/3 chance down
+            //                     (so either short, medium or long single pop
+            //                     or double pop)
+            //                     4) Random down time from 800 to 2000 msec
+            //                     Above steps repead until duration expires.
+
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-Hiding");
+ #endif
+            lock_molecomm();
+            aspec->synccount = 1;  // Indicate animation running
+            unlock_molecomm();
+
+            int timeremaining = aspec->duration;
+            int level;
+            while (timeremaining > 0) {
+                if (timeremaining < 600) {  // < 600msec left?
+                    sleeptime.tv_sec = 0;
+                    sleeptime.tv_nsec = timeremaining * MSEC;
+                    nanosleep(&sleeptime, NULL);
+                    break;
+                } else {
+                    disable_thread_cancel(); // don't get cancelled while holding a lock
+                    if (lock_frame(FRAME_COSMETIC)) {
+                        show_mole(aspec->hole, aspec->numholes, 1); // show the ears
+                        screen_update();
+                        unlock_ncurses();
+                    }
+                    enable_thread_cancel();
+                    // Ears up for 200 msec
+                    sleeptime.tv_sec = 0;
+                    sleeptime.tv_nsec = 200*MSEC; 
+                    nanosleep(&sleeptime, NULL);
+
+                    disable_thread_cancel(); // don't get cancelled while holding a lock
+                    level = tsrandom()%3?0:1; // 1/3 chance for extended bounce
+                    if (lock_frame(level ? FRAME_COSMETIC : FRAME_FEEDBACK)) { // (Never drop clearing the hole)
+                        show_mole(aspec->hole, aspec->numholes, level);
+                        screen_update();
+                        unlock_ncurses();
+                    }
+                    enable_thread_cancel();
+                    // Ears up for 200 msec
+                    sleeptime.tv_sec = 0;
+                    sleeptime.tv_nsec = 200*MSEC; 
+                    nanosleep(&sleeptime, NULL);
+
+                    disable_thread_cancel(); // don't get cancelled while holding a lock
+                    level = tsrandom()%3?0:1; // 1/3 chance for extended or double bounce
+                    if (lock_frame(level ? FRAME_COSMETIC : FRAME_FEEDBACK)) { // (Never drop clearing the hole)
+                        show_mole(aspec->hole, aspec->numholes, level);
+                        screen_update();
+                        unlock_ncurses();
+                    }
+                    enable_thread_cancel();
+                    // Ears up for 200 msec
+                    sleeptime.tv_sec = 0;
+                    sleeptime.tv_nsec = 200*MSEC; 
+                    nanosleep(&sleeptime, NULL);
+
+                    timeremaining -= 600;
+                }
+
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+                show_mole(aspec->hole, aspec->numholes, 0); // blank hole
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                long targettime;
+                targettime = tsrandom();
+                targettime = targettime % 1200 + 800;
+                if (targettime > timeremaining) {
+                    targettime = timeremaining;
+                }
+                sleeptime.tv_sec = targettime / 1000; 
+                sleeptime.tv_nsec = (targettime % 1000) * MSEC; 
+                nanosleep(&sleeptime, NULL);
+                timeremaining -= targettime;
+            }
+            lock_molecomm();
+            aspec->synccount = 2;  // Indicate animation complete
+            unlock_molecomm();
+        } break;
+
+        case ANIMPOPUP: {
+            // The mole is up!
+            // Animation behavior: 1) Mole rises 5 steps. calibration.framemsec (30msec
+            //                        on a fast terminal) after each. (150msec total)
+            //                        This counts as part of the initial stage when the
+            //                        player is eligible for "lightning reflexes" bonus.
+            //                     2) Mole stays up at level 5 for (duration/5) - 5 steps.
+            //                     3) Mole drops one level each (duration/5) msec.
+
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-PopUp");
+ #endif
+            int synccount = 0;
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_molecomm();
+            aspec->synccount = ++synccount;
+            unlock_molecomm();
+            enable_thread_cancel();
+            int leveltime = aspec->duration / 5; // amount of time to keep mole at each level
+            int framemsec = calibration.framemsec;
+            if (5 * framemsec > leveltime) {  // Rise within the first level, so the pop-up lasts no
+                framemsec = leveltime / 5;    // longer than the mole's up time however slow the terminal
+            }
+            sleeptime.tv_sec = 0;
+            sleeptime.tv_nsec = framemsec * MSEC; 
+            int i;
+            for (i=1; i<=5; i++) {
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+                show_mole(aspec->hole, aspec->numholes, i); // Mole popping up
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                nanosleep(&sleeptime, NULL);
+            }
+
+            int holdtime = leveltime - 5 * framemsec;  // less time spent rising
+            sleeptime.tv_sec = holdtime / 1000;
+            sleeptime.tv_nsec = holdtime % 1000 * 1000000L;
+
+            nanosleep(&sleeptime, NULL);
+
+            sleeptime.tv_sec = leveltime / 1000;
+            sleeptime.tv_nsec = (leveltime % 1000) * 1000000L;
+            for (i=4; i>=1; i--) {
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                if (lock_frame(FRAME_COSMETIC)) {
+                    show_mole(aspec->hole, aspec->numholes, i); // Mole going back down
+                    screen_update();
+                    unlock_ncurses();
+                }
+                lock_molecomm();
+                aspec->synccount = ++synccount; // synccounts 2-5
+                unlock_molecomm();
+                enable_thread_cancel();
+
+                nanosleep(&sleeptime, NULL);
+            }
+
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_molecomm();
+            aspec->synccount = ++synccount; 
+            unlock_molecomm();
+            lock_frame(FRAME_FEEDBACK);
+            show_mole(aspec->hole, aspec->numholes, 0); // Blank out the hole
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+        } break;
+
+        case ANIMWHACKED: {
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-Whack");
+ #endif
+            lock_molecomm();
+            aspec->synccount = 1;  // Indicate animation running
+            unlock_molecomm();
+            // Frame 1
+            const int frame1time = 500; //msec
+            sleeptime.tv_sec = 0;
+            sleeptime.tv_nsec = frame1time * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, WHACK, 0, 0, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            // Frame 2
+            sleeptime.tv_sec = (int)((aspec->duration - frame1time) / 1000L);
+            sleeptime.tv_nsec = (long)((aspec->duration - frame1time) % 1000L) * MSEC;
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, WHACK, aspec->score1, aspec->score2, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            lock_molecomm();
+            aspec->synccount = 2;  // Indicate animation progressing
+            unlock_molecomm();
+            nanosleep(&sleeptime, NULL);
+
+            // Blank after animation
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            lock_molecomm();
+            aspec->synccount = 3;  // Indicate animation complete
+            unlock_molecomm();
+        } break;
+
+        case ANIMESCAPED: {
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-Escape");
+ #endif
+            lock_molecomm();
+            aspec->synccount = 1;  // Indicate animation running
+            unlock_molecomm();
+            // Blank at start (makes it look better)
+            const int blanktime = 250; //msec 
+            sleeptime.tv_sec = 0;
+            sleeptime.tv_nsec = blanktime * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            // Frame 1
+            const int frame1time = 500; //msec 
+            sleeptime.tv_sec = 0;
+            sleeptime.tv_nsec = frame1time * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, ESCAPE, 0, 0, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            // Frame 2
+            sleeptime.tv_sec = (int)((aspec->duration - frame1time - blanktime) / 1000L);
+            sleeptime.tv_nsec = (long)((aspec->duration - frame1time - blanktime) % 1000L) * MSEC;
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, ESCAPE, aspec->score1, aspec->score2, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            lock_molecomm();
+            aspec->synccount = 2;  // Indicate animation progressing
+            unlock_molecomm();
+            nanosleep(&sleeptime, NULL);
+
+            // Blank after animation
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            lock_molecomm();
+            aspec->synccount = 3;  // Indicate animation complete
+            unlock_molecomm();
+        } break;
+
+        case ANIMMISFIRE: {  // Shows misfire animation on hole not occupied by mole
+            // Currently unimplemented.  display_thread handles "misfire" frame directly.
+        } break;
+
+        case ANIMMISFIRESCARED: { // Shows misfire on hole where mole was hiding
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-Scare1");
+ #endif
+            lock_molecomm();
+            aspec->synccount = 1;  // Indicate animation running
+            unlock_molecomm();
+
+            int frametime = aspec->duration / 4;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, MISFIRE, 0, 0, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            frametime = aspec->duration / 20;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            int i;
+            for (i=0; i<3; i++) {
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+
+                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                nanosleep(&sleeptime, NULL);
+
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+
+                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                nanosleep(&sleeptime, NULL);
+            }
+
+            frametime = aspec->duration / 4;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, SCAREDOFF, 0, 0, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            frametime = aspec->duration * 2 / 10;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            // Blank after animation
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            lock_molecomm();
+            aspec->synccount = 2;  // Indicate animation complete
+            unlock_molecomm();
+        } break;
+
+        case ANIMUPSCARED: { // UP mole scared off by missfire on other hole.
+ #if defined(debug) && defined(_GNU_SOURCE)
+            pthread_setname_np(pthread_self(), "WAM-Anim-Scare2");
+ #endif
+            lock_molecomm();
+            aspec->synccount = 1;  // Indicate animation running
+            unlock_molecomm();
+
+            int frametime = aspec->duration / 20;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            int i;
+            for (i=0; i<3; i++) {
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+
+                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                nanosleep(&sleeptime, NULL);
+
+                disable_thread_cancel(); // don't get cancelled while holding a lock
+                lock_frame(FRAME_FEEDBACK);
+
+                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");
+                screen_update();
+                unlock_ncurses();
+                enable_thread_cancel();
+                nanosleep(&sleeptime, NULL);
+            }
+
+            frametime = aspec->duration * 5 / 10;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, SCAREDOFF, 0, 0, NULL);
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            frametime = aspec->duration * 2 / 10;
+            sleeptime.tv_sec = frametime / 1000;
+            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+            nanosleep(&sleeptime, NULL);
+
+            // Blank after animation
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_frame(FRAME_FEEDBACK);
+
+            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+
+            screen_update();
+            unlock_ncurses();
+            enable_thread_cancel();
+
+            lock_molecomm();
+            aspec->synccount = 2;  // Indicate animation complete
+            unlock_molecomm();
+        } break;
+
+        default: {
+            // intentionally left empty
+        };
+    }
+    return NULL;
+}
+
+//================================
+// void *display_thread(void *arg)
+// Display management thread. 
+//
+// Looks for changes to molecomm and scores buffers and updates display accordingly.
+// Ack's status changes back to mole_thread.
+//
+// Also looks for new entries in the scores buffer and displays results.
+//
+// This function makes extensive use of the ncurses_mutex to help it
+// play nice with the animation_thread.
+//
+void *display_thread(void *arg){
+    static struct {
+        int status; // 1=misfire active (displayed), 0=not
+        struct timespec timer;
+    } misfires[MAXMOLEHOLES]; // Used to track misfire display for each hole.
+    static struct {
+        int active;           // 1=animation running (or waiting to be joined)
+        pthread_t thread;
+        struct AnimationSpec spec;
+    } resultanims[MAXMOLEHOLES]; // WHACKED/ESCAPED animations. These belong to the hole
+                                 // (see hand_off_mole_hole()), so the mole's slot is
+                                 // free while they play.
+    struct MoleCommRecord newmolecomm[CONCURRENTMOLES];
+    struct MoleCommRecord oldmolecomm[CONCURRENTMOLES];
+    long eventcursor = 0;  // Our place in the game event log
+    long keymapshown = -1; // Generation of the keymap the hole labels show
+    int err;
+
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-Display");
+ #endif
+    threadrole = TR_DISPLAY;
+    perf_thread_begin();
+
+    memset(newmolecomm, 0, sizeof(newmolecomm));
+    memset(oldmolecomm, 0, sizeof(oldmolecomm));
+
+    if (! faststart) {
+        lock_ncurses();
+        screen_begin_play();
+        display_empty_playfield(BASEGAME, DISP_ELE_ALL, moleholes, "Good luck and have fun!!!");
+        screen_flush();
+        unlock_ncurses();
+        mark_startup_phase(SP_PLAYFIELD);
+
+        struct timespec sleeptime = {0, 500000000L}; // 500 msec sleep to give player a chance
+        nanosleep(&sleeptime, NULL);                 // to get ready for the moles.
+    }
+
+    if ((err = pthread_mutex_lock(&start_mtx)) != 0) {   // set up mutex for cond wait
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    }
+
+    display_thread_running = 1;
+
+    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    }
+
+    if ((err = pthread_cond_signal(&start_cond)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send start_cond signal to main thread.");
+    }
+
+    if (faststart) {
+        // main() is running the countdown.  Wait for it to finish before
+        // drawing the playfield. (The countdown gives the player time to get
+        // ready, so no extra delay is needed.)
+        if ((err = pthread_mutex_lock(&start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+        }
+
+        while (!countdown_complete) {
+            if ((err = pthread_cond_wait(&start_cond, &start_mtx)) != 0) {
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Countdown cond wait failed.");
+            }
+        }
+
+        if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock start mutex.");
+        }
+
+        lock_ncurses();
+        screen_begin_play();
+        display_empty_playfield(BASEGAME, DISP_ELE_ALL, moleholes, "Good luck and have fun!!!");
+        screen_flush();
+        unlock_ncurses();
+        mark_startup_phase(SP_PLAYFIELD);
+    }
+
+    int misfirepending = 0;  // dont allow thread to be cancelled if misfire display pending
+    int resultpending = 0;   //    ...or a result animation still needs joining
+
+    for (;;) {
+        heartbeat(TR_DISPLAY);
+        disable_thread_cancel(); // don't get cancelled while holding a lock
+        handle_resize();         // Relayout and redraw once if the window has been resized
+        int drows = __sync_lock_test_and_set(&scrollrows, 0);
+        int dcols = __sync_lock_test_and_set(&scrollcols, 0);
+        if (drows != 0 || dcols != 0) {
+            scroll_viewport(drows, dcols);
+        }
+        lock_molecomm();
+
+        // Lock and snapshot live molecomm buffer, then work from the snaphot
+        memcpy(newmolecomm, molecomm, sizeof(newmolecomm));
+
+        unlock_molecomm();
+        lock_ncurses();
+        if (molesremaining >= 0) {
+            screen_print(layout.molesrow, layout.molescol + 10, "%-4d ", molesremaining);
+        }
+        if (keymaprotate) {
+            long generation = keymap_read_lock()->generation;
+            keymap_read_unlock();
+            if (generation != keymapshown) {
+                show_hole_keys();
+                screen_update();
+                keymapshown = generation;
+            }
+        }
+        unlock_ncurses();
+
+        int i;
+        for (i=0; i<CONCURRENTMOLES; i++) { // check each mole slot
+            struct MoleCommRecord *pnew = &newmolecomm[i];
+            struct MoleCommRecord *pold = &oldmolecomm[i];
+
+            if (pnew->molestatus == pold->molestatus) continue;  // No Change
+
+            lock_molecomm();
+            switch (pnew->molestatus) {
+                case HIDING: {
+                    mark_startup_phase(SP_FIRSTHIDING);
+
+                    molecomm[i].animspec = HidingAnim;
+                    molecomm[i].animspec.hole = pnew->hole;
+                    molecomm[i].animspec.duration = pnew->duration - pnew->uptime;
+                    molecomm[i].animspec.mole = pnew->mole;
+                    molecomm[i].animcancelled = 0;
+#if defined(debug)
+                    molecomm[i].animspec.threadsn = ++threadsn;
+#endif
+
+                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                    }
+                } break;
+
+                case UP: {
+                    mark_startup_phase(SP_FIRSTUP);
+
+                    // First, join with terminated HIDING animation thread (cleanup zombie)
+
+                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
+                                                               // molecomm while we wait on joining
+                                                               // the animation thread. But without the 
+                                                               // lock, some other thread could mess
+                                                               // with it.
+                    unlock_molecomm();
+
+                    void *retval;
+                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join hiding animation thread
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d Error=%d.", i,err);
+                    }
+
+                    lock_ncurses();
+                    show_mole(molecomm[i].hole, moleholes, 0); // blank hole
+                    screen_update();
+                    unlock_ncurses();
+
+                    lock_molecomm();
+                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
+                    molecomm[i].animspec = PopupAnim;
+                    molecomm[i].animspec.hole = pnew->hole;
+                    molecomm[i].animspec.duration = pnew->uptime;
+                    molecomm[i].animspec.mole = pnew->mole;
+                    molecomm[i].animcancelled = 0;
+#if defined(debug)
+                    molecomm[i].animspec.threadsn = ++threadsn;
+#endif
+
+                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                    }
+                } break;
+
+                case WHACKED: {
+
+                    // First, join with terminated UP animation thread (cleanup zombie)
+
+                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
+                                                               // molecomm while we wait on joining
+                                                               // the animation thread. But without the 
+                                                               // lock, some other thread could mess
+                                                               // with it.
+
+                    unlock_molecomm();
+
+                    void *retval;
+
+                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join the UP animation thread
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
+                    }
+
+                    lock_ncurses();
+                    show_mole(molecomm[i].hole, moleholes, 0); // blank hole
+                    screen_update();
+                    unlock_ncurses();
+
+                    lock_molecomm();
+                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
+                    lock_ncurses();
+                    show_mole(molecomm[i].hole, moleholes, 0); // Clear out mole hole
+                    screen_update();
+                    struct AnimationSpec *rspec = &resultanims[pnew->hole].spec;
+                    *rspec = WhackedAnim;
+                    rspec->hole = pnew->hole;
+                    unlock_ncurses();   // maintain proper lock order
+                    lock_scores(); //prevent scores from moving due to asyncronous realloc call
+                    lock_ncurses();
+                    const struct ScoreSheetRecord *sr = score_record(molecomm[i].scoreplayer, molecomm[i].scoreidx);
+                    rspec->score1 = sr != NULL ? sr->whackedscore : 0;
+                    rspec->score2 = sr != NULL ? sr->bonusscore : 0;
+
+                    unlock_scores();
+                    rspec->mole = pnew->mole;
+                    molecomm[i].animcancelled = 0;
+#if defined(debug)
+                    rspec->threadsn = ++threadsn;
+#endif
+
+                    resultanims[pnew->hole].active = 1;
+                    if ((err = pthread_create(&resultanims[pnew->hole].thread, NULL, animation_thread, rspec)) != 0) {
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                    }
+                    unlock_ncurses();
+                } break;
+
+                case EXPIRED: {
+
+                    // First, join with terminated UP animation thread (cleanup zombie)
+
+                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
+                                                               // molecomm while we wait on joining
+                                                               // the animation thread. But without the 
+                                                               // lock, some other thread could mess
+                                                               // with it.
+
+                    unlock_molecomm();
+
+                    void *retval;
+
+                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join the UP animation thread
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
+                    }
+
+                    lock_ncurses();
+                    show_mole(molecomm[i].hole, moleholes, 0); // blank hole
+                    screen_update();
+                    unlock_ncurses();
 
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
                     lock_molecomm();
-                    aspec->synccount = ++synccount; 
+                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
+                    struct AnimationSpec *rspec = &resultanims[pnew->hole].spec;
+                    *rspec = EscapedAnim;
+                    rspec->hole = pnew->hole;
+                    lock_scores(); //prevent scores from moving due to asyncronous realloc call
+                    lock_ncurses();
+                    const struct ScoreSheetRecord *sr = score_record(molecomm[i].scoreplayer, molecomm[i].scoreidx);
+                    rspec->score1 = sr != NULL ? sr->missedscore : 0;
+                    unlock_scores();
+                    rspec->score2 = 0;
+                    rspec->mole = pnew->mole;
+                    molecomm[i].animcancelled = 0;
+#if defined(debug)
+                    rspec->threadsn = ++threadsn;
+#endif
+
+                    resultanims[pnew->hole].active = 1;
+                    if ((err = pthread_create(&resultanims[pnew->hole].thread, NULL, animation_thread, rspec)) != 0) {
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                    }
+                    unlock_ncurses();
+                } break;
+
+                case TERMINATING: {
+                    // Join the animation thread from prev status. (Whacked and escaped
+                    // moles have none: their result animation went to resultanims[].)
+                    //
+                    if (molecomm[i].animspec.syncpoints == 0) {
+                        break;
+                    }
+                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
+                                                               // molecomm while we wait on joining
+                                                               // the animation thread. But without the 
+                                                               // lock, some other thread could mess
+                                                               // with it.
+
                     unlock_molecomm();
+                    void *retval;
+
+                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join whacked/missed/scared anim thread
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
+                    }
+
                     lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, 0); // Blank out the hole
+                    show_mole(molecomm[i].hole, moleholes, 0); // blank hole
+                    screen_update();
                     unlock_ncurses();
-                    enable_thread_cancel();
 
-                    if (aspec->animationtype == INSTRPOPUP) {
-                        sleeptime.tv_sec = 0;
-                        sleeptime.tv_nsec = 500L * MSEC;
-                        nanosleep(&sleeptime, NULL);
+                    lock_molecomm();
+                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
+                } break;
+
+                case SCARED: {
+                    // Join the UP or HIDING animation thread from prev status
+                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
+                                                               // molecomm while we wait on joining
+                                                               // the animation thread. But without the
+                                                               // lock, some other thread could mess
+                                                               // with it.
+                    unlock_molecomm();
+                    void *retval;
+
+                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join up/hiding anim thread
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
                     }
-                }
-            } while (aspec->animationtype == INSTRPOPUP);
-        } break;
 
-        case ANIMWHACKED: {
- #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-Whack");
- #endif
-            lock_molecomm();
-            aspec->synccount = 1;  // Indicate animation running
-            unlock_molecomm();
-            // Frame 1
-            const int frame1time = 500; //msec
-            sleeptime.tv_sec = 0;
-            sleeptime.tv_nsec = frame1time * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+                    lock_ncurses();
+                    show_mole(molecomm[i].hole, moleholes, 0); // blank hole
+                    screen_update();
+                    unlock_ncurses();
 
-            show_result(aspec->hole, aspec->numholes, WHACK, 0, 0, NULL);
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
+                    lock_molecomm();
+                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
 
-            // Frame 2
-            sleeptime.tv_sec = (int)((aspec->duration - frame1time) / 1000L);
-            sleeptime.tv_nsec = (long)((aspec->duration - frame1time) % 1000L) * MSEC;
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+                    // Select one of three animations, depending on mole state when scared
+                    if (molecomm[i].displayack == UP) {
+                        molecomm[i].animspec = UpScaredAnim;
+                        molecomm[i].animspec.hole = pnew->hole;
+                        molecomm[i].animspec.mole = pnew->mole;
+                        molecomm[i].animcancelled = 0;
+#if defined(debug)
+                        molecomm[i].animspec.threadsn = ++threadsn;
+#endif
 
-            show_result(aspec->hole, aspec->numholes, WHACK, aspec->score1, aspec->score2, NULL);
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            lock_molecomm();
-            aspec->synccount = 2;  // Indicate animation progressing
-            unlock_molecomm();
-            nanosleep(&sleeptime, NULL);
+                        if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
+                            restore_terminal();
+                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                        }
+                    } else if (molecomm[i].displayack == HIDING) {
+                        if (molecomm[i].keyhole == molecomm[i].hole) {
+                            molecomm[i].animspec = MisfireScaredAnim;
+                            molecomm[i].animspec.hole = pnew->hole;
+                            molecomm[i].animspec.mole = pnew->mole;
+                            molecomm[i].animcancelled = 0;
+#if defined(debug)
+                            molecomm[i].animspec.threadsn = ++threadsn;
+#endif
 
-            // Blank after animation
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+                            if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
+                                restore_terminal();
+                                error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                            }
+                        } else {
+                            molecomm[i].animspec = HideScaredAnim;
+                            molecomm[i].animspec.hole = pnew->hole;
+                            molecomm[i].animspec.mole = pnew->mole;
+                            molecomm[i].animcancelled = 0;
+#if defined(debug)
+                            molecomm[i].animspec.threadsn = ++threadsn;
+#endif
 
-            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            lock_molecomm();
-            aspec->synccount = 3;  // Indicate animation complete
+                            if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
+                                restore_terminal();
+                                error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
+                            }
+                        }
+                    } else {
+                    }
+                } break;
+
+                default: {
+                    // intentionally left empty
+                } break;
+            }
+
+            molecomm[i].displayack = molecomm[i].molestatus; // Ack mole_thread
+            trace_event(TE_ACK, i, molecomm[i].displayack);
+            long acklag = launch_msec() - heartbeats[TR_MOLE + i]; // Since the status change
+            ++acklatency[acklag < 0 ? 0 : acklag > ACKHISTMSEC ? ACKHISTMSEC : acklag];
+            ++acklatencyrun[acklag < 0 ? 0 : acklag > ACKHISTMSEC ? ACKHISTMSEC : acklag];
+            log_event("slot %ld: display acked %s after %ld ms", i, (long)molestatusnames[molecomm[i].displayack], acklag);
+            if ((err = pthread_cond_signal(&molecomm[i].dispcond)) != 0) {
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Unable to send display cond signal to mole thread %d.", i);
+            }
             unlock_molecomm();
-        } break;
+        }
+
+        memcpy(oldmolecomm, newmolecomm, sizeof(oldmolecomm)); // save copy 
+
+        // Join finished result animations, and give their holes back.
+        resultpending = 0;
+        for (i=0; i<moleholes; i++) {
+            if (! resultanims[i].active) continue;
 
-        case ANIMESCAPED: {
- #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-Escape");
- #endif
             lock_molecomm();
-            aspec->synccount = 1;  // Indicate animation running
+            int finished = (resultanims[i].spec.synccount == resultanims[i].spec.syncpoints);
             unlock_molecomm();
-            // Blank at start (makes it look better)
-            const int blanktime = 250; //msec 
-            sleeptime.tv_sec = 0;
-            sleeptime.tv_nsec = blanktime * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+            if (! finished) {
+                resultpending = 1;  // Causes thread to be uncancellable
+                continue;
+            }
 
-            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
+            void *retval;
+            if ((err = pthread_join(resultanims[i].thread, &retval)) != 0) { // Join whacked/escaped anim thread
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Unable to join result animation thread for hole %d. Error=%d.", i, err);
+            }
+            resultanims[i].active = 0;
+            trace_event(TE_RESULTDONE, i, 0);
+            log_event("hole %ld: result animation done, hole released", i);
 
-            // Frame 1
-            const int frame1time = 500; //msec 
-            sleeptime.tv_sec = 0;
-            sleeptime.tv_nsec = frame1time * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
             lock_ncurses();
-
-            show_result(aspec->hole, aspec->numholes, ESCAPE, 0, 0, NULL);
-            refresh();
+            show_mole(i, moleholes, 0); // blank hole
+            screen_update();
             unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
 
-            // Frame 2
-            sleeptime.tv_sec = (int)((aspec->duration - frame1time - blanktime) / 1000L);
-            sleeptime.tv_nsec = (long)((aspec->duration - frame1time - blanktime) % 1000L) * MSEC;
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+            release_mole_hole(i);
+        }
+
+        // Now look for a new scoresheet record (in the game event log) and handle it
+
+        const struct GameEvent *ge;
+        while ((ge = next_game_event(&eventcursor)) != NULL && ge->type != GE_SCORE);
+        long lag = __atomic_load_n(&gameeventhead, __ATOMIC_RELAXED) - eventcursor;
+        if (lag > eventstats.worstlag) {
+            eventstats.worstlag = lag;
+        }
+
+        if (ge != NULL) {
+            struct ScoreSheetRecord tscore = ge->score;
+            if (tscore.playresult == MISFIRE || tscore.playresult == TOOSOON) {
+                // If we get here, we have a misfire.
+
+                lock_molecomm();
+                int i;
+                // First step with misfire is to cancel all active animation threads
+                for (i=0; i<CONCURRENTMOLES; i++) { // Check each mole thread for active animation
+
+                    if ((molecomm[i].animspec.animationtype == ANIMHIDING ||
+                         molecomm[i].animspec.animationtype == ANIMPOPUP)
+                        && molecomm[i].animspec.synccount > 0     // animation must have started
+                        && molecomm[i].animspec.synccount < molecomm[i].animspec.syncpoints // and animation can't be ending
+                        && molecomm[i].animcancelled == 0) {      // and animation not already cancelled
+
+                        if ((err = pthread_cancel(molecomm[i].animthread)) != 0) { //kill animation
+                            restore_terminal();
+                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
+                        }
+
+                        molecomm[i].animcancelled = 1;
+                        // flag animation as finished
+                        molecomm[i].animspec.synccount =  molecomm[i].animspec.syncpoints;
+                    }
+                }
+
+                // Next step is to let each mole thread proceed, if it was waiting on key press
+                for (i=0; i<CONCURRENTMOLES; i++) {
+
+                    molecomm[i].keystruck = tscore.selection;
+                    molecomm[i].keyhole = tscore.hole;
+                    molecomm[i].scaredby = tscore.player;
+                    if ((err = pthread_cond_signal(&molecomm[i].keycond)) != 0) {
+                        restore_terminal();
+                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send cond signal to thread slot %d",i);
+                    }
+                }
 
-            show_result(aspec->hole, aspec->numholes, ESCAPE, aspec->score1, aspec->score2, NULL);
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            lock_molecomm();
-            aspec->synccount = 2;  // Indicate animation progressing
-            unlock_molecomm();
-            nanosleep(&sleeptime, NULL);
+                unlock_molecomm();
+
+                const long MisfireDisplayTime = 1500; //(msec)
+                struct timespec tsnow, tsexp;
+                clock_gettime(CLOCK_MONOTONIC, &tsnow);
+                tsexp = tsnow;
+                tsexp.tv_nsec += (MisfireDisplayTime % 1000) * MSEC;
+                tsexp.tv_sec += MisfireDisplayTime / 1000;
+                if (tsexp.tv_nsec >=  1000000000L) {
+                    tsexp.tv_nsec -= 1000000000L;
+                    tsexp.tv_sec++;
+                }
+
+                misfires[tscore.hole].timer = tsexp;  // notes misfire status for later
+            }
 
-            // Blank after animation
-            disable_thread_cancel(); // don't get cancelled while holding a lock
             lock_ncurses();
 
-            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
-            refresh();
+            // Add up the record's points rather than take its end score: two
+            // players' records can be logged out of turn, but the sum comes out
+            // the same whatever the order.
+            hudscores[tscore.player] += tscore.missedscore + tscore.whackedscore + tscore.bonusscore + tscore.penaltyscore;
+            show_hud_score();
+            if (heatmap && tscore.hole >= 0 && tscore.hole < moleholes) {
+                show_hole_heat(tscore.hole);
+            }
+            screen_update();
             unlock_ncurses();
-            enable_thread_cancel();
-            lock_molecomm();
-            aspec->synccount = 3;  // Indicate animation complete
-            unlock_molecomm();
-        } break;
+        }
 
-        case ANIMMISFIRE: {  // Shows misfire animation on hole not occupied by mole
-            // Currently unimplemented.  display_thread handles "misfire" frame directly.
-        } break;
+        // Handle misfire display.  If timer has not expired, misfire needs to be displayed
+        // (if it isn't already up).  If timer has expires, take down the display if needed.
+        // The misfire panel is an overlay in the hole occupancy index: new moles pick
+        // another hole while it is up, rather than waiting for this one.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
 
-        case ANIMMISFIRESCARED: { // Shows misfire on hole where mole was hiding
- #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-Scare1");
- #endif
-            lock_molecomm();
-            aspec->synccount = 1;  // Indicate animation running
-            unlock_molecomm();
+        misfirepending = 0;  // Flag indicates one or more misfires pending, 
+                             // so don't let thread be cancelled if set.
+        for (i=0; i<moleholes; i++) {
 
-            int frametime = aspec->duration / 4;
-            sleeptime.tv_sec = frametime / 1000;
-            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+            if (misfires[i].timer.tv_sec > now.tv_sec || (misfires[i].timer.tv_sec == now.tv_sec && misfires[i].timer.tv_nsec > now.tv_nsec)) {
 
-            show_result(aspec->hole, aspec->numholes, MISFIRE, 0, 0, NULL);
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
+                // make sure misfire is displayed.
+                // If a mole has the hole, it means the misfire was on a
+                // hiding mole (or one whose result is still showing). Thius will be handled by an animation, so no need
+                // to do the misfile frame here.
+                if (misfires[i].status == 0 && overlay_mole_hole(i, 1)) {
+                    misfires[i].status = 1;
+                    lock_frame(FRAME_FEEDBACK);
 
-            frametime = aspec->duration / 20;
-            sleeptime.tv_sec = frametime / 1000;
-            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-            int i;
-            for (i=0; i<3; i++) {
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
+                    show_result(i, moleholes, MISFIRE, 0, 0, NULL);
+                    screen_update();
+                    unlock_ncurses();
+                }
+            } else {
+                // make sure misfire is NOT displayed
+                if (misfires[i].status == 1) {
+                    // Clear misfire display
+                    misfires[i].status = 0;
+                    lock_ncurses();
 
-                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
-                nanosleep(&sleeptime, NULL);
+                    show_result(i, moleholes, -1, 0, 0, "");
+                    screen_update();
+                    unlock_ncurses();
 
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
+                    overlay_mole_hole(i, 0);
+                }
+            }
 
-                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
-                nanosleep(&sleeptime, NULL);
+            if (misfires[i].status == 1) {
+                    misfirepending = 1;     // Causes thread to be uncancellable
             }
+        }
 
-            frametime = aspec->duration / 4;
-            sleeptime.tv_sec = frametime / 1000;
-            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
+        if (screen_dirty) {  // Flush animation frames coalesced since last pass
             lock_ncurses();
-
-            show_result(aspec->hole, aspec->numholes, SCAREDOFF, 0, 0, NULL);
-            refresh();
+            screen_dirty = 0;
+            screen_flush();
+            ++frameflushes;
             unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
+        }
 
-            frametime = aspec->duration * 2 / 10;
-            sleeptime.tv_sec = frametime / 1000;
-            sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+        if (! misfirepending && ! resultpending) {  // can't cancel thread if any misfires
+                                                    // or result animations pending
 
-            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            nanosleep(&sleeptime, NULL);
+            enable_thread_cancel(); // Give main() a chance to cancel the thread
+        }
 
-            // Blank after animation
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_ncurses();
+        struct timespec sleeptime = {0, 10000000L}; // 10 msec sleep so we
+        nanosleep(&sleeptime, NULL);                // don't burn up the cpu
+    }
 
-            show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+    return NULL;
+}
 
-            refresh();
-            unlock_ncurses();
-            enable_thread_cancel();
-            lock_molecomm();
-            aspec->synccount = 2;  // Indicate animation complete
-            unlock_molecomm();
-        } break;
+//=========================
+// char autoplay_key(void)
+//
+// The autoplay (-a) bot.  Called by input_thread when no key was pressed.
+// Every AUTOPLAYREACTMIN to AUTOPLAYREACTMAX msec it makes a move: whacks a
+// mole the display shows as up, if there is one, or 1 time in
+// AUTOPLAYMISFIRE hits a random hole.  So it whacks, misses, misfires and
+// scares moles off, like a player would, and exercises every path.
+// In two-player mode (-2) it plays for both, picking a player at random
+// each move, and 1 whack in AUTOPLAYRACE has the other player go for the
+// same mole right after, to exercise the whack race.
+//
+// Returns: key for input_thread to act on, or '\0' for none.
+//
+char autoplay_key(void) {
+    static long nextmove = 0;
+    static char racekey = '\0';  // The other player's key, for a race
+    long now = launch_msec();
+    char key = '\0';
+    int i;
 
-        case INSTRSCARED:    // Scared animation from instructions page.
-        case ANIMUPSCARED: { // UP mole scared off by missfire on other hole.
+    if (racekey != '\0') {
+        key = racekey;
+        racekey = '\0';
+        return key;
+    }
+    if (now < nextmove) return '\0';
+    nextmove = now + AUTOPLAYREACTMIN + tsrandom() % (AUTOPLAYREACTMAX - AUTOPLAYREACTMIN);
+
+    int player = tsrandom() % players;
+    const struct Keymap *km = keymap_read_lock();
+    if (tsrandom() % AUTOPLAYMISFIRE == 0) {
+        key = km->keys[player][tsrandom() % moleholes];
+        keymap_read_unlock();
+        return key;
+    }
+
+    disable_thread_cancel(); // don't get cancelled while holding a lock
+    lock_molecomm();
+    for (i=0; i<CONCURRENTMOLES; i++) {
+        if (molecomm[i].molestatus == UP && molecomm[i].displayack == UP) {
+            key = km->keys[player][molecomm[i].hole];
+            if (players > 1 && tsrandom() % AUTOPLAYRACE == 0) {
+                racekey = km->keys[1 - player][molecomm[i].hole];
+            }
+            break;
+        }
+    }
+    unlock_molecomm();
+    enable_thread_cancel();
+    keymap_read_unlock();
+
+    return key;
+}
+
+//===============================
+// void *input_thread(void *arg)
+//
+// Keyboard input thread.
+//
+// Scans for keyboard input and communicates key presses to
+// mole threads through global MoleComm structure.
+//
+// If no mole thread is expecting the key, a scoresheet record is
+// created with a misfire record.  Misfire also sets scaredflag for each
+// molecomm record.
+//
+// A key for a mole that is up stakes a claim to it (claim_whack()), stamped
+// with when the key was read.  With two players (-2) both may go for the
+// same mole: the earlier key gets the whack, and the other is a near miss.
+//
+void *input_thread(void *arg) {
+    char inputkey;
+    long msec;
+    long keystamp;
+    struct timespec now;
+    int err;
  #if defined(debug) && defined(_GNU_SOURCE)
-            pthread_setname_np(pthread_self(), "WAM-Anim-Scare2");
+    pthread_setname_np(pthread_self(), "WAM-Input");
  #endif
-            lock_molecomm();
-            aspec->synccount = 1;  // Indicate animation running
-            unlock_molecomm();
+    threadrole = TR_INPUT;
+    perf_thread_begin();
 
-            do {    // ANIMUPSCARED does this once, INSTRSCARED loops until cancelled
+    if ((err = pthread_mutex_lock(&start_mtx)) != 0) {   // set up mutex for cond wait
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    }
 
-                // INTRSCARED starts out displaying an UP mole
-                if (aspec->animationtype == INSTRSCARED) {
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_mole(aspec->hole, aspec->numholes, 5);
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    sleeptime.tv_sec = 3;
-                    sleeptime.tv_nsec = 0l;
-                    nanosleep(&sleeptime, NULL);
+    kbthread_running = 1;
 
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
-                    show_result(aspec->hole, aspec->numholes, SCAREDOFF, 0, 0, NULL);
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    sleeptime.tv_sec = 0;
-                    sleeptime.tv_nsec = 750000000L;
-                    nanosleep(&sleeptime, NULL);
-                }
+    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    }
 
-                int frametime = aspec->duration / 20;
-                sleeptime.tv_sec = frametime / 1000;
-                sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-                int i;
-                for (i=0; i<3; i++) {
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
+    if ((err = pthread_cond_signal(&start_cond)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send start_cond signal to main thread.");
+    }
 
-                    show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    nanosleep(&sleeptime, NULL);
+    for (;;) {
+        heartbeat(TR_INPUT);
+        msec = 1L;   // wait a msec so as not to slam cpu
+        if (headless) {
+            nanosleep(&one_msec, NULL);
+            inputkey = '\0';
+        } else {
+            inputkey = waitforkey(&msec);
+        }
+        keystamp = key_stamp(&inputparser.readtime, inputparser.head);
 
-                    disable_thread_cancel(); // don't get cancelled while holding a lock
-                    lock_ncurses();
+        if (! countdown_complete) { // With fast start, we are running during the countdown.
+            continue;               // Keys hit before the game starts don't count.
+        }
 
-                    show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");
-                    refresh();
-                    unlock_ncurses();
-                    enable_thread_cancel();
-                    nanosleep(&sleeptime, NULL);
-                }
+        switch (inputkey) {  // Viewport scrolling. (display_thread does the work.)
+            case SCROLLUPKEY:    __sync_fetch_and_sub(&scrollrows, 1); continue;
+            case SCROLLDOWNKEY:  __sync_fetch_and_add(&scrollrows, 1); continue;
+            case SCROLLLEFTKEY:  __sync_fetch_and_sub(&scrollcols, 1); continue;
+            case SCROLLRIGHTKEY: __sync_fetch_and_add(&scrollcols, 1); continue;
+        }
 
-                frametime = aspec->duration * 5 / 10;
-                sleeptime.tv_sec = frametime / 1000;
-                sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
+        if (autoplay && inputkey == '\0') {
+            inputkey = autoplay_key();
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            keystamp = key_stamp(&now, 0);
+        }
 
-                show_result(aspec->hole, aspec->numholes, SCAREDOFF, 0, 0, NULL);
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
-                nanosleep(&sleeptime, NULL);
+        if (inputkey != '\0') {
+            // make sure this key is even a valid selection
+            int keyplayer;
+            int keyhole = keymap_hole(inputkey, &keyplayer);
+            if (keyhole < 0) {
+                continue;
+            }
+            trace_event(TE_KEY, inputkey, 0);
+            append_game_event(GE_KEY, -1, 0, -1, 0, inputkey, NULL);
+            log_event("key code %ld", inputkey);
 
-                frametime = aspec->duration * 2 / 10;
-                sleeptime.tv_sec = frametime / 1000;
-                sleeptime.tv_nsec = (frametime % 1000) * MSEC; 
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
+            // Some key was hit. Lock molecomm mutex while we figure it out.
+            disable_thread_cancel(); // don't get cancelled while holding a lock
+            lock_molecomm();
+
+            int whackflag = 0;
+            int i;
+            for (i=0; i<CONCURRENTMOLES; i++) { // Check each mole thread
+
+                if (molecomm[i].molestatus == UP              // Mole must be UP
+                    && molecomm[i].displayack == UP           // and display thread must agree it's up
+                    && molecomm[i].hole == keyhole            // and correct key must be hit
+                    && (molecomm[i].whackclaim != 0           // and either it has been claimed (the
+                                                              // race is decided by claim_whack()),
+                        || (molecomm[i].animspec.synccount > 0 // or animation must have started
+                            && molecomm[i].animspec.synccount < // and animation can't be ending
+                                    molecomm[i].animspec.syncpoints
+                            && molecomm[i].animcancelled == 0))) { // and animation not already cancelled
+
+                    whackflag = 1;  // A whack, or a swing at a mole already claimed (a near miss)
+                    if (claim_whack(&molecomm[i], keystamp, keyplayer) == 1) {
+                        if ((err = pthread_cancel(molecomm[i].animthread)) != 0) { //kill animation
+                            restore_terminal();
+                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
+                        }
+                        molecomm[i].animcancelled = 1;
+                        molecomm[i].keystruck = inputkey;
+                        molecomm[i].keyhole = keyhole;
+                        __sync_fetch_and_add(&keymapwhacks, 1);
+
+                        // let mole thread proceed
+                        if ((err = pthread_cond_signal(&molecomm[i].keycond)) != 0) {
+                            restore_terminal();
+                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to send cond signal to thread slot %d",i);
+                        }
+                    }
+                } else if ((molecomm[i].molestatus == EXPIRED || molecomm[i].molestatus == WHACKED || (molecomm[i].molestatus == UP && molecomm[i].animspec.synccount == molecomm[i].animspec.syncpoints)) && molecomm[i].hole == keyhole){
+                    // Both these conditions are considered near miss (no score or penalty).
+                    // First is a recendly expired mole, second takes care of double strike.
+                    whackflag = 1; 
+                    if (players > 1 && molecomm[i].whackclaim == WHACKCLOSED) {  // Too late for the
+                        __sync_fetch_and_add(&playerstats.late, 1);             // whack race
+                    }
+                } else {
+                }
+            }
 
-                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "!SCARED!");
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
-                nanosleep(&sleeptime, NULL);
+            // unlock molecomm mutex
+            unlock_molecomm();
 
-                // Blank after animation
-                disable_thread_cancel(); // don't get cancelled while holding a lock
-                lock_ncurses();
+            if (!whackflag) {  // Also a near miss if the hole's mole just left (see hand_off_mole_hole())
+                whackflag = check_hole_grace(keyhole);
+            }
 
-                show_result(aspec->hole, aspec->numholes, -1, 0, 0, "");  // Blank out hole
+            if (!whackflag) {  // This is a misfire!
+                int i;
+                int misfirehole;
+                enum PlayResult misfiretype = MISFIRE; // default, unless we set to TOOSOON later
+                lock_molecomm();
+                for(i=0; i<CONCURRENTMOLES; i++) {  // Set scaredflag for each Hiding/Up mole 
+                                                    // so mole_thread can exit early
 
-                refresh();
-                unlock_ncurses();
-                enable_thread_cancel();
+                    if (molecomm[i].molestatus == HIDING || molecomm[i].molestatus == UP ) {
+                        molecomm[i].scaredflag = 1;
+                        molecomm[i].scaredby = keyplayer;
+                        clock_gettime(CLOCK_MONOTONIC, &molecomm[i].scaredtime);
+                    }
 
-                if (aspec->animationtype == INSTRSCARED) {
-                    sleeptime.tv_sec = 2;
-                    sleeptime.tv_nsec = 500000000l;
-                    nanosleep(&sleeptime, NULL);
+                    if (molecomm[i].molestatus == HIDING && molecomm[i].hole == keyhole) {
+                        misfiretype = TOOSOON;
+                    }
                 }
-            } while (aspec->animationtype == INSTRSCARED);
-            lock_molecomm();
-            aspec->synccount = 2;  // Indicate animation complete
-            unlock_molecomm();
-        } break;
+                unlock_molecomm();
 
-        default: {
-            // intentionally left empty
-        };
+                misfirehole = keyhole;
+                // Log the misfire in the scores buffer. (triggers display_thread to handle it) 
+                compute_score(keyplayer, -1, misfirehole, inputkey, 0, misfiretype, 0, 0);
+            }
+
+            enable_thread_cancel(); 
+        }
     }
+
     return NULL;
 }
 
-//================================
-// void *display_thread(void *arg)
-// Display management thread. 
-//
-// Looks for changes to molecomm and scores buffers and updates display accordingly.
-// Ack's status changes back to mole_thread.
+//===================================
+//pthread_t *start_input_thread(void)
 //
-// Also looks for new entries in the scores buffer and displays results.
+// Starts up the input monitoring thread.
 //
-// This function makes extensive use of the ncurses_mutex to help it
-// play nice with the animation_thread.
+// returns the thread ID
 //
-void *display_thread(void *arg){
-    static struct {
-        int status; // 1=misfire active (displayed), 0=not
-        struct timespec timer;
-    } misfires[MOLEHOLES]; // Used to track misfire display for each hole.
-    struct MoleCommRecord newmolecomm[CONCURRENTMOLES];
-    struct MoleCommRecord oldmolecomm[CONCURRENTMOLES];
-    int knownscores = 0;
+pthread_t *start_input_thread(void) {
+    static pthread_t tid;   // thread ID
     int err;
 
- #if defined(debug) && defined(_GNU_SOURCE)
-    pthread_setname_np(pthread_self(), "WAM-Display");
- #endif
-
-    memset(newmolecomm, 0, sizeof(newmolecomm));
-    memset(oldmolecomm, 0, sizeof(oldmolecomm));
-
-    lock_ncurses();
-    display_empty_playfield(BASEGAME, DISP_ELE_ALL, MOLEHOLES, "Good luck and have fun!!!");
-    unlock_ncurses();
-
-    struct timespec sleeptime = {0, 500000000L}; // 500 msec sleep to give player a chance
-    nanosleep(&sleeptime, NULL);                 // to get ready for the moles.
+    clear_input_buffer();
 
     if ((err = pthread_mutex_lock(&start_mtx)) != 0) {   // set up mutex for cond wait
         restore_terminal();
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
     }
 
-    display_thread_running = 1;
+    if ((err = pthread_create(&tid, NULL, input_thread, NULL)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set create input thread.");
+    }
+
+    while (!kbthread_running) {
+        if ((err = pthread_cond_wait(&start_cond, &start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Input thread cond wait failed.");
+        }
+    }
 
     if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
         restore_terminal();
         error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
     }
 
-    if ((err = pthread_cond_signal(&start_cond)) != 0) {
+    return &tid;
+}
+
+//====================================
+//pthread_t *start_display_thread(void)
+//
+// Starts up the display monitoring thread.
+//
+// returns the thread ID
+//
+pthread_t *start_display_thread(void) {
+    static pthread_t tid;   // thread ID
+    pthread_attr_t tattr;   // thread attributes
+    int err;
+
+    if ((err = pthread_attr_init(&tattr)) != 0) {  // Start with default thread attributes.
         restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send start_cond signal to main thread.");
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to assign default display thread attributes.\n");
     }
 
-    int misfirepending = 0;  // dont allow thread to be cancelled if misfire display pending
+    if ((err = pthread_mutex_lock(&start_mtx) != 0)) {   // set up mutex for cond wait
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    }
 
-    for (;;) {
-        disable_thread_cancel(); // don't get cancelled while holding a lock
-        lock_molecomm();
+    if ((err = pthread_create(&tid, &tattr, display_thread, NULL)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set create display thread.");
+    }
 
-        // Lock and snapshot live molecomm buffer, then work from the snaphot
-        memcpy(newmolecomm, molecomm, sizeof(newmolecomm));
+    if ((err = pthread_attr_destroy(&tattr)) != 0) {     // attributes no longer needed
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set release display thread attributes.");
+    }
 
-        unlock_molecomm();
-        lock_ncurses();
-        if (molesremaining >= 0) {
-            mvprintw(6, 63, "%-4d ", molesremaining);
+    while (!display_thread_running) {
+        if ((err = pthread_cond_wait(&start_cond, &start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Input thread cond wait failed.");
         }
-        unlock_ncurses();
+    }
 
-        int i;
-        for (i=0; i<CONCURRENTMOLES; i++) { // check each mole slot
-            struct MoleCommRecord *pnew = &newmolecomm[i];
-            struct MoleCommRecord *pold = &oldmolecomm[i];
+    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock start mutex.");
+    }
 
-            if (pnew->molestatus == pold->molestatus) continue;  // No Change
+    return &tid;
+}
 
-            lock_molecomm();
-            switch (pnew->molestatus) {
-                case HIDING: {
+//============================
+// void assign_hole_keys(void)
+//
+// Assigns a key to each mole hole.
+// The classic 3x3 grid uses the numeric keypad layout ("7" top left, "3"
+// bottom right).  Other grids (-g) take keys from HOLEKEYS in reading order.
+// In two-player mode (-2, 3x3 only) player 2 gets PLAYER2KEYS, a keypad
+// shaped block on the left of the keyboard.
+// With -k, rotate_keymap() shuffles them after each hit.
+//
+// Publishes the first keymap from keymappool[]; the rest start out free.
+//
+void assign_hole_keys(void) {
+    struct Keymap *km = &keymappool[0];
+    int i;
 
-                    molecomm[i].animspec = HidingAnim;
-                    molecomm[i].animspec.hole = pnew->hole;
-                    molecomm[i].animspec.duration = pnew->duration - pnew->uptime;
-                    molecomm[i].animspec.mole = pnew->mole;
-                    molecomm[i].animcancelled = 0;
-#if defined(debug)
-                    molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+    for (i = 1; i < KEYMAPS; i++) {
+        keymappool[i].retired = -1;
+    }
+    memset(km, 0, sizeof(struct Keymap));
+    if (gridrows == MOLEHOLES / REFGRIDCOLS && gridcols == REFGRIDCOLS) {
+        memcpy(km->keys[0],"789456123", MOLEHOLES);
+        memcpy(km->keys[1], PLAYER2KEYS, MOLEHOLES);
+    } else {
+        memcpy(km->keys[0], HOLEKEYS, moleholes);
+    }
+    __atomic_store_n(&holekeys, km, __ATOMIC_SEQ_CST);
+}
 
-                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                    }
-                } break;
+//=============================================
+// const struct Keymap *keymap_read_lock(void)
+//
+// Starts reading the keymap.  Returns the live one, which stays valid and
+// unchanged until keymap_read_unlock(), even if rotate_keymap() replaces it
+// in the meantime.  Lock free: the reader just notes the epoch it started
+// in, for reclaim_keymaps() to wait out.  Don't nest these, and keep what
+// is done in between short.
+//
+// Only threads with a role below TR_ANIMATION have a reader slot.  Others
+// (the score sheet's, say) only read the keymap outside play, when it
+// can't rotate.
+//
+// Returns: the keymap
+//
+const struct Keymap *keymap_read_lock(void) {
+    if (threadrole >= 0 && threadrole < TR_ANIMATION) {
+        __atomic_store_n(&keymapreaders[threadrole], __atomic_load_n(&keymapepoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    }
+    return __atomic_load_n(&holekeys, __ATOMIC_SEQ_CST);
+}
 
-                case UP: {
-                    // First, join with terminated HIDING animation thread (cleanup zombie)
+//=============================
+// void keymap_read_unlock(void)
+//
+// Done with the keymap from keymap_read_lock().
+//
+// Returns: void
+//
+void keymap_read_unlock(void) {
+    if (threadrole >= 0 && threadrole < TR_ANIMATION) {
+        __atomic_store_n(&keymapreaders[threadrole], 0, __ATOMIC_RELEASE);
+    }
+}
 
-                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
-                                                               // molecomm while we wait on joining
-                                                               // the animation thread. But without the 
-                                                               // lock, some other thread could mess
-                                                               // with it.
-                    unlock_molecomm();
+//=========================================
+// int keymap_hole(char key, int *player)
+//
+// Looks a key up in the live keymap.  Keys are turned into holes once, by
+// whoever reads the key: everything after that goes by hole, so a rotation
+// in between can't change what the key meant.
+//
+// key = key pressed
+// player = where to put whose key it is (two-player mode), else 0
+//
+// Returns: hole the key is for, or -1 if it isn't a hole key.
+//
+int keymap_hole(char key, int *player) {
+    const struct Keymap *km = keymap_read_lock();
+    const char *k = NULL;
+    int i;
 
-                    void *retval;
-                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join hiding animation thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d Error=%d.", i,err);
-                    }
+    for (i = 0; i < players && k == NULL && key != '\0'; i++) {
+        k = memchr(km->keys[i], key, moleholes);
+    }
+    int hole = k != NULL ? k - km->keys[i - 1] : -1;
+    *player = k != NULL ? i - 1 : 0;
+    keymap_read_unlock();
 
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, MOLEHOLES, 0); // blank hole
-                    refresh();
-                    unlock_ncurses();
+    return hole;
+}
 
-                    lock_molecomm();
-                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
-                    molecomm[i].animspec = PopupAnim;
-                    molecomm[i].animspec.hole = pnew->hole;
-                    molecomm[i].animspec.duration = pnew->uptime;
-                    molecomm[i].animspec.mole = pnew->mole;
-                    molecomm[i].animcancelled = 0;
-#if defined(debug)
-                    molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+//=====================================================================
+// int claim_whack(struct MoleCommRecord *p, long stamp, int player)
+//
+// Stakes a player's claim to whacking the mole in slot p.  The earliest key
+// wins, by its stamp (key_stamp()), not by which claim gets here first:
+// each claim is a compare and swap that only ever lowers p->whackclaim, so
+// the outcome is the same whatever order threads get the molecomm mutex
+// (or the CPU) in.  mole_visit() closes the race when it scores the mole,
+// and the whack goes to whoever holds the claim then.
+//
+// p = the mole's slot
+// stamp = the key's stamp
+// player = whose key it was
+//
+// Returns: 1 = first claim (the caller wakes the mole), 0 = the mole was
+//          already claimed (this claim wins if its key came first),
+//          -1 = too late: the mole has been scored.
+//
+int claim_whack(struct MoleCommRecord *p, long stamp, int player) {
+    long claim = stamp * PLAYERS + player;
+    long seen = __atomic_load_n(&p->whackclaim, __ATOMIC_SEQ_CST);
 
-                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                    }
-                } break;
+    for (;;) {
+        if (seen == WHACKCLOSED) {
+            __sync_fetch_and_add(&playerstats.late, 1);
+            return -1;
+        }
+        if (seen != 0 && seen <= claim) {  // An earlier key has it
+            __sync_fetch_and_add(&playerstats.contested, 1);
+            return 0;
+        }
+        if (__atomic_compare_exchange_n(&p->whackclaim, &seen, claim, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            if (seen != 0) {
+                __sync_fetch_and_add(&playerstats.contested, 1);
+            }
+            log_event("whack claim: slot %ld player %ld stamp %ld", p - molecomm, player + 1, stamp);
+            return seen == 0;
+        }
+    }
+}
+
+//==========================
+// void rotate_keymap(void)
+//
+// Publishes a new keymap (-k): the live one's keys, shuffled, in a free map
+// from keymappool[].  Readers get it with an atomic pointer swap, so each
+// sees either the old map or the new one, never a mix.  The old map is
+// retired, to be reclaimed once every reader that might still be using it
+// is done (reclaim_keymaps()).  If no map is free yet, the rotation is put
+// off.  Called by control_moles() only: there is one writer.
+//
+// Returns: void
+//
+void rotate_keymap(void) {
+    struct Keymap *old = holekeys;
+    struct Keymap *km = NULL;
+    int i, p;
+
+    for (i = 0; i < KEYMAPS && km == NULL; i++) {
+        if (keymappool[i].retired == -1) km = &keymappool[i];
+    }
+    if (km == NULL) {
+        ++keymapstats.deferred;
+        return;
+    }
+
+    memcpy(km->keys, old->keys, sizeof(km->keys));
+    for (p = 0; p < players; p++) {
+        for (i = moleholes - 1; i > 0; i--) {  // Fisher-Yates shuffle
+            int j = tsrandom() % (i + 1);
+            char key = km->keys[p][i];
+            km->keys[p][i] = km->keys[p][j];
+            km->keys[p][j] = key;
+        }
+    }
+    km->generation = old->generation + 1;
+    km->retired = 0;
+
+    __atomic_store_n(&holekeys, km, __ATOMIC_SEQ_CST);  // Publish, then start old's grace period
+    old->retiredmsec = launch_msec();
+    old->retired = __atomic_add_fetch(&keymapepoch, 1, __ATOMIC_SEQ_CST);
+    ++keymapstats.rotations;
+    log_event("keymap %ld published", km->generation);
+}
+
+//============================
+// void reclaim_keymaps(void)
+//
+// Frees retired keymaps whose grace period is over: no reader slot shows a
+// read that started before the map was replaced.  (Readers that started
+// later got the new map.)  Called by control_moles() on each pass.
+//
+// Returns: void
+//
+void reclaim_keymaps(void) {
+    int i, r;
+
+    for (i = 0; i < KEYMAPS; i++) {
+        struct Keymap *km = &keymappool[i];
+        if (km->retired <= 0) continue;
+
+        for (r = 0; r < TR_ANIMATION; r++) {
+            long seen = __atomic_load_n(&keymapreaders[r], __ATOMIC_SEQ_CST);
+            if (seen != 0 && seen < km->retired) break;  // Still reading since before the swap
+        }
+        if (r < TR_ANIMATION) continue;
+
+        long grace = launch_msec() - km->retiredmsec;
+        if (grace > keymapstats.gracemsec) keymapstats.gracemsec = grace;
+        km->retired = -1;
+        ++keymapstats.reclaimed;
+    }
+}
 
-                case WHACKED: {
+//===========================
+// void show_hole_keys(void)
+//
+// Redraws the key labels on the visible holes, from the live keymap.
+// (display_thread, after a rotation.)
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: void
+//
+void show_hole_keys(void) {
+    const struct Keymap *km = keymap_read_lock();
+    int i;
 
-                    // First, join with terminated UP animation thread (cleanup zombie)
+    for (i = 0; i < moleholes; i++) {
+        struct HoleScreenCoords *hsc = &holescreencoords[i];
+        if (hsc->visible) {
+            screen_print(hsc->frametop + 1, hsc->frameleft + HOLEWIDTH - 1, "%c", km->keys[0][i]);
+            if (players > 1) {
+                screen_print(hsc->frametop + 1, hsc->frameleft, "%c", km->keys[1][i]);
+            }
+        }
+    }
+    keymap_read_unlock();
+}
 
-                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
-                                                               // molecomm while we wait on joining
-                                                               // the animation thread. But without the 
-                                                               // lock, some other thread could mess
-                                                               // with it.
+//=================================
+// void print_keymap_stats(FILE *f)
+//
+// Prints keymap rotation (-k) statistics.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_keymap_stats(FILE *f) {
+    if (! keymaprotate) return;
 
-                    unlock_molecomm();
+    fprintf(f, "Keymap rotation: %ld keymaps published, %ld reclaimed, %ld rotations put off (no free map)\n",
+            keymapstats.rotations, keymapstats.reclaimed, keymapstats.deferred);
+    fprintf(f, "  grace period:    %ld ms at most (as seen by the control loop)\n", keymapstats.gracemsec);
+}
 
-                    void *retval;
+//==========================
+// void tally_players(void)
+//
+// Adds the game just played to the two-player totals in playerstats.
+// Called at game end, with only the main thread running.
+//
+// Returns: void
+//
+void tally_players(void) {
+    int i, j;
+
+    for (i = 0; i < players; i++) {
+        const struct PlayerLog *pl = &playerlogs[i];
+        long logged = pl->reserved < PLAYERLOGSIZE ? pl->reserved : PLAYERLOGSIZE;
+        for (j = 0; j < logged; j++) {
+            ++playerstats.results[i][pl->records[j].playresult];
+        }
+        playerstats.points[i] += pl->total;
+    }
+    if (playerlogs[0].total != playerlogs[1].total) {
+        ++playerstats.wins[playerlogs[0].total > playerlogs[1].total ? 0 : 1];
+    }
+    ++playerstats.games;
+}
 
-                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join the UP animation thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
-                    }
+//=================================
+// void print_player_stats(FILE *f)
+//
+// Prints results per player (two-player mode), and how the whack races
+// between them went.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_player_stats(FILE *f) {
+    int i;
 
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, MOLEHOLES, 0); // blank hole
-                    refresh();
-                    unlock_ncurses();
+    if (players < 2) return;
 
-                    lock_molecomm();
-                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, 9, 0); // Clear out mole hole
-                    refresh();
-                    molecomm[i].animspec = WhackedAnim;
-                    molecomm[i].animspec.hole = pnew->hole;
-                    unlock_ncurses();   // maintain proper lock order
-                    lock_scores(); //prevent scores from moving due to asyncronous realloc call
-                    lock_ncurses();
-                    molecomm[i].animspec.score1 = scores[molecomm[i].scoreidx].whackedscore;
-                    molecomm[i].animspec.score2 = scores[molecomm[i].scoreidx].bonusscore;
+    fprintf(f, "Players: %d games, %d drawn\n", playerstats.games,
+            playerstats.games - playerstats.wins[0] - playerstats.wins[1]);
+    fprintf(f, "  player  wins  points  whack  escape  misfire  toosoon  scared\n");
+    for (i = 0; i < players; i++) {
+        const long *n = playerstats.results[i];
+        fprintf(f, "  %6d  %4d  %6ld  %5ld  %6ld  %7ld  %7ld  %6ld\n", i + 1, playerstats.wins[i], playerstats.points[i],
+                n[WHACK], n[ESCAPE], n[MISFIRE], n[TOOSOON], n[SCAREDOFF]);
+    }
+    fprintf(f, "  whack races:     %ld claims found the mole already claimed, %ld already scored\n",
+            playerstats.contested, playerstats.late);
+    fprintf(f, "  score records:   %ld dropped (log full)\n", playerstats.dropped);
+}
 
-                    unlock_scores();
-                    molecomm[i].animspec.mole = pnew->mole;
-                    molecomm[i].animcancelled = 0;
-#if defined(debug)
-                    molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+//============================================
+// void play_game(int moles, int moletime)
+//
+// Plays one game: the intro and countdown (unless autoplay or fast start),
+// then the input, display and watchdog threads for as long as
+// control_moles() runs the moles.  Returns with only the calling thread
+// left, and the screen back on ncurses.
+//
+// moles = How many moles in the game.
+// moletime = Time for each mole in msec.
+//
+// Returns: void
+//
+void play_game(int moles, int moletime) {
+    pthread_t *kbinput_tid;
+    pthread_t *display_tid;
+    pthread_t *watchdog_tid;
+    int err;
 
-                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                    }
-                    unlock_ncurses();
-                } break;
+    log_event("game start: %ld moles, %ld ms each", moles, moletime);
+    reset_game_events();
+    append_game_event(GE_GAMESTART, -1, moles, -1, 0, 0, NULL);
 
-                case EXPIRED: {
+    if (roundplan.round > 0 && roundplan.scores != NULL) {  // Score sheet storage, set up ahead
+        lock_scores();
+        scores = roundplan.scores;
+        scorescapacity = roundplan.scorescapacity;
+        numscores = 0;
+        roundplan.scores = NULL;
+        unlock_scores();
+    }
 
-                    // First, join with terminated UP animation thread (cleanup zombie)
+    start_mole_workers();  // (Before display_thread, which reads their slots)
 
-                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
-                                                               // molecomm while we wait on joining
-                                                               // the animation thread. But without the 
-                                                               // lock, some other thread could mess
-                                                               // with it.
+    if (faststart) {
+        // Bring up the input and display threads while the countdown runs.
+        // Both hold off on play until countdown_complete is set.
+        kbinput_tid = start_input_thread();
+        display_tid = start_display_thread();
+        mark_startup_phase(SP_THREADS);
 
-                    unlock_molecomm();
+        display_countdown(FASTCOUNTDOWNSTEPS, FASTCOUNTDOWNSTEP);
 
-                    void *retval;
+        if ((err = pthread_mutex_lock(&start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+        }
 
-                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join the UP animation thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
-                    }
+        countdown_complete = 1;
 
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, MOLEHOLES, 0); // blank hole
-                    refresh();
-                    unlock_ncurses();
+        if ((err = pthread_cond_broadcast(&start_cond)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to broadcast start_cond.");
+        }
 
-                    lock_molecomm();
-                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
-                    molecomm[i].animspec = EscapedAnim;
-                    molecomm[i].animspec.hole = pnew->hole;
-                    lock_scores(); //prevent scores from moving due to asyncronous realloc call
-                    lock_ncurses();
-                    molecomm[i].animspec.score1 = scores[molecomm[i].scoreidx].missedscore;
-                    unlock_scores();
-                    molecomm[i].animspec.score2 = 0;
-                    molecomm[i].animspec.mole = pnew->mole;
-                    molecomm[i].animcancelled = 0;
-#if defined(debug)
-                    molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+        if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock start mutex.");
+        }
+        mark_startup_phase(SP_COUNTDOWN);
+    } else {
+        if (! autoplay) {
+            if (roundplan.round <= 1) {  // Tournament rounds after the first go straight to the countdown
+                display_intro(moles, moles * (moletime + GRACEPERIOD) / 1000);
+            }
+            mark_startup_phase(SP_MENU);
+            display_countdown(COUNTDOWNSTEPS, COUNTDOWNSTEP);
+            mark_startup_phase(SP_COUNTDOWN);
+        }
+        countdown_complete = 1;
 
-                    if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                    }
-                    unlock_ncurses();
-                } break;
+        kbinput_tid = start_input_thread();
+        display_tid = start_display_thread();
+        mark_startup_phase(SP_THREADS);
+    }
 
-                case TERMINATING: {
-                    // Join the animation thread from prev status
-                    //
-                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
-                                                               // molecomm while we wait on joining
-                                                               // the animation thread. But without the 
-                                                               // lock, some other thread could mess
-                                                               // with it.
+    watchdog_tid = start_watchdog_thread();
 
-                    unlock_molecomm();
-                    void *retval;
+    perf_phase(PP_PLAY);
+    control_moles(moles, moletime);
+    append_game_event(GE_GAMEEND, -1, 0, -1, 0, 0, NULL);
 
-                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join whacked/missed/scared anim thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
-                    }
+    if ((err = pthread_cancel(*watchdog_tid)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel watchdog thread.");
+    }
 
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, MOLEHOLES, 0); // blank hole
-                    refresh();
-                    unlock_ncurses();
+    void *retval;
+    if ((err = pthread_join(*watchdog_tid, &retval)) != 0) { // join watchdog thread
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join watchdog thread. Error=%d.", err);
+    }
 
-                    lock_molecomm();
-                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
-                } break;
+    if ((err = pthread_cancel(*kbinput_tid)) != 0) {
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel input thread.");
+    }
 
-                case SCARED: {
-                    // Join the UP or HIDING animation thread from prev status
-                    pthread_t pttemp = molecomm[i].animthread; // Snapshot this. We have to unlock
-                                                               // molecomm while we wait on joining
-                                                               // the animation thread. But without the
-                                                               // lock, some other thread could mess
-                                                               // with it.
-                    unlock_molecomm();
-                    void *retval;
+    if ((err = pthread_join(*kbinput_tid, &retval)) != 0) { // join input thread
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join input thread. Error=%d.", err);
+    }
 
-                    if ((err = pthread_join(pttemp, &retval)) != 0) { // Join up/hiding anim thread
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join animation thread %d. Error=%d.", i, err);
-                    }
+    if ((err = pthread_cancel(*display_tid)) != 0) { 
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel display thread.");
+    }
 
-                    lock_ncurses();
-                    show_mole(molecomm[i].hole, MOLEHOLES, 0); // blank hole
-                    refresh();
-                    unlock_ncurses();
+    if ((err = pthread_join(*display_tid, &retval)) != 0) { // join display thread
+        restore_terminal();
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join display thread. Error=%d.", err);
+    }
 
-                    lock_molecomm();
-                    memset(&molecomm[i].animspec, 0, sizeof(molecomm[i].animspec));
+    stop_mole_workers();
+    audit_game_events();
+    if (players > 1) {
+        tally_players();
+    }
 
-                    // Select one of three animations, depending on mole state when scared
-                    if (molecomm[i].displayack == UP) {
-                        molecomm[i].animspec = UpScaredAnim;
-                        molecomm[i].animspec.hole = pnew->hole;
-                        molecomm[i].animspec.mole = pnew->mole;
-                        molecomm[i].animcancelled = 0;
-#if defined(debug)
-                        molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+    lock_ncurses();
+    screen_end_play();  // Back to ncurses output
+    unlock_ncurses();
+}
 
-                        if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                            restore_terminal();
-                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                        }
-                    } else if (molecomm[i].displayack == HIDING) {
-                        if (molecomm[i].keystruck == holekeys[molecomm[i].hole]) {
-                            molecomm[i].animspec = MisfireScaredAnim;
-                            molecomm[i].animspec.hole = pnew->hole;
-                            molecomm[i].animspec.mole = pnew->mole;
-                            molecomm[i].animcancelled = 0;
-#if defined(debug)
-                            molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+//=========================
+// void reset_game(void)
+//
+// Puts the per-game state back the way it was at launch, so play_game() can
+// run again.  (Soak and tournament modes.)  Only the main thread may be
+// running, besides a round_prep_thread(), which touches none of this.
+//
+// Returns: void
+//
+void reset_game(void) {
+    lock_scores();
+    if (scores != NULL) free(scores);
+    scores = NULL;
+    numscores = 0;
+    scorescapacity = 0;
+    missedcount = 0;
+    int i, j;
+    for (i = 0; i < moleholes; i++) {
+        for (j = 0; j < PLAYRESULTS; j++) {
+            holestatsrun[i].results[j] += holestats[i].results[j];
+        }
+        holestatsrun[i].reactmsec += holestats[i].reactmsec;
+    }
+    memset(holestats, 0, sizeof(holestats));
+    unlock_scores();
+    if (players > 1) {
+        memset(playerlogs, 0, sizeof(playerlogs));
+    }
 
-                            if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                                restore_terminal();
-                                error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                            }
-                        } else {
-                            molecomm[i].animspec = HideScaredAnim;
-                            molecomm[i].animspec.hole = pnew->hole;
-                            molecomm[i].animspec.mole = pnew->mole;
-                            molecomm[i].animcancelled = 0;
-#if defined(debug)
-                            molecomm[i].animspec.threadsn = ++threadsn;
-#endif
+    molesremaining = -1;
+    watchdogstats.dumps = 0;  // (The next game's first dump starts a new file)
+    memset(hudscores, 0, sizeof(hudscores));
+    kbthread_running = 0;
+    display_thread_running = 0;
+    scrollrows = scrollcols = 0;
+    reset_slots();
+}
 
-                            if ((err = pthread_create(&molecomm[i].animthread, NULL, animation_thread, &molecomm[i].animspec)) != 0) {
-                                restore_terminal();
-                                error_at_line(-1, err, __FILE__, __LINE__, "Unable to create animation thread %d.", i);
-                            }
-                        }
-                    } else {
-                    }
-                } break;
+//=========================
+// void reset_slots(void)
+//
+// Clears the mole slots and holes for a new game.  Nothing but the caller
+// may be using them: no mole workers, and no input or display thread.  The
+// holes' sprites are drawn by the menus too, so this is for the main thread.
+//
+// Returns: void
+//
+void reset_slots(void) {
+    memset(molecomm, 0, sizeof(molecomm));   // (Slots are all AVAILABLE by now anyway.)
+    memset(holeuse, 0, sizeof(holeuse));
+    memset(holegrace, 0, sizeof(holegrace));
+    memset(holesprites, 0, sizeof(holesprites));
+}
 
-                default: {
-                    // intentionally left empty
-                } break;
-            }
+//==========================================
+// void prepare_round(struct RoundPlan *plan)
+//
+// Sets up a round ahead of time, so it can start the moment the player is
+// ready: draws the spawn schedule (the same start delays and up times
+// mole_visit() would otherwise draw as it goes), and allocates score sheet
+// storage.  Runs on round_prep_thread() while the previous round's score
+// sheet is up, so it keeps to the plan: the slots, holes and screen are the
+// main thread's, and are reset by reset_game() at the start of the round.
+//
+// plan = round to prepare. round, moles and moletime are filled in; the
+//        rest is filled in here.
+//
+// Returns: void
+//
+void prepare_round(struct RoundPlan *plan) {
+    struct timespec t0, t1;
+    int i;
 
-            molecomm[i].displayack = molecomm[i].molestatus; // Ack mole_thread
-            if ((err = pthread_cond_signal(&molecomm[i].dispcond)) != 0) {
-                restore_terminal();
-                error_at_line(-1, err, __FILE__, __LINE__, "Unable to send display cond signal to mole thread %d.", i);
-            }
-            unlock_molecomm();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < plan->moles; i++) {
+        if (i == 0) {
+            plan->startdelay[i] = faststart ? MOLESTARTDELAYFAST : MOLESTARTDELAYMIN;
+        } else {
+            plan->startdelay[i] = tsrandom() % (MOLESTARTDELAYMAX - MOLESTARTDELAYMIN) + MOLESTARTDELAYMIN;
         }
+        plan->uptime[i] = (tsrandom() % 5000L + 3000L) * plan->moletime / 10000L;
+    }
 
-        memcpy(oldmolecomm, newmolecomm, sizeof(oldmolecomm)); // save copy 
+    plan->scorescapacity = plan->moles * 2;  // A record per mole, with room for misfires
+    if ((plan->scores = malloc(plan->scorescapacity * sizeof(struct ScoreSheetRecord))) == NULL) {
+        restore_terminal();
+        error_at_line(-1, errno, __FILE__, __LINE__, "Unable to allocate score sheet for round %d.", plan->round);
+    }
 
-        // Now look for a new scoresheet record and handle it
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ++roundstats.prepared;
+    roundstats.prepusec += (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
+    log_event("round %ld prepared: %ld moles, %ld ms each", plan->round, plan->moles, plan->moletime);
+}
 
-        lock_scores(); 
+//=================================
+// void *round_prep_thread(void *arg)
+//
+// Runs prepare_round() in the background.
+//
+// arg = pointer to the struct RoundPlan
+//
+void *round_prep_thread(void *arg) {
+ #if defined(debug) && defined(_GNU_SOURCE)
+    pthread_setname_np(pthread_self(), "WAM-RoundPrep");
+ #endif
 
-        if (numscores > knownscores) {
+    prepare_round((struct RoundPlan *)arg);
+    return NULL;
+}
 
-            // make temp copy, since scores can be realloc'd and move on us
-            struct ScoreSheetRecord tscore = scores[knownscores];
-            unlock_scores();
-            if (tscore.playresult == MISFIRE || tscore.playresult == TOOSOON) {
-                // If we get here, we have a misfire.
+//=====================================
+// void read_initials(char *initials)
+//
+// Asks the next tournament player for their initials (up to 3 letters or
+// digits, Enter when done).
+//
+// initials = where to put them (4 chars, with the terminating nul).
+//
+// Returns: void
+//
+void read_initials(char *initials) {
+    int row = 8;
+    int col = 30;
+    int len = 0;
+    char key;
 
-                lock_molecomm();
-                int i;
-                // First step with misfire is to cancel all active animation threads
-                for (i=0; i<CONCURRENTMOLES; i++) { // Check each mole thread for active animation
+    lock_ncurses();
+    clear();
+    mvprintw(row, col, "===================");
+    mvprintw(row+1, col, "    TOURNAMENT");
+    mvprintw(row+2, col, " Player initials:");
+    mvprintw(row+5, col, "  (Enter when done)");
+    mvprintw(row+6, col, "===================");
+    refresh();
+    unlock_ncurses();
 
-                    if ((molecomm[i].animspec.animationtype == ANIMHIDING ||
-                         molecomm[i].animspec.animationtype == ANIMPOPUP)
-                        && molecomm[i].animspec.synccount > 0     // animation must have started
-                        && molecomm[i].animspec.synccount < molecomm[i].animspec.syncpoints // and animation can't be ending
-                        && molecomm[i].animcancelled == 0) {      // and animation not already cancelled
+    clear_input_buffer();
+    memset(initials, 0, 4);
+    for (;;) {
+        lock_ncurses();
+        mvprintw(row+3, col+7, "%c %c %c", len > 0 ? initials[0] : '_', len > 1 ? initials[1] : '_', len > 2 ? initials[2] : '_');
+        refresh();
+        unlock_ncurses();
 
-                        if ((err = pthread_cancel(molecomm[i].animthread)) != 0) { //kill animation
-                            restore_terminal();
-                            error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
-                        }
+        key = waitforkey(NULL);
+        if ((key == '\n' || key == '\r') && len > 0) {
+            break;
+        } else if ((key == 127 || key == '\b') && len > 0) {
+            initials[--len] = '\0';
+        } else if (isalnum((unsigned char)key) && len < 3) {
+            initials[len++] = toupper(key);
+        }
+    }
+}
 
-                        molecomm[i].animcancelled = 1;
-                        // flag animation as finished
-                        molecomm[i].animspec.synccount =  molecomm[i].animspec.syncpoints;
-                    }
-                }
+//==============================================
+// int leaderboard_player(const char *initials)
+//
+// Finds a player's leaderboard entry, adding one if need be.  When the
+// board is full, the lowest total makes way.
+//
+// initials = player's initials
+//
+// Returns: index of the entry in leaderboard[]
+//
+int leaderboard_player(const char *initials) {
+    int i;
 
-                // Next step is to let each mole thread proceed, if it was waiting on key press
-                for (i=0; i<CONCURRENTMOLES; i++) {
+    for (i = 0; i < leaderboardsize; i++) {
+        if (strcmp(leaderboard[i].initials, initials) == 0) return i;
+    }
+    if (leaderboardsize < LEADERBOARDSIZE) {
+        i = leaderboardsize++;
+    } else {
+        i = LEADERBOARDSIZE - 1;
+    }
+    memset(&leaderboard[i], 0, sizeof(struct LeaderboardEntry));
+    strncpy(leaderboard[i].initials, initials, sizeof(leaderboard[i].initials) - 1);
+    return leaderboard_place(i);
+}
 
-                    molecomm[i].keystruck = tscore.selection;
-                    if ((err = pthread_cond_signal(&molecomm[i].keycond)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send cond signal to thread slot %d",i);
-                    }
-                }
+//==============================================
+// int leaderboard_add_round(int idx, int score)
+//
+// Adds a round's score to a player's totals.
+//
+// idx = player's entry
+// score = round score
+//
+// Returns: the entry's new index (see leaderboard_place())
+//
+int leaderboard_add_round(int idx, int score) {
+    struct LeaderboardEntry *e = &leaderboard[idx];
 
-                unlock_molecomm();
+    if (e->rounds == 0 || score > e->best) e->best = score;
+    e->total += score;
+    ++e->rounds;
+    return leaderboard_place(idx);
+}
 
-                const long MisfireDisplayTime = 1500; //(msec)
-                struct timespec tsnow, tsexp;
-                clock_gettime(CLOCK_MONOTONIC, &tsnow);
-                tsexp = tsnow;
-                tsexp.tv_nsec += (MisfireDisplayTime % 1000) * MSEC;
-                tsexp.tv_sec += MisfireDisplayTime / 1000;
-                if (tsexp.tv_nsec >=  1000000000L) {
-                    tsexp.tv_nsec -= 1000000000L;
-                    tsexp.tv_sec++;
-                }
+//=================================
+// int leaderboard_place(int idx)
+//
+// Moves an entry whose total changed to keep the board sorted: best total
+// first, ties to whoever got there first.
+//
+// idx = entry
+//
+// Returns: the entry's new index
+//
+int leaderboard_place(int idx) {
+    struct LeaderboardEntry e = leaderboard[idx];
 
-                misfires[tscore.hole].timer = tsexp;  // notes misfire status for later
-            }
+    for (; idx > 0 && leaderboard[idx - 1].total < e.total; idx--) {
+        leaderboard[idx] = leaderboard[idx - 1];
+    }
+    for (; idx < leaderboardsize - 1 && leaderboard[idx + 1].total > e.total; idx++) {
+        leaderboard[idx] = leaderboard[idx + 1];
+    }
+    leaderboard[idx] = e;
+    return idx;
+}
 
-            lock_ncurses();
 
-            mvprintw(10,53, "   SCORE: %d ", tscore.endscore);
-            refresh();
-            unlock_ncurses();
+//===============================
+// void show_hole_heat(int hole)
+//
+// Draws a hole's heatmap (-m) on the rims of its frame, which moles and
+// results never draw over.  The top rim has its counts: W whacked, M missed
+// (escaped or scared off) and F misfired (misfire or too soon).  When they
+// don't fit, the spaces go, then the biggest counts show as + (10 or more),
+// so a count is never cut short.  The bottom rim fills with # in proportion
+// to the moles that got away.
+//
+// Reads holestats[] without the score lock: a count that is one result
+// behind gets fixed by the next one's redraw.
+//
+// The calling function must hold the ncurses mutex.
+//
+// Returns: void
+//
+void show_hole_heat(int hole) {
+    struct HoleScreenCoords *hsc = &holescreencoords[hole];
+    struct HoleStats *hs = &holestats[hole];
+    char counts[3 * 12 + 8];
+    char shown[3][12];
+    char bar[HEATWIDTH + 1];
+    int capped[3] = {0, 0, 0};
+    int i, len;
+
+    if (! hsc->visible) return;
+
+    int whacked = hs->results[WHACK];
+    int missed = hs->results[ESCAPE] + hs->results[SCAREDOFF];
+    int misfired = hs->results[MISFIRE] + hs->results[TOOSOON];
+    int n[3] = {whacked, missed, misfired};
+    for (;;) {  // (Long games) Ends by "W+ M+ F+" at the latest
+        for (i = 0; i < 3; i++) {
+            snprintf(shown[i], sizeof(shown[i]), capped[i] ? "+" : "%d", n[i]);
+        }
+        len = snprintf(counts, sizeof(counts), "W%s M%s F%s", shown[0], shown[1], shown[2]);
+        if (len <= HEATWIDTH) break;
+        len = snprintf(counts, sizeof(counts), "W%sM%sF%s", shown[0], shown[1], shown[2]);
+        if (len <= HEATWIDTH) break;
+        int big = -1;  // Cap the biggest count not yet capped (one of 10 or more, or it'd fit)
+        for (i = 0; i < 3; i++) {
+            if (! capped[i] && (big < 0 || n[i] > n[big])) big = i;
+        }
+        capped[big] = 1;
+    }
+    for (i = len; i < HEATWIDTH; i++) counts[i] = '_';
+    counts[HEATWIDTH] = '\0';
 
-            ++knownscores;
-        } else {
+    int moles = whacked + missed;
+    int heat = moles > 0 ? (missed * HEATWIDTH + moles - 1) / moles : 0;  // (Rounded up: any miss shows)
+    for (i = 0; i < HEATWIDTH; i++) bar[i] = i < heat ? '#' : '_';
+    bar[HEATWIDTH] = '\0';
+
+    screen_print(hsc->frametop, hsc->frameleft + 2, "%s", counts);
+    screen_print(hsc->frametop + HOLEHEIGHT - 1, hsc->frameleft + 2, "%s", bar);
+}
+
+//================================
+// void print_hole_stats(FILE *f)
+//
+// Prints the outcomes at each hole over the whole run, and the average
+// reaction time of the whacks there.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_hole_stats(FILE *f) {
+    int i, j;
+    long total = 0;
 
-            unlock_scores();
+    for (i = 0; i < moleholes; i++) {
+        for (j = 0; j < PLAYRESULTS; j++) total += holestats[i].results[j] + holestatsrun[i].results[j];
+    }
+    if (total == 0) return;
+
+    fprintf(f, "Holes: %ld results\n", total);
+    fprintf(f, "  hole  whack  escape  misfire  toosoon  scared  avg whack ms\n");
+    for (i = 0; i < moleholes; i++) {
+        int n[PLAYRESULTS];
+        for (j = 0; j < PLAYRESULTS; j++) n[j] = holestats[i].results[j] + holestatsrun[i].results[j];
+        long reactmsec = holestats[i].reactmsec + holestatsrun[i].reactmsec;
+        fprintf(f, "  %4c  %5d  %6d  %7d  %7d  %6d", holekeys->keys[0][i], n[WHACK], n[ESCAPE], n[MISFIRE], n[TOOSOON], n[SCAREDOFF]);
+        if (n[WHACK] > 0) {
+            fprintf(f, "  %12ld\n", reactmsec / n[WHACK]);
+        } else {
+            fprintf(f, "  %12s\n", "-");
         }
+    }
+}
 
-        // Handle misfire display.  If timer has not expired, misfire needs to be displayed
-        // (if it isn't already up).  If timer has expires, take down the display if needed.
-        // Also, we lock out the hole during the misfire display so any mole than needs it
-        // will be forced to wait.
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
+//==================================
+// void print_leaderboard(FILE *f)
+//
+// Prints the tournament leaderboard, and how long round setup took and
+// how long rounds waited for it.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_leaderboard(FILE *f) {
+    int i;
 
-        misfirepending = 0;  // Flag indicates one or more misfires pending, 
-                             // so don't let thread be cancelled if set.
-        for (i=0; i<MOLEHOLES; i++) {
+    fprintf(f, "Tournament leaderboard (%d rounds each):\n", tournamentrounds);
+    fprintf(f, "    #  player  rounds    best   total\n");
+    for (i = 0; i < leaderboardsize; i++) {
+        struct LeaderboardEntry *e = &leaderboard[i];
+        fprintf(f, "  %3d  %-6s  %6d  %6d  %6d\n", i + 1, e->initials, e->rounds, e->best, e->total);
+    }
+    if (roundstats.prepared > 0) {
+        fprintf(f, "  round setup:     %ld rounds, %ld us each, %ld us waited for on average\n", roundstats.prepared,
+                roundstats.prepusec / roundstats.prepared, roundstats.waitusec / roundstats.prepared);
+    }
+}
 
-            if (misfires[i].timer.tv_sec > now.tv_sec || (misfires[i].timer.tv_sec == now.tv_sec && misfires[i].timer.tv_nsec > now.tv_nsec)) {
+//===================================
+// int display_leaderboard(int player)
+//
+// Shows the tournament leaderboard after a player's last round, and asks
+// whether another player is up.
+//
+// player = the player who just finished (leaderboard index), marked with >
+//
+// Returns: 1 = another player, 0 = tournament over
+//
+int display_leaderboard(int player) {
+    int row = 3;
+    int col = 24;
+    char key;
+    int i;
 
-                // make sure misfire is displayed.
-                // If mole hole is already locked, it meand the misfire was on a
-                // hiding mole. Thius will be handled by an animation, so no need
-                // to do the misfile frame here.
-                if (misfires[i].status == 0 && check_mole_hole(i) == 0) {
-                    claim_mole_hole(i); // Lock hole
+    lock_ncurses();
+    clear();
+    mvprintw(row, col, "================================");
+    mvprintw(row+1, col, "   TOURNAMENT LEADERBOARD");
+    mvprintw(row+2, col, "================================");
+    mvprintw(row+3, col, "     #  PLAYER  ROUNDS   TOTAL");
+    for (i = 0; i < leaderboardsize; i++) {
+        struct LeaderboardEntry *e = &leaderboard[i];
+        mvprintw(row+4+i, col, "%c  %3d  %-6s  %6d  %6d", i == player ? '>' : ' ', i + 1, e->initials, e->rounds, e->total);
+    }
+    mvprintw(row+5+leaderboardsize, col, "  Another player? (Y/N)");
+    refresh();
+    unlock_ncurses();
 
-                    misfires[i].status = 1;
-                    lock_ncurses();
+    clear_input_buffer();
+    do {
+        key = toupper(waitforkey(NULL));
+    } while (key != 'Y' && key != 'N');
+    return key == 'Y';
+}
 
-                    show_result(i, MOLEHOLES, MISFIRE, 0, 0, NULL);
-                    unlock_ncurses();
-                }
-            } else {
-                // make sure misfire is NOT displayed
-                if (misfires[i].status == 1) {
-                    // Clear misfire display
-                    misfires[i].status = 0;
-                    lock_ncurses();
+//==============================================
+// int play_tournament(int moles, int moletime)
+//
+// Plays a tournament (-T): each player plays tournamentrounds rounds, each
+// with more and quicker moles than the last, and their totals go on the
+// leaderboard.  Each round is prepared on a round_prep_thread() while the
+// player is busy with something else (their initials, or the last round's
+// score sheet), so it starts as soon as they are ready.  Autoplay has one
+// player, BOT.
+//
+// moles, moletime = first round's moles and cycle time (msec)
+//
+// Returns: rounds played
+//
+int play_tournament(int moles, int moletime) {
+    char initials[4];
+    pthread_t prep_tid;
+    struct timespec t0, t1;
+    int played = 0;
+    int another;
+    int err;
 
-                    show_result(i, MOLEHOLES, -1, 0, 0, "");
-                    unlock_ncurses();
+    do {
+        roundplan.round = 1;
+        roundplan.moles = moles;
+        roundplan.moletime = moletime;
+        if ((err = pthread_create(&prep_tid, NULL, round_prep_thread, &roundplan)) != 0) {
+            restore_terminal();
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create round setup thread.");
+        }
 
-                    release_mole_hole(i); 
+        if (autoplay) {
+            strcpy(initials, "BOT");
+        } else {
+            read_initials(initials);
+        }
+        int player = leaderboard_player(initials);
+
+        int round;
+        for (round = 1; round <= tournamentrounds; round++) {
+            void *retval;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if ((err = pthread_join(prep_tid, &retval)) != 0) { // join round setup thread
+                restore_terminal();
+                error_at_line(-1, err, __FILE__, __LINE__, "Unable to join round setup thread. Error=%d.", err);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            roundstats.waitusec += (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
+            reset_game();
+
+            int roundmoles = roundplan.moles;
+            int roundmoletime = roundplan.moletime;
+            play_game(roundmoles, roundmoletime);
+            ++played;
+
+            int roundscore = numscores > 0 ? scores[numscores - 1].endscore : 0;
+            player = leaderboard_add_round(player, roundscore);
+            log_event("tournament: player %ld round %ld score %ld", player, round, roundscore);
+
+            if (round < tournamentrounds) {  // Set up the next round while this one's score sheet is up
+                roundplan.round = round + 1;
+                roundplan.moles = roundmoles + ROUNDMOLESTEP;
+                if (roundplan.moles > MAXPOPUPCOUNT) roundplan.moles = MAXPOPUPCOUNT;
+                roundplan.moletime = roundmoletime * ROUNDSPEEDUP / 100;
+                if (roundplan.moletime < ROUNDMINMOLETIME) roundplan.moletime = ROUNDMINMOLETIME;
+                if ((err = pthread_create(&prep_tid, NULL, round_prep_thread, &roundplan)) != 0) {
+                    restore_terminal();
+                    error_at_line(-1, err, __FILE__, __LINE__, "Unable to create round setup thread.");
                 }
+            } else {
+                roundplan.round = 0;
             }
 
-            if (misfires[i].status == 1) {
-                    misfirepending = 1;     // Causes thread to be uncancellable
+            perf_phase(PP_SCORESHEET);
+            if (! autoplay) {
+                display_gameover();
+                display_score_sheet(roundscore, roundmoles, roundmoles * (roundmoletime + GRACEPERIOD) / 1000);
             }
         }
 
-        if (! misfirepending) {  // can't cancel thread if any misfires pending
+        another = autoplay ? 0 : display_leaderboard(player);
+        if (another) {
+            reset_game();
+        }
+    } while (another);
 
-            enable_thread_cancel(); // Give main() a chance to cancel the thread
+    return played;
+}
+
+//================================================
+// const char *load_sprite_pack(const char *path)
+//
+// Reads a sprite pack (see struct SpritePackFile) into spritepack.pack with
+// one read(), then points the sprites' rows (asciimole[] and the rest, and
+// holeframe[]) straight at the copy.  Nothing is parsed: the copy is checked
+// (size, magic, each sprite's name line, every row printable and ending in
+// a newline), and if it passes, it is used as is.  If it doesn't, the
+// compiled-in art is left as it was.
+//
+// The file isn't used after that, so it may be edited, rewritten (-W) or
+// deleted while the game runs.
+//
+// Must be called before any threads are started.
+//
+// path = pack file
+//
+// Returns: NULL on success, else why the pack can't be used.
+//
+const char *load_sprite_pack(const char *path) {
+    static char why[128];
+    struct SpritePack *sp = &spritepack;
+    const struct SpritePackFile *pack = &sp->pack;
+    struct timespec t0, t1;
+    struct stat st;
+    char name[SPRITEWIDTH + 2];
+    size_t got = 0;
+    ssize_t n;
+    int s, r, fd;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        snprintf(why, sizeof(why), "%s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return why;
+    }
+    if (st.st_size != sizeof(struct SpritePackFile)) {
+        snprintf(why, sizeof(why), "it is %ld bytes, a pack is %ld", (long)st.st_size, (long)sizeof(struct SpritePackFile));
+        close(fd);
+        return why;
+    }
+    while (got < sizeof(struct SpritePackFile)) {  // (Regular files read whole, barring signals)
+        n = read(fd, (char *)&sp->pack + got, sizeof(struct SpritePackFile) - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            snprintf(why, sizeof(why), "%s", n < 0 ? strerror(errno) : "it was cut short while being read");
+            close(fd);
+            return why;
         }
+        got += n;
+    }
+    close(fd);
 
-        struct timespec sleeptime = {0, 10000000L}; // 10 msec sleep so we
-        nanosleep(&sleeptime, NULL);                // don't burn up the cpu
+    snprintf(why, sizeof(why), "not a sprite pack");
+    if (memcmp(pack->magic, SPRITEPACKMAGIC, sizeof(pack->magic)) != 0) {
+        return why;
+    }
+    for (s = 0; s < SPRITES; s++) {
+        snprintf(name, sizeof(name), "%-*s\n", SPRITEWIDTH, spritenames[s]);
+        if (memcmp(pack->sprites[s].name, name, sizeof(pack->sprites[s].name)) != 0) {
+            snprintf(why, sizeof(why), "expected sprite \"%s\" at byte %ld", spritenames[s],
+                     (long)((const char *)pack->sprites[s].name - (const char *)pack));
+            return why;
+        }
+        for (r = 0; r < SPRITEROWS; r++) {
+            if (! pack_row_ok(pack->sprites[s].rows[r], SPRITEWIDTH)) {
+                snprintf(why, sizeof(why), "sprite \"%s\" row %d isn't %d printable characters", spritenames[s], r + 1, SPRITEWIDTH);
+                return why;
+            }
+        }
+    }
+    snprintf(name, sizeof(name), "%-*s\n", SPRITEWIDTH, "frame");
+    if (memcmp(pack->framename, name, sizeof(pack->framename)) != 0) {
+        snprintf(why, sizeof(why), "expected \"frame\" at byte %ld", (long)(pack->framename - (const char *)pack));
+        return why;
+    }
+    for (r = 0; r < HOLEHEIGHT; r++) {
+        if (! pack_row_ok(pack->frame[r], HOLEWIDTH)) {
+            snprintf(why, sizeof(why), "frame row %d isn't %d printable characters", r + 1, HOLEWIDTH);
+            return why;
+        }
     }
 
+    for (s = 0; s < SPRITES; s++) {
+        for (r = 0; r < SPRITEROWS; r++) {
+            spriteart[s][r] = pack->sprites[s].rows[r];
+        }
+    }
+    for (r = 0; r < HOLEHEIGHT; r++) {
+        holeframe[r] = pack->frame[r];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sp->path = path;
+    sp->loadusec = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
     return NULL;
 }
 
-//===============================
-// void *input_thread(void *arg)
-//
-// Keyboard input thread.
+//===============================================
+// int pack_row_ok(const char *row, int width)
 //
-// Scans for keyboard input and communicates key presses to
-// mole threads through global MoleComm structure.
+// row = a row of a sprite pack (as read, so not NUL terminated)
+// width = characters it should have before its newline
 //
-// If no mole thread is expecting the key, a scoresheet record is
-// created with a misfire record.  Misfire also sets scaredflag for each
-// molecomm record.
+// Returns: 1 if it is that many printable ASCII characters and a newline, else 0.
 //
-void *input_thread(void *arg) {
-    char inputkey;
-    long msec;
-    int err;
- #if defined(debug) && defined(_GNU_SOURCE)
-    pthread_setname_np(pthread_self(), "WAM-Input");
- #endif
+int pack_row_ok(const char *row, int width) {
+    int i;
 
-    if ((err = pthread_mutex_lock(&start_mtx)) != 0) {   // set up mutex for cond wait
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    for (i = 0; i < width; i++) {
+        if (row[i] < ' ' || row[i] > '~') return 0;
     }
+    return row[width] == '\n';
+}
 
-    kbthread_running = 1;
+//=========================================
+// int write_sprite_pack(const char *path)
+//
+// Writes the compiled-in art as a sprite pack, to start a new one from.
+// (Call it before load_sprite_pack(), which replaces that art.)
+//
+// path = file to create (or truncate)
+//
+// Returns: 0 on success, -1 on error (errno set).
+//
+int write_sprite_pack(const char *path) {
+    FILE *f = fopen(path, "w");
+    int s, r;
+
+    if (f == NULL) return -1;
+    fputs(SPRITEPACKMAGIC, f);
+    for (s = 0; s < SPRITES; s++) {
+        fprintf(f, "%-*s\n", SPRITEWIDTH, spritenames[s]);
+        for (r = 0; r < SPRITEROWS; r++) {
+            fprintf(f, "%-*.*s\n", SPRITEWIDTH, SPRITEWIDTH, spriteart[s][r]);
+        }
+    }
+    fprintf(f, "%-*s\n", SPRITEWIDTH, "frame");
+    for (r = 0; r < HOLEHEIGHT; r++) {
+        fprintf(f, "%-*.*s\n", HOLEWIDTH, HOLEWIDTH, holeframe[r]);
+    }
+    if (ferror(f)) {
+        int err = errno;
+        fclose(f);
+        errno = err;
+        return -1;
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+//=================================
+// void print_sprite_stats(FILE *f)
+//
+// Prints which sprite pack is in use, if any.
+//
+// f = stream to print on.
+//
+// Returns: void
+//
+void print_sprite_stats(FILE *f) {
+    if (spritepack.path == NULL) return;
+
+    fprintf(f, "Sprites: pack %s, %ld bytes read, checked and in use %ld usec after opening\n",
+            spritepack.path, (long)sizeof(struct SpritePackFile), spritepack.loadusec);
+}
 
-    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+//=================================================================================
+// int rescore_archives(const char *rulespath, char *paths[], int npaths)
+//
+// Offline rescoring (-R): reads archived game event logs (-E files), scores
+// every game again under the rule table in rulespath, and prints the final
+// scores' distribution before (as logged) and after, on stdout.
+//
+// Nothing is replayed in time: each game's score records (result, bonus
+// stage, player) are simply run through the new rules.  The archive is
+// streamed: this thread reads it a game at a time into a short queue, and a
+// worker per core (up to RESCOREWORKERS) takes games from it and rescores
+// them, each into its own tally.  The tallies are added up at the end.
+//
+// rulespath = rule table (see read_score_rules())
+// paths = archive files, "-" for stdin...
+// npaths =    ...and how many (0 = just stdin).
+//
+// Returns: exit status for main(): 0, or 1 if the rules or an archive
+//          couldn't be read.
+//
+int rescore_archives(const char *rulespath, char *paths[], int npaths) {
+    struct RescoreQueue *q = &rescorequeue;
+    struct RescoreWorker *workers;
+    struct RescoreTally *total;
+    struct timespec t0, t1;
+    char *line = NULL;
+    size_t linesize = 0;
+    int nworkers, i, j, err, status = 0;
+
+    if (read_score_rules(rulespath, &rescorerules) != 0) {
+        return 1;
     }
 
-    if ((err = pthread_cond_signal(&start_cond)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send start_cond signal to main thread.");
+    nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) nworkers = 1;
+    if (nworkers > RESCOREWORKERS) nworkers = RESCOREWORKERS;
+    workers = calloc(nworkers, sizeof(struct RescoreWorker));
+    total = calloc(1, sizeof(struct RescoreTally));
+    if (workers == NULL || total == NULL) {
+        error_at_line(-1, errno, __FILE__, __LINE__, "Unable to allocate rescoring tallies.");
     }
 
-    for (;;) {
-        msec = 1L;   // wait a msec so as not to slam cpu
-        inputkey = waitforkey(&msec);
-
-#if defined(AUTOPLAY)
-        if (inputkey == '\0') {
-            struct timespec chaos;
-            int autoplaymsec = tsrandom() % AUTOPLAY;
-            chaos.tv_sec = autoplaymsec / 1000;
-            chaos.tv_nsec = autoplaymsec % 1000 * 1000000L;
-            nanosleep(&chaos, NULL);
-            inputkey = holekeys[tsrandom() % sizeof(holekeys)];
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nworkers; i++) {
+        if ((err = pthread_create(&workers[i].tid, NULL, rescore_worker, &workers[i].tally)) != 0) {
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create rescoring worker.");
         }
-#endif
+    }
 
-        if (inputkey != '\0') {
-            // make sure this key is even a valid selection
-            if (memchr((const void *)holekeys, (int)inputkey, sizeof(holekeys)) == NULL) {
-                continue;
+    for (i = 0; i < (npaths > 0 ? npaths : 1); i++) {
+        const char *path = npaths > 0 ? paths[i] : "-";
+        FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+        char *game = NULL;      // Lines of the game being read...
+        size_t len = 0, cap = 0; //    ...how much of it there is, and room for.
+        ssize_t n;
+
+        if (f == NULL) {
+            fprintf(stderr, "rescore: unable to open \"%s\": %s\n", path, strerror(errno));
+            status = 1;
+            continue;
+        }
+        while ((n = getline(&line, &linesize, f)) > 0) {
+            if (strncmp(line, "# game ", 7) == 0 && len > 0) {  // The last game is complete
+                rescore_queue_put(game);
+                game = NULL;
+                len = cap = 0;
             }
-
-            // Some key was hit. Lock molecomm mutex while we figure it out.
-            disable_thread_cancel(); // don't get cancelled while holding a lock
-            lock_molecomm();
-
-            int whackflag = 0;
-            int i;
-            for (i=0; i<CONCURRENTMOLES; i++) { // Check each mole thread
-
-                if (molecomm[i].molestatus == UP              // Mole must be UP
-                    && molecomm[i].displayack == UP           // and display thread must agree it's up
-                    && holekeys[molecomm[i].hole] == inputkey // and correct key must be hit
-                    && molecomm[i].keystruck != inputkey      // and this is first time key struck
-                    && molecomm[i].animspec.synccount > 0     // and animation must have started
-                    && molecomm[i].animspec.synccount <       // and animation can't be ending
-                            molecomm[i].animspec.syncpoints   
-                    && molecomm[i].animcancelled == 0) {      // and animation not already cancelled
-
-                    if ((err = pthread_cancel(molecomm[i].animthread)) != 0) { //kill animation
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel animation thread.");
-                    }
-                    molecomm[i].animcancelled = 1;
-                    whackflag = 1;
-                    molecomm[i].keystruck = inputkey;
-
-                    // let mole thread proceed
-                    if ((err = pthread_cond_signal(&molecomm[i].keycond)) != 0) {
-                        restore_terminal();
-                        error_at_line(-1, err, __FILE__, __LINE__, "Unable to send cond signal to thread slot %d",i);
-                    }
-                } else if ((molecomm[i].molestatus == EXPIRED || molecomm[i].molestatus == WHACKED || (molecomm[i].molestatus == UP && molecomm[i].animspec.synccount == molecomm[i].animspec.syncpoints)) && holekeys[molecomm[i].hole] == inputkey){
-                    // Both these conditions are considered near miss (no score or penalty).
-                    // First is a recendly expired mole, second takes care of double strike.
-                    whackflag = 1; 
-                } else {
+            if (len + n + 1 > cap) {
+                char *temp;
+                cap = (len + n + 1) * 2;
+                if ((temp = realloc(game, cap)) == NULL) {
+                    error_at_line(-1, errno, __FILE__, __LINE__, "realloc failed.");
                 }
+                game = temp;
             }
+            memcpy(game + len, line, n + 1);
+            len += n;
+        }
+        if (ferror(f)) {
+            fprintf(stderr, "rescore: error reading \"%s\": %s\n", path, strerror(errno));
+            status = 1;
+        }
+        if (len > 0) {
+            rescore_queue_put(game);  // (Games don't span files)
+        } else {
+            free(game);
+        }
+        if (f != stdin) fclose(f);
+    }
+    free(line);
 
-            // unlock molecomm mutex
-            unlock_molecomm();
-
-            if (!whackflag) {  // This is a misfire!
-                int i;
-                int misfirehole;
-                enum PlayResult misfiretype = MISFIRE; // default, unless we set to TOOSOON later
-                lock_molecomm();
-                for(i=0; i<CONCURRENTMOLES; i++) {  // Set scaredflag for each Hiding/Up mole 
-                                                    // so mole_thread can exit early
-
-                    if (molecomm[i].molestatus == HIDING || molecomm[i].molestatus == UP ) {
-                        molecomm[i].scaredflag = 1;
-                        clock_gettime(CLOCK_MONOTONIC, &molecomm[i].scaredtime);
-                    }
-
-                    if (molecomm[i].molestatus == HIDING && inputkey == holekeys[molecomm[i].hole]) {
-                        misfiretype = TOOSOON;
-                    }
-                }
-                unlock_molecomm();
+    if ((err = pthread_mutex_lock(&rescore_mtx)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock rescoring mutex.");
+    }
+    q->done = 1;
+    pthread_cond_broadcast(&rescore_ready);
+    pthread_mutex_unlock(&rescore_mtx);
+
+    for (i = 0; i < nworkers; i++) {
+        const struct RescoreTally *t = &workers[i].tally;
+        if ((err = pthread_join(workers[i].tid, NULL)) != 0) {
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to join rescoring worker.");
+        }
+        total->games += t->games;
+        total->scores += t->scores;
+        total->records += t->records;
+        total->skipped += t->skipped;
+        total->truncated += t->truncated;
+        total->malformed += t->malformed;
+        total->reproduced += t->reproduced;
+        total->raised += t->raised;
+        total->lowered += t->lowered;
+        total->beforesum += t->beforesum;
+        total->aftersum += t->aftersum;
+        if (t->mostup > total->mostup) total->mostup = t->mostup;
+        if (t->mostdown < total->mostdown) total->mostdown = t->mostdown;
+        for (j = 0; j < RESCOREMAXSCORE; j++) {
+            total->before[j] += t->before[j];
+            total->after[j] += t->after[j];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
 
-                for (i=0; i<MOLEHOLES; i++) {  // search holekeys to find misfire hole
-                    if (inputkey == holekeys[i]) {
-                        break;
-                    }
-                }
-                misfirehole = i;
-                // Log the misfire in the scores buffer. (triggers display_thread to handle it) 
-                compute_score(-1, misfirehole, inputkey, 0, misfiretype);
-            }
+    print_rescore_report(stdout, total, nworkers, elapsed_msec(&t0, &t1));
+    free(total);
+    free(workers);
+    return status;
+}
 
-            enable_thread_cancel(); 
+//=================================================================
+// int read_score_rules(const char *path, struct ScoreRules *rules)
+//
+// Reads a rule table for -R.  One rule per line, # starts a comment:
+//
+//   whack 20             points for a whack
+//   bonus 25 0 0 20 80   bonus by stage, BONUSSLICES of them (see compute_score())
+//   missed -10           missed mole penalty, per mole missed so far...
+//   multiplier 1         ...times this...
+//   cap -50              ...but no worse than this
+//
+// Rules left out keep their compiled-in values (defaultrules).
+//
+// path = rule table file
+// rules = where to put it
+//
+// Returns: 0 on success, -1 if it can't be read (having said why).
+//
+int read_score_rules(const char *path, struct ScoreRules *rules) {
+    FILE *f = fopen(path, "r");
+    char buf[256], name[16];
+    int linenum = 0, n;
+    struct ScoreRules *r = rules;
+
+    *rules = defaultrules;
+    if (f == NULL) {
+        fprintf(stderr, "rescore: unable to open rule table \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        char *c = strchr(buf, '#');
+        int ok;
+
+        ++linenum;
+        if (c != NULL) *c = '\0';
+        if (sscanf(buf, "%15s%n", name, &n) != 1) continue;  // Blank
+
+        if (strcmp(name, "whack") == 0) {
+            ok = sscanf(buf + n, "%d", &r->whacked) == 1;
+        } else if (strcmp(name, "bonus") == 0) {
+            ok = sscanf(buf + n, "%d %d %d %d %d", &r->bonus[0], &r->bonus[1], &r->bonus[2], &r->bonus[3], &r->bonus[4]) == BONUSSLICES;
+        } else if (strcmp(name, "missed") == 0) {
+            ok = sscanf(buf + n, "%d", &r->missed) == 1;
+        } else if (strcmp(name, "multiplier") == 0) {
+            ok = sscanf(buf + n, "%d", &r->multiplier) == 1;
+        } else if (strcmp(name, "cap") == 0) {
+            ok = sscanf(buf + n, "%d", &r->cap) == 1;
+        } else {
+            ok = 0;
+        }
+        if (! ok) {
+            fprintf(stderr, "rescore: %s line %d: can't read \"%s\".\n", path, linenum, name);
+            fclose(f);
+            return -1;
         }
     }
+    fclose(f);
+    return 0;
+}
+
+//==================================
+// void *rescore_worker(void *arg)
+//
+// Rescoring worker thread (-R): takes games off rescorequeue and rescores
+// them under rescorerules until the queue is done and empty.
+//
+// arg = this worker's struct RescoreTally
+//
+// Returns: NULL
+//
+void *rescore_worker(void *arg) {
+    struct RescoreTally *t = arg;
+    char *game;
 
+    while ((game = rescore_queue_take()) != NULL) {
+        rescore_game(game, t);
+        free(game);
+    }
     return NULL;
 }
 
 //===================================
-//pthread_t *start_input_thread(void)
+// void rescore_queue_put(char *game)
 //
-// Starts up the input monitoring thread.
+// Queues a game for the rescoring workers, waiting for room if the queue
+// is full.  (So however big the archive, only a few games are in memory.)
 //
-// returns the thread ID
+// game = the game's event log lines (malloc()ed, freed by the worker)
 //
-pthread_t *start_input_thread(void) {
-    static pthread_t tid;   // thread ID
+// Returns: void
+//
+void rescore_queue_put(char *game) {
+    struct RescoreQueue *q = &rescorequeue;
     int err;
 
-    clear_input_buffer();
-
-    if ((err = pthread_mutex_lock(&start_mtx)) != 0) {   // set up mutex for cond wait
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    if ((err = pthread_mutex_lock(&rescore_mtx)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock rescoring mutex.");
     }
-
-    if ((err = pthread_create(&tid, NULL, input_thread, NULL)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set create input thread.");
+    while (q->tail - q->head == RESCOREQUEUE) {
+        pthread_cond_wait(&rescore_room, &rescore_mtx);
     }
+    q->games[q->tail++ % RESCOREQUEUE] = game;
+    pthread_cond_signal(&rescore_ready);
+    pthread_mutex_unlock(&rescore_mtx);
+}
 
-    while (!kbthread_running) {
-        if ((err = pthread_cond_wait(&start_cond, &start_mtx)) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Input thread cond wait failed.");
-        }
-    }
+//================================
+// char *rescore_queue_take(void)
+//
+// Returns: the next queued game, waiting for one if need be, or NULL once
+//          the archive has been read and every game taken.
+//
+char *rescore_queue_take(void) {
+    struct RescoreQueue *q = &rescorequeue;
+    char *game = NULL;
+    int err;
 
-    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    if ((err = pthread_mutex_lock(&rescore_mtx)) != 0) {
+        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock rescoring mutex.");
     }
-
-    return &tid;
+    while (q->head == q->tail && ! q->done) {
+        pthread_cond_wait(&rescore_ready, &rescore_mtx);
+    }
+    if (q->head != q->tail) {
+        game = q->games[q->head++ % RESCOREQUEUE];
+        pthread_cond_signal(&rescore_room);
+    }
+    pthread_mutex_unlock(&rescore_mtx);
+    return game;
 }
 
-//====================================
-//pthread_t *start_display_thread(void)
+//==================================================================
+// void rescore_game(char *game, struct RescoreTally *t)
 //
-// Starts up the display monitoring thread.
+// Rescores one game from its event log lines: each player's score records,
+// in the order they were logged, under defaultrules (which should give the
+// logged score back, a check on the rescoring) and under rescorerules.
+// The logged final score is the sum of the logged changes.  (Two-player
+// records may be logged out of turn, so the last one's total may not be
+// the final one.)
 //
-// returns the thread ID
+// Games logged before bonus stages were (any whack without one) can't be
+// rescored, and are only counted.  So are games whose log filled up (the
+// header says so): their later score records were dropped, so the logged
+// final scores can't be worked out from what is left.
 //
-pthread_t *start_display_thread(void) {
-    static pthread_t tid;   // thread ID
-    pthread_attr_t tattr;   // thread attributes
-    int err;
+// game = the game's lines (modified)
+// t = tally to add the game to
+//
+// Returns: void
+//
+void rescore_game(char *game, struct RescoreTally *t) {
+    int logged[PLAYERS] = {0, 0};   // Final scores as logged...
+    int check[PLAYERS] = {0, 0};    //    ...with the compiled-in rules...
+    int after[PLAYERS] = {0, 0};    //    ...and with the new ones.
+    int checkmissed[PLAYERS] = {0, 0}, aftermissed[PLAYERS] = {0, 0}; // Moles missed so far
+    int nplayers = 0, records = 0, p;
+    char *save, *line;
+
+    for (line = strtok_r(game, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+        char *s = strstr(line, " score ");
+        char resultname[16], key;
+        int slot, mole, hole, start, missed, whacked, bonus, penalty, end, used;
+        int stage = -1, player = 0, r;
+        enum PlayResult result;
+
+        if (strncmp(line, "# game ", 7) == 0 && strstr(line, GAMEEVENTSFULL) != NULL) {
+            ++t->truncated;
+            return;
+        }
+        if (s == NULL) continue;
+        if (sscanf(s, " score #%d mole %d hole %d %15s key '%c' %d %d %d %d %d = %d%n", &slot, &mole, &hole,
+                   resultname, &key, &start, &missed, &whacked, &bonus, &penalty, &end, &used) != 11) {
+            ++t->malformed;
+            continue;
+        }
+        for (r = 0; r < PLAYRESULTS && strcmp(resultname, playresultnames[r]) != 0; r++);
+        if (r == PLAYRESULTS) {
+            ++t->malformed;
+            continue;
+        }
+        result = r;
+        s += used;
+        if (strstr(s, " stage ") != NULL) sscanf(strstr(s, " stage "), " stage %d", &stage);
+        if (strstr(s, " player ") != NULL) sscanf(strstr(s, " player "), " player %d", &player);
+        --player;
+        if (player < 0) player = 0;  // (One player games don't say)
+        if (player >= PLAYERS || (result == WHACK && (stage < 0 || stage >= BONUSSLICES))) {
+            ++t->skipped;  // Logged before bonus stages were
+            return;
+        }
 
-    if ((err = pthread_attr_init(&tattr)) != 0) {  // Start with default thread attributes.
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to assign default display thread attributes.\n");
+        logged[player] += missed + whacked + bonus + penalty;
+        check[player] += rule_score(&defaultrules, result, stage, &checkmissed[player], check[player]);
+        after[player] += rule_score(&rescorerules, result, stage, &aftermissed[player], after[player]);
+        if (player >= nplayers) nplayers = player + 1;
+        ++records;
     }
-
-    if ((err = pthread_mutex_lock(&start_mtx) != 0)) {   // set up mutex for cond wait
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to lock start mutex.");
+    if (records == 0) return;
+
+    ++t->games;
+    t->records += records;
+    for (p = 0; p < nplayers; p++) {
+        int change = after[p] - logged[p];
+
+        ++t->scores;
+        if (check[p] == logged[p]) ++t->reproduced;
+        if (change > 0) ++t->raised;
+        if (change < 0) ++t->lowered;
+        if (change > t->mostup) t->mostup = change;
+        if (change < t->mostdown) t->mostdown = change;
+        t->beforesum += logged[p];
+        t->aftersum += after[p];
+        ++t->before[logged[p] < 0 ? 0 : logged[p] >= RESCOREMAXSCORE ? RESCOREMAXSCORE - 1 : logged[p]];
+        ++t->after[after[p] < 0 ? 0 : after[p] >= RESCOREMAXSCORE ? RESCOREMAXSCORE - 1 : after[p]];
     }
+}
 
-    if ((err = pthread_create(&tid, &tattr, display_thread, NULL)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set create display thread.");
+//=====================================================================================================
+// int rule_score(const struct ScoreRules *rules, enum PlayResult result, int stage, int *missedcount, int score)
+//
+// Scores one result under a rule table, as compute_score() does with the
+// compiled-in one.
+//
+// rules = rule table
+// result = what happened
+// stage = bonus stage (whacks)
+// missedcount = moles missed so far (updated)
+// score = score so far (a missed mole can't take it below zero)
+//
+// Returns: the change in score
+//
+int rule_score(const struct ScoreRules *rules, enum PlayResult result, int stage, int *missedcount, int score) {
+    int missed;
+
+    switch (result) {
+        case WHACK:
+            return rules->whacked + rules->bonus[stage];
+
+        case ESCAPE:
+        case SCAREDOFF:
+            missed = ++*missedcount * rules->missed * rules->multiplier;
+            if (missed < rules->cap) missed = rules->cap;
+            if (-missed > score) missed = -score;
+            return missed;
+
+        default:
+            return 0;  // No misfire penalty in this version
     }
+}
 
-    if ((err = pthread_attr_destroy(&tattr)) != 0) {     // attributes no longer needed
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to set release display thread attributes.");
+//=====================================================================================================
+// void print_rescore_report(FILE *f, const struct RescoreTally *t, int workers, long msec)
+//
+// Prints -R's results: the rule change, and the final scores before and
+// after it, with their distribution.
+//
+// f = stream to print on
+// t = all the workers' tallies, added up
+// workers = how many there were...
+// msec =    ...and how long they took (reading the archive included)
+//
+// Returns: void
+//
+void print_rescore_report(FILE *f, const struct RescoreTally *t, int workers, long msec) {
+    const struct ScoreRules *a = &defaultrules, *b = &rescorerules;
+    int lo, hi, i;
+
+    fprintf(f, "Rescore: %ld games, %ld scores, %ld score records; %d workers, %ld ms\n",
+            t->games, t->scores, t->records, workers, msec);
+    fprintf(f, "  rules:     whack %d, bonus %d/%d/%d/%d/%d, missed %d x%d capped at %d\n",
+            a->whacked, a->bonus[0], a->bonus[1], a->bonus[2], a->bonus[3], a->bonus[4], a->missed, a->multiplier, a->cap);
+    fprintf(f, "  new rules: whack %d, bonus %d/%d/%d/%d/%d, missed %d x%d capped at %d\n",
+            b->whacked, b->bonus[0], b->bonus[1], b->bonus[2], b->bonus[3], b->bonus[4], b->missed, b->multiplier, b->cap);
+    if (t->skipped > 0 || t->truncated > 0 || t->malformed > 0) {
+        fprintf(f, "  not rescored: %ld games logged without bonus stages, %ld truncated (log full), %ld unreadable score lines\n",
+                t->skipped, t->truncated, t->malformed);
     }
-
-    while (!display_thread_running) {
-        if ((err = pthread_cond_wait(&start_cond, &start_mtx)) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Input thread cond wait failed.");
+    if (t->scores == 0) return;
+
+    fprintf(f, "  check:     the current rules give %ld of %ld logged scores back exactly\n", t->reproduced, t->scores);
+    fprintf(f, "  score       mean     p50     p90     max\n");
+    fprintf(f, "  before  %7.1f %7ld %7ld %7ld\n", (double)t->beforesum / t->scores, histogram_percentile(t->before, RESCOREMAXSCORE, 50),
+            histogram_percentile(t->before, RESCOREMAXSCORE, 90), histogram_percentile(t->before, RESCOREMAXSCORE, 100));
+    fprintf(f, "  after   %7.1f %7ld %7ld %7ld\n", (double)t->aftersum / t->scores, histogram_percentile(t->after, RESCOREMAXSCORE, 50),
+            histogram_percentile(t->after, RESCOREMAXSCORE, 90), histogram_percentile(t->after, RESCOREMAXSCORE, 100));
+    fprintf(f, "  change:    %ld scores up, %ld down, %ld the same; mean %+.1f, from %+d to %+d\n",
+            t->raised, t->lowered, t->scores - t->raised - t->lowered,
+            (double)(t->aftersum - t->beforesum) / t->scores, t->mostdown, t->mostup);
+
+    for (lo = 0; lo < RESCOREMAXSCORE && t->before[lo] == 0 && t->after[lo] == 0; lo++);
+    for (hi = RESCOREMAXSCORE - 1; hi > lo && t->before[hi] == 0 && t->after[hi] == 0; hi--);
+    fprintf(f, "  distribution      before        after\n");
+    for (i = lo / RESCOREBUCKET * RESCOREBUCKET; i <= hi; i += RESCOREBUCKET) {
+        long nb = 0, na = 0;
+        int j;
+        for (j = i; j < i + RESCOREBUCKET && j < RESCOREMAXSCORE; j++) {
+            nb += t->before[j];
+            na += t->after[j];
         }
+        fprintf(f, "  %5d-%-5d  %6ld %4.0f%%  %6ld %4.0f%%\n", i, i + RESCOREBUCKET - 1,
+                nb, 100.0 * nb / t->scores, na, 100.0 * na / t->scores);
     }
+}
 
-    if ((err = pthread_mutex_unlock(&start_mtx)) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to unlock start mutex.");
+//=======================================
+// void run_generic_engine(char *argv[])
+//
+// Classic build only (see LAYOUTROWS): its grid is fixed at 3x3, so a game
+// on any other grid is handed to the generic build, GENERICENGINE in the
+// same directory as this program, with the same arguments.
+//
+// argv = main()'s arguments
+//
+// Returns: only if the generic build can't be run (having said why).
+//
+void run_generic_engine(char *argv[]) {
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    char *slash;
+
+    if (len < 0) {
+        fprintf(stderr, "%s: unable to find this program's directory: %s\n", argv[0], strerror(errno));
+        return;
     }
-
-    return &tid;
+    path[len] = '\0';
+    slash = strrchr(path, '/');
+    snprintf(slash + 1, sizeof(path) - (slash + 1 - path), "%s", GENERICENGINE);
+    execv(path, argv);
+    fprintf(stderr, "%s: this build only plays the classic 3x3 grid, and the generic build \"%s\" can't be run: %s\n",
+            argv[0], path, strerror(errno));
 }
 
-//============================
-// void assign_hole_keys(void)
+//=================================
+// void usage(const char *progname)
 //
-// Assigns a key to each mole hole.
-// Currently just "1" to "9" for the 9 holes, but could expanded in the future
-// or randomized to provide additional challenge, changed after each hit, etc.
+// Prints command line help.
 //
-void assign_hole_keys(void) {
-    memcpy(holekeys,"789456123", sizeof(holekeys));
+void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [options]\n", progname);
+    fprintf(stderr, "  -2    Two players on one playfield (3x3 only): player 1 has the keypad, player 2\n");
+    fprintf(stderr, "        %.3s/%.3s/%.3s. The first to hit a mole gets it.\n", PLAYER2KEYS, PLAYER2KEYS + 3, PLAYER2KEYS + 6);
+    fprintf(stderr, "  -a    Autoplay: a bot plays the game (no intro, game over or score sheet)\n");
+    fprintf(stderr, "  -b    Benchmark: print a one line result to stderr at exit (see perfcheck.sh)\n");
+    fprintf(stderr, "  -c    Skip terminal calibration (fixed 30 msec animation frames)\n");
+    fprintf(stderr, "  -E F  Write each game's event log (every state change, in order) to file F\n");
+    fprintf(stderr, "  -f    Fast start: skip intro, short countdown (kiosk/benchmark use)\n");
+    fprintf(stderr, "  -g RxC  Playfield grid, %d to %d rows and columns, up to %d holes (default 3x3).\n", MINGRIDSIDE, MAXGRIDSIDE, MAXMOLEHOLES);
+    fprintf(stderr, "        If it doesn't fit the terminal, scroll with %c %c %c %c.\n", SCROLLLEFTKEY, SCROLLDOWNKEY, SCROLLUPKEY, SCROLLRIGHTKEY);
+    fprintf(stderr, "  -H    Headless: output to /dev/null, keyboard ignored (use with -a)\n");
+    fprintf(stderr, "  -k    Keymap rotation: the hole keys are shuffled after each hit\n");
+    fprintf(stderr, "  -L F  Log diagnostics (mole transitions, keys, scores...) to file F\n");
+    fprintf(stderr, "  -m    Heatmap: show whacks, misses and misfires on each hole\n");
+    fprintf(stderr, "  -p F  Sprite pack: draw the moles, results and holes with the art read from file F\n");
+    fprintf(stderr, "  -P    Report CPU performance counters per phase, thread and mole stage at exit\n");
+    fprintf(stderr, "  -r    Raw VT output during play (one writev() per frame, bypasses ncurses)\n");
+    fprintf(stderr, "  -R F  Rescore: score the games in the event logs (-E files) named after the\n");
+    fprintf(stderr, "        options (or stdin) again with the rule table in F, and print the scores'\n");
+    fprintf(stderr, "        distribution before and after. F has lines like \"bonus 25 0 0 20 80\".\n");
+    fprintf(stderr, "  -s    Print statistics to stderr at exit\n");
+    fprintf(stderr, "  -S H  Soak test: -a -H games back to back for H hours (e.g. 0.5), then report\n");
+    fprintf(stderr, "        resource and latency drift. Exit status 2 if any was found.\n");
+    fprintf(stderr, "  -W F  Write the built-in art to file F as a sprite pack to start from, and exit\n");
+    fprintf(stderr, "  -T N  Tournament: N rounds per player (up to %d), each with more and quicker moles,\n", TOURNAMENTMAX);
+    fprintf(stderr, "        then a leaderboard of player totals\n");
+    fprintf(stderr, "  -z N  Random seed (the soak report shows the one used)\n");
+    fprintf(stderr, "  -h    This help\n");
 }
 
 //===============================
 // MAIN
 int main(int argc, char *argv[]) {
-    int err;
     const int moles = 20;      // How many moles in this game.
     const int moletime = 6500; // Time for each mole in msec.
                                // (Split randomly between HIDING and UP time)
-    pthread_t *kbinput_tid;
-    pthread_t *display_tid;
-
     long seed = time(NULL);
-    srandom(seed);
-    int i;
-    for (i=0; i<MOLEHOLES; i++) {    // Initialize hole_mtx[]
-        if ((err = pthread_mutex_init(&hole_mtx[i], NULL)) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to initialize hole mutex.\n");
+    const char *packpath = NULL;
+    const char *rulespath = NULL;
+    int rows, cols;  // -g
+    int drift = 0;
+    int lastscore = 0;
+    pthread_t *logger_tid = NULL;
+
+    mark_startup_phase(SP_LAUNCH);
+    threadrole = TR_CONTROL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "2abcE:fg:kL:mp:PR:rsHS:T:W:z:h")) != -1) {
+        switch (opt) {
+            case '2': players = PLAYERS; break;
+            case 'a': autoplay = 1; break;
+            case 'b': benchmark = 1; break;
+            case 'c': skipcalibration = 1; break;
+            case 'E': eventpath = optarg; break;
+            case 'f': faststart = 1; break;
+            case 'g':
+                if (sscanf(optarg, "%dx%d", &rows, &cols) != 2
+                    || rows < MINGRIDSIDE || rows > MAXGRIDSIDE
+                    || cols < MINGRIDSIDE || cols > MAXGRIDSIDE
+                    || rows * cols > MAXMOLEHOLES) {
+                    fprintf(stderr, "%s: invalid grid \"%s\".\n", argv[0], optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+#if defined(classicgrid)
+                if (rows != gridrows || cols != gridcols) {
+                    run_generic_engine(argv);
+                    return 1;
+                }
+#else
+                gridrows = rows;
+                gridcols = cols;
+                moleholes = gridrows * gridcols;
+#endif
+                break;
+            case 'k': keymaprotate = 1; break;
+            case 'L': logpath = optarg; break;
+            case 'm': heatmap = 1; break;
+            case 'p': packpath = optarg; break;
+            case 'P': perfcounters = 1; break;
+            case 'R': rulespath = optarg; break;
+            case 'r': rawoutput = 1; break;
+            case 's': showstats = 1; break;
+            case 'H': headless = 1; break;
+            case 'S':
+                if (sscanf(optarg, "%lf", &soakhours) != 1 || soakhours <= 0) {
+                    fprintf(stderr, "%s: invalid soak time \"%s\".\n", argv[0], optarg);
+                    usage(argv[0]);
+                    return 1;
+                }
+                autoplay = 1;
+                headless = 1;
+                break;
+            case 'T':
+                tournamentrounds = atoi(optarg);
+                if (tournamentrounds < 1 || tournamentrounds > TOURNAMENTMAX) {
+                    fprintf(stderr, "%s: invalid number of rounds \"%s\" (1 to %d).\n", argv[0], optarg, TOURNAMENTMAX);
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'W':
+                if (write_sprite_pack(optarg) != 0) {
+                    fprintf(stderr, "%s: unable to write sprite pack \"%s\": %s\n", argv[0], optarg, strerror(errno));
+                    return 1;
+                }
+                return 0;
+            case 'z': seed = atol(optarg); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
         }
     }
+    if (tournamentrounds > 0 && soakhours > 0) {
+        fprintf(stderr, "%s: -T and -S can't be used together.\n", argv[0]);
+        usage(argv[0]);
+        return 1;
+    }
+    if (players > 1 && (tournamentrounds > 0 || moleholes != MOLEHOLES || gridcols != REFGRIDCOLS)) {
+        fprintf(stderr, "%s: -2 is for the classic 3x3 playfield, and can't be used with -T.\n", argv[0]);
+        usage(argv[0]);
+        return 1;
+    }
 
-    assign_hole_keys();   // Assign a key to each mole hole
+    if (rulespath != NULL) {  // Offline: no game, no terminal
+        return rescore_archives(rulespath, argv + optind, argc - optind);
+    }
 
-    initialize_terminal();
+    srandom(seed);
 
-#if !defined(AUTOPLAY)
-    display_intro(moles, moles * (moletime + GRACEPERIOD) / 1000);
+#if defined(debug)
+    if (logpath == NULL) logpath = DEBUGLOG;
 #endif
-
-    kbinput_tid = start_input_thread();
-    display_tid = start_display_thread();
-
-    control_moles(moles, moletime);
-
-    if ((err = pthread_cancel(*kbinput_tid)) != 0) {
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel input thread.");
+    if (logpath != NULL && (logger_tid = start_logger(logpath)) == NULL) {
+        fprintf(stderr, "%s: unable to open log file \"%s\": %s\n", argv[0], logpath, strerror(errno));
+        return 1;
     }
-
-    void *retval;
-    if ((err = pthread_join(*kbinput_tid, &retval)) != 0) { // join input thread
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join input thread. Error=%d.", err);
+    if (eventpath != NULL && (eventfile = fopen(eventpath, "w")) == NULL) {
+        fprintf(stderr, "%s: unable to open event log file \"%s\": %s\n", argv[0], eventpath, strerror(errno));
+        return 1;
     }
-
-    if ((err = pthread_cancel(*display_tid)) != 0) { 
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to cancel display thread.");
+    log_event("launch: seed %ld, grid %ldx%ld", seed, gridrows, gridcols);
+    if (packpath != NULL) {
+        const char *why = load_sprite_pack(packpath);
+        if (why != NULL) {  // Not worth stopping a cabinet for: it still has the built-in art
+            fprintf(stderr, "%s: sprite pack \"%s\" not used (%s), using the built-in art.\n", argv[0], packpath, why);
+            log_event("sprites: pack not used: %s", (long)why);  // (why is static)
+        } else {
+            log_event("sprites: pack read and checked in %ld usec", spritepack.loadusec);
+        }
     }
 
-    if ((err = pthread_join(*display_tid, &retval)) != 0) { // join display thread
-        restore_terminal();
-        error_at_line(-1, err, __FILE__, __LINE__, "Unable to join display thread. Error=%d.", err);
+    if (perfcounters) {
+        int err;
+        if ((err = pthread_key_create(&perfthreadkey, perf_thread_end)) != 0) {
+            error_at_line(-1, err, __FILE__, __LINE__, "Unable to create perf counter key.");
+        }
+        perf_thread_begin();
+        int i;
+        for (i = 0; i < PERFCOUNTERS && perfthread.fd[i] < 0; i++);
+        if (i == PERFCOUNTERS) {
+            perf_thread_end(NULL);
+            perfcounters = -1;  // None at all. Reported at exit, and other threads don't try.
+        }
     }
 
-#if !defined(AUTOPLAY)
-    display_gameover();
+    assign_hole_keys();   // Assign a key to each mole hole
 
-    if (numscores > 0) {
-        display_score_sheet(scores[numscores - 1].endscore, moles, moles * (moletime + GRACEPERIOD) / 1000);
+    if (headless) {
+        // Everything still gets drawn (that's part of what a soak exercises),
+        // just into /dev/null, on a terminal type every system has.
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0) {
+            error_at_line(-1, errno, __FILE__, __LINE__, "Unable to send output to /dev/null.");
+        }
+        close(devnull);
+        setenv("TERM", "vt100", 1);
+        skipcalibration = 1;
     }
-#endif
 
-    for (i=0; i<MOLEHOLES; i++) {    // Destroy dynamically initialized hole_mtx[]
-        if ((err = pthread_mutex_destroy(&hole_mtx[i])) != 0) {
-            restore_terminal();
-            error_at_line(-1, err, __FILE__, __LINE__, "Unable to destroy hole mutex %d.", i);
+    initialize_terminal();
+    mark_startup_phase(SP_TERMINAL);
+    calibrate_terminal();
+    mark_startup_phase(SP_CALIBRATE);
+
+    int game = 1;
+    if (tournamentrounds > 0) {
+        game = play_tournament(moles, moletime);
+    } else for (;;) {
+        play_game(moles, moletime);
+        if (soakhours <= 0) break;
+
+        reset_game();
+        sample_resources(game);
+        struct SoakSample *ss = &soaksamples[numsoaksamples - 1];
+        fprintf(stderr, "soak: game %d at %.2f hours: rss %ld kB, %d threads, %d fds, %ld sync objects, ack p95 %ld ms\n",
+                game, ss->msec / 3600000.0, ss->rsskb, ss->threads, ss->fds, ss->syncobjects, ss->ackp95);
+        log_event("soak: game %ld done, rss %ld kB, %ld threads, %ld fds", game, ss->rsskb, ss->threads, ss->fds);
+        if (ss->msec >= soakhours * 3600000.0) break;
+        ++game;
+    }
+
+    perf_phase(PP_SCORESHEET);
+    if (! autoplay && tournamentrounds == 0) {  // (A tournament shows its own)
+        display_gameover();
+
+        if (numscores > 0) {
+            display_score_sheet(scores[numscores - 1].endscore, moles, moles * (moletime + GRACEPERIOD) / 1000);
         }
     }
 
     clear_input_buffer();
     lock_scores();
 
+    if (numscores > 0) lastscore = scores[numscores - 1].endscore;
+    if (players > 1) {  // The winner's
+        lastscore = playerlogs[0].total > playerlogs[1].total ? playerlogs[0].total : playerlogs[1].total;
+    }
     if (scores != NULL) free(scores);
     unlock_scores();
     restore_terminal();
 
-    return 0;
+    if (logger_tid != NULL) {
+        stop_logger(logger_tid);
+    }
+    if (eventfile != NULL) {
+        fclose(eventfile);
+    }
+    perf_thread_end(NULL);
+    print_perf_report(stderr);
+    if (tournamentrounds > 0) {
+        print_leaderboard(stderr);
+    }
+    if (showstats) {
+        print_stats(stderr);
+    } else if (watchdogstats.breaches > 0) {
+        fprintf(stderr, "Watchdog: %d SLO breaches during play, see %s\n", watchdogstats.breaches, WATCHDOGDUMP);
+    }
+    if (soakhours > 0) {
+        drift = print_soak_report(stderr, seed);
+    }
+    if (benchmark) {
+        print_benchmark_line(stderr, seed, game, lastscore);
+    }
+
+    return drift ? 2 : 0;
 }